@@ -68,7 +68,7 @@ int main()
 	 if (token != NULL && 0==strcmp(token, "quit"))
             goto _quit;
 
-	 while (token != NULL) 
+	 while (token != NULL && argc < MAX_TOKENS) 
 	 {
 	    argv[argc] = token;
 	    argc++;
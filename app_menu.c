@@ -20,6 +20,8 @@
 #include "menu.h"
 #include "app_menu.h"
 #include "scope_plot.h"
+#include "logq.h"
+#include "csv_load.h"
 
 
 
@@ -289,6 +291,52 @@ int f_show(struct _menu *m, int argc, char **argv, void *p_usr)
 }
 
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void log_default_name(const char *fn, char *name)
+ *
+ *  @brief	Default sink name: file name without directory and extension
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void log_default_name(const char *fn, char *name)
+{
+   const char *base = strrchr(fn, '/');
+   base = (base != NULL) ? base+1 : fn;
+
+   size_t len = strcspn(base, ".");
+   if (len == 0) len = strlen(base);
+   if (len >= NAME_LEN) len = NAME_LEN-1;
+
+   memcpy(name, base, len);
+   name[len] = '\0';
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void log_print(const logger_t *lg)
+ *
+ *  @brief	Print one log sink
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void log_print(const logger_t *lg)
+{
+   static const char *dec_str[] = { "all", "every", "interval", "minmax", "mean", "onchange" };
+   static const char *st_str[] = { "waiting", "running", "done" };
+
+   printf("%s\t%s\t%d cols\t%s", lg->name, lg->fn, lg->n, dec_str[lg->dec]);
+   if (lg->dec == LOG_DEC_EVERY) printf(" %d", lg->every);
+   else if (lg->dec != LOG_DEC_NONE && lg->dec != LOG_DEC_ONCHANGE) printf(" %g", lg->width);
+   printf("\t%s\t%ld rows from %ld steps\n", st_str[lg->state], lg->rows, lg->steps);
+}
+
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
@@ -296,14 +344,34 @@ int f_show(struct _menu *m, int argc, char **argv, void *p_usr)
  *
  *  @brief	Start/stop Logging data to file
  *
- *  @note	log <start <file> <data0> <data1> ...> | <stop>
+ *  @note	log <start <file> [-name <name>] [<decimation>] [<trigger>] <data0>[:<deadband>] <data1> ...> 
+ *		  | <stop [<name>]> | <list>
+ *
+ *		any number of sinks (up to MAX_LOGS) log concurrently, each with its own file, columns, 
+ *		decimation and triggers.  The sink name defaults to the file name without extension; starting
+ *		a sink with a name in use replaces it.  'log stop' without a name stops all sinks.
+ *
+ *		a <file> ending in .lgz is written in the compressed log format (see logz.h)
+ *
+ *		decimation (default: every step):
+ *		  -every <n>		every n-th step
+ *		  -interval <secs>	first sample of each interval
+ *		  -minmax <secs>	min and max of each bucket, keeps peaks and edges 
+ *		  -mean <secs>		mean of each bucket
+ *		  -onchange		only when a column moves more than its deadband (default 0)
+ *
+ *		trigger:
+ *		  -start <param> <op> <value>	log nothing until the condition is true
+ *		  -stop <param> <op> <value>	close the log when the condition is true
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
 int f_log(struct _menu *m, int argc, char **argv, void *p_usr)
 {
-   int rc = -1;
+   int rc = 0;
+   logger_t *lg = NULL;
+   char name[NAME_LEN];
 
    if (m==NULL || p_usr==NULL || argv==NULL) return -1;
    sim_t *sim = (sim_t *)p_usr;
@@ -311,110 +379,200 @@ int f_log(struct _menu *m, int argc, char **argv, void *p_usr)
    if (argc < 2) 
       return -2;
 
-   // log stop
-   if (argc == 2)
+   // log list
+   if (0==strcmp(argv[1], "list"))
+   {
+      if (argc != 2) return -3;
+
+      LOCK(&sim->mtx);
+      for (int k=0; k<sim->logs.n; k++) log_print(sim->logs.lg[k]);
+      if (sim->logs.n == 0) printf("no log sinks.\n");
+      UNLOCK(&sim->mtx);
+      return 0;
+   }
+
+   // log stop [<name>]
+   if (0==strcmp(argv[1], "stop"))
+   {
+      if (argc > 3) return -3;
+
+      while (true)
+      {
+         LOCK(&sim->mtx);
+         if (argc == 3)
+            lg = logset_remove(&sim->logs, argv[2]);
+         else
+            lg = (sim->logs.n > 0) ? logset_remove(&sim->logs, sim->logs.lg[0]->name) : NULL;
+         UNLOCK(&sim->mtx);
+
+         if (lg == NULL) break;
+
+         logger_finish(lg);
+         printf("log %s (%s) closed (%ld rows from %ld steps).\n", lg->name, lg->fn, lg->rows, lg->steps);
+         logger_destroy(lg);
+         rc++;
+
+         if (argc == 3) break;
+      }
+
+      if (argc == 3 && rc == 0)
+      {
+         printf("error: no log sink '%s'.\n", argv[2]);
+         return -3;
+      }
+      return 0;
+   }
+
+   if (0!=strcmp(argv[1], "start") || argc < 3) return -3;
+
+   if (strlen(argv[2]) >= FN_LEN)
+   {
+      printf("error: filename must be < %d.\n", FN_LEN); 
+      return -4;
+   }
+
+   log_default_name(argv[2], name);
+   for (int n = 3; n+1 < argc; n++)
    {
-      if (0==strcmp(argv[1], "stop"))
+      if (0==strcmp(argv[n], "-name"))
       {
-         if (sim != NULL && sim->logfp != NULL)
-            fclose(sim->logfp);
-	 return 0;
+         if (strlen(argv[n+1]) == 0 || strlen(argv[n+1]) >= NAME_LEN)
+         {
+            printf("error: sink name must be 1 to %d chars.\n", NAME_LEN-1); 
+            return -4;
+         }
+         strcpy(name, argv[n+1]);
       }
-      return -3; 
    }
 
-   if (0!=strcmp(argv[1], "start")) return -3;
+   lg = logger_create(name, argv[2], sim->params);
+   if (lg == NULL) 
+   {
+      printf("error: out of memory.\n");
+      return -4; 
+   }
 
-   if (strlen(argv[2]) < FN_LEN)
+   for (int n = 3; n < argc; n++)
    {
-      strcpy(sim->logfn, argv[2]); 
-      if (sim->logfp != NULL) fclose(sim->logfp);
-      sim->logfp = fopen(sim->logfn, "w");
-      if (sim->logfp == NULL) 
+      char *arg = argv[n];
+
+      if (0==strcmp(arg, "-name"))
       {
-         printf("error: file %s open error.\n", sim->logfn);
-         return -4; 
+         n++;
+         continue;
       }
-     
-      /* print params names  */ 
-      char *data_name = NULL;
-      sim->logn = 0;
-      fprintf(sim->logfp, "t,"); 
-      for (int n = 3; n < argc; n++)
+
+      if (0==strcmp(arg, "-start") || 0==strcmp(arg, "-stop"))
       {
-         bool found = false;
-         data_name = argv[n];
-         for (int i=0; i < sim->params_sz; i++) 
-	 {
-            if (0==strcmp(data_name, sim->params[i].name))
-	    {
-               if (n==argc-1)
-                  fprintf(sim->logfp, "%s", sim->params[i].name); 
-	       else
-                  fprintf(sim->logfp, "%s,", sim->params[i].name); 
-
-	       sim->logi[sim->logn++] = i;
-	       found = true;
-	    }
-	 }
-	 if (!found)
-	 {
-            printf("error: variable \'%s\' not found.\n", data_name);
-	    return -5;
-	 }
+         if (n+3 >= argc || !util_is_numeric(argv[n+3]) ||
+             logger_set_trigger(lg, sim->params_sz, 0==strcmp(arg, "-stop"), argv[n+1], 
+                                util_strtolop(argv[n+2]), strtod(argv[n+3], NULL)) != 0)
+         {
+            printf("error: option '%s' needs <param> <op> <value>.\n", arg);
+            rc = -5;
+            goto _err_ret;
+         }
+         n += 3;
+         continue;
       }
 
-      fprintf(sim->logfp, "\n");
-      rc = 0;
+      if (arg[0] == '-')
+      {
+         log_dec_t dec = LOG_DEC_NONE;
+         double val = 0.0;
+
+         if (0==strcmp(arg, "-every")) dec = LOG_DEC_EVERY;
+         else if (0==strcmp(arg, "-interval")) dec = LOG_DEC_INTERVAL;
+         else if (0==strcmp(arg, "-minmax")) dec = LOG_DEC_MINMAX;
+         else if (0==strcmp(arg, "-mean")) dec = LOG_DEC_MEAN;
+         else if (0==strcmp(arg, "-onchange")) dec = LOG_DEC_ONCHANGE;
+         else
+         {
+            printf("error: unknown option '%s'.\n", arg);
+            rc = -5;
+            goto _err_ret;
+         }
+
+         if (dec != LOG_DEC_ONCHANGE)
+         {
+            if (n+1 >= argc || !util_is_numeric(argv[n+1])) 
+            {
+               printf("error: option '%s' needs a value.\n", arg);
+               rc = -5;
+               goto _err_ret;
+            }
+            val = strtod(argv[++n], NULL);
+         }
+
+         if (logger_set_dec(lg, dec, val) != 0)
+         {
+            printf("error: bad value for '%s'.\n", arg);
+            rc = -5;
+            goto _err_ret;
+         }
+         continue;
+      }
+
+      if (logger_add_col(lg, sim->params_sz, arg) != 0)
+      {
+         printf("error: variable '%s' not found.\n", arg);
+         rc = -5;
+         goto _err_ret;
+      }
    }
-   else 
+
+   // close a sink of the same name or file before the file is truncated under it
+   while (true)
    {
-      printf("error: filename must be < %d.\n", FN_LEN); 
+      LOCK(&sim->mtx);
+      logger_t *prev = logset_find(&sim->logs, name);
+      if (prev == NULL) prev = logset_find_fn(&sim->logs, argv[2]);
+      if (prev != NULL) logset_remove(&sim->logs, prev->name);
+      int n = sim->logs.n;
+      UNLOCK(&sim->mtx);
+
+      if (prev == NULL) 
+      {
+         if (n < MAX_LOGS) break;
+         printf("error: at most %d log sinks.\n", MAX_LOGS);
+         rc = -7;
+         goto _err_ret;
+      }
+
+      logger_finish(prev);
+      printf("log %s (%s) closed (%ld rows from %ld steps).\n", prev->name, prev->fn, prev->rows, prev->steps);
+      logger_destroy(prev);
    }
 
-   return rc;
-}
+   rc = logger_start(lg);
+   if (rc != 0)
+   {
+      printf((rc == -3) ? "error: file %s open error.\n" : "error: out of memory.\n", argv[2]);
+      rc = (rc == -3) ? -4 : -6;
+      goto _err_ret;
+   }
 
+   logger_t *old = NULL;
+   LOCK(&sim->mtx);
+   rc = logset_add(&sim->logs, lg, &old);
+   UNLOCK(&sim->mtx);
 
-/*!
- *---------------------------------------------------------------------------------------------------------------------
- *
- *  @fn		int split_csv_line(char *line, char **out, int max_out) 
- *
- *  @brief	Read a CSV line and separate out the fields
- *
- *---------------------------------------------------------------------------------------------------------------------
- */
-static
-int split_csv_line(char *line, char **out, int max_out)
-{
-    // Simple CSV splitter (no quotes) good enough for numeric logs
-    int n = 0;
-    char *p = line;
-    while (p && *p && n < max_out)
-    {
-        // trim leading spaces
-        while (*p == ' ' || *p == '\t') p++;
-        out[n++] = p;
-        char *comma = strchr(p, ',');
-        if (!comma) break;
-        *comma = '\0';
-        p = comma + 1;
-    }
-
-    // trim trailing newline/spaces for each token
-    for (int i = 0; i < n; i++)
-    {
-        char *s = out[i];
-        size_t L = strlen(s);
-        while (L && (s[L-1] == '\n' || s[L-1] == '\r' || s[L-1] == ' ' || s[L-1] == '\t')) {
-            s[L-1] = '\0';
-            L--;
-        }
-    }
-    return n;
+   if (rc != 0)
+   {
+      printf("error: at most %d log sinks.\n", MAX_LOGS);
+      rc = -7;
+      goto _err_ret;
+   }
+
+   if (old != NULL) logger_destroy(old);
+   return 0;
+
+_err_ret:
+   logger_destroy(lg);
+   return rc;
 }
 
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
@@ -477,198 +635,20 @@ bool trace_name_valid(sim_t *sim, char *trace_name)
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		int f_plot_table(struct _menu *m, int argc, char **argv, void *p_usr)
- *
- *  @brief	Plot specified tabular variable, each a table indexed over SOC_GRIDS
+ *  @fn		void plot_event_loop(scope_plot_t *p, SDL_Renderer *ren)
  *
- *  @note	plot table <list of tabular vars>  
+ *  @brief	Run a plot window until it is closed (q, Esc).  Mouse and keys zoom and pan the x-axis; the
+ *		plot is rendered again only when the view changes, at most every 16 ms.
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static
-int f_plot_table(struct _menu *m, int argc, char **argv, void *p_usr)
+void plot_event_loop(scope_plot_t *p, SDL_Renderer *ren)
 {
-   int rc = 0;
-   scope_plot_t *p = NULL;
-   SDL_Window *win = NULL;
-   SDL_Renderer *ren = NULL;
-   scope_trace_desc_t tr[MAX_PARAMS];
-
-
-   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
-   sim_t *sim = (sim_t *)p_usr;
-
-   if (argc < 2) { rc = -1; goto _err_ret; }
-   int curve_count = argc - 1;
-
-   for (int i=0; i < curve_count; i++)
-   {
-      char *varname = argv[i+1];
-      if (0==strcmp(varname, "R0_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      } 
-      else if (0==strcmp(varname, "R1_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      } 
-      else if (0==strcmp(varname, "C1_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      } 
-      else if (0==strcmp(varname, "OCV_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "H_chg_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "H_dsg_batt"))
-      {
-         tr[i].name = str_dup(argv[i+1]); 
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "R0_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "R1_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "C1_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "OCV_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "H_chg_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else if (0==strcmp(varname, "H_dsg_fgic"))
-      {
-         tr[i].name = str_dup(argv[i+1]);
-         tr[i].color = palette(i);
-      }
-      else
-      {
-         printf("cannot recognized %s\n", varname);
-         rc = -2;
-         goto _err_ret;
-      }
-   }
-
-   // Init SDL renderer
-   if (SDL_Init(SDL_INIT_VIDEO) != 0) { rc = -5; goto _err_ret; }
-   win = SDL_CreateWindow("ScopeTrace",
-                          SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                          1100, 650, SDL_WINDOW_SHOWN);
-   if (!win) { rc = -2; goto _err_ret; }
-
-   ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-   if (!ren) { rc = -3; goto _err_ret; }
-
-
-   // Create plot object with default config
-   scope_plot_cfg_t cfg = scope_plot_default_cfg();
-   p = scope_plot_create(win, ren, curve_count, tr, &cfg);
-   if (!p) { rc = -3; goto _err_ret; }
-
-
-   // Prepare trace array 
-   double *y = (double*)calloc((size_t)curve_count, sizeof(double));
-   double x_min = sim->fgic->ecm->params.soc_tbl[0];
-   double x_max = sim->fgic->ecm->params.soc_tbl[SOC_GRIDS-1];
-
-#if 1      
-   for (int k=0; k<SOC_GRIDS; k++)
-   {
-      double x = sim->fgic->ecm->params.soc_tbl[k];
-      for (int i=0; i < curve_count; i++)
-      {
-         char *varname = argv[i+1];
-         if (0==strcmp(varname, "R0_batt"))
-         {
-            y[i] = sim->batt->ecm->params.r0_tbl[k];   
-         }
-         else if (0==strcmp(varname, "R1_batt"))
-         {
-            y[i] = sim->batt->ecm->params.r1_tbl[k];   
-         }
-	 else if (0==strcmp(varname, "C1_batt"))
-	 {
-            y[i] = sim->batt->ecm->params.c1_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "OCV_batt"))
-	 {
-            y[i] = sim->batt->ecm->params.ocv_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "H_chg_batt"))
-	 {
-            y[i] = sim->batt->ecm->params.ocv_tbl[k] + sim->batt->ecm->params.h_chg_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "H_dsg_batt"))
-	 {
-            y[i] = sim->batt->ecm->params.ocv_tbl[k] + sim->batt->ecm->params.h_dsg_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "R0_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.r0_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "R1_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.r1_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "C1_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.c1_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "OCV_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.ocv_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "H_chg_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.ocv_tbl[k] + sim->fgic->ecm->params.h_chg_tbl[k];   
-	 }
-	 else if (0==strcmp(varname, "H_dsg_fgic"))
-	 {
-            y[i] = sim->fgic->ecm->params.ocv_tbl[k] + sim->fgic->ecm->params.h_dsg_tbl[k];   
-	 }
-      }
-      scope_plot_push(p, x, y);
-   } // for k
-	
-#endif
-   if (y) free(y);
-
-
-   // Set plot title and X label
-   scope_plot_set_title(p, "Table Chart");
-   scope_plot_set_x_label(p, "SOC");
-   scope_plot_set_x_range(p, x_min, x_max);
-   scope_plot_render(p);
-   SDL_RenderPresent(ren);
-
-
-   // Event loop
    bool quit = false;
    while (!quit)
    {
+      bool redraw = false;
       SDL_Event e;
       while (SDL_PollEvent(&e))
       {
@@ -677,83 +657,1073 @@ int f_plot_table(struct _menu *m, int argc, char **argv, void *p_usr)
              SDL_Keycode k = e.key.keysym.sym;
              if (k == SDLK_ESCAPE || k == SDLK_q) quit = true;
          }
+         if (scope_plot_handle_event(p, &e)) redraw = true;
+      }
+      if (redraw && !quit)
+      {
+         scope_plot_render(p);
+         SDL_RenderPresent(ren);
       }
       SDL_Delay(16);
    }
+}
 
 
-_err_ret:
-   if (p != NULL) scope_plot_destroy(p);
-   if (ren != NULL) SDL_DestroyRenderer(ren);
-   if (win != NULL) SDL_DestroyWindow(win);
-   SDL_Quit();
-
-   return rc;
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool scope_open(sim_t *sim)
+ *
+ *  @brief	True (with a message) if the live scope window is open.  The plot commands end with SDL_Quit(),
+ *		which would pull the display from under the scope's render thread.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+bool scope_open(sim_t *sim)
+{
+   if (!scope_live_running(sim->scope)) return false;
 
+   printf("error: close the scope first.\n");
+   return true;
 }
 
 
-
-
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		int f_plot_file(struct _menu *m, int argc, char **argv, void *p_usr)
+ *  @fn		int table_var(const char *name, int *id, bool *fgic)
  *
- *  @brief	Plot a saved CSV file
+ *  @brief	Parse a tabular var name <OCV|R0|R1|C1|H_dsg|H_chg>_<batt|fgic>
  *
- *  @note	plot <file> 
+ *  @return	0 if success; negative otherwise
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static
-int f_plot_file(struct _menu *m, int argc, char **argv, void *p_usr)
+int table_var(const char *name, int *id, bool *fgic)
 {
-   int rc = 0;
-   scope_plot_t *p = NULL;
-   SDL_Window *win = NULL;
-   SDL_Renderer *ren = NULL;
-
-
-   // Get sim pointer 
-   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
-   sim_t *sim = (sim_t *)p_usr;
-   if (argc != 2) { rc = -1; goto _err_ret; }
+   const char *us = strrchr(name, '_');
+   if (us == NULL) return -1;
 
-   /* Setup data labels */
-   const char *csv_path = argv[1];
-   FILE *f = fopen(csv_path, "r");
-   if (!f) { rc = -2; goto _err_ret; }
+   if (0==strcmp(us, "_fgic")) *fgic = true;
+   else if (0==strcmp(us, "_batt")) *fgic = false;
+   else return -2;
 
-   // Read first line and parse data labels
-   char line[4096];
-   if (!fgets(line, sizeof(line), f)) { rc = -3; goto _err_ret; }
+   for (int k=0; k<TBL_IDS; k++)
+   {
+      const char *tn = tbl_hist_name(k);
+      if (strlen(tn) == (size_t)(us - name) && 0==strncmp(name, tn, strlen(tn)))
+      {
+         *id = k;
+         return 0;
+      }
+   }
+   return -3;
+}
 
-   char *cols[64] = {0};
-   int ncol = split_csv_line(line, cols, 64);
-   if (ncol < 2) { rc = -4; goto _err_ret; }
 
-   // Setup X labels
-   const char *x_label = cols[0];
-   int trace_count = ncol - 1;
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void table_push(scope_plot_t *p, int n, const int *id, const bool *fgic,
+ *		                const flash_params_t *bp, const flash_params_t *fp)
+ *
+ *  @brief	Push the n tabular vars over SOC_GRIDS, batt vars from bp and fgic vars from fp.  H tables are
+ *		plotted as OCV + H.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void table_push(scope_plot_t *p, int n, const int *id, const bool *fgic,
+                const flash_params_t *bp, const flash_params_t *fp)
+{
+   double y[MAX_PARAMS];
 
-   // Init scope trace object 
-   scope_trace_desc_t tr[MAX_PARAMS];
-   memset(tr, 0, sizeof(scope_trace_desc_t));
-   for (int i = 0; i < trace_count; i++) 
+   for (int k=0; k<SOC_GRIDS; k++)
    {
-      /* check if trace valid */
-      if (trace_name_valid(sim, cols[i+1]))
+      for (int i=0; i<n; i++)
       {
-         tr[i].name = str_dup(cols[i+1]); 
-         tr[i].color = palette(i);
+         flash_params_t *tp = (flash_params_t *)(fgic[i] ? fp : bp);
+         y[i] = tbl_hist_tbl(tp, id[i])[k];
+         if (id[i] == TBL_H_CHG || id[i] == TBL_H_DSG) y[i] += tp->ocv_tbl[k];
       }
+      scope_plot_push(p, fp->soc_tbl[k], y);
    }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double table_err(const flash_params_t *bp, const flash_params_t *fp, int id)
+ *
+ *  @brief	RMS error of fgic table 'id' against the batt table, in percent of the batt table's RMS
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double table_err(const flash_params_t *bp, const flash_params_t *fp, int id)
+{
+   const double *b = tbl_hist_tbl((flash_params_t *)bp, id);
+   const double *f = tbl_hist_tbl((flash_params_t *)fp, id);
+   double se = 0.0, sb = 0.0;
+
+   for (int k=0; k<SOC_GRIDS; k++)
+   {
+      se += (f[k] - b[k]) * (f[k] - b[k]);
+      sb += b[k] * b[k];
+   }
+   return (sb > 0.0) ? 100.0 * sqrt(se / sb) : NAN;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void table_anim_loop(sim_t *sim, scope_plot_t *p, SDL_Renderer *ren, int n, const int *id,
+ *		                     const bool *fgic, const flash_params_t *bp, flash_params_t *fp,
+ *		                     double t0, double t1)
+ *
+ *  @brief	Animate the tables over [t0, t1], rebuilding each frame from the table history.  Space plays
+ *		and pauses, Left/Right step 1% of the span, Home/End jump, q closes.  A full play takes
+ *		TABLE_ANIM_MS.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+#define TABLE_ANIM_MS	(10000.0)
+
+static
+void table_anim_loop(sim_t *sim, scope_plot_t *p, SDL_Renderer *ren, int n, const int *id, const bool *fgic,
+                     const flash_params_t *bp, flash_params_t *fp, double t0, double t1)
+{
+   char title[80];
+   double span = t1 - t0, t = t0;
+   bool quit = false, play = true, redraw = true;
+   Uint32 last = SDL_GetTicks();
+
+   while (!quit)
+   {
+      SDL_Event e;
+      while (SDL_PollEvent(&e))
+      {
+         if (e.type == SDL_QUIT) quit = true;
+         if (e.type == SDL_KEYDOWN) 
+         {
+            SDL_Keycode k = e.key.keysym.sym;
+            if (k == SDLK_ESCAPE || k == SDLK_q) quit = true;
+            else if (k == SDLK_SPACE) { play = !play; if (play && t >= t1) t = t0; }
+            else if (k == SDLK_LEFT) { t -= 0.01 * span; play = false; }
+            else if (k == SDLK_RIGHT) { t += 0.01 * span; play = false; }
+            else if (k == SDLK_HOME) { t = t0; play = false; }
+            else if (k == SDLK_END) { t = t1; play = false; }
+            redraw = true;
+         }
+         else if (scope_plot_handle_event(p, &e)) redraw = true;
+      }
+
+      Uint32 now = SDL_GetTicks();
+      if (play)
+      {
+         t += span * (double)(now - last) / TABLE_ANIM_MS;
+         if (t >= t1) play = false;
+         redraw = true;
+      }
+      last = now;
+
+      if (redraw && !quit)
+      {
+         if (t < t0) t = t0;
+         if (t > t1) t = t1;
+
+         tbl_hist_at(sim->hist, t, fp);
+         scope_plot_clear(p);
+         table_push(p, n, id, fgic, bp, fp);
+
+         snprintf(title, sizeof(title), "Table Chart at t=%.0f s%s", t, play ? "" : " (paused)");
+         scope_plot_set_title(p, title);
+         scope_plot_render(p);
+         SDL_RenderPresent(ren);
+         redraw = false;
+      }
+      SDL_Delay(16);
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_plot_table(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Plot specified tabular variable, each a table indexed over SOC_GRIDS
+ *
+ *  @note	plot table <list of tabular vars> [-at <t> | -anim | -err]
+ *		-at shows the fgic tables as learned by time t, -anim plays their evolution, and -err plots
+ *		each fgic table's error against the batt table over time.  All three read the table history.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+#define TABLE_ERR_PTS	(2000)
+
+static
+int f_plot_table(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   scope_plot_t *p = NULL;
+   SDL_Window *win = NULL;
+   SDL_Renderer *ren = NULL;
+   scope_trace_desc_t tr[MAX_PARAMS];
+   char names[MAX_PARAMS][FN_LEN];
+   int id[MAX_PARAMS];
+   bool fgic[MAX_PARAMS];
+   int curve_count = 0;
+   bool anim = false, err = false, at = false;
+   double t_at = 0.0;
+
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (scope_open(sim)) return -9;
+
+   for (int n=1; n < argc; n++)
+   {
+      if (0==strcmp(argv[n], "-anim")) anim = true;
+      else if (0==strcmp(argv[n], "-err")) err = true;
+      else if (0==strcmp(argv[n], "-at") && n+1 < argc) { at = true; t_at = strtod(argv[++n], NULL); }
+      else if (curve_count < MAX_PARAMS && table_var(argv[n], &id[curve_count], &fgic[curve_count]) == 0)
+      {
+         snprintf(names[curve_count], FN_LEN, "%s", argv[n]);
+         curve_count++;
+      }
+      else
+      {
+         printf("cannot recognized %s\n", argv[n]);
+         return -2;
+      }
+   }
+   if (curve_count == 0 || (int)anim + (int)err + (int)at > 1) return -1;
+
+   // -err compares each fgic table against the batt one
+   for (int i=0; err && i < curve_count; i++)
+   {
+      if (!fgic[i])
+      {
+         printf("error: -err compares fgic tables against batt; %s is not an fgic table\n", names[i]);
+         return -2;
+      }
+      snprintf(names[i], FN_LEN, "%s_fgic err%%", tbl_hist_name(id[i]));
+   }
+
+   memset(tr, 0, sizeof(tr));
+   for (int i=0; i < curve_count; i++)
+   {
+      tr[i].name = names[i];
+      tr[i].color = palette(i);
+   }
+
+   // Snapshot both models' tables and the span of the table history
+   LOCK(&sim->mtx);
+   flash_params_t bp = sim->batt->ecm->params;
+   flash_params_t fp = sim->fgic->ecm->params;
+   double t_now = sim->t;
+   UNLOCK(&sim->mtx);
+
+   double h0, h1;
+   tbl_hist_span(sim->hist, &h0, &h1);
+   if (h1 < t_now) h1 = t_now;
+
+   if (at && tbl_hist_at(sim->hist, t_at, &fp) == 1)
+      printf("note: table history starts at t=%lf\n", h0);
+
+   // Init SDL renderer
+   if (SDL_Init(SDL_INIT_VIDEO) != 0) { rc = -5; goto _err_ret; }
+   win = SDL_CreateWindow("ScopeTrace",
+                          SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                          1100, 650, SDL_WINDOW_SHOWN);
+   if (!win) { rc = -2; goto _err_ret; }
+
+   ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+   if (!ren) { rc = -3; goto _err_ret; }
+
+
+   // Create plot object with default config
+   scope_plot_cfg_t cfg = scope_plot_default_cfg();
+   if (err) cfg.max_points = TABLE_ERR_PTS + 1;
+   p = scope_plot_create(win, ren, curve_count, tr, &cfg);
+   if (!p) { rc = -3; goto _err_ret; }
+
+   if (err)
+   {
+      // Error of each table over time, sampled evenly over the history
+      double y[MAX_PARAMS];
+      for (int k=0; k <= TABLE_ERR_PTS; k++)
+      {
+         double t = h0 + (h1 - h0) * k / TABLE_ERR_PTS;
+         tbl_hist_at(sim->hist, t, &fp);
+         for (int i=0; i < curve_count; i++) y[i] = table_err(&bp, &fp, id[i]);
+         scope_plot_push(p, t, y);
+      }
+      scope_plot_set_title(p, "Table Error vs batt (RMS %)");
+      scope_plot_set_x_label(p, "t");
+      scope_plot_set_x_range(p, h0, (h1 > h0) ? h1 : h0 + 1.0);
+   }
+   else
+   {
+      char title[80];
+      if (at) snprintf(title, sizeof(title), "Table Chart at t=%.0f s", t_at);
+      else snprintf(title, sizeof(title), "Table Chart");
+
+      table_push(p, curve_count, id, fgic, &bp, &fp);
+      scope_plot_set_title(p, title);
+      scope_plot_set_x_label(p, "SOC");
+      scope_plot_set_x_range(p, fp.soc_tbl[0], fp.soc_tbl[SOC_GRIDS-1]);
+   }
+
+   // Event loop
+   if (anim)
+   {
+      table_anim_loop(sim, p, ren, curve_count, id, fgic, &bp, &fp, h0, h1);
+   }
+   else
+   {
+      scope_plot_render(p);
+      SDL_RenderPresent(ren);
+      plot_event_loop(p, ren);
+   }
+
+
+_err_ret:
+   if (p != NULL) scope_plot_destroy(p);
+   if (ren != NULL) SDL_DestroyRenderer(ren);
+   if (win != NULL) SDL_DestroyWindow(win);
+   SDL_Quit();
+
+   return rc;
+
+}
+
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int load_lgz(const char *fn, const char *const *cols, int ncols, csv_data_t **out)
+ *
+ *  @brief	Load a compressed log into columns (same selection rules and return codes as csv_load)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int load_lgz(const char *fn, const char *const *cols, int ncols, csv_data_t **out)
+{
+   int rc = 0, nsel = 0;
+   long rows = 0;
+   int map[MAX_PARAMS+1];
+   const char *sel[MAX_PARAMS+1];
+   double t, *v = NULL;
+   csv_data_t *d = NULL;
+
+   *out = NULL;
+   logz_reader_t *zr = logz_reader_open(fn);
+   if (zr == NULL) return -2;
+   if (zr->n > MAX_PARAMS) { rc = -3; goto _err_ret; }
+
+   /* column map: value column -> loaded column */
+   for (int i=0; i<zr->n; i++) map[i] = -1;
+   sel[nsel++] = zr->names[0];
+   for (int i=0; i<(ncols > 0 ? ncols : zr->n); i++)
+   {
+      int c = i;
+      if (ncols > 0)
+      {
+         if (0==strcmp(cols[i], zr->names[0])) continue;
+         for (c=0; c<zr->n; c++) if (0==strcmp(cols[i], zr->names[c+1])) break;
+         if (c == zr->n) { rc = -4; goto _err_ret; }
+      }
+      if (map[c] < 0)
+      {
+         map[c] = nsel;
+         sel[nsel++] = zr->names[c+1];
+      }
+   }
+
+   /* size from the block headers, then decode */
+   while ((rc = logz_next_block(zr)) == 1) rows += zr->blk.rows;
+   if (rc < 0 || logz_rewind(zr) != 0) { rc = -3; goto _err_ret; }
+
+   v = (double *)malloc(((size_t)zr->n + 1) * sizeof(double));
+   d = csv_data_create(nsel, sel, rows);
+   if (v == NULL || d == NULL) { rc = -5; goto _err_ret; }
+
+   while (d->rows < rows && logz_read_row(zr, &t, v) == 1)
+   {
+      d->col[0][d->rows] = t;
+      for (int i=0; i<zr->n; i++)
+         if (map[i] > 0) d->col[map[i]][d->rows] = v[i];
+      d->rows++;
+   }
+
+   *out = d;
+   d = NULL;
+
+_err_ret:
+   csv_data_free(d);
+   free(v);
+   logz_reader_close(zr);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		SDL_Color file_shade(SDL_Color c, int k)
+ *
+ *  @brief	Color of a column in the k-th overlaid file: the column's color, darker for each later file
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+SDL_Color file_shade(SDL_Color c, int k)
+{
+   c.r = (Uint8)(c.r * 2 / (2 + k));
+   c.g = (Uint8)(c.g * 2 / (2 + k));
+   c.b = (Uint8)(c.b * 2 / (2 + k));
+   return c;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void push_merged(scope_plot_t *p, csv_data_t **d, int nf, double *x_min, double *x_max)
+ *
+ *  @brief	Push the rows of nf loaded files into one plot on a shared x-axis.  The files are merged by x;
+ *		a file with no row at a merged x is interpolated between its neighbouring rows, or NaN (a gap)
+ *		outside its own x-range.  Traces of file f are the columns 1.. of d[f], in file order.
+ *
+ *  @note	Runs sharing the same time steps merge row for row with no interpolation.  A single file is
+ *		pushed as it is.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void push_merged(scope_plot_t *p, csv_data_t **d, int nf, double *x_min, double *x_max)
+{
+   long r[PLOT_FILES_MAX] = {0};
+   double y[MAX_PARAMS];
+   bool first = true;
+
+   *x_min = 0.0;
+   *x_max = 1.0;
+   for (;;)
+   {
+      /* next x: smallest head among the files */
+      double x = INFINITY;
+      bool more = false;
+      for (int f = 0; f < nf; f++)
+      {
+         if (r[f] < d[f]->rows && (!more || d[f]->col[0][r[f]] < x)) x = d[f]->col[0][r[f]];
+         if (r[f] < d[f]->rows) more = true;
+      }
+      if (!more) break;
+
+      int k = 0;
+      for (int f = 0; f < nf; f++)
+      {
+         const csv_data_t *df = d[f];
+         long i = r[f];
+
+         if (i < df->rows && (nf == 1 || df->col[0][i] == x))
+         {
+            for (int c = 1; c < df->ncol; c++) y[k++] = df->col[c][i];
+            r[f]++;
+         }
+         else if (i > 0 && i < df->rows && df->col[0][i-1] <= x && x < df->col[0][i])
+         {
+            double x0 = df->col[0][i-1], u = (x - x0) / (df->col[0][i] - x0);
+            for (int c = 1; c < df->ncol; c++)
+               y[k++] = df->col[c][i-1] + u * (df->col[c][i] - df->col[c][i-1]);
+         }
+         else
+         {
+            for (int c = 1; c < df->ncol; c++) y[k++] = NAN;
+         }
+      }
+
+      if (first) { *x_min = *x_max = x; first = false; }
+      else { if (x < *x_min) *x_min = x; if (x > *x_max) *x_max = x; }
+
+      scope_plot_push(p, x, y);
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_plot_file(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Plot saved CSV files or compressed (.lgz) logs.  CSV files are memory-mapped and parsed in
+ *		parallel, converting only the selected columns; the plot holds every row.  Several files are
+ *		overlaid on a shared x-axis, each in its own shade.  With -o the plot is rendered offscreen
+ *		and written to an image file instead of opening a window.
+ *
+ *  @note	plot file <file> [<file> ...] [-c <col,...>] [-o <out.png|out.ppm>]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_plot_file(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   csv_data_t *d[PLOT_FILES_MAX] = {NULL};
+   const char *files[PLOT_FILES_MAX];
+   int nf = 0;
+   scope_plot_t *p = NULL;
+   SDL_Window *win = NULL;
+   SDL_Renderer *ren = NULL;
+   scope_trace_desc_t tr[MAX_PARAMS];
+   char names[MAX_PARAMS][FN_LEN];
+   const char *cols[MAX_PARAMS];
+   int ncols = 0;
+   const char *out = NULL;
+   bool sdl_up = false;
+
+
+   // Get sim pointer 
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   // Files, then options: -c <col,...> and -o <image>
+   int i = 1;
+   for (; i < argc && argv[i][0] != '-'; i++)
+   {
+      if (nf == PLOT_FILES_MAX) { printf("error: at most %d files.\n", PLOT_FILES_MAX); return -1; }
+      files[nf++] = argv[i];
+   }
+   if (nf == 0 || ((argc - i) % 2) != 0) return -1;
+   for (; i < argc; i += 2)
+   {
+      if (0==strcmp(argv[i], "-c"))
+      {
+         for (char *tok = strtok(argv[i+1], ","); tok != NULL && ncols < MAX_PARAMS; tok = strtok(NULL, ","))
+            cols[ncols++] = tok;
+      }
+      else if (0==strcmp(argv[i], "-o")) out = argv[i+1];
+      else return -1;
+   }
+   if (out == NULL && scope_open(sim)) return -9;
+
+   // Load all rows of the selected columns of each file
+   int trace_count = 0;
+   long rows = 0;
+   for (int f = 0; f < nf; f++)
+   {
+      const char *path = files[f];
+      rc = logz_is_logz(path) ? load_lgz(path, cols, ncols, &d[f]) : csv_load(path, cols, ncols, 0, &d[f]);
+      if (rc == -4) printf("error: column not found in '%s'.\n", path);
+      if (rc != 0) goto _err_ret;
+      if (d[f]->ncol < 2) { rc = -4; goto _err_ret; }
+
+      trace_count += d[f]->ncol - 1;
+      rows += d[f]->rows;
+   }
+   if (trace_count > MAX_PARAMS) { rc = -4; goto _err_ret; }
+
+   // Setup X labels
+   const char *x_label = d[0]->names[0];
+
+   // Init scope trace object: one trace per column of each file; overlaid files are named in the legend
+   memset(tr, 0, sizeof(tr));
+   for (int f = 0, k = 0; f < nf; f++)
+   {
+      for (int c = 1; c < d[f]->ncol; c++, k++)
+      {
+         /* check if trace valid */
+         if (!trace_name_valid(sim, d[f]->names[c])) continue;
+
+         if (nf == 1) 
+            snprintf(names[k], FN_LEN, "%s", d[f]->names[c]);
+         else 
+         {
+            /* <file stem>:<column> */
+            const char *stem = strrchr(files[f], '/');
+            stem = (stem != NULL) ? stem + 1 : files[f];
+            const char *dot = strrchr(stem, '.');
+            int len = (dot != NULL && dot != stem) ? (int)(dot - stem) : (int)strlen(stem);
+            snprintf(names[k], FN_LEN, "%.*s:%s", len, stem, d[f]->names[c]);
+         }
+         tr[k].name = names[k];
+         tr[k].color = file_shade(palette(c-1), f);
+      }
+   }
+
+
+   // Create plot object sized to hold every row
+   scope_plot_cfg_t cfg = scope_plot_default_cfg();
+   cfg.max_points = (rows > 1024) ? (int)rows : 1024;
+   cfg.compact = (rows > PLOT_COMPACT_ROWS);
+
+   if (out != NULL)
+   {
+      // Offscreen: no display, window or event loop needed
+      p = scope_plot_create_headless(1100, 650, trace_count, tr, &cfg);
+      if (!p) { rc = -8; goto _err_ret; }
+   }
+   else
+   {
+      // Init SDL renderer
+      if (SDL_Init(SDL_INIT_VIDEO) != 0) { rc = -5; goto _err_ret; }
+      sdl_up = true;
+      win = SDL_CreateWindow("ScopeTrace", 
+		             SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                             1100, 650, SDL_WINDOW_SHOWN);
+      if (!win) { rc = -6; goto _err_ret; }
+
+      ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+      if (!ren) { rc = -7; goto _err_ret; }
+
+      p = scope_plot_create(win, ren, trace_count, tr, &cfg);
+      if (!p) { rc = -8; goto _err_ret; }
+   }
+
+   // Set plot title and X label
+   scope_plot_set_title(p, "ScopeTrace");
+   scope_plot_set_x_label(p, x_label);
+
+   // Push data into plot
+   double x_min, x_max;
+   push_merged(p, d, nf, &x_min, &x_max);
+   if (nf == 1) printf("%ld rows of %d columns.\n", rows, trace_count);
+   else printf("%ld rows of %d columns from %d files.\n", rows, trace_count, nf);
+   for (int f = 0; f < nf; f++)
+   {
+      csv_data_free(d[f]);
+      d[f] = NULL;
+   }
+
+   scope_plot_set_x_range(p, x_min, x_max);
+
+   // Write image
+   if (out != NULL)
+   {
+      rc = scope_plot_save_image(p, out);
+      if (rc != 0) { printf("error: cannot write '%s'.\n", out); rc = -10; }
+      else printf("wrote %s\n", out);
+      goto _err_ret;
+   }
+
+   // Render plot
+   scope_plot_render(p);
+   SDL_RenderPresent(ren);
+
+   // Event loop
+   plot_event_loop(p, ren);
+
+
+_err_ret:
+   for (int f = 0; f < nf; f++) csv_data_free(d[f]);
+   if (p != NULL) scope_plot_destroy(p);
+   if (ren != NULL) SDL_DestroyRenderer(ren);
+   if (win != NULL) SDL_DestroyWindow(win);
+   if (sdl_up) SDL_Quit();
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_plot_xy(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Plot columns of a saved log against another column (e.g. V_batt vs soc_batt) as an x-y density,
+ *		so hysteresis and R0 steps show on runs of millions of rows
+ *
+ *  @note	plot xy <file> <x_col> <y_col,...> [-o <out.png|out.ppm>]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_plot_xy(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   csv_data_t *d = NULL;
+   scope_plot_t *p = NULL;
+   SDL_Window *win = NULL;
+   SDL_Renderer *ren = NULL;
+   scope_trace_desc_t tr[MAX_PARAMS];
+   const char *cols[MAX_PARAMS];
+   int yi[MAX_PARAMS];
+   int ncols = 0, xi = -1;
+   const char *out = NULL;
+   bool sdl_up = false;
+
+
+   // Get sim pointer 
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (argc != 4 && !(argc == 6 && 0==strcmp(argv[4], "-o"))) return -1;
+   if (argc == 6) out = argv[5];
+   if (out == NULL && scope_open(sim)) return -9;
+
+   // Columns: x, then y's
+   cols[ncols++] = argv[2];
+   for (char *tok = strtok(argv[3], ","); tok != NULL && ncols < MAX_PARAMS; tok = strtok(NULL, ","))
+      cols[ncols++] = tok;
+
+   // Load all rows of the selected columns 
+   const char *path = argv[1];
+   rc = logz_is_logz(path) ? load_lgz(path, cols, ncols, &d) : csv_load(path, cols, ncols, 0, &d);
+   if (rc == -4) printf("error: column not found in '%s'.\n", path);
+   if (rc != 0) goto _err_ret;
+
+   // Where each selected column landed (x may be the time column)
+   for (int k = 0; k < ncols; k++)
+   {
+      int c = 0;
+      while (c < d->ncol && 0 != strcmp(cols[k], d->names[c])) c++;
+      if (c == d->ncol) { rc = -4; goto _err_ret; }
+      if (k == 0) xi = c; else yi[k-1] = c;
+   }
+   int trace_count = ncols - 1;
+
+   // Init scope trace object 
+   memset(tr, 0, sizeof(tr));
+   for (int i = 0; i < trace_count; i++) 
+   {
+      /* check if trace valid */
+      if (trace_name_valid(sim, d->names[yi[i]]))
+      {
+         tr[i].name = d->names[yi[i]]; 
+         tr[i].color = palette(i);
+      }
+   }
+
+
+   // Create plot object sized to hold every row
+   scope_plot_cfg_t cfg = scope_plot_default_cfg();
+   cfg.max_points = (d->rows > 1024) ? (int)d->rows : 1024;
+   cfg.compact = (d->rows > PLOT_COMPACT_ROWS);
+
+   if (out != NULL)
+   {
+      // Offscreen: no display, window or event loop needed
+      p = scope_plot_create_headless(1100, 650, trace_count, tr, &cfg);
+      if (!p) { rc = -8; goto _err_ret; }
+   }
+   else
+   {
+      // Init SDL renderer
+      if (SDL_Init(SDL_INIT_VIDEO) != 0) { rc = -5; goto _err_ret; }
+      sdl_up = true;
+      win = SDL_CreateWindow("ScopeXY", 
+		             SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                             1100, 650, SDL_WINDOW_SHOWN);
+      if (!win) { rc = -6; goto _err_ret; }
+
+      ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+      if (!ren) { rc = -7; goto _err_ret; }
+
+      p = scope_plot_create(win, ren, trace_count, tr, &cfg);
+      if (!p) { rc = -8; goto _err_ret; }
+   }
+
+   // Set plot title, X label and density mode
+   scope_plot_set_title(p, "ScopeXY");
+   scope_plot_set_x_label(p, d->names[xi]);
+   scope_plot_set_density(p, true);
+
+   // Push data into plot
+   double x_min = INFINITY, x_max = -INFINITY;
+   double y[MAX_PARAMS];
+   for (long r = 0; r < d->rows; r++)
+   {
+      double x = d->col[xi][r];
+      for (int i = 0; i < trace_count; i++) y[i] = d->col[yi[i]][r];
+
+      if (x < x_min) x_min = x;
+      if (x > x_max) x_max = x;
+
+      scope_plot_push(p, x, y);
+   }
+   if (x_min > x_max) { x_min = 0.0; x_max = 1.0; }
+   printf("%ld points of %d columns.\n", d->rows, trace_count);
+   csv_data_free(d);
+   d = NULL;
+
+   scope_plot_set_x_range(p, x_min, x_max);
+
+   // Write image
+   if (out != NULL)
+   {
+      rc = scope_plot_save_image(p, out);
+      if (rc != 0) { printf("error: cannot write '%s'.\n", out); rc = -10; }
+      else printf("wrote %s\n", out);
+      goto _err_ret;
+   }
+
+   // Render plot
+   scope_plot_render(p);
+   SDL_RenderPresent(ren);
+
+   // Event loop
+   plot_event_loop(p, ren);
+
+
+_err_ret:
+   csv_data_free(d);
+   if (p != NULL) scope_plot_destroy(p);
+   if (ren != NULL) SDL_DestroyRenderer(ren);
+   if (win != NULL) SDL_DestroyWindow(win);
+   if (sdl_up) SDL_Quit();
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_trace_start(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Start capturing the last <secs> of selected params in memory
+ *
+ *  @note	trace start <secs> <data0> <data1> ...
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_trace_start(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   if (argc < 3 || !util_is_numeric(argv[1])) return -2;
+
+   double secs = strtod(argv[1], NULL);
+   if (secs < sim->dt) 
+   {
+      printf("error: trace length must be >= %g secs.\n", sim->dt);
+      return -3;
+   }
+
+   trace_t *tr = trace_create(sim->params, (long)ceil(secs / sim->dt) + 1);
+   if (tr == NULL)
+   {
+      printf("error: out of memory.\n");
+      return -4;
+   }
+
+   for (int n = 2; n < argc; n++)
+   {
+      if (trace_add_col(tr, sim->params_sz, argv[n]) != 0)
+      {
+         printf("error: variable \'%s\' not found.\n", argv[n]);
+         trace_destroy(tr);
+         return -5;
+      }
+   }
+
+   LOCK(&sim->mtx);
+   trace_t *old = sim->trace;
+   sim->trace = tr;
+   UNLOCK(&sim->mtx);
+
+   trace_destroy(old);
+   printf("trace of %d params, last %g secs (%ld rows, %.1f MB).\n", tr->n, secs, tr->cap,
+          (double)tr->cap * (tr->n + 1) * sizeof(double) / 1e6);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_trace_stop(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Stop capturing and free the trace ring
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_trace_stop(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   (void)argv;
+
+   if (m==NULL || p_usr==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   if (argc != 1) return -2;
+
+   LOCK(&sim->mtx);
+   trace_t *tr = sim->trace;
+   sim->trace = NULL;
+   UNLOCK(&sim->mtx);
+
+   trace_destroy(tr);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int trace_window(trace_t *tr, int argc, char **argv, int n, long *first, long *cnt)
+ *
+ *  @brief	Parse an optional time window from argv[n..]: nothing (all rows), <t0> <t1>, or -last <secs>
+ *
+ *  @note	Caller holds sim->mtx
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int trace_window(trace_t *tr, int argc, char **argv, int n, long *first, long *cnt)
+{
+   if (tr == NULL || tr->count == 0)
+   {
+      printf("error: trace is empty.\n");
+      return -3;
+   }
+
+   double t_end = trace_t_at(tr, tr->count-1);
+   double t0 = trace_t_at(tr, 0), t1 = t_end;
+
+   if (argc == n+2 && 0==strcmp(argv[n], "-last") && util_is_numeric(argv[n+1]))
+   {
+      t0 = t_end - strtod(argv[n+1], NULL);
+   }
+   else if (argc == n+2 && util_is_numeric(argv[n]) && util_is_numeric(argv[n+1]))
+   {
+      t0 = strtod(argv[n], NULL);
+      t1 = strtod(argv[n+1], NULL);
+   }
+   else if (argc != n)
+   {
+      return -2;
+   }
+
+   *cnt = trace_range(tr, t0, t1, first);
+   if (*cnt == 0)
+   {
+      printf("error: no samples in [%g, %g]; trace holds [%g, %g].\n", t0, t1, trace_t_at(tr, 0), t_end);
+      return -4;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_trace_stats(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Show min/max/mean/std of each traced param over a time window
+ *
+ *  @note	trace stats [<t0> <t1> | -last <secs>]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_trace_stats(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc;
+   long first = 0, cnt = 0;
+   trace_stats_t st[MAX_PARAMS];
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   LOCK(&sim->mtx);
+   trace_t *tr = sim->trace;
+   rc = trace_window(tr, argc, argv, 1, &first, &cnt);
+   if (rc == 0)
+   {
+      trace_stats(tr, first, cnt, st);
+
+      printf("t=[%lf, %lf], %ld samples\n", trace_t_at(tr, first), trace_t_at(tr, first+cnt-1), cnt);
+      printf("%-20s %14s %14s %14s %14s %14s %12s %12s\n", 
+             "param", "min", "max", "mean", "std", "last", "t_min", "t_max");
+      for (int i=0; i<tr->n; i++)
+      {
+         printf("%-20s %14.6g %14.6g %14.6g %14.6g %14.6g %12.2lf %12.2lf\n", tr->params[tr->idx[i]].name,
+                st[i].min, st[i].max, st[i].mean, st[i].std, st[i].last, st[i].t_min, st[i].t_max);
+      }
+   }
+   UNLOCK(&sim->mtx);
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_trace_dump(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Write a time window of the trace to a CSV (or .lgz) file
+ *
+ *  @note	trace dump <file> [<t0> <t1> | -last <secs>]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_trace_dump(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc;
+   long first = 0, cnt = 0;
 
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   if (argc < 2) return -2;
+
+   LOCK(&sim->mtx);
+   rc = trace_window(sim->trace, argc, argv, 2, &first, &cnt);
+   if (rc == 0 && trace_dump(sim->trace, argv[1], first, cnt) != 0)
+   {
+      printf("error: cannot write %s.\n", argv[1]);
+      rc = -5;
+   }
+   UNLOCK(&sim->mtx);
+
+   if (rc == 0) printf("%ld samples written to %s.\n", cnt, argv[1]);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_trace_plot(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Plot a time window of the trace
+ *
+ *  @note	trace plot [<t0> <t1> | -last <secs>]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_trace_plot(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   long first = 0, cnt = 0;
+   scope_plot_t *p = NULL;
+   SDL_Window *win = NULL;
+   SDL_Renderer *ren = NULL;
+   scope_trace_desc_t td[MAX_PARAMS];
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (scope_open(sim)) return -9;
 
    // Init SDL renderer
    if (SDL_Init(SDL_INIT_VIDEO) != 0) { rc = -5; goto _err_ret; }
-   win = SDL_CreateWindow("ScopeTrace", 
+   win = SDL_CreateWindow("Trace", 
 		          SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                           1100, 650, SDL_WINDOW_SHOWN);
    if (!win) { rc = -6; goto _err_ret; }
@@ -761,68 +1731,177 @@ int f_plot_file(struct _menu *m, int argc, char **argv, void *p_usr)
    ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
    if (!ren) { rc = -7; goto _err_ret; }
 
+   // Copy the window out of the ring while the sim thread is held off
+   LOCK(&sim->mtx);
+   trace_t *tr = sim->trace;
+   rc = trace_window(tr, argc, argv, 1, &first, &cnt);
+   if (rc == 0)
+   {
+      for (int i = 0; i < tr->n; i++)
+      {
+         td[i].name = tr->params[tr->idx[i]].name;
+         td[i].color = palette(i);
+      }
+
+      scope_plot_cfg_t cfg = scope_plot_default_cfg();
+      cfg.max_points = (int)cnt;
+      p = scope_plot_create(win, ren, tr->n, td, &cfg);
+      if (p != NULL)
+      {
+         for (long k = first; k < first + cnt; k++)
+            scope_plot_push(p, trace_t_at(tr, k), trace_row(tr, k));
+         scope_plot_set_x_range(p, trace_t_at(tr, first), trace_t_at(tr, first+cnt-1));
+      }
+   }
+   UNLOCK(&sim->mtx);
 
-   // Create plot object with default config
-   scope_plot_cfg_t cfg = scope_plot_default_cfg();
-   p = scope_plot_create(win, ren, trace_count, tr, &cfg);
+   if (rc != 0) goto _err_ret;
    if (!p) { rc = -8; goto _err_ret; }
 
-   // Set plot title and X label
-   scope_plot_set_title(p, "ScopeTrace");
-   scope_plot_set_x_label(p, x_label);
+   scope_plot_set_title(p, "Trace");
+   scope_plot_set_x_label(p, "t");
+   scope_plot_render(p);
+   SDL_RenderPresent(ren);
 
-   // Read data into plot one line at a time.  Data buffer overflows at 40000 data ponts
-   double x_min = 0.0, x_max = 1.0;
-   bool first = true;
-   double *y = (double*)calloc((size_t)trace_count, sizeof(double));
-   if (!y) { rc = -9; goto _err_ret; }
-   while (fgets(line, sizeof(line), f)) 
+   // Event loop
+   plot_event_loop(p, ren);
+
+_err_ret:
+   if (p != NULL) scope_plot_destroy(p);
+   if (ren != NULL) SDL_DestroyRenderer(ren);
+   if (win != NULL) SDL_DestroyWindow(win);
+   SDL_Quit();
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_scope_start(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Open a live plot of selected params that follows the running simulation
+ *
+ *  @note	scope start [-window <secs>] [-fps <n>] <data0> <data1> ...
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_scope_start(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   double window = 600.0;
+   int fps = SCOPE_LIVE_FPS;
+   int n = 1;
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   for (; n+1 < argc && argv[n][0] == '-'; n += 2)
+   {
+      if (0==strcmp(argv[n], "-window") && util_is_numeric(argv[n+1])) window = strtod(argv[n+1], NULL);
+      else if (0==strcmp(argv[n], "-fps") && util_is_numeric(argv[n+1])) fps = atoi(argv[n+1]);
+      else return -2;
+   }
+   if (n >= argc || window < sim->dt || fps <= 0) return -2;
+
+   scope_live_t *sl = scope_live_create(sim->params);
+   if (sl == NULL)
+   {
+      printf("error: out of memory.\n");
+      return -4;
+   }
+
+   SDL_Color colors[MAX_PARAMS];
+   for (; n < argc; n++)
+   {
+      if (scope_live_add_col(sl, sim->params_sz, argv[n]) != 0)
+      {
+         printf("error: variable \'%s\' not found.\n", argv[n]);
+         scope_live_destroy(sl);
+         return -5;
+      }
+      colors[sl->n-1] = palette(sl->n-1);
+   }
+
+   // Close any open scope before the new one takes the display
+   LOCK(&sim->mtx);
+   scope_live_t *old = sim->scope;
+   sim->scope = NULL;
+   UNLOCK(&sim->mtx);
+   scope_live_destroy(old);
+
+   // Plot holds one window of steps; older samples scroll out 
+   if (scope_live_start(sl, colors, window, (int)ceil(window / sim->dt) + 16, fps) != 0)
    {
-      if (line[0] == '\0' || line[0] == '\n' || line[0] == '\r') continue;
+      printf("error: cannot start scope.\n");
+      scope_live_destroy(sl);
+      return -6;
+   }
 
-      char *tok[64] = {0};
-      int nt = split_csv_line(line, tok, 64);
-      if (nt != ncol) continue; // skip malformed rows
+   LOCK(&sim->mtx);
+   sim->scope = sl;
+   UNLOCK(&sim->mtx);
+
+   printf("scope of %d params, last %g secs at %d fps.\n", sl->n, window, sl->fps);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_scope_stop(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Close the live scope
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int f_scope_stop(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   (void)argv;
 
-      double x = strtod(tok[0], NULL);
-      for (int i = 0; i < trace_count; i++) y[i] = strtod(tok[i+1], NULL);
+   if (m==NULL || p_usr==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
 
-      if (first) { x_min = x_max = x; first = false; }
-      else { if (x < x_min) x_min = x; if (x > x_max) x_max = x; }
+   if (argc != 1) return -2;
 
-      scope_plot_push(p, x, y);
-   }
-   fclose(f);
+   LOCK(&sim->mtx);
+   scope_live_t *sl = sim->scope;
+   sim->scope = NULL;
+   UNLOCK(&sim->mtx);
 
-   // Render plot
-   scope_plot_set_x_range(p, x_min, x_max);
-   scope_plot_render(p);
-   SDL_RenderPresent(ren);
+   if (sl != NULL && atomic_load(&sl->dropped) > 0)
+      printf("scope dropped %ld rows.\n", (long)atomic_load(&sl->dropped));
+   scope_live_destroy(sl);
+   return 0;
+}
 
-   // Event loop
-   bool quit = false;
-   while (!quit) 
-   {
-      SDL_Event e;
-      while (SDL_PollEvent(&e)) 
-      {
-         if (e.type == SDL_QUIT) quit = true;
-         if (e.type == SDL_KEYDOWN) {
-             SDL_Keycode k = e.key.keysym.sym;
-             if (k == SDLK_ESCAPE || k == SDLK_q) quit = true;
-         }
-      }
-      SDL_Delay(16);
-   }
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_logq(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Indexed query on a CSV or .lgz log file (same syntax as the logq tool)
+ *
+ *  @note	logq <file> info | index
+ *		logq <file> window <t0> <t1> [-c <col,...>] [-o <out.csv>]
+ *		logq <file> find <col> <op> <val> [&& ...] [-after <t>] [-edge] [-n <hits>] [-c ...] [-o ...]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_logq(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   if (argc < 3) return -2;
 
-_err_ret:
-   if (p != NULL) scope_plot_destroy(p);
-   if (ren != NULL) SDL_DestroyRenderer(ren);
-   if (win != NULL) SDL_DestroyWindow(win);
-   SDL_Quit();
+   int rc = logq_run(argc-1, &argv[1], stdout);
+   fflush(stdout);
 
-   return rc;
+   return (rc < 0) ? -3 : 0;
 }
 
 
@@ -934,6 +2013,328 @@ _err_ret:
 }
 
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_ocv_load(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Load a fine OCV curve from a log for the batt (or fgic) ECM
+ *
+ *  @note	ocv load <file.csv|file.lgz> [-c <soc_col>,<v_col>] [-n <points>] [-fgic]
+ *		The curve is averaged into <points> bins on a uniform SOC grid (default OCV_POINTS), which
+ *		also averages the charge and discharge branches of a slow cycle; -n 0 keeps every point.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_ocv_load(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   csv_data_t *d = NULL;
+   const char *cols[2] = { "soc_batt", "V_batt" };
+   int n_out = OCV_POINTS;
+   bool fgic = false;
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (argc < 2) return -1;
+
+   for (int n=2; n < argc; n++)
+   {
+      if (0==strcmp(argv[n], "-c") && n+1 < argc)
+      {
+         char *comma = strchr(argv[++n], ',');
+         if (comma == NULL) return -2;
+         *comma = '\0';
+         cols[0] = argv[n];
+         cols[1] = comma + 1;
+      }
+      else if (0==strcmp(argv[n], "-n") && n+1 < argc) n_out = atoi(argv[++n]);
+      else if (0==strcmp(argv[n], "-fgic")) fgic = true;
+      else return -2;
+   }
+   if (n_out < 0 || n_out == 1) return -2;
+
+   const char *path = argv[1];
+   rc = logz_is_logz(path) ? load_lgz(path, cols, 2, &d) : csv_load(path, cols, 2, 0, &d);
+   if (rc == -4) printf("error: column not found in '%s'.\n", path);
+   if (rc != 0) return -3;
+
+   // Where the two columns landed (either may be the time column)
+   int ci[2];
+   for (int k = 0; k < 2; k++)
+   {
+      ci[k] = 0;
+      while (ci[k] < d->ncol && 0 != strcmp(cols[k], d->names[ci[k]])) ci[k]++;
+      if (ci[k] == d->ncol) { rc = -4; goto _err_ret; }
+   }
+
+   tbl_t *ocv = tbl_create(d->col[ci[0]], d->col[ci[1]], d->rows, n_out);
+   if (ocv == NULL) 
+   {
+      printf("error: need at least 2 distinct %s values.\n", cols[0]);
+      rc = -5;
+      goto _err_ret;
+   }
+   printf("ocv: %d points over %s [%lf, %lf], %s grid\n", ocv->n, cols[0], ocv->x[0], ocv->x[ocv->n-1],
+          (ocv->g.inv_h > 0.0) ? "uniform" : "non-uniform");
+
+   LOCK(&sim->mtx);
+   ecm_set_ocv(fgic ? sim->fgic->ecm : sim->batt->ecm, ocv);
+   UNLOCK(&sim->mtx);
+
+_err_ret:
+   csv_data_free(d);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_ocv_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Go back to the flash OCV table
+ *
+ *  @note	ocv clear [-fgic]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_ocv_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   bool fgic = (argc == 2 && 0==strcmp(argv[1], "-fgic"));
+   if (argc > 2 || (argc == 2 && !fgic)) return -2;
+
+   LOCK(&sim->mtx);
+   ecm_set_ocv(fgic ? sim->fgic->ecm : sim->batt->ecm, NULL);
+   UNLOCK(&sim->mtx);
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_tmap_load(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Load measured R0, R1, C1 over temperature and SOC from a log for the batt (or fgic) ECM
+ *
+ *  @note	tmap load <file.csv|file.lgz> [-c <T_col>,<soc_col>,<R0_col>,<R1_col>,<C1_col>] [-fgic]
+ *		Samples are grouped into temperature levels of T_GRID_STEP_C, e.g. runs at a few ambient
+ *		temperatures; the r0/r1/c1 tables are replaced by the data at T_ref.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_tmap_load(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int rc = 0;
+   csv_data_t *d = NULL;
+   const char *cols[5] = { "T_batt", "soc_batt", "R0_batt", "R1_batt", "C1_batt" };
+   bool fgic = false;
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (argc < 2) return -1;
+
+   for (int n=2; n < argc; n++)
+   {
+      if (0==strcmp(argv[n], "-c") && n+1 < argc)
+      {
+         char *s = argv[++n];
+         for (int k = 0; k < 5; k++)
+         {
+            cols[k] = s;
+            s = strchr(s, ',');
+            if ((s == NULL) != (k == 4)) return -2;
+            if (s != NULL) *s++ = '\0';
+         }
+      }
+      else if (0==strcmp(argv[n], "-fgic")) fgic = true;
+      else return -2;
+   }
+
+   const char *path = argv[1];
+   rc = logz_is_logz(path) ? load_lgz(path, cols, 5, &d) : csv_load(path, cols, 5, 0, &d);
+   if (rc == -4) printf("error: column not found in '%s'.\n", path);
+   if (rc != 0) return -3;
+
+   // Where the columns landed (any may be the time column)
+   const double *col[5];
+   for (int k = 0; k < 5; k++)
+   {
+      int c = 0;
+      while (c < d->ncol && 0 != strcmp(cols[k], d->names[c])) c++;
+      if (c == d->ncol) { rc = -4; goto _err_ret; }
+      col[k] = d->col[c];
+   }
+
+   LOCK(&sim->mtx);
+   ecm_t *ecm = fgic ? sim->fgic->ecm : sim->batt->ecm;
+   int nlv = ecm_load_tf(ecm, col[0], col[1], &col[2], d->rows);
+   if (nlv > 0 && fgic)
+   {
+      tbl_hist_sync(sim->hist, sim->t, TBL_R0);
+      tbl_hist_sync(sim->hist, sim->t, TBL_R1);
+      tbl_hist_sync(sim->hist, sim->t, TBL_C1);
+   }
+   UNLOCK(&sim->mtx);
+
+   if (nlv == -2) printf("error: need at least 2 temperatures with 2 distinct %s values each.\n", cols[1]);
+   else if (nlv == -3) printf("error: %s, %s, %s must be > 0 at T_ref.\n", cols[2], cols[3], cols[4]);
+   if (nlv < 0) 
+   {
+      rc = -5;
+      goto _err_ret;
+   }
+   printf("tmap: %d temperatures, %d x %d grid over [%lf, %lf] degC\n", nlv, T_GRIDS, SOC_GRIDS,
+          ecm->T_tbl[0], ecm->T_tbl[T_GRIDS-1]);
+
+_err_ret:
+   csv_data_free(d);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_tmap_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Go back to Arrhenius temperature factors (the r0/r1/c1 tables are kept)
+ *
+ *  @note	tmap clear [-fgic]
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_tmap_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   bool fgic = (argc == 2 && 0==strcmp(argv[1], "-fgic"));
+   if (argc > 2 || (argc == 2 && !fgic)) return -2;
+
+   LOCK(&sim->mtx);
+   ecm_build_tf(fgic ? sim->fgic->ecm : sim->batt->ecm);
+   UNLOCK(&sim->mtx);
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_pack_build(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Build a pack of n_s groups in series of n_p cells in parallel, copies of the batt cell
+ *
+ *  @note	pack build <n_s> <n_p> [-j <threads>]
+ *		Cells vary by sd_R_pack, sd_Q_pack, sd_V_pack (seed_pack); the system load is per cell, so the
+ *		pack carries n_p times it.  The cells take the batt cell's loaded OCV curve and temperature map
+ *		as they are at the build.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_pack_build(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   int nthreads = 0;
+
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+
+   if (argc != 3 && argc != 5) return -2;
+   if (!util_is_numeric(argv[1]) || !util_is_numeric(argv[2])) return -3;
+   if (argc == 5)
+   {
+      if (0 != strcmp(argv[3], "-j") || !util_is_numeric(argv[4])) return -3;
+      nthreads = atoi(argv[4]);
+   }
+   int n_s = atoi(argv[1]);
+   int n_p = atoi(argv[2]);
+
+   LOCK(&sim->mtx);
+   int rc = pack_build(sim->pack, sim->batt->ecm, n_s, n_p, nthreads);
+   int n_rc = (sim->pack->b != NULL) ? sim->pack->b->n_rc : 0;
+   bool fine_ocv = (sim->pack->b != NULL && sim->pack->b->ocv_n > 0);
+   bool tmap = (sim->pack->b != NULL && sim->pack->b->tf != NULL);
+   int n_thr = sim->pack->n_thr;
+   UNLOCK(&sim->mtx);
+
+   if (rc == -1 || rc == -2) 
+   {
+      printf("error: need 1 <= n_s, n_p and n_s * n_p <= %d.\n", PACK_MAX_CELLS);
+      return -4;
+   }
+   if (rc != 0) return -5;
+
+   printf("pack: %ds%dp, %d cells of %d RC%s%s, %d thread%s\n", n_s, n_p, n_s * n_p, n_rc,
+          fine_ocv ? ", fine OCV" : "", tmap ? ", measured temperature factors" : "", n_thr, (n_thr > 1) ? "s" : "");
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_pack_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Remove the pack
+ *
+ *  @note	pack clear
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_pack_clear(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (argc != 1) return -2;
+
+   LOCK(&sim->mtx);
+   pack_clear(sim->pack);
+   UNLOCK(&sim->mtx);
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int f_pack_dump(struct _menu *m, int argc, char **argv, void *p_usr)
+ *
+ *  @brief	Write the state and variation of every pack cell to a CSV file
+ *
+ *  @note	pack dump <file.csv>
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int f_pack_dump(struct _menu *m, int argc, char **argv, void *p_usr)
+{
+   if (m==NULL || p_usr==NULL || argv==NULL) return -1;
+   sim_t *sim = (sim_t *)p_usr;
+   if (argc != 2) return -2;
+
+   LOCK(&sim->mtx);
+   int rc = pack_dump(sim->pack, argv[1]);
+   UNLOCK(&sim->mtx);
+
+   if (rc == -2) printf("error: no pack, see 'pack build'.\n");
+   return (rc == 0) ? 0 : -3;
+}
+
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
@@ -1089,7 +2490,7 @@ int f_run_script(struct _menu *m, int argc, char **argv, void *p_usr)
          memset(xargv, 0, MAX_TOKENS*sizeof(char *));
          char *token = strtok(linebuf, delim);
 
-         while (token != NULL)
+         while (token != NULL && xargc < MAX_TOKENS)
          {
             xargv[xargc] = token;
             xargc++;
@@ -1245,25 +2646,112 @@ menu_t *app_menu_init()
 
 
    /* log command */
-   menu_t *m_log = menu_create("log", "log data to file", "log <start <file> <data0> <data1> ...> | <stop>", "", f_log);
+   menu_t *m_log = menu_create("log", "log data to file", 
+                               "log <start <file> [-name <name>] [-every <n>|-interval <s>|-minmax <s>|-mean <s>|-onchange] "
+                               "[-start|-stop <param> <op> <value>] <data0>[:<deadband>] <data1> ...> | "
+                               "<stop [<name>]> | <list>", "", f_log);
    menu_add_peer(m_root, m_log);
 
+   /* trace commands */
+   menu_t *m_trace = menu_create("trace", "trace <start | stop | stats | dump | plot>", "", "", NULL);
+   menu_add_peer(m_root, m_trace);
+
+   menu_t *m_trace_start = menu_create("start", "capture the last <secs> of params in memory", 
+                                       "trace start <secs> <data0> <data1> ...", "", f_trace_start);
+   menu_add_child(m_trace, m_trace_start);
+
+   menu_t *m_trace_stop = menu_create("stop", "stop capture", "trace stop", "", f_trace_stop);
+   menu_add_peer(m_trace_start, m_trace_stop);
+
+   menu_t *m_trace_stats = menu_create("stats", "show trace statistics", 
+                                       "trace stats [<t0> <t1> | -last <secs>]", "", f_trace_stats);
+   menu_add_peer(m_trace_stop, m_trace_stats);
+
+   menu_t *m_trace_dump = menu_create("dump", "write trace to file", 
+                                      "trace dump <file> [<t0> <t1> | -last <secs>]", "", f_trace_dump);
+   menu_add_peer(m_trace_stats, m_trace_dump);
+
+   menu_t *m_trace_plot = menu_create("plot", "plot trace", 
+                                      "trace plot [<t0> <t1> | -last <secs>]", "", f_trace_plot);
+   menu_add_peer(m_trace_dump, m_trace_plot);
+
+   /* scope commands */
+   menu_t *m_scope = menu_create("scope", "scope <start | stop>", "", "", NULL);
+   menu_add_peer(m_root, m_scope);
+
+   menu_t *m_scope_start = menu_create("start", "live plot of params while the sim runs", 
+                                       "scope start [-window <secs>] [-fps <n>] <data0> <data1> ...", "", f_scope_start);
+   menu_add_child(m_scope, m_scope_start);
+
+   menu_t *m_scope_stop = menu_create("stop", "close live plot", "scope stop", "", f_scope_stop);
+   menu_add_peer(m_scope_start, m_scope_stop);
+
+   /* logq command */
+   menu_t *m_logq = menu_create("logq", "indexed query on a log file", 
+                                "logq <file> <info | index | window <t0> <t1> | find <col> <op> <val> [&& ...]> "
+                                "[-c <cols>] [-o <out>] [-after <t>] [-edge] [-n <hits>]", "", f_logq);
+   menu_add_peer(m_root, m_logq);
+
    /* plot file command */
-   menu_t *m_plot = menu_create("plot", "plot <file | table>", "", "", NULL);
+   menu_t *m_plot = menu_create("plot", "plot <file | xy | table>", "", "", NULL);
    menu_add_peer(m_root, m_plot);
 
    /* plot file command */
-   menu_t *m_plot_file = menu_create("file", "plot file", "plot file <file>", "", f_plot_file);
+   menu_t *m_plot_file = menu_create("file", "plot file", "plot file <file.csv|file.lgz> [<file> ...] [-c <col,...>] [-o <out.png|out.ppm>]", "", f_plot_file);
    menu_add_child(m_plot, m_plot_file);
 
+   /* plot xy command */
+   menu_t *m_plot_xy = menu_create("xy", "plot columns against a column as an x-y density", 
+                                   "plot xy <file.csv|file.lgz> <x_col> <y_col,...> [-o <out.png|out.ppm>]", "", f_plot_xy);
+   menu_add_peer(m_plot_file, m_plot_xy);
+
    /* plot table command */
-   menu_t *m_plot_table = menu_create("table", "plot table", "plot table <OCV|R0|R1|C1|H_dsg|H_chg>", "", f_plot_table);
-   menu_add_peer(m_plot_file, m_plot_table);
+   menu_t *m_plot_table = menu_create("table", "plot table", "plot table <OCV|R0|R1|C1|H_dsg|H_chg>_<batt|fgic> ... [-at <t> | -anim | -err]", "", f_plot_table);
+   menu_add_peer(m_plot_xy, m_plot_table);
 
    /* Compare command */
    menu_t *m_compare = menu_create("compare", "compare fgic & batt ecm model", "compare", "", f_compare);
    menu_add_peer(m_root, m_compare);
 
+   /* OCV curve commands */
+   menu_t *m_ocv = menu_create("ocv", "ocv <load | clear>", "", "", NULL);
+   menu_add_peer(m_root, m_ocv);
+
+   menu_t *m_ocv_load = menu_create("load", "use a fine OCV curve from a log", 
+                                    "ocv load <file.csv|file.lgz> [-c <soc_col>,<v_col>] [-n <points>] [-fgic]", "", f_ocv_load);
+   menu_add_child(m_ocv, m_ocv_load);
+
+   menu_t *m_ocv_clear = menu_create("clear", "go back to the flash OCV table", "ocv clear [-fgic]", "", f_ocv_clear);
+   menu_add_peer(m_ocv_load, m_ocv_clear);
+
+   /* Temperature table commands */
+   menu_t *m_tmap = menu_create("tmap", "tmap <load | clear>", "", "", NULL);
+   menu_add_peer(m_root, m_tmap);
+
+   menu_t *m_tmap_load = menu_create("load", "use measured R0/R1/C1 over temperature and SOC from a log", 
+                                     "tmap load <file.csv|file.lgz> [-c <T_col>,<soc_col>,<R0_col>,<R1_col>,<C1_col>] [-fgic]",
+                                     "", f_tmap_load);
+   menu_add_child(m_tmap, m_tmap_load);
+
+   menu_t *m_tmap_clear = menu_create("clear", "go back to Arrhenius temperature factors", "tmap clear [-fgic]", "",
+                                      f_tmap_clear);
+   menu_add_peer(m_tmap_load, m_tmap_clear);
+
+   /* Pack commands */
+   menu_t *m_pack = menu_create("pack", "pack <build | clear | dump>", "", "", NULL);
+   menu_add_peer(m_root, m_pack);
+
+   menu_t *m_pack_build = menu_create("build", "series/parallel pack of varied copies of the batt cell", 
+                                      "pack build <n_s> <n_p> [-j <threads>]", "", f_pack_build);
+   menu_add_child(m_pack, m_pack_build);
+
+   menu_t *m_pack_clear = menu_create("clear", "remove the pack", "pack clear", "", f_pack_clear);
+   menu_add_peer(m_pack_build, m_pack_clear);
+
+   menu_t *m_pack_dump = menu_create("dump", "write every pack cell to a CSV file", "pack dump <file.csv>", "", 
+                                     f_pack_dump);
+   menu_add_peer(m_pack_clear, m_pack_dump);
+
    /* Repeat command */
    menu_t *m_repeat = menu_create("repeat", "repeat a script <n> times", "repeat <n> <script>", "", f_repeat);
    menu_add_peer(m_root, m_repeat);
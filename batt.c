@@ -33,7 +33,8 @@ batt_t *batt_create(flash_params_t *p, double T0_C)
    batt_t *batt = (batt_t *)calloc(1, sizeof(batt_t));
    if (batt != NULL)
    {
-      batt->ecm = (ecm_t *)malloc(sizeof(ecm_t));
+      batt->ecm = ecm_alloc();
+      if (batt->ecm == NULL) return NULL;
       int rc = ecm_init(batt->ecm, &g_batt_flash_params, T0_C);
       if (rc != 0) return NULL;
    }
@@ -70,6 +71,7 @@ void batt_destroy(batt_t *batt)
 {
    if (batt != NULL)
    {
+      ecm_cleanup(batt->ecm);
       if (batt->ecm != NULL) free(batt->ecm);
       free(batt);
    }
@@ -253,6 +253,36 @@
 					2.500f
 
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Silicon anode slow relaxation: 2nd RC branch (tau ~ 5 min) and 3rd RC branch (tau ~ 3 hours)
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+#define SI_R2_TBL 			0.0030f,0.0027f,0.0025f,0.0024f,0.0023f,\
+ 					0.0022f,0.0022f,0.0021f,0.0021f,0.0021f,\
+ 					0.0021f,0.0021f,0.0021f,0.0022f,0.0022f,\
+ 					0.0023f,0.0024f,0.0025f,0.0027f,0.0029f,\
+ 					0.0032f
+
+#define SI_C2_TBL 			100000,110000,120000,130000,140000,\
+ 					140000,140000,140000,140000,140000,\
+ 					140000,140000,140000,140000,140000,\
+ 					140000,130000,120000,110000,100000,\
+ 					100000
+
+#define SI_R3_TBL 			0.0050f,0.0044f,0.0040f,0.0037f,0.0035f,\
+ 					0.0034f,0.0033f,0.0032f,0.0032f,0.0032f,\
+ 					0.0032f,0.0032f,0.0032f,0.0033f,0.0034f,\
+ 					0.0035f,0.0037f,0.0040f,0.0044f,0.0048f,\
+ 					0.0054f
+
+#define SI_C3_TBL 			2000000,2200000,2400000,2600000,2800000,\
+ 					3000000,3000000,3000000,3000000,3000000,\
+ 					3000000,3000000,3000000,3000000,3000000,\
+ 					3000000,2800000,2600000,2400000,2200000,\
+ 					2000000
+
+
 /*--------------------------------------------------------------------------------------------------------------*/
 
 #define ZERO_H_DSG_TBL                  0.0,0.0,0.0,0.0,0.0,\
@@ -0,0 +1,456 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		csv_load.c
+ *
+ *  @brief		Memory-mapped, multithreaded CSV log loader implementation
+ *
+ *=====================================================================================================================
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csv_load.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Per-thread chunk
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   const char *beg;		/* first byte of chunk (start of a line) */
+   const char *end;		/* one past last byte (after a newline or end of file) */
+   long row0;			/* first output row */
+   long lines;			/* num of lines (upper bound on rows) */
+   long rows;			/* num of rows parsed */
+   int nfield;			/* num of fields per row */
+   const int *map;		/* output column per field, -1 if not loaded */
+   double **col;		/* output columns */
+}
+csv_chunk_t;
+
+
+/* exact powers of ten for the fast path */
+static const double pow10_tab[23] = {
+   1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double csv_atof_slow(const char *p, const char *end)
+ *
+ *  @brief	strtod on a NUL-terminated copy of the field (the mapping is not NUL-terminated)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double csv_atof_slow(const char *p, const char *end)
+{
+   char buf[128];
+   size_t len = (size_t)(end - p);
+
+   if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+   memcpy(buf, p, len);
+   buf[len] = '\0';
+
+   char *e;
+   double v = strtod(buf, &e);
+   return (e == buf) ? NAN : v;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double csv_atof(const char *p, const char *end, const char **next)
+ *
+ *  @brief	Parse the number in the field starting at p.  Decimal numbers with up to 19 significant digits,
+ *		a mantissa below 2^53 and a power of ten within +/-22 are converted with one exact multiply or
+ *		divide (correctly rounded); anything else goes to strtod.  An empty or non-numeric field is NaN.
+ *
+ *  @param	next	set to the field terminator (',', '\r', '\n' or end)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+double csv_atof(const char *p, const char *end, const char **next)
+{
+   const char *s = p;
+   bool neg = false;
+   uint64_t mant = 0;
+   int ndig = 0, dexp = 0;
+
+   /* field end */
+   const char *f = p;
+   while (f < end && *f != ',' && *f != '\n' && *f != '\r') f++;
+   *next = f;
+
+   if (s < f && (*s == '-' || *s == '+')) neg = (*s++ == '-');
+
+   const char *d0 = s;
+   while (s < f && *s == '0') s++;			// leading zeros are not significant
+   while (s < f && (unsigned)(*s - '0') < 10)
+   {
+      if (ndig < 19) mant = mant * 10 + (uint64_t)(*s - '0'); else dexp++;
+      ndig++;
+      s++;
+   }
+   bool any = (s > d0);
+
+   if (s < f && *s == '.')
+   {
+      const char *fr = ++s;
+      if (ndig == 0) while (s < f && *s == '0') { s++; dexp--; }
+      while (s < f && (unsigned)(*s - '0') < 10)
+      {
+         if (ndig < 19) { mant = mant * 10 + (uint64_t)(*s - '0'); dexp--; }
+         ndig++;
+         s++;
+      }
+      any = any || (s > fr);
+   }
+   if (!any) return csv_atof_slow(p, f);		// nan, inf, empty
+
+   if (s < f && (*s == 'e' || *s == 'E'))
+   {
+      s++;
+      bool eneg = false;
+      int e = 0;
+      if (s < f && (*s == '-' || *s == '+')) eneg = (*s++ == '-');
+      if (s == f) return csv_atof_slow(p, f);
+      while (s < f && (unsigned)(*s - '0') < 10)
+      {
+         if (e < 10000) e = e * 10 + (*s - '0');
+         s++;
+      }
+      dexp += eneg ? -e : e;
+   }
+   if (s != f) return csv_atof_slow(p, f);		// trailing garbage: let strtod decide
+
+   if (ndig > 19 || mant > (1ULL << 53) || dexp < -22 || dexp > 22)
+      return csv_atof_slow(p, f);
+
+   double v = (double)mant;
+   v = (dexp < 0) ? v / pow10_tab[-dexp] : v * pow10_tab[dexp];
+   return neg ? -v : v;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void *csv_count_fn(void *arg)
+ *
+ *  @brief	Pass 1: count the lines of a chunk
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void *csv_count_fn(void *arg)
+{
+   csv_chunk_t *c = (csv_chunk_t *)arg;
+   long n = 0;
+
+   for (const char *p = c->beg; p < c->end; p++)
+   {
+      p = memchr(p, '\n', (size_t)(c->end - p));
+      if (p == NULL) { n++; break; }			// last line without newline
+      n++;
+   }
+
+   c->lines = n;
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void *csv_parse_fn(void *arg)
+ *
+ *  @brief	Pass 2: parse the rows of a chunk into rows [row0, row0+lines).  Blank and malformed rows are
+ *		skipped; c->rows is the num of rows kept.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void *csv_parse_fn(void *arg)
+{
+   csv_chunk_t *c = (csv_chunk_t *)arg;
+   const char *p = c->beg;
+   long r = c->row0;
+
+   while (p < c->end)
+   {
+      const char *eol = memchr(p, '\n', (size_t)(c->end - p));
+      if (eol == NULL) eol = c->end;
+
+      int f = 0;
+      const char *q = p;
+      if (q < eol && *q != '\r')
+      {
+         for (;;)
+         {
+            const char *nx;
+            int k = (f < c->nfield) ? c->map[f] : -1;
+            if (k >= 0)
+               c->col[k][r] = csv_atof(q, eol, &nx);
+            else
+               for (nx = q; nx < eol && *nx != ','; nx++) ;
+            f++;
+            if (nx < eol && *nx == ',') q = nx + 1; else break;
+         }
+      }
+      if (f == c->nfield) r++;
+
+      p = eol + 1;
+   }
+
+   c->rows = r - c->row0;
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int csv_run(csv_chunk_t *ck, int n, void *(*fn)(void *))
+ *
+ *  @brief	Run fn on every chunk, one thread each (the first in the calling thread)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int csv_run(csv_chunk_t *ck, int n, void *(*fn)(void *))
+{
+   pthread_t th[CSV_LOAD_MAX_THREADS];
+   int started = 1, rc = 0;
+
+   for (int i=1; i<n; i++, started++)
+   {
+      if (pthread_create(&th[i], NULL, fn, &ck[i]) != 0)
+      {
+         rc = -1;
+         break;
+      }
+   }
+   fn(&ck[0]);
+   for (int i=1; i<started; i++) pthread_join(th[i], NULL);
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		csv_data_t *csv_data_create(int ncol, const char *const *names, long cap)
+ *
+ *  @brief	Allocate ncol named columns of cap rows (rows is left 0)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+csv_data_t *csv_data_create(int ncol, const char *const *names, long cap)
+{
+   if (ncol <= 0 || names == NULL || cap < 0) return NULL;
+
+   csv_data_t *d = (csv_data_t *)calloc(1, sizeof(csv_data_t));
+   if (d == NULL) return NULL;
+
+   d->ncol = ncol;
+   d->names = (char **)calloc((size_t)ncol, sizeof(char *));
+   d->col = (double **)calloc((size_t)ncol, sizeof(double *));
+   if (d->names == NULL || d->col == NULL) goto _err_ret;
+
+   for (int k=0; k<ncol; k++)
+   {
+      size_t len = strlen(names[k]) + 1;
+      d->names[k] = (char *)malloc(len);
+      d->col[k] = (double *)malloc((size_t)(cap > 0 ? cap : 1) * sizeof(double));
+      if (d->names[k] == NULL || d->col[k] == NULL) goto _err_ret;
+      memcpy(d->names[k], names[k], len);
+   }
+
+   return d;
+
+_err_ret:
+   csv_data_free(d);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void csv_data_free(csv_data_t *d)
+ *
+ *  @brief	Free loaded data
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void csv_data_free(csv_data_t *d)
+{
+   if (d == NULL) return;
+
+   for (int k=0; k<d->ncol; k++)
+   {
+      if (d->names != NULL) free(d->names[k]);
+      if (d->col != NULL) free(d->col[k]);
+   }
+   free(d->names);
+   free(d->col);
+   free(d);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int csv_load(const char *fn, const char *const *cols, int ncols, int nthreads, csv_data_t **out)
+ *
+ *  @brief	Load a CSV log.  The first column is always loaded as x; cols[] selects the others by name
+ *		(all if ncols is 0; naming x is allowed).  nthreads <= 0 uses one thread per online CPU.
+ *
+ *  @return	0 if success; -1 bad args, -2 cannot open/map, -3 no header, -4 unknown column, -5 out of memory
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int csv_load(const char *fn, const char *const *cols, int ncols, int nthreads, csv_data_t **out)
+{
+   int rc = 0, nf = 0, nsel = 0;
+   char *hdr = NULL;
+   char *name[CSV_LOAD_MAX_COLS];
+   int map[CSV_LOAD_MAX_COLS];
+   const char *sel[CSV_LOAD_MAX_COLS];
+   csv_chunk_t ck[CSV_LOAD_MAX_THREADS];
+   csv_data_t *d = NULL;
+   const char *buf = NULL;
+   size_t sz = 0;
+
+   if (fn == NULL || out == NULL || ncols < 0 || (ncols > 0 && cols == NULL)) return -1;
+   *out = NULL;
+
+   int fd = open(fn, O_RDONLY);
+   if (fd < 0) return -2;
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size == 0) { rc = -2; goto _err_ret; }
+   sz = (size_t)st.st_size;
+
+   buf = (const char *)mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (buf == MAP_FAILED) { buf = NULL; rc = -2; goto _err_ret; }
+   posix_madvise((void *)buf, sz, POSIX_MADV_SEQUENTIAL);
+
+   /* header */
+   const char *eol = memchr(buf, '\n', sz);
+   const char *body = (eol != NULL) ? eol + 1 : buf + sz;
+   size_t hlen = (size_t)(body - buf);
+   if ((hdr = (char *)malloc(hlen + 1)) == NULL) { rc = -5; goto _err_ret; }
+   memcpy(hdr, buf, hlen);
+   hdr[hlen] = '\0';
+   hdr[strcspn(hdr, "\r\n")] = '\0';
+
+   for (char *p = hdr; nf < CSV_LOAD_MAX_COLS; )
+   {
+      while (*p == ' ' || *p == '\t') p++;
+      name[nf++] = p;
+      char *c = strchr(p, ',');
+      if (c != NULL) *c = '\0';
+      for (char *e = p + strlen(p); e > p && (e[-1] == ' ' || e[-1] == '\t'); ) *--e = '\0';
+      if (c == NULL) break;
+      p = c + 1;
+   }
+   if (nf < 1 || name[0][0] == '\0') { rc = -3; goto _err_ret; }
+
+   /* field -> column map */
+   for (int f=0; f<nf; f++) map[f] = -1;
+   map[0] = 0;
+   sel[nsel++] = name[0];
+   for (int i=0; i<(ncols > 0 ? ncols : nf-1); i++)
+   {
+      int f = 0;
+      if (ncols > 0)
+      {
+         for (f=0; f<nf; f++) if (0==strcmp(cols[i], name[f])) break;
+         if (f == nf) { rc = -4; goto _err_ret; }
+      }
+      else f = i + 1;
+
+      if (map[f] < 0)
+      {
+         map[f] = nsel;
+         sel[nsel++] = name[f];
+      }
+   }
+
+   /* chunks split at line boundaries */
+   size_t body_sz = (size_t)(buf + sz - body);
+   if (nthreads <= 0)
+   {
+      long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      nthreads = (ncpu > 0) ? (int)ncpu : 1;
+   }
+   if (nthreads > CSV_LOAD_MAX_THREADS) nthreads = CSV_LOAD_MAX_THREADS;
+   if ((size_t)nthreads > body_sz / CSV_LOAD_MIN_CHUNK) nthreads = (int)(body_sz / CSV_LOAD_MIN_CHUNK);
+   if (nthreads < 1) nthreads = 1;
+
+   const char *p = body;
+   int n = 0;
+   for (int i=0; i<nthreads && p < buf + sz; i++)
+   {
+      const char *e = (i == nthreads-1) ? buf + sz : body + body_sz * (size_t)(i+1) / (size_t)nthreads;
+      if (e < p) e = p;
+      if (e < buf + sz)
+      {
+         const char *nl = memchr(e, '\n', (size_t)(buf + sz - e));
+         e = (nl != NULL) ? nl + 1 : buf + sz;
+      }
+      ck[n] = (csv_chunk_t){ .beg = p, .end = e, .nfield = nf, .map = map };
+      n++;
+      p = e;
+   }
+
+   if (n > 0 && csv_run(ck, n, csv_count_fn) != 0) { rc = -5; goto _err_ret; }
+
+   long lines = 0;
+   for (int i=0; i<n; i++) { ck[i].row0 = lines; lines += ck[i].lines; }
+
+   if ((d = csv_data_create(nsel, sel, lines)) == NULL) { rc = -5; goto _err_ret; }
+   for (int i=0; i<n; i++) ck[i].col = d->col;
+
+   if (n > 0 && csv_run(ck, n, csv_parse_fn) != 0) { rc = -5; goto _err_ret; }
+
+   /* close the gaps left by skipped rows */
+   long rows = 0;
+   for (int i=0; i<n; i++)
+   {
+      if (ck[i].row0 != rows)
+         for (int k=0; k<nsel; k++)
+            memmove(&d->col[k][rows], &d->col[k][ck[i].row0], (size_t)ck[i].rows * sizeof(double));
+      rows += ck[i].rows;
+   }
+   d->rows = rows;
+
+   *out = d;
+   d = NULL;
+
+_err_ret:
+   csv_data_free(d);
+   free(hdr);
+   if (buf != NULL) munmap((void *)buf, sz);
+   close(fd);
+
+   return rc;
+}
@@ -0,0 +1,44 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		csv_load.h
+ *
+ *  @brief		Memory-mapped, multithreaded CSV log loader header
+ *
+ *  @note		The file is mapped, split at line boundaries into one chunk per thread and parsed in
+ *			parallel.  Only the selected columns are converted; the first column (x) always is.
+ *
+ *=====================================================================================================================
+ */
+#ifndef __CSV_LOAD_H__
+#define __CSV_LOAD_H__
+
+#include <stdbool.h>
+
+
+#define CSV_LOAD_MAX_THREADS	(16)
+#define CSV_LOAD_MIN_CHUNK	(1<<20)		/* min bytes per thread */
+#define CSV_LOAD_MAX_COLS	(1024)		/* max columns in a file */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Loaded columns, x first
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   int ncol;			/* num of loaded columns including x */
+   char **names;		/* column names */
+   long rows;			/* num of rows */
+   double **col;		/* col[k][row]; col[0] is x */
+}
+csv_data_t;
+
+
+int csv_load(const char *fn, const char *const *cols, int ncols, int nthreads, csv_data_t **out);
+csv_data_t *csv_data_create(int ncol, const char *const *names, long cap);
+void csv_data_free(csv_data_t *d);
+double csv_atof(const char *p, const char *end, const char **next);
+
+
+#endif // __CSV_LOAD_H__
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 199309L
+#include "csv_load.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_RANDOM    (2000000)
+#define N_ROWS      (2000000)
+#define TMP_FN      "test_csv_load.tmp"
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double ref_atof(const char *s) {
+    char *e;
+    double v = strtod(s, &e);
+    return (e == s) ? NAN : v;
+}
+
+/* csv_atof must match strtod bit for bit (NaN for anything strtod rejects) */
+static void check_atof(const char *s) {
+    const char *next;
+    double v = csv_atof(s, s + strlen(s), &next);
+    double r = ref_atof(s);
+    if (!(isnan(v) && isnan(r)) && memcmp(&v, &r, sizeof(v)) != 0) {
+        fprintf(stderr, "csv_atof(\"%s\") = %.17g, strtod = %.17g\n", s, v, r);
+        assert(0);
+    }
+    assert(*next == '\0');
+}
+
+static void test_atof(void) {
+    const char *fixed[] = {
+        "0", "-0", "+1", "1.", ".5", "-.5", "0.1", "3.14159", "1e10", "1E-5", "-2.5e+3", "4.2",
+        "0.000123", "123456789012345678", "1234567890123456789012", "9007199254740993",
+        "1e22", "1e23", "1e-22", "1e-23", "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308",
+        "1e400", "nan", "inf", "-inf", "", "-", "e5", "1e", "abc", "00012.5000", "0.30000000000000004",
+    };
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) check_atof(fixed[i]);
+
+    const char *fmts[] = { "%.17g", "%g", "%.6f", "%.3f", "%.8e", "%.1f" };
+    char s[64];
+    for (long i = 0; i < N_RANDOM; i++) {
+        uint64_t b = xorshift64();
+        double v;
+        if (i & 1) {
+            memcpy(&v, &b, sizeof(v));
+            if (!isfinite(v)) continue;
+        } else {
+            v = (double)(int64_t)(b >> 20) / (double)(1 << (b & 15)) * ((b & 16) ? -1e-3 : 1.0);
+        }
+        snprintf(s, sizeof(s), fmts[i % 6], v);
+        check_atof(s);
+    }
+    printf("csv_atof: %d random values match strtod\n", N_RANDOM);
+}
+
+static void write_log(void) {
+    FILE *fp = fopen(TMP_FN, "w");
+    assert(fp != NULL);
+    fprintf(fp, "t,I_batt,V_batt,soc_batt,T\n");
+    for (long i = 0; i < N_ROWS; i++) {
+        double soc = 1.0 - (double)i / N_ROWS;
+        if (i % 100000 == 7) fprintf(fp, "\n");              // blank
+        if (i % 100000 == 9) fprintf(fp, "1,2,3\n");         // malformed
+        fprintf(fp, "%.1f,%g,%.6f,%.8f,%.3f%s\n", i * 0.5, (i / 1200) % 3 ? 0.0 : 2.5,
+                3.2 + soc, soc, 25.0 + (i % 7) * 0.1, (i % 3) ? "" : "\r");
+    }
+    fprintf(fp, "%.1f,1,2,3,4", N_ROWS * 0.5);               // last line without newline
+    fclose(fp);
+}
+
+/* reference: fgets + strtod */
+static long ref_load(double **col) {
+    char line[4096];
+    long rows = 0;
+    FILE *fp = fopen(TMP_FN, "r");
+    assert(fp != NULL && fgets(line, sizeof(line), fp));
+    while (fgets(line, sizeof(line), fp)) {
+        double v[5];
+        char *p = line, *e;
+        int n = 0;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        for (;;) {
+            if (n < 5) v[n] = ref_atof(p);
+            n++;
+            if ((e = strchr(p, ',')) == NULL) break;
+            p = e + 1;
+        }
+        if (n != 5) continue;
+        if (col != NULL) for (int k = 0; k < 5; k++) col[k][rows] = v[k];
+        rows++;
+    }
+    fclose(fp);
+    return rows;
+}
+
+static void test_load(void) {
+    double *ref[5];
+    for (int k = 0; k < 5; k++) assert((ref[k] = malloc((N_ROWS + 1) * sizeof(double))) != NULL);
+
+    double t0 = now_s();
+    long rows = ref_load(ref);
+    double t_ref = now_s() - t0;
+    assert(rows == N_ROWS + 1);
+
+    int threads[] = { 1, 4, 0 };
+    for (int i = 0; i < 3; i++) {
+        csv_data_t *d = NULL;
+        t0 = now_s();
+        assert(csv_load(TMP_FN, NULL, 0, threads[i], &d) == 0);
+        double t = now_s() - t0;
+        assert(d->rows == rows && d->ncol == 5 && 0 == strcmp(d->names[3], "soc_batt"));
+        for (int k = 0; k < 5; k++)
+            assert(0 == memcmp(d->col[k], ref[k], (size_t)rows * sizeof(double)));
+        printf("csv_load %d threads: %ld rows in %.3f s (fgets+strtod %.3f s, %.1fx)\n",
+               threads[i], d->rows, t, t_ref, t_ref / t);
+        csv_data_free(d);
+    }
+
+    /* column subset, duplicates ignored, x always first */
+    const char *cols[] = { "T", "soc_batt", "T" };
+    csv_data_t *d = NULL;
+    t0 = now_s();
+    assert(csv_load(TMP_FN, cols, 3, 0, &d) == 0);
+    double t = now_s() - t0;
+    assert(d->ncol == 3 && d->rows == rows);
+    assert(0 == strcmp(d->names[0], "t") && 0 == strcmp(d->names[1], "T") && 0 == strcmp(d->names[2], "soc_batt"));
+    assert(0 == memcmp(d->col[0], ref[0], (size_t)rows * sizeof(double)));
+    assert(0 == memcmp(d->col[1], ref[4], (size_t)rows * sizeof(double)));
+    assert(0 == memcmp(d->col[2], ref[3], (size_t)rows * sizeof(double)));
+    printf("csv_load 2 of 4 columns: %.3f s\n", t);
+    csv_data_free(d);
+
+    /* naming x selects nothing extra */
+    const char *with_x[] = { "t", "T" };
+    assert(csv_load(TMP_FN, with_x, 2, 0, &d) == 0);
+    assert(d->ncol == 2 && 0 == strcmp(d->names[0], "t") && 0 == strcmp(d->names[1], "T"));
+    csv_data_free(d);
+
+    const char *bad[] = { "nope" };
+    assert(csv_load(TMP_FN, bad, 1, 0, &d) == -4 && d == NULL);
+    assert(csv_load("no_such_file.csv", NULL, 0, 0, &d) == -2);
+
+    for (int k = 0; k < 5; k++) free(ref[k]);
+    remove(TMP_FN);
+}
+
+int main(void) {
+    test_atof();
+    write_log();
+    test_load();
+    printf("All csv_load tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		dtoa.h
+ *
+ *  @brief		Fast double to shortest round-trip decimal string
+ *
+ *=====================================================================================================================
+ */
+#ifndef __DTOA_H__
+#define __DTOA_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DTOA_BUF_SZ		(32)		/* enough for any double incl. sign, point and exponent */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write 'v' into 'buf' (at least DTOA_BUF_SZ bytes) as the shortest decimal string that strtod() reads back
+ * bit-exact.  Output uses plain notation for 1e-6 <= |v| < 1e21 (e.g. "0.25", "4.16724", "7200") and
+ * "d.ddde[-]xx" otherwise.  NaN and infinities are written as "nan", "inf" and "-inf".
+ *
+ * Returns the string length; 'buf' is NOT null terminated.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int dtoa_shortest(double v, char *buf);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write the CSV row "t,v[0],...,v[n-1]\n" into 'buf' (at least (n + 1) * DTOA_BUF_SZ bytes): doubles as by
+ * dtoa_shortest(), and the integer part of columns with as_long[i] set (as_long may be NULL) as by dtoa_long().
+ *
+ * Returns the row length; 'buf' is NOT null terminated.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int dtoa_row(double t, const double *v, int n, const bool *as_long, char *buf);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write a signed integer into 'buf' (at least 21 bytes).  Returns the length; 'buf' is NOT null terminated.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int dtoa_long(long v, char *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DTOA_H__
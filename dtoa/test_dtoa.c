@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 199309L
+#include "dtoa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_RANDOM    (2000000)
+#define N_BENCH     (1000000)
+#define BENCH_RUNS  (7)
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* length of the shortest %.*g representation that round-trips */
+static int shortest_len(double v) {
+    char s[64];
+    for (int p = 1; p <= 17; p++) {
+        snprintf(s, sizeof(s), "%.*e", p - 1, v);
+        if (strtod(s, NULL) == v) return p;
+    }
+    return 17;
+}
+
+static int num_digits(const char *s, int len) {
+    int n = 0, lead = 1, trail = 0;
+    for (int i = 0; i < len && s[i] != 'e'; i++) {
+        if (s[i] < '0' || s[i] > '9') continue;
+        if (lead && s[i] == '0') continue;
+        lead = 0;
+        n++;
+        trail = (s[i] == '0') ? trail + 1 : 0;
+    }
+    return n - trail;
+}
+
+static void check_round_trip(double v, long *longer) {
+    char buf[DTOA_BUF_SZ + 1];
+    int len = dtoa_shortest(v, buf);
+    assert(len > 0 && len < DTOA_BUF_SZ);
+    buf[len] = '\0';
+
+    double r = strtod(buf, NULL);
+    if (memcmp(&r, &v, sizeof(v)) != 0) {
+        fprintf(stderr, "round trip failed: %.17g -> %s\n", v, buf);
+        assert(0);
+    }
+
+    int d = num_digits(buf, len);
+    int s = shortest_len(v);
+    assert(d >= s);
+    if (d > s) {
+        if (*longer == 0) fprintf(stderr, "not shortest: %.17g -> %s, %d digits do\n", v, buf, s);
+        (*longer)++;
+    }
+}
+
+static void test_fixed(void) {
+    static const struct { double v; const char *s; } cases[] = {
+        { 0.0, "0" }, { -0.0, "-0" }, { 1.0, "1" }, { -2.5, "-2.5" }, { 0.1, "0.1" },
+        { 3.7, "3.7" }, { 4.16724, "4.16724" }, { 7200.0, "7200" }, { 0.000001, "0.000001" },
+        { 1e-7, "1e-7" }, { 1.5e300, "1.5e300" }, { 123456789012345678.0, "123456789012345680" },
+        { 1e21, "1e21" }, { 5e-324, "5e-324" }, { 1.7976931348623157e308, "1.7976931348623157e308" },
+        { 0.30000000000000004, "0.30000000000000004" },
+    };
+    char buf[DTOA_BUF_SZ + 1];
+
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        int len = dtoa_shortest(cases[i].v, buf);
+        buf[len] = '\0';
+        if (strcmp(buf, cases[i].s) != 0) {
+            fprintf(stderr, "expected %s, got %s\n", cases[i].s, buf);
+            assert(0);
+        }
+    }
+
+    int len = dtoa_shortest(NAN, buf); buf[len] = '\0';
+    assert(strcmp(buf, "nan") == 0);
+    len = dtoa_shortest(-INFINITY, buf); buf[len] = '\0';
+    assert(strcmp(buf, "-inf") == 0);
+
+    len = dtoa_long(-1234567890123L, buf); buf[len] = '\0';
+    assert(strcmp(buf, "-1234567890123") == 0);
+    len = dtoa_long(0, buf); buf[len] = '\0';
+    assert(strcmp(buf, "0") == 0);
+
+    /* a row: doubles shortest, flagged columns as integers */
+    char row[4 * (DTOA_BUF_SZ + 1) + 1];
+    const double v[3] = { 3.7, -12.0, 0.30000000000000004 };
+    const bool as_long[3] = { false, true, false };
+    len = dtoa_row(7200.25, v, 3, as_long, row); row[len] = '\0';
+    assert(strcmp(row, "7200.25,3.7,-12,0.30000000000000004\n") == 0);
+    len = dtoa_row(0.0, v, 3, NULL, row); row[len] = '\0';
+    assert(strcmp(row, "0,3.7,-12,0.30000000000000004\n") == 0);
+}
+
+static void test_random(void) {
+    long longer = 0;
+    long n = 0;
+
+    /* random bit patterns cover the full exponent range */
+    for (int i = 0; i < N_RANDOM; i++) {
+        uint64_t bits = xorshift64();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (!isfinite(v)) continue;
+        check_round_trip(v, &longer);
+        n++;
+    }
+
+    /* values typical of a sim log: short decimals and sensor-like readings */
+    for (int i = 0; i < N_RANDOM; i++) {
+        double v = (double)(xorshift64() % 10000000) / 1000.0;
+        check_round_trip(v, &longer);
+        check_round_trip(v * 1e-6, &longer);
+        n += 2;
+    }
+
+    printf("round trip: %ld values ok, %ld longer than shortest\n", n, longer);
+    assert(longer == 0);
+}
+
+static void bench(void) {
+    static double vals[N_BENCH];
+    char buf[DTOA_BUF_SZ];
+    char s[64];
+    volatile size_t sink = 0;
+
+    for (int i = 0; i < N_BENCH; i++)
+        vals[i] = 3.0 + (double)(xorshift64() % 1000000) / 1e6 + 1e-9 * (double)(xorshift64() % 1000);
+
+    double t0 = now_s();
+    for (int i = 0; i < N_BENCH; i++) sink += (size_t)snprintf(s, sizeof(s), "%lf", vals[i]);
+    double t1 = now_s();
+    for (int i = 0; i < N_BENCH; i++) sink += (size_t)snprintf(s, sizeof(s), "%.17g", vals[i]);
+    double t2 = now_s();
+    for (int i = 0; i < N_BENCH; i++) sink += (size_t)dtoa_shortest(vals[i], buf);
+    double t3 = now_s();
+
+    printf("snprintf %%lf:   %6.1f ns/value\n", (t1 - t0) * 1e9 / N_BENCH);
+    printf("snprintf %%.17g: %6.1f ns/value\n", (t2 - t1) * 1e9 / N_BENCH);
+    printf("dtoa_shortest:  %6.1f ns/value (%.1fx vs %%lf)\n", (t3 - t2) * 1e9 / N_BENCH, (t1 - t0) / (t3 - t2));
+    (void)sink;
+}
+
+/* logger-style rows: t plus 8 double columns, fprintf per field vs dtoa_row() + fwrite; best of BENCH_RUNS each,
+ * against the logger's 5x target on the row path */
+static void bench_rows(void) {
+    enum { ROWS = 50000, COLS = 8 };
+    static double v[COLS];
+    char row[(COLS + 1) * (DTOA_BUF_SZ + 1) + 1];
+    double t_printf = 1e9, t_row = 1e9;
+    FILE *fp = tmpfile();
+    assert(fp != NULL);
+
+    for (int c = 0; c < COLS; c++) v[c] = 3.0 + (double)(xorshift64() % 1000000) / 1e6;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double t0 = now_s();
+        for (int r = 0; r < ROWS; r++) {
+            fprintf(fp, "%lf", r * 0.25);
+            for (int c = 0; c < COLS; c++) fprintf(fp, ",%lf", v[c] + r * 1e-7);
+            fprintf(fp, "\n");
+        }
+        fflush(fp);
+        double t1 = now_s();
+        for (int r = 0; r < ROWS; r++) {
+            double x[COLS];
+            for (int c = 0; c < COLS; c++) x[c] = v[c] + r * 1e-7;
+            int len = dtoa_row(r * 0.25, x, COLS, NULL, row);
+            fwrite(row, 1, (size_t)len, fp);
+        }
+        fflush(fp);
+        double t2 = now_s();
+        rewind(fp);
+
+        t_printf = fmin(t_printf, t1 - t0);
+        t_row = fmin(t_row, t2 - t1);
+    }
+    fclose(fp);
+
+    printf("rows fprintf %%lf:      %6.2f us/row\n", t_printf * 1e6 / ROWS);
+    printf("rows dtoa_row + fwrite: %5.2f us/row (%.1fx, target 5x)\n", t_row * 1e6 / ROWS, t_printf / t_row);
+}
+
+int main(void) {
+    test_fixed();
+    test_random();
+    bench();
+    bench_rows();
+    printf("All dtoa tests passed.\n");
+    return 0;
+}
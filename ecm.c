@@ -18,45 +18,75 @@
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- * @fn 		int tbl_interp(const double *grid, const double *tbl, int n, double soc, double *val)
+ * @fn 		int tbl_interp(ecm_t *ecm, const double *tbl, double soc, double *val)
  *
- * @brief	Linear interpolation on SOC grid (assumed monotonic). 
+ * @brief	Linear interpolation of tbl on the SOC grid
  *
  * @return	0 if success; negative otherwise
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-static 
-int tbl_interp(const double *grid, const double *tbl, int n, double soc, double *val)
+static inline
+int tbl_interp(ecm_t *ecm, const double *tbl, double soc, double *val)
 {
-    if (soc <= grid[0]) 
-    {
-       *val = tbl[0];
-    }
-    else if (soc >= grid[n - 1]) 
-    {
-       *val = tbl[n - 1];
-    }
-    else 
-    {
-       for (int i = 0; i < n - 1; ++i) 
-       {
-           double s0 = grid[i];
-           double s1 = grid[i + 1];
-           if (soc >= s0 && soc <= s1) 
-   	   {
-               double t = (soc - s0) / (s1 - s0);
-               *val = tbl[i] + t * (tbl[i + 1] - tbl[i]);
-	       return 0;
-           }
-       }
-    }
+    return tbl_grid_interp(&ecm->soc_grid, ecm->params.soc_tbl, tbl, soc, val);
+}
+
 
-    /* Fallback (should not happen): */
-    return -1;
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		ecm_t *ecm_alloc(void)
+ *
+ *  @brief	Allocate an ECM with its table rows on cache-line boundaries; free with free()
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+ecm_t *ecm_alloc(void)
+{
+   return (ecm_t *)aligned_alloc(_Alignof(ecm_t), sizeof(ecm_t));
 }
 
 
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		void ecm_load_rows(ecm_t *ecm)
+ *
+ *  @brief	Rebuild the interleaved rows from the tables in params
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+void ecm_load_rows(ecm_t *ecm)
+{
+   const double *r_tbl[ECM_RC_MAX] = { ecm->params.r1_tbl, ecm->params.r2_tbl, ecm->params.r3_tbl };
+   const double *c_tbl[ECM_RC_MAX] = { ecm->params.c1_tbl, ecm->params.c2_tbl, ecm->params.c3_tbl };
+
+   int n = ecm->n_rc;
+   if (n < 1) n = 1;
+   if (n > ECM_RC_MAX) n = ECM_RC_MAX;
+   int w = ECM_ROW_LEN(n);
+
+   for (int i=0; i<SOC_GRIDS; i++)
+   {
+      double *row = &ecm->rows[i * w];
+      row[ECM_OCV] = ecm->params.ocv_tbl[i];
+      row[ECM_R0] = ecm->params.r0_tbl[i];
+      row[ECM_H_CHG] = ecm->params.h_chg_tbl[i];
+      row[ECM_H_DSG] = ecm->params.h_dsg_tbl[i];
+      for (int k=0; k<n; k++)
+      {
+         row[ECM_R1 + 2*k] = r_tbl[k][i];
+         row[ECM_C1 + 2*k] = c_tbl[k][i];
+      }
+      for (int k=ECM_R1 + 2*n; k<w; k++) row[k] = 0.0;
+   }
+   ecm->row_n_rc = n;
+   ecm->row_w = w;
+   ecm->dirty = true;
+}
+
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
@@ -82,10 +112,21 @@ int ecm_init(ecm_t *ecm, flash_params_t *p, double T0_C)
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.r0_tbl[i] = p->r0_tbl[i];
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.r1_tbl[i] = p->r1_tbl[i];
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.c1_tbl[i] = p->c1_tbl[i];
+   for (int i=0; i<SOC_GRIDS; i++) ecm->params.r2_tbl[i] = p->r2_tbl[i];
+   for (int i=0; i<SOC_GRIDS; i++) ecm->params.c2_tbl[i] = p->c2_tbl[i];
+   for (int i=0; i<SOC_GRIDS; i++) ecm->params.r3_tbl[i] = p->r3_tbl[i];
+   for (int i=0; i<SOC_GRIDS; i++) ecm->params.c3_tbl[i] = p->c3_tbl[i];
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.h_chg_tbl[i] = p->h_chg_tbl[i];
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.h_dsg_tbl[i] = p->h_dsg_tbl[i];
    for (int i=0; i<SOC_GRIDS; i++) ecm->params.h_dsg_tbl[i] = p->h_dsg_tbl[i];
 
+   if (tbl_grid_init(&ecm->soc_grid, ecm->params.soc_tbl, SOC_GRIDS) != 0) return -2;
+   ecm->n_rc = DEFAULT_N_RC;
+   ecm_load_rows(ecm);
+
+   for (int j=0; j<T_GRIDS; j++) ecm->T_tbl[j] = T_GRID_MIN_C + j * T_GRID_STEP_C;
+   if (tbl_grid_init(&ecm->T_grid, ecm->T_tbl, T_GRIDS) != 0) return -2;
+
    ecm->params.design_capacity = p->design_capacity;
    ecm->params.v_end = p->v_end;
    ecm->params.T_ref_C = p->T_ref_C;
@@ -100,6 +141,11 @@ int ecm_init(ecm_t *ecm, flash_params_t *p, double T0_C)
    ecm->Ea_R0 = DEFAULT_EA_R0; 
    ecm->Ea_R1 = DEFAULT_EA_R1;
    ecm->Ea_C1 = DEFAULT_EA_C1;
+   ecm_build_tf(ecm);
+
+   /* Lookup reuse */
+   ecm->soc_tol = ECM_SOC_TOL;
+   ecm->T_tol = ECM_T_TOL;
 
    /* Capacity and thermal */
    ecm->Q_Ah = Q_DESIGN; 	/* Ah */
@@ -127,6 +173,14 @@ int ecm_init(ecm_t *ecm, flash_params_t *p, double T0_C)
    
    ecm->Tau = ecm->C1 * ecm->R1;
 
+   double row[ECM_ROW_W];
+   ecm_lookup_row(ecm, ecm->soc, row);
+   for (int k=0; k<ecm->row_n_rc; k++)
+   {
+      ecm->Rk[k] = row[ECM_R1 + 2*k];
+      ecm->Ck[k] = row[ECM_C1 + 2*k];
+   }
+
    ecm->prev_chg_state = REST;
    ecm->chg_state = ecm->prev_chg_state;
 
@@ -149,47 +203,68 @@ int ecm_init(ecm_t *ecm, flash_params_t *p, double T0_C)
  */
 void ecm_cleanup(ecm_t *ecm)
 {
-   (void)ecm;
+   if (ecm == NULL) return;
+
+   tbl_destroy(ecm->ocv);
+   ecm->ocv = NULL;
 }
 
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- *  @fn		int ecm_lookup_ocv(const ecm_t *ecm, double soc, double T, double *val)
+ *  @fn		void ecm_set_ocv(ecm_t *ecm, tbl_t *ocv)
+ *
+ *  @brief	Look OCV up in 'ocv' (taking ownership) instead of params.ocv_tbl; NULL goes back to ocv_tbl
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+void ecm_set_ocv(ecm_t *ecm, tbl_t *ocv)
+{
+   tbl_destroy(ecm->ocv);
+   ecm->ocv = ocv;
+   ecm->dirty = true;
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_lookup_ocv(ecm_t *ecm, double soc, double T, double *val)
  *
  *  @brief	Read OCV table given SOC
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-int ecm_lookup_ocv(const ecm_t *ecm, double soc, double *val)
+int ecm_lookup_ocv(ecm_t *ecm, double soc, double *val)
 {
-    return tbl_interp(ecm->params.soc_tbl, ecm->params.ocv_tbl, SOC_GRIDS, soc, val);
+    if (ecm->ocv != NULL) return tbl_eval(ecm->ocv, soc, val);
+    return tbl_interp(ecm, ecm->params.ocv_tbl, soc, val);
 }
 
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- *  @fn		int ecm_lookup_h(const ecm_t *ecm, double soc, double *val)
+ *  @fn		int ecm_lookup_h(ecm_t *ecm, double soc, double *val)
  *
  *  @brief	Read  H lookup given SOC
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-int ecm_lookup_h(const ecm_t *ecm, double soc, double *val)
+int ecm_lookup_h(ecm_t *ecm, double soc, double *val)
 {
     int rc=0;
     double H=0;
 
     if (ecm->chg_state==CHG)
     {
-       rc = tbl_interp(ecm->params.soc_tbl, ecm->params.h_chg_tbl, SOC_GRIDS, soc, &H);
+       rc = tbl_interp(ecm, ecm->params.h_chg_tbl, soc, &H);
        *val = H;
     }
     else if (ecm->chg_state==DSG) 
     {
-       rc = tbl_interp(ecm->params.soc_tbl, ecm->params.h_dsg_tbl, SOC_GRIDS, soc, &H);
+       rc = tbl_interp(ecm, ecm->params.h_dsg_tbl, soc, &H);
        *val = H;
     }
     else
@@ -202,47 +277,430 @@ int ecm_lookup_h(const ecm_t *ecm, double soc, double *val)
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- * @fn		int ecm_lookup_r0(const ecm_t *ecm, double soc, double *r0_val)
+ * @fn		int ecm_lookup_r0(ecm_t *ecm, double soc, double *r0_val)
  *
  * @brief	Read R0 given SOC 
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-int ecm_lookup_r0(const ecm_t *ecm, double soc, double *val)
+int ecm_lookup_r0(ecm_t *ecm, double soc, double *val)
 {
-    return tbl_interp(ecm->params.soc_tbl, ecm->params.r0_tbl, SOC_GRIDS, soc, val);
+    return tbl_interp(ecm, ecm->params.r0_tbl, soc, val);
 }
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- * @fn		int ecm_lookup_r1(const ecm_t *ecm, double soc, double *val)
+ * @fn		int ecm_lookup_r1(ecm_t *ecm, double soc, double *val)
  *
  * @brief	Read R1 given SOC
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-int ecm_lookup_r1(const ecm_t *ecm, double soc, double *val)
+int ecm_lookup_r1(ecm_t *ecm, double soc, double *val)
 {
-    return tbl_interp(ecm->params.soc_tbl, ecm->params.r1_tbl, SOC_GRIDS, soc, val);
+    return tbl_interp(ecm, ecm->params.r1_tbl, soc, val);
 }
 
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
  *
- *  @fn		int ecm_lookup_c1(const ecm_t *ecm, double soc, double *val)
+ *  @fn		int ecm_lookup_c1(ecm_t *ecm, double soc, double *val)
  *
  *  @brief	Read C1 given SOC
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
-int ecm_lookup_c1(const ecm_t *ecm, double soc, double *val)
+int ecm_lookup_c1(ecm_t *ecm, double soc, double *val)
 {
-    return tbl_interp(ecm->params.soc_tbl, ecm->params.c1_tbl, SOC_GRIDS, soc, val);
+    return tbl_interp(ecm, ecm->params.c1_tbl, soc, val);
 }
 
 
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_lookup_row(ecm_t *ecm, double soc, double *row)
+ *
+ *  @brief	Read every table given SOC: find the segment once and interpolate whole rows
+ *
+ *  @param	row	ECM_ROW_W values, indexed by ECM_OCV, ECM_R0, ... (row_w of them are set).  Same values as
+ *			the single-table lookups (OCV from the fine curve if one is set).
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+int ecm_lookup_row(ecm_t *ecm, double soc, double *row)
+{
+    int rc = tbl_grid_interp_rows(&ecm->soc_grid, ecm->params.soc_tbl, ecm->rows, ecm->row_w, soc, row);
+    if (rc == 0 && ecm->ocv != NULL) rc = tbl_eval(ecm->ocv, soc, &row[ECM_OCV]);
+    return rc;
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		double ecm_row_h(const ecm_t *ecm, const double *row)
+ *
+ *  @brief	H from a looked-up row for the charge state, as ecm_lookup_h()
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+double ecm_row_h(const ecm_t *ecm, const double *row)
+{
+    if (ecm->chg_state==CHG) return row[ECM_H_CHG];
+    if (ecm->chg_state==DSG) return row[ECM_H_DSG];
+    return ecm->H;   // no change
+}
+
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		void ecm_build_tf(ecm_t *ecm)
+ *
+ *  @brief	Precompute the Arrhenius factors of R0, R1, C1 on the temperature grid from the current Ea
+ *		values, replacing any measured factors
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+void ecm_build_tf(ecm_t *ecm)
+{
+   double Ea[3] = { ecm->Ea_R0, ecm->Ea_R1, ecm->Ea_C1 };
+
+   for (int j=0; j<T_GRIDS; j++)
+   {
+      double f[ECM_TF_W] = { 0 };
+      for (int k=0; k<3; k++) f[k] = util_temp_adj(1.0, Ea[k], ecm->T_tbl[j], ecm->params.T_ref_C);
+      for (int i=0; i<SOC_GRIDS; i++) memcpy(ecm->tf[j][i], f, sizeof(f));
+   }
+
+   memcpy(ecm->tf_Ea, Ea, sizeof(Ea));
+   ecm->tf_measured = false;
+   ecm->dirty = true;
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		void tf_check(ecm_t *ecm)
+ *
+ *  @brief	Rebuild the Arrhenius factors if an Ea was changed (e.g. by 'set')
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+static inline
+void tf_check(ecm_t *ecm)
+{
+   if (!ecm->tf_measured && 
+       (ecm->tf_Ea[0] != ecm->Ea_R0 || ecm->tf_Ea[1] != ecm->Ea_R1 || ecm->tf_Ea[2] != ecm->Ea_C1))
+      ecm_build_tf(ecm);
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_lookup_tf(ecm_t *ecm, double soc, double T_C, double *k)
+ *
+ *  @brief	Temperature factors of R0, R1, C1 at (T_C, soc), interpolated bilinearly
+ *
+ *  @param	k	ECM_TF_W values, indexed by ECM_TF_R0, ECM_TF_R1, ECM_TF_C1
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+int ecm_lookup_tf(ecm_t *ecm, double soc, double T_C, double *k)
+{
+   return tbl_grid_interp2_rows(&ecm->T_grid, ecm->T_tbl, &ecm->soc_grid, ecm->params.soc_tbl,
+                                &ecm->tf[0][0][0], ECM_TF_W, T_C, soc, k);
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_lookup_row_at(ecm_t *ecm, double soc, double T_C, double *row)
+ *
+ *  @brief	ecm_lookup_row() with R0, R1, C1 scaled to temperature T_C
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+int ecm_lookup_row_at(ecm_t *ecm, double soc, double T_C, double *row)
+{
+   double k[ECM_TF_W];
+
+   int rc = ecm_lookup_row(ecm, soc, row);
+   if (rc == 0) rc = ecm_lookup_tf(ecm, soc, T_C, k);
+   if (rc != 0) return rc;
+
+   row[ECM_R0] *= k[ECM_TF_R0];
+   for (int b=0; b<ecm->row_n_rc; b++)
+   {
+      row[ECM_R1 + 2*b] *= k[ECM_TF_R1];
+      row[ECM_C1 + 2*b] *= k[ECM_TF_C1];
+   }
+   return 0;
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_lookup_cached(ecm_t *ecm, double soc, double T_C, double *row)
+ *
+ *  @brief	ecm_lookup_row_at(), reusing the last row while soc and T_C are within soc_tol and T_tol of it
+ *		and no table has changed (ecm_load_rows(), ecm_set_ocv(), new temperature factors)
+ *
+ *  @note	With zero tolerances a row is reused only for the same soc and T_C, e.g. at rest in thermal
+ *		equilibrium, so results are unchanged.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+int ecm_lookup_cached(ecm_t *ecm, double soc, double T_C, double *row)
+{
+   if (!ecm->dirty && fabs(soc - ecm->c_soc) <= ecm->soc_tol && fabs(T_C - ecm->c_T_C) <= ecm->T_tol)
+   {
+      memcpy(row, ecm->c_row, (size_t)ecm->row_w * sizeof(double));
+      return 0;
+   }
+
+   int rc = ecm_lookup_row_at(ecm, soc, T_C, row);
+   if (rc != 0) return rc;
+
+   memcpy(ecm->c_row, row, (size_t)ecm->row_w * sizeof(double));
+   ecm->c_soc = soc;
+   ecm->c_T_C = T_C;
+   ecm->dirty = false;
+   return 0;
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int cmp_lv(const void *a, const void *b)
+ *
+ *  @brief	qsort order of (temperature level, sample index) pairs
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+static
+int cmp_lv(const void *a, const void *b)
+{
+   const long *la = (const long *)a, *lb = (const long *)b;
+   if (la[0] != lb[0]) return (la[0] > lb[0]) - (la[0] < lb[0]);
+   return (la[1] > lb[1]) - (la[1] < lb[1]);
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		double lv_eval(tbl_t *(*c)[3], const double *T_lv, int nlv, int k, double T_C, double soc)
+ *
+ *  @brief	Value of table k at (T_C, soc): each level's curve at soc, linear in T between the two levels
+ *		around T_C and held beyond the outer ones
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+static
+double lv_eval(tbl_t *(*c)[3], const double *T_lv, int nlv, int k, double T_C, double soc)
+{
+   double v0, v1;
+   int j = 0;
+
+   while (j < nlv - 2 && T_C > T_lv[j+1]) j++;
+   double t = (T_C - T_lv[j]) / (T_lv[j+1] - T_lv[j]);
+   t = util_clamp(t, 0.0, 1.0);
+
+   tbl_eval(c[j][k], soc, &v0);
+   tbl_eval(c[j+1][k], soc, &v1);
+   return v0 + t * (v1 - v0);
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		int ecm_load_tf(ecm_t *ecm, const double *T_C, const double *soc, const double *const val[3], long n)
+ *
+ *  @brief	Replace the Arrhenius factors with measured R0, R1, C1 (val[0..2]) at n points of (T_C, soc),
+ *		e.g. the columns of characterization logs taken at several temperatures
+ *
+ *  @note	Samples are grouped into temperature levels of T_GRID_STEP_C; each level needs 2 distinct SOCs
+ *		and at least 2 levels are needed.  The r0/r1/c1 tables are set to the data at T_ref and the
+ *		factors to the data on the grid over the data at T_ref, so the model reproduces the data at
+ *		the grid points.  Ea is not used until ecm_build_tf().
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+int ecm_load_tf(ecm_t *ecm, const double *T_C, const double *soc, const double *const val[3], long n)
+{
+   int rc = 0, nlv = 0;
+   long *lv = (long *)malloc((size_t)n * 2 * sizeof(long));
+   double *buf = (double *)malloc((size_t)n * 4 * sizeof(double));
+   double *T_lv = (double *)malloc((size_t)n * sizeof(double));
+   tbl_t *(*c)[3] = (tbl_t *(*)[3])calloc((size_t)n, sizeof(*c));
+   double (*tf)[SOC_GRIDS][ECM_TF_W] = malloc(sizeof(ecm->tf));
+
+   if (n < 4 || lv == NULL || buf == NULL || T_lv == NULL || c == NULL || tf == NULL)
+   {
+      rc = -1;
+      goto _ret;
+   }
+
+   /* samples by temperature level */
+   long m = 0;
+   for (long r=0; r<n; r++)
+   {
+      if (!isfinite(T_C[r])) continue;
+      lv[2*m] = lround((T_C[r] - T_GRID_MIN_C) / T_GRID_STEP_C);
+      lv[2*m+1] = r;
+      m++;
+   }
+   qsort(lv, (size_t)m, 2 * sizeof(long), cmp_lv);
+
+   /* one curve over soc per level and table */
+   for (long a=0; a<m; )
+   {
+      long b = a, cnt = 0;
+      double T_sum = 0.0;
+      for (; b<m && lv[2*b] == lv[2*a]; b++)
+      {
+         long r = lv[2*b+1];
+         buf[cnt] = soc[r];
+         for (int k=0; k<3; k++) buf[(k+1)*n + cnt] = val[k][r];
+         T_sum += T_C[r];
+         cnt++;
+      }
+      a = b;
+
+      for (int k=0; k<3; k++) c[nlv][k] = tbl_create(buf, &buf[(k+1)*n], cnt, 0);
+      if (c[nlv][0] == NULL || c[nlv][1] == NULL || c[nlv][2] == NULL)
+      {
+         for (int k=0; k<3; k++) tbl_destroy(c[nlv][k]);
+         memset(c[nlv], 0, sizeof(c[nlv]));
+         continue;
+      }
+      T_lv[nlv++] = T_sum / (double)cnt;
+   }
+   if (nlv < 2)
+   {
+      rc = -2;
+      goto _ret;
+   }
+
+   /* tables at T_ref, factors relative to them */
+   double base[SOC_GRIDS][3];
+   for (int i=0; i<SOC_GRIDS; i++)
+   {
+      for (int k=0; k<3; k++)
+      {
+         base[i][k] = lv_eval(c, T_lv, nlv, k, ecm->params.T_ref_C, ecm->params.soc_tbl[i]);
+         if (!(base[i][k] > 0.0) || !isfinite(base[i][k]))
+         {
+            rc = -3;
+            goto _ret;
+         }
+      }
+   }
+   for (int j=0; j<T_GRIDS; j++)
+   {
+      for (int i=0; i<SOC_GRIDS; i++)
+      {
+         for (int k=0; k<3; k++)
+            tf[j][i][k] = lv_eval(c, T_lv, nlv, k, ecm->T_tbl[j], ecm->params.soc_tbl[i]) / base[i][k];
+         tf[j][i][ECM_TF_W-1] = 0.0;
+      }
+   }
+
+   for (int i=0; i<SOC_GRIDS; i++)
+   {
+      ecm->params.r0_tbl[i] = base[i][0];
+      ecm->params.r1_tbl[i] = base[i][1];
+      ecm->params.c1_tbl[i] = base[i][2];
+   }
+   ecm_load_rows(ecm);
+   memcpy(ecm->tf, tf, sizeof(ecm->tf));
+   ecm->tf_measured = true;
+   ecm->dirty = true;
+   rc = nlv;
+
+_ret:
+   for (int l=0; c != NULL && l<nlv; l++)
+      for (int k=0; k<3; k++) tbl_destroy(c[l][k]);
+   free(c);
+   free(tf);
+   free(T_lv);
+   free(buf);
+   free(lv);
+   return rc;
+}
+
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		void rc_check(ecm_t *ecm)
+ *
+ *  @brief	Reload the rows if n_rc was changed (e.g. by 'set'); branches dropped or added start at 0 V
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+static inline
+void rc_check(ecm_t *ecm)
+{
+   if (ecm->n_rc == ecm->row_n_rc) return;
+
+   ecm_load_rows(ecm);
+   ecm->n_rc = ecm->row_n_rc;
+
+   ecm->V_rc = 0.0;
+   for (int k=0; k<ECM_RC_MAX; k++)
+   {
+      if (k >= ecm->n_rc) ecm->V_rck[k] = ecm->prev_V_rck[k] = 0.0;
+      ecm->V_rc += ecm->V_rck[k];
+   }
+}
+
+
+/*! 
+ *--------------------------------------------------------------------------------------------------------------------- 
+ *
+ *  @fn		double rc_step(double *V, const double *R, const double *C, int n, double I, double dt)
+ *
+ *  @brief	Step the voltages of n RC branches under current I
+ *
+ *  @return	sum of the branch voltages
+ *
+ *--------------------------------------------------------------------------------------------------------------------- 
+ */
+static inline
+double rc_step(double *restrict V, const double *restrict R, const double *restrict C, int n, double I, double dt)
+{
+   double sum = 0.0;
+   for (int k=0; k<n; k++)
+   {
+      V[k] += dt * ( -V[k] / (R[k] * C[k]) + I / C[k] );
+      sum += V[k];
+   }
+   return sum;
+}
+
 
 /*! 
  *--------------------------------------------------------------------------------------------------------------------- 
@@ -256,8 +714,8 @@ int ecm_lookup_c1(const ecm_t *ecm, double soc, double *val)
  * @param	T     : cell temperature [°C]
  * @param	dt    : time step [s]
  *
- * @note	States updated: soc, V_rc, T, chg_state
- * 		Parameters R0/R1/C1 are read via lookup + Arrhenius scaling.
+ * @note	States updated: soc, V_rc (each branch), T, chg_state
+ * 		Parameters R0 and each branch's R/C are read via lookup, scaled by the SOC x T factor tables.
  *
  *--------------------------------------------------------------------------------------------------------------------- 
  */
@@ -266,13 +724,13 @@ int ecm_update(ecm_t *ecm, double I, double T_amb_C, double t, double dt)
     (void)t;
 
 
-    double R0=0.0, C1=0.0, R1=0.0;
     int rc = 0;
 
 
     ecm->prev_I = ecm->I;
     ecm->prev_V_batt = ecm->V_batt;
     ecm->prev_V_rc = ecm->V_rc;
+    memcpy(ecm->prev_V_rck, ecm->V_rck, sizeof(ecm->V_rck));
     ecm->prev_V_oc = ecm->V_oc;
     ecm->prev_H = ecm->H;
 
@@ -284,25 +742,35 @@ int ecm_update(ecm_t *ecm, double I, double T_amb_C, double t, double dt)
     ecm->soc -= (ecm->I*dt)/Qmax;
     ecm->soc = util_clamp(ecm->soc, 0.0, 1.0);
 
-    /* model param update */
-    ecm_lookup_r0(ecm, ecm->soc, &R0);
-    ecm->R0 = util_temp_adj(R0, ecm->Ea_R0, ecm->T_C, ecm->params.T_ref_C);
+    /* model param update: all tables in one lookup, R/C at temperature; skipped if soc, T unchanged */
+    rc_check(ecm);
+    tf_check(ecm);
+    /* if the lookup fails (e.g. a NaN soc) the previous parameters are kept and rc returned */
+    double row[ECM_ROW_W];
+    rc = ecm_lookup_cached(ecm, ecm->soc, ecm->T_C, row);
 
-    ecm_lookup_r1(ecm, ecm->soc, &R1);
-    ecm->R1 = util_temp_adj(R1, ecm->Ea_R1, ecm->T_C, ecm->params.T_ref_C); 
+    int n = ecm->row_n_rc;
+    if (rc == 0)
+    {
+       ecm->R0 = row[ECM_R0];
+       for (int k=0; k<n; k++)
+       {
+          ecm->Rk[k] = row[ECM_R1 + 2*k];
+          ecm->Ck[k] = row[ECM_C1 + 2*k];
+       }
+       ecm->R1 = ecm->Rk[0];
+       ecm->C1 = ecm->Ck[0];
 
-    ecm_lookup_c1(ecm, ecm->soc, &C1);
-    ecm->C1 = util_temp_adj(C1, ecm->Ea_C1, ecm->T_C, ecm->params.T_ref_C);  
+       /* update V_oc */
+       ecm->V_oc = row[ECM_OCV];
+    }
 
     /* update Tau */
     ecm->Tau = ecm->C1 * ecm->R1;
-
-    /* update V_oc */
-    ecm_lookup_ocv(ecm, ecm->soc, &ecm->V_oc);
     
 
-    /* update V_rc */
-    ecm->V_rc += dt * ( -ecm->V_rc / (ecm->R1 * ecm->C1) + ecm->I / ecm->C1 );
+    /* update V_rc: every branch */
+    ecm->V_rc = rc_step(ecm->V_rck, ecm->Rk, ecm->Ck, n, ecm->I, dt);
 
     /* temp update */
     double powerloss = ecm->I * ecm->I * ecm->R0;
@@ -321,7 +789,7 @@ int ecm_update(ecm_t *ecm, double I, double T_amb_C, double t, double dt)
 
 
     /* update H */
-    ecm_lookup_h(ecm, ecm->soc, &ecm->H);
+    if (rc == 0) ecm->H = ecm_row_h(ecm, row);
 
 
     /* update V_batt */
@@ -346,5 +814,6 @@ void ecm_update_delta(ecm_t *ecm)
     ecm->prev_I = ecm->I;
     ecm->prev_V_batt = ecm->V_batt;
     ecm->prev_V_rc = ecm->V_rc;
+    memcpy(ecm->prev_V_rck, ecm->V_rck, sizeof(ecm->V_rck));
 }
 
@@ -11,22 +11,60 @@
 #define __ECM_H__
 
 #include <stddef.h>
+#include <stdbool.h>
 #include "globals.h"
 #include "flash_params.h"
+#include "tbl_lookup.h"
+
+
+/*
+ * Interleaved tables: row i holds every table's value at soc_tbl[i].  RC branch k (0..n_rc-1) has its R and C at
+ * ECM_R1 + 2k and ECM_C1 + 2k.  Rows are packed ECM_ROW_LEN(n_rc) wide: one 64-byte cache line for 1 or 2 branches.
+ */
+enum { ECM_OCV = 0, ECM_R0, ECM_H_CHG, ECM_H_DSG, ECM_R1, ECM_C1, ECM_ROW_W = 16, ECM_RC_MAX = 3 };
+
+#define ECM_ROW_LEN(n)		((ECM_R1 + 2*(n) + 3) & ~3)
+
+/* Temperature factors of R0, R1, C1: value at T = value at T_ref (in the rows) * factor(T, soc).  Every RC
+ * branch is scaled by the R1 and C1 factors. */
+enum { ECM_TF_R0 = 0, ECM_TF_R1, ECM_TF_C1, ECM_TF_W = 4 };
 
 
 typedef struct 
 {
+   /* Interleaved copy of the tables in params; refresh with ecm_load_rows() after changing them */
+   _Alignas(64) double rows[SOC_GRIDS * ECM_ROW_W];
+   int row_w;					/* row length, ECM_ROW_LEN(row_n_rc) */
+   int row_n_rc;				/* RC branches in the rows */
+
    /* Flash tables */
    flash_params_t params;			/* pointer to flash */
+   tbl_grid_t soc_grid;				/* lookup state of params.soc_tbl */
+   tbl_t *ocv;					/* OCV on its own grid, used instead of ocv_tbl; NULL if none */
+
+   /* Temperature factors over T_tbl x soc_tbl: Arrhenius unless measured ones are loaded */
+   _Alignas(64) double tf[T_GRIDS][SOC_GRIDS][ECM_TF_W];
+   double T_tbl[T_GRIDS];			/* temperature grid [°C] */
+   tbl_grid_t T_grid;				/* lookup state of T_tbl */
+   double tf_Ea[3];				/* Ea_R0, Ea_R1, Ea_C1 the Arrhenius factors were built with */
+   bool tf_measured;				/* factors loaded from data; Ea is not used */
+
+   /* Row of the last lookup, reused while soc and T_C stay within the tolerances and no table changes */
+   double c_row[ECM_ROW_W];			/* row at c_soc, c_T_C; R0/R1/C1 at temperature */
+   double c_soc, c_T_C;
+   double soc_tol, T_tol;			/* 0 recomputes on any change: results are exact */
+   bool dirty;					/* a table changed since c_row */
 
    /* Model paramters */
    double R0, R1, C1;
-   double Tau;
+   double Tau;					/* R1*C1 */
+   int n_rc;					/* RC branches (1..ECM_RC_MAX); R1/C1 is the first */
+   double Rk[ECM_RC_MAX], Ck[ECM_RC_MAX];	/* branch R, C */
 
    /* Model states */
    double V_batt;				/* V_batt */
-   double V_rc;					/* VRC */ 
+   double V_rc;					/* VRC: sum of the branch voltages */ 
+   double V_rck[ECM_RC_MAX];			/* branch voltages */
    double V_oc;					/* OCV */
    double soc;     				/* current SOC (0..1) */
    double H;       				/* OCV hysteresis */
@@ -36,6 +74,7 @@ typedef struct
    double prev_I;				/* previous current */
    double prev_V_batt;				/* previous Vrc voltage */
    double prev_V_rc;				/* previous Vrc voltage */
+   double prev_V_rck[ECM_RC_MAX];		/* previous branch voltages */
    double prev_V_oc;				/* previous Vrc voltage */
    double prev_H;				/* previous Vrc voltage */
 
@@ -68,11 +107,21 @@ typedef struct
 ecm_t;
 
 
-int ecm_lookup_ocv(const ecm_t *ecm, double soc, double *val);
-int ecm_lookup_h(const ecm_t *ecm, double soc, double *val);
-int ecm_lookup_r0(const ecm_t *ecm, double soc, double *val);
-int ecm_lookup_r1(const ecm_t *ecm, double soc, double *val);
-int ecm_lookup_c1(const ecm_t *ecm, double soc, double *val);
+int ecm_lookup_ocv(ecm_t *ecm, double soc, double *val);
+int ecm_lookup_h(ecm_t *ecm, double soc, double *val);
+int ecm_lookup_r0(ecm_t *ecm, double soc, double *val);
+int ecm_lookup_r1(ecm_t *ecm, double soc, double *val);
+int ecm_lookup_c1(ecm_t *ecm, double soc, double *val);
+int ecm_lookup_row(ecm_t *ecm, double soc, double *row);
+double ecm_row_h(const ecm_t *ecm, const double *row);
+void ecm_load_rows(ecm_t *ecm);
+void ecm_set_ocv(ecm_t *ecm, tbl_t *ocv);
+int ecm_lookup_tf(ecm_t *ecm, double soc, double T_C, double *k);
+int ecm_lookup_row_at(ecm_t *ecm, double soc, double T_C, double *row);
+int ecm_lookup_cached(ecm_t *ecm, double soc, double T_C, double *row);
+void ecm_build_tf(ecm_t *ecm);
+int ecm_load_tf(ecm_t *ecm, const double *T_C, const double *soc, const double *const val[3], long n);
+ecm_t *ecm_alloc(void);
 int ecm_init(ecm_t *ecm, flash_params_t *p, double T0_C);
 int ecm_update(ecm_t *ecm, double I, double T_amb, double t, double dt);
 void ecm_update_delta(ecm_t *ecm);
@@ -0,0 +1,599 @@
+/*!
+ *=====================================================================================================================
+ *
+ * @file		ecm_batch.c
+ *
+ * @brief		Batched ECM implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "ecm_batch.h"
+
+
+/* AVX2 and default builds of the step kernel on x86-64, picked at load time; NEON is the ARM baseline */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define BATCH_CLONES		__attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_CLONES
+#endif
+
+#define LOG2E			(1.4426950408889634)
+#define LN2_HI			(6.93147180369123816490e-01)
+#define LN2_LO			(1.90821492927058770002e-10)
+#define ROUND_MAGIC		(6755399441055744.0)		/* 1.5 * 2^52: adding it rounds to an integer */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double vexp(double x)
+ *
+ *  @brief	exp(x) without branches or calls, so a loop of it vectorizes: x = k ln2 + r, |r| <= ln2/2, then
+ *		a degree 13 Taylor polynomial in r (error < 1e-17) times 2^k built in the exponent bits
+ *
+ *  @note	x is held to [-708, 708]; within about 2 ulp of exp()
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+double vexp(double x)
+{
+   x = (x < -708.0) ? -708.0 : x;
+   x = (x > 708.0) ? 708.0 : x;
+
+   double kr = x * LOG2E + ROUND_MAGIC;
+   double k = kr - ROUND_MAGIC;
+   double r = (x - k * LN2_HI) - k * LN2_LO;
+
+   double p = 1.0 / 6227020800.0;
+   p = p * r + 1.0 / 479001600.0;
+   p = p * r + 1.0 / 39916800.0;
+   p = p * r + 1.0 / 3628800.0;
+   p = p * r + 1.0 / 362880.0;
+   p = p * r + 1.0 / 40320.0;
+   p = p * r + 1.0 / 5040.0;
+   p = p * r + 1.0 / 720.0;
+   p = p * r + 1.0 / 120.0;
+   p = p * r + 1.0 / 24.0;
+   p = p * r + 1.0 / 6.0;
+   p = p * r + 0.5;
+   p = p * r + 1.0;
+   p = p * r + 1.0;
+
+   /* the low bits of kr hold k: shifted into the exponent field with the bias they make 2^k */
+   uint64_t u;
+   memcpy(&u, &kr, sizeof(u));
+   u = (u << 52) + ((uint64_t)1023 << 52);
+   double s;
+   memcpy(&s, &u, sizeof(s));
+
+   return p * s;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int soc_seg(const ecm_batch_t *b, double soc, double *t)
+ *
+ *  @brief	Segment of the SOC grid holding soc and the fraction t along it, as the step finds them: the last
+ *		point (t 0) at or above its end
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int soc_seg(const ecm_batch_t *b, double soc, double *t)
+{
+   const double *xs = b->soc_tbl;
+
+   *t = 0.0;
+   if (soc <= xs[0]) return 0;
+   if (soc >= xs[SOC_GRIDS-1]) return SOC_GRIDS-1;
+
+   int j = 0;
+   while (j < SOC_GRIDS-2 && soc > xs[j+1]) j++;
+   *t = (soc - xs[j]) / b->d_soc[j];
+   return j;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double tbl_at(const ecm_batch_t *b, int k, double soc)
+ *
+ *  @brief	Table k at soc, by linear interpolation (held at the ends)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double tbl_at(const ecm_batch_t *b, int k, double soc)
+{
+   double t;
+   int j = soc_seg(b, soc, &t);
+   return b->tbl[k][j] + t * b->d_tbl[k][j];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void tf_at(const ecm_batch_t *b, int j, double t, double T_C, double *f)
+ *
+ *  @brief	Measured factors of R0, R1, C1 (f[ECM_TF_R0..ECM_TF_C1]) at T_C and SOC segment j, fraction t
+ *		(j may be the last point), bilinear as ecm_lookup_tf() with T_C held at the ends of the grid
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void tf_at(const ecm_batch_t *b, int j, double t, double T_C, double *f)
+{
+   double u = (T_C - b->T0_C) * b->inv_hT;
+   u = (u > 0.0) ? u : 0.0;
+   u = (u < T_GRIDS-1) ? u : T_GRIDS-1;
+   int i = (int)u;
+   i = (i > T_GRIDS-2) ? T_GRIDS-2 : i;
+   double ty = u - i;
+
+   t = (j > SOC_GRIDS-2) ? 1.0 : t;
+   j = (j > SOC_GRIDS-2) ? SOC_GRIDS-2 : j;
+
+   const double *a = b->tf[i][j], *a1 = b->tf[i][j+1], *c = b->tf[i+1][j], *c1 = b->tf[i+1][j+1];
+   for (int k=0; k<3; k++)
+   {
+      double lo = a[k] + t * (a1[k] - a[k]);
+      double hi = c[k] + t * (c1[k] - c[k]);
+      f[k] = lo + ty * (hi - lo);
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double ocv_fine(const ecm_batch_t *b, int *seg, double soc)
+ *
+ *  @brief	The fine OCV curve at soc, the same value as tbl_eval() gives: the segment of the cell's last
+ *		lookup is tried first (SOC moves very little per step), else a binary search
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+double ocv_fine(const ecm_batch_t *b, int *seg, double soc)
+{
+   const double *x = b->ocv_x, *y = b->ocv_y;
+   const int n = b->ocv_n;
+
+   if (soc <= x[0]) return y[0];
+   if (soc >= x[n-1]) return y[n-1];
+
+   /* segment i: x[i] < soc <= x[i+1] */
+   int i = *seg;
+   if (!(x[i] < soc && soc <= x[i+1]))
+   {
+      int lo = 0, hi = n-2;
+      while (lo < hi)
+      {
+         int mid = (lo + hi) / 2;
+         if (soc <= x[mid+1]) hi = mid;
+         else lo = mid + 1;
+      }
+      i = lo;
+   }
+   *seg = i;
+
+   double t = (soc - x[i]) / (x[i+1] - x[i]);
+   return y[i] + t * (y[i+1] - y[i]);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		ecm_batch_t *ecm_batch_create(const ecm_t *ecm, int n)
+ *
+ *  @brief	Create n cells, each a copy of 'ecm': its tables (as loaded in its rows), fine OCV curve and
+ *		measured temperature factors if it has them, RC branches, parameters and state.  Cell-to-cell
+ *		variation is then set in the per-cell arrays.
+ *
+ *  @return	batch; NULL if error (the SOC grid needs more than ECM_BATCH_BUCKETS buckets, out of memory)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+ecm_batch_t *ecm_batch_create(const ecm_t *ecm, int n)
+{
+   if (ecm == NULL || n < 1) return NULL;
+
+   ecm_batch_t *b = (ecm_batch_t *)aligned_alloc(_Alignof(ecm_batch_t), sizeof(ecm_batch_t));
+   if (b == NULL) return NULL;
+   memset(b, 0, sizeof(*b));
+
+   b->n = n;
+   b->n_rc = ecm->row_n_rc;
+   b->T_ref_C = ecm->params.T_ref_C;
+
+   /* tables, transposed from the rows */
+   const double *xs = ecm->params.soc_tbl;
+   double min_h = xs[SOC_GRIDS-1] - xs[0];
+   for (int i=0; i<SOC_GRIDS; i++)
+   {
+      b->soc_tbl[i] = xs[i];
+      b->d_soc[i] = (i < SOC_GRIDS-1) ? xs[i+1] - xs[i] : 1.0;
+      if (i < SOC_GRIDS-1 && b->d_soc[i] < min_h) min_h = b->d_soc[i];
+
+      for (int k=0; k<ecm->row_w; k++)
+      {
+         b->tbl[k][i] = ecm->rows[i * ecm->row_w + k];
+         b->d_tbl[k][i] = (i < SOC_GRIDS-1) ? ecm->rows[(i+1) * ecm->row_w + k] - b->tbl[k][i] : 0.0;
+      }
+   }
+
+   /* segment index */
+   double range = xs[SOC_GRIDS-1] - xs[0];
+   if (!(min_h > 0.0) || 2.0 * range / min_h >= ECM_BATCH_BUCKETS) goto _err;
+   b->n_bkt = (int)ceil(2.0 * range / min_h);
+   b->inv_bw = (double)b->n_bkt / range;
+   for (int j=0, i=0; j<b->n_bkt; j++)
+   {
+      double x = xs[0] + j * range / b->n_bkt;
+      while (i < SOC_GRIDS-2 && xs[i+1] <= x) i++;
+      b->seg_at[j] = i;
+   }
+
+   /* fine OCV curve, measured temperature factors */
+   if (ecm->ocv != NULL)
+   {
+      b->ocv_x = (double *)malloc((size_t)ecm->ocv->n * 2 * sizeof(double));
+      if (b->ocv_x == NULL) goto _err;
+      b->ocv_y = b->ocv_x + ecm->ocv->n;
+      memcpy(b->ocv_x, ecm->ocv->x, (size_t)ecm->ocv->n * sizeof(double));
+      memcpy(b->ocv_y, ecm->ocv->y, (size_t)ecm->ocv->n * sizeof(double));
+      b->ocv_n = ecm->ocv->n;
+   }
+   if (ecm->tf_measured)
+   {
+      b->tf = malloc(sizeof(ecm->tf));
+      if (b->tf == NULL) goto _err;
+      memcpy(b->tf, ecm->tf, sizeof(ecm->tf));
+      b->T0_C = ecm->T_tbl[0];
+      b->inv_hT = 1.0 / (ecm->T_tbl[1] - ecm->T_tbl[0]);
+   }
+
+   /* per-cell arrays, each on its own cache lines */
+   size_t stride = ((size_t)n + 7) & ~(size_t)7;
+   double **arr[] = {
+      &b->Q_Ah, &b->k_R0, &b->k_R, &b->k_C, &b->dV_oc, &b->Ea_R0, &b->Ea_R1, &b->Ea_C1, &b->Cp, &b->ht,
+      &b->I_quit, &b->soc, &b->V_rck[0], &b->V_rck[1], &b->V_rck[2], &b->V_rc, &b->T_C, &b->H, &b->V_oc,
+      &b->V_batt, &b->I, &b->R0, &b->dV_rc, &b->inv_C, &b->H_dsg, &b->H_chg
+   };
+   int n_arr = (int)(sizeof(arr) / sizeof(arr[0]));
+   size_t sz = ((n_arr * stride * sizeof(double) + 2 * stride * sizeof(int)) + 63) & ~(size_t)63;
+
+   b->mem = aligned_alloc(64, sz);
+   if (b->mem == NULL) goto _err;
+
+   double *p = (double *)b->mem;
+   for (int a=0; a<n_arr; a++, p+=stride) *arr[a] = p;
+   b->chg_state = (int *)p;
+   b->ocv_seg = b->chg_state + stride;
+
+   /* slopes of the first step: the branches at the template's SOC and temperature */
+   double T = ecm->T_C + 273.15, T_r = b->T_ref_C + 273.15;
+   double f_R = exp(-ecm->Ea_R1 * (1.0 / T - 1.0 / T_r)), f_C = exp(-ecm->Ea_C1 * (1.0 / T - 1.0 / T_r));
+   if (b->tf != NULL)
+   {
+      double t, f[ECM_TF_W];
+      int j = soc_seg(b, ecm->soc, &t);
+      tf_at(b, j, t, ecm->T_C, f);
+      f_R = f[ECM_TF_R1];
+      f_C = f[ECM_TF_C1];
+   }
+   double rate = 0.0, inv_C = 0.0;
+   for (int k=0; k<b->n_rc; k++)
+   {
+      double R = tbl_at(b, ECM_R1 + 2*k, ecm->soc) * f_R;
+      double C = tbl_at(b, ECM_C1 + 2*k, ecm->soc) * f_C;
+      rate += ecm->V_rck[k] / (R * C);
+      inv_C += 1.0 / C;
+   }
+
+   for (int c=0; c<n; c++)
+   {
+      b->Q_Ah[c] = ecm->Q_Ah;
+      b->k_R0[c] = b->k_R[c] = b->k_C[c] = 1.0;
+      b->dV_oc[c] = 0.0;
+      b->Ea_R0[c] = ecm->Ea_R0;
+      b->Ea_R1[c] = ecm->Ea_R1;
+      b->Ea_C1[c] = ecm->Ea_C1;
+      b->Cp[c] = ecm->Cp;
+      b->ht[c] = ecm->ht;
+      b->I_quit[c] = ecm->I_quit;
+
+      b->soc[c] = ecm->soc;
+      for (int k=0; k<ECM_RC_MAX; k++) b->V_rck[k][c] = (k < b->n_rc) ? ecm->V_rck[k] : 0.0;
+      b->V_rc[c] = ecm->V_rc;
+      b->T_C[c] = ecm->T_C;
+      b->H[c] = ecm->H;
+      b->V_oc[c] = ecm->V_oc;
+      b->V_batt[c] = ecm->V_batt;
+      b->I[c] = ecm->I;
+      b->R0[c] = ecm->R0;
+      b->chg_state[c] = ecm->chg_state;
+      b->ocv_seg[c] = 0;
+
+      b->dV_rc[c] = rate;
+      b->inv_C[c] = inv_C;
+      b->H_dsg[c] = tbl_at(b, ECM_H_DSG, ecm->soc);
+      b->H_chg[c] = tbl_at(b, ECM_H_CHG, ecm->soc);
+   }
+
+   return b;
+
+_err:
+   ecm_batch_destroy(b);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void batch_block(ecm_batch_t *b, int c0, int m, const double *I_in, double T_amb_C, double dt)
+ *
+ *  @brief	Step cells c0..c0+m-1 (m <= ECM_BATCH_BLK) as ecm_update() does
+ *
+ *  @note	Table reads (gathers) and stores to the cell arrays are kept in separate loops, through local
+ *		arrays of the block, so the compiler can prove they do not overlap and vectorizes every loop.
+ *		The segment and its fraction are the ones tbl_grid_interp_rows() finds, so the tables read the
+ *		same values as in ecm_update().
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+BATCH_CLONES
+static
+void batch_block(ecm_batch_t *b, int c0, int m, const double *I_in, double T_amb_C, double dt)
+{
+   int bkt[ECM_BATCH_BLK], seg[ECM_BATCH_BLK];
+   double s_l[ECM_BATCH_BLK], t_l[ECM_BATCH_BLK];
+   double f_R0[ECM_BATCH_BLK], f_R[ECM_BATCH_BLK], f_C[ECM_BATCH_BLK];
+   double v_ocv[ECM_BATCH_BLK], v_r0[ECM_BATCH_BLK], v_hc[ECM_BATCH_BLK], v_hd[ECM_BATCH_BLK];
+   double v_R[ECM_RC_MAX][ECM_BATCH_BLK], v_C[ECM_RC_MAX][ECM_BATCH_BLK];
+   double T_l[ECM_BATCH_BLK], Vb_l[ECM_BATCH_BLK];
+   double dv_l[ECM_BATCH_BLK], ic_l[ECM_BATCH_BLK], h_l[ECM_BATCH_BLK];
+   int st_l[ECM_BATCH_BLK];
+
+   const double *I = I_in + c0;
+   const int n_rc = b->n_rc;
+
+   /* soc, bucket of the segment index, temperature factors */
+   {
+      const double *Q_Ah = b->Q_Ah + c0;
+      const double *Ea_R0 = b->Ea_R0 + c0, *Ea_R1 = b->Ea_R1 + c0, *Ea_C1 = b->Ea_C1 + c0;
+      const double *T_C = b->T_C + c0;
+      double *soc = b->soc + c0;
+      const double x0 = b->soc_tbl[0], inv_bw = b->inv_bw;
+      const int last_bkt = b->n_bkt - 1;
+      const double T_r = b->T_ref_C + 273.15;
+      const double inv_Tr = 1.0 / ((T_r < 1.0) ? 1.0 : T_r);
+
+      for (int c=0; c<m; c++)
+      {
+         double Qmax = Q_Ah[c] * 3600;
+         double s = soc[c] - (I[c] * dt) / Qmax;
+         s = (s > 1.0) ? 1.0 : s;
+         s = (s < 0.0) ? 0.0 : s;
+         soc[c] = s;
+         s_l[c] = s;
+
+         int j = (int)((s - x0) * inv_bw);
+         j = (j < 0) ? 0 : j;
+         bkt[c] = (j > last_bkt) ? last_bkt : j;
+      }
+
+      /* Arrhenius, unless measured factors are read at the segment below */
+      if (b->tf == NULL)
+      {
+         for (int c=0; c<m; c++)
+         {
+            double T = T_C[c] + 273.15;
+            T = (T < 1.0) ? 1.0 : T;
+            double dinv = 1.0 / T - inv_Tr;
+            f_R0[c] = vexp(-Ea_R0[c] * dinv);
+            f_R[c] = vexp(-Ea_R1[c] * dinv);
+            f_C[c] = vexp(-Ea_C1[c] * dinv);
+         }
+      }
+   }
+
+   /* segment: the bucket's, one step either way; the last point holds SOC 1.  Tables other than the branches */
+   {
+      const double *xs = b->soc_tbl, *dxs = b->d_soc;
+      const int *seg_at = b->seg_at;
+      const double x0 = xs[0], x_end = xs[SOC_GRIDS-1];
+      const double *ocv = b->tbl[ECM_OCV], *d_ocv = b->d_tbl[ECM_OCV];
+      const double *r0 = b->tbl[ECM_R0], *d_r0 = b->d_tbl[ECM_R0];
+      const double *hc = b->tbl[ECM_H_CHG], *d_hc = b->d_tbl[ECM_H_CHG];
+      const double *hd = b->tbl[ECM_H_DSG], *d_hd = b->d_tbl[ECM_H_DSG];
+
+      for (int c=0; c<m; c++)
+      {
+         double s = s_l[c];
+         int j = seg_at[bkt[c]];
+         j -= (j > 0) & (s <= xs[j]);
+         j += (j < SOC_GRIDS-2) & (s > xs[j+1]);
+         j = (s >= x_end) ? SOC_GRIDS-1 : j;
+         double t = (s - xs[j]) / dxs[j] * (double)((s > x0) & (s < x_end));
+         seg[c] = j;
+         t_l[c] = t;
+
+         v_ocv[c] = ocv[j] + t * d_ocv[j];
+         v_r0[c] = r0[j] + t * d_r0[j];
+         v_hc[c] = hc[j] + t * d_hc[j];
+         v_hd[c] = hd[j] + t * d_hd[j];
+      }
+
+      for (int k=0; k<n_rc; k++)
+      {
+         const double *r = b->tbl[ECM_R1 + 2*k], *d_r = b->d_tbl[ECM_R1 + 2*k];
+         const double *cc = b->tbl[ECM_C1 + 2*k], *d_c = b->d_tbl[ECM_C1 + 2*k];
+         for (int c=0; c<m; c++)
+         {
+            int j = seg[c];
+            v_R[k][c] = r[j] + t_l[c] * d_r[j];
+            v_C[k][c] = cc[j] + t_l[c] * d_c[j];
+         }
+      }
+   }
+
+   /* measured temperature factors; the fine OCV curve (a search per cell, not vectorized) */
+   if (b->tf != NULL)
+   {
+      const double *T_C = b->T_C + c0;
+      for (int c=0; c<m; c++)
+      {
+         double f[ECM_TF_W];
+         tf_at(b, seg[c], t_l[c], T_C[c], f);
+         f_R0[c] = f[ECM_TF_R0];
+         f_R[c] = f[ECM_TF_R1];
+         f_C[c] = f[ECM_TF_C1];
+      }
+   }
+   if (b->ocv_n > 0)
+   {
+      int *ocv_seg = b->ocv_seg + c0;
+      for (int c=0; c<m; c++) v_ocv[c] = ocv_fine(b, &ocv_seg[c], s_l[c]);
+   }
+
+   /* RC branches; their slopes of the next step */
+   {
+      const double *k_R = b->k_R + c0, *k_C = b->k_C + c0;
+      double *V_rc = b->V_rc + c0;
+
+      for (int k=0; k<n_rc; k++)
+      {
+         double *V = b->V_rck[k] + c0;
+         for (int c=0; c<m; c++)
+         {
+            double R = v_R[k][c] * f_R[c] * k_R[c];
+            double C = v_C[k][c] * f_C[c] * k_C[c];
+            double v = V[c] + dt * ( -V[c] / (R * C) + I[c] / C );
+            V[c] = v;
+            V_rc[c] = (k == 0) ? v : V_rc[c] + v;
+            dv_l[c] = ((k == 0) ? 0.0 : dv_l[c]) + v / (R * C);
+            ic_l[c] = ((k == 0) ? 0.0 : ic_l[c]) + 1.0 / C;
+         }
+      }
+   }
+
+   /* R0, OCV, temperature, charge state, H, terminal voltage: computed into the block's arrays, then stored */
+   {
+      const double *k_R0 = b->k_R0 + c0, *dV_oc = b->dV_oc + c0, *I_quit = b->I_quit + c0;
+      const double *Cp = b->Cp + c0, *ht = b->ht + c0, *T_C = b->T_C + c0, *H = b->H + c0;
+      const double *V_rc = b->V_rc + c0;
+
+      for (int c=0; c<m; c++)
+      {
+         double r0 = v_r0[c] * f_R0[c] * k_R0[c];
+         double v_oc = v_ocv[c] + dV_oc[c];
+
+         double powerloss = I[c] * I[c] * r0;
+         T_l[c] = T_C[c] + dt * (powerloss - ht[c] * (T_C[c] - T_amb_C)) / Cp[c];
+
+         /* both compares made on every cell (REST is 0), so no branch is left in the loop */
+         int st = (I[c] > I_quit[c]) * DSG + (I[c] < -I_quit[c]) * CHG;
+         double h = (st == DSG) ? v_hd[c] : H[c];
+         h = (st == CHG) ? v_hc[c] : h;
+
+         Vb_l[c] = (v_oc + h) - V_rc[c] - I[c] * r0;
+         v_r0[c] = r0;
+         v_ocv[c] = v_oc;
+         h_l[c] = h;
+         st_l[c] = st;
+      }
+
+      memcpy(b->R0 + c0, v_r0, (size_t)m * sizeof(double));
+      memcpy(b->V_oc + c0, v_ocv, (size_t)m * sizeof(double));
+      memcpy(b->T_C + c0, T_l, (size_t)m * sizeof(double));
+      memcpy(b->H + c0, h_l, (size_t)m * sizeof(double));
+      memcpy(b->V_batt + c0, Vb_l, (size_t)m * sizeof(double));
+      memcpy(b->chg_state + c0, st_l, (size_t)m * sizeof(int));
+      memcpy(b->I + c0, I, (size_t)m * sizeof(double));
+      memcpy(b->dV_rc + c0, dv_l, (size_t)m * sizeof(double));
+      memcpy(b->inv_C + c0, ic_l, (size_t)m * sizeof(double));
+      memcpy(b->H_dsg + c0, v_hd, (size_t)m * sizeof(double));
+      memcpy(b->H_chg + c0, v_hc, (size_t)m * sizeof(double));
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int ecm_batch_update(ecm_batch_t *b, const double *I, double T_amb_C, double dt)
+ *
+ *  @brief	Step every cell one time step under its current I[c] (> 0 discharge), as ecm_update()
+ *
+ *  @param	I	n currents; not b->I, which is set to them
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int ecm_batch_update(ecm_batch_t *b, const double *I, double T_amb_C, double dt)
+{
+   if (b == NULL) return -1;
+
+   return ecm_batch_update_cells(b, 0, b->n, I, T_amb_C, dt);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int ecm_batch_update_cells(ecm_batch_t *b, int c0, int n, const double *I, double T_amb_C, double dt)
+ *
+ *  @brief	ecm_batch_update() of cells c0..c0+n-1 only, e.g. one thread's share of the cells
+ *
+ *  @param	I	b->n currents, of which I[c0..c0+n-1] are read
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int ecm_batch_update_cells(ecm_batch_t *b, int c0, int n, const double *I, double T_amb_C, double dt)
+{
+   if (b == NULL || I == NULL || c0 < 0 || n < 0 || c0 + n > b->n) return -1;
+
+   for (int c=c0; c<c0+n; c+=ECM_BATCH_BLK)
+   {
+      int m = (c0 + n - c < ECM_BATCH_BLK) ? c0 + n - c : ECM_BATCH_BLK;
+      batch_block(b, c, m, I, T_amb_C, dt);
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void ecm_batch_destroy(ecm_batch_t *b)
+ *
+ *  @brief	Free the batch
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void ecm_batch_destroy(ecm_batch_t *b)
+{
+   if (b == NULL) return;
+
+   free(b->mem);
+   free(b->ocv_x);
+   free(b->tf);
+   free(b);
+}
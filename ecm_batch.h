@@ -0,0 +1,95 @@
+/*!
+ *======================================================================================================================
+ *
+ * @file	ecm_batch.h
+ *
+ * @brief	Batched ECM header: many cells stepped together
+ *
+ * @note	Each cell state and parameter is an array over the cells (structure of arrays), so one step is a few
+ *		loops over contiguous doubles that the compiler vectorizes (AVX2 when the CPU has it, NEON on
+ *		ARM).  The cells share one chemistry, the tables of a template ECM, and differ by their state,
+ *		capacity, Arrhenius energies, thermal constants and the scale factors k_R0, k_R, k_C, dV_oc that
+ *		model cell-to-cell variation.  R and C are scaled to temperature by the Arrhenius model itself,
+ *		or by the template's factor tables if measured ones are loaded (ecm_load_tf()); OCV comes from the
+ *		template's fine curve if it has one (ecm_set_ocv()), else from the OCV table.
+ *
+ *======================================================================================================================
+ */
+#ifndef __ECM_BATCH_H__
+#define __ECM_BATCH_H__
+
+#include "globals.h"
+#include "ecm.h"
+
+
+#define ECM_BATCH_BLK		(128)		/* cells per block of a step: the block's temporaries stay in L1 */
+#define ECM_BATCH_BUCKETS	(1024)		/* max buckets of the SOC segment index */
+
+
+typedef struct
+{
+   int n;					/* cells */
+   int n_rc;					/* RC branches of every cell (1..ECM_RC_MAX) */
+
+   /* Shared tables over the SOC grid, indexed by ECM_OCV, ECM_R0, ...; d_tbl[k][i] = tbl[k][i+1] - tbl[k][i]
+    * (0 at the last point, which SOC 1 reads) */
+   _Alignas(64) double tbl[ECM_ROW_W][SOC_GRIDS];
+   _Alignas(64) double d_tbl[ECM_ROW_W][SOC_GRIDS];
+   double soc_tbl[SOC_GRIDS];
+   double d_soc[SOC_GRIDS];			/* soc_tbl[i+1] - soc_tbl[i]; 1 at the last point */
+
+   /* Segment guess by direct index: the SOC range in buckets of half the shortest segment or less */
+   int seg_at[ECM_BATCH_BUCKETS];		/* segment holding the start of each bucket */
+   int n_bkt;					/* buckets used */
+   double inv_bw;				/* 1/bucket width */
+   double T_ref_C;				/* temperature of the tables */
+
+   /* The template's fine OCV curve, read instead of the OCV table; ocv_n is 0 if it has none */
+   int ocv_n;
+   double *ocv_x, *ocv_y;
+
+   /* The template's measured temperature factors over T x soc_tbl, read instead of Arrhenius (the per-cell Ea
+    * are then unused); NULL if it has none */
+   double (*tf)[SOC_GRIDS][ECM_TF_W];
+   double T0_C, inv_hT;				/* first point, 1/step of the uniform temperature grid */
+
+   /* Per-cell parameters (the template's values after ecm_batch_create()) */
+   double *Q_Ah;				/* capacity */
+   double *k_R0, *k_R, *k_C;			/* scale of R0, of every branch R, of every branch C */
+   double *dV_oc;				/* OCV offset */
+   double *Ea_R0, *Ea_R1, *Ea_C1;		/* Arrhenius energies; Ea_R1, Ea_C1 apply to every branch */
+   double *Cp, *ht;				/* thermal capacitance, transfer */
+   double *I_quit;				/* rest current */
+
+   /* Per-cell states, as the ecm_t fields of the same name */
+   double *soc;
+   double *V_rck[ECM_RC_MAX];			/* branch voltages */
+   double *V_rc;				/* sum of the branch voltages */
+   double *T_C;
+   double *H;
+   double *V_oc;
+   double *V_batt;
+   double *I;
+   double *R0;					/* R0 at temperature of the last step */
+   int *chg_state;
+   int *ocv_seg;				/* segment of the last fine OCV lookup */
+
+   /* The next step of each cell, linear in its dt and current I with the R, C of the last step (for solving the
+    * currents between connected cells): V_batt = V_oc + H' - (V_rc - dt dV_rc) - I (R0 + dt inv_C), where H' is
+    * H_dsg if discharging, H_chg if charging, else H */
+   double *dV_rc;				/* decay rate of V_rc: the sum of V_k / (R_k C_k) */
+   double *inv_C;				/* sum of 1/C_k */
+   double *H_dsg, *H_chg;			/* hysteresis tables at soc */
+
+   void *mem;					/* one block holding every array */
+}
+ecm_batch_t;
+
+
+ecm_batch_t *ecm_batch_create(const ecm_t *ecm, int n);
+int ecm_batch_update(ecm_batch_t *b, const double *I, double T_amb_C, double dt);
+int ecm_batch_update_cells(ecm_batch_t *b, int c0, int n, const double *I, double T_amb_C, double dt);
+void ecm_batch_destroy(ecm_batch_t *b);
+
+
+#endif /* __ECM_BATCH_H__ */
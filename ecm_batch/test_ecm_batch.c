@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 199309L
+#include "ecm_batch.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_CHECK     (40)        /* cells stepped both ways */
+#define N_STEPS     (40000)     /* 10000 s at DT */
+#define DT_S        (0.25)
+#define N_SCALAR    (512)       /* ecm_t for the bench (~100 kB each) */
+#define N_BATCH     (65536)
+
+extern flash_params_t g_batt_flash_params;
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double urand(void) {
+    return (double)(xorshift64() >> 11) / 9007199254740992.0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ecm_t *make_ecm(int n_rc, double T0_C) {
+    ecm_t *e = ecm_alloc();
+    assert(e != NULL);
+    assert(ecm_init(e, &g_batt_flash_params, T0_C) == 0);
+    e->n_rc = n_rc;
+    ecm_load_rows(e);
+    return e;
+}
+
+/* pulses of charge, discharge and rest, different per cell */
+static double current(int c, int k) {
+    int per = 400 + 37 * c;
+    int ph = (k / per) % 4;
+    double I = 1.0 + 0.1 * (c % 7);
+    return (ph == 0) ? I : (ph == 1) ? 0.0 : (ph == 2) ? -0.5 * I : 0.02 * (c % 3);
+}
+
+/* every cell of a batch follows its own ecm_update() run: SOC, OCV and H bit for bit; R and C to the accuracy of
+ * the bilinear factor tables ecm_update() reads (~2e-7 at 1 degC steps), as the batch evaluates Arrhenius exactly */
+static void test_match(int n_rc) {
+    ecm_t *tmpl = make_ecm(n_rc, 25.0);
+    ecm_t *e[N_CHECK];
+    for (int c = 0; c < N_CHECK; c++) {
+        e[c] = make_ecm(n_rc, 25.0);
+        e[c]->soc = tmpl->soc = 0.9;
+    }
+    ecm_batch_t *b = ecm_batch_create(tmpl, N_CHECK);
+    assert(b != NULL && b->n_rc == n_rc);
+
+    double I[N_CHECK], max_dv = 0.0;
+    for (int k = 0; k < N_STEPS; k++) {
+        double T_amb = 25.0 + 10.0 * sin(k * 1e-4);
+        for (int c = 0; c < N_CHECK; c++) {
+            I[c] = current(c, k);
+            ecm_update(e[c], I[c], T_amb, k * DT_S, DT_S);
+        }
+        assert(ecm_batch_update(b, I, T_amb, DT_S) == 0);
+
+        for (int c = 0; c < N_CHECK; c++) {
+            assert(b->soc[c] == e[c]->soc);
+            assert(b->chg_state[c] == e[c]->chg_state);
+            assert(b->H[c] == e[c]->H);
+            assert(b->V_oc[c] == e[c]->V_oc);
+            assert(fabs(b->R0[c] / e[c]->R0 - 1.0) < 1e-6);
+            assert(fabs(b->T_C[c] - e[c]->T_C) < 1e-6);
+            for (int j = 0; j < n_rc; j++) assert(fabs(b->V_rck[j][c] - e[c]->V_rck[j]) < 1e-6);
+            double dv = fabs(b->V_batt[c] - e[c]->V_batt);
+            if (dv > max_dv) max_dv = dv;
+        }
+    }
+    assert(max_dv < 1e-6);
+    printf("%d RC: %d cells x %d steps match ecm_update(), max |dV_batt| %.1e V\n", n_rc, N_CHECK, N_STEPS, max_dv);
+
+    ecm_batch_destroy(b);
+    for (int c = 0; c < N_CHECK; c++) free(e[c]);
+    free(tmpl);
+}
+
+/* R0 at temperature against exp(), over -40..85 degC and large energies: checks the vectorized exp */
+static void test_arrhenius(void) {
+    enum { N = 1000 };
+    ecm_t *tmpl = make_ecm(1, 25.0);
+    ecm_batch_t *b = ecm_batch_create(tmpl, N);
+    assert(b != NULL);
+
+    double I[N], max_err = 0.0;
+    for (int c = 0; c < N; c++) {
+        b->T_C[c] = -40.0 + 125.0 * c / (N - 1);
+        b->Ea_R0[c] = (c & 1) ? -6000.0 * urand() : 6000.0 * urand();
+        b->soc[c] = urand();
+        I[c] = 0.0;
+    }
+    double T_C[N], soc[N];
+    memcpy(T_C, b->T_C, sizeof(T_C));
+    memcpy(soc, b->soc, sizeof(soc));
+    assert(ecm_batch_update(b, I, 25.0, DT_S) == 0);
+
+    for (int c = 0; c < N; c++) {
+        double row[ECM_ROW_W];
+        ecm_lookup_row(tmpl, soc[c], row);
+        double R0 = row[ECM_R0] * util_temp_adj(1.0, b->Ea_R0[c], T_C[c], tmpl->params.T_ref_C);
+        double err = fabs(b->R0[c] / R0 - 1.0);
+        if (err > max_err) max_err = err;
+    }
+    assert(max_err < 1e-14);
+    printf("Arrhenius: max rel err %.1e against exp()\n", max_err);
+
+    ecm_batch_destroy(b);
+    free(tmpl);
+}
+
+/* cell-to-cell variation: a cell with more R0 and less capacity sags more and empties first */
+static void test_variation(void) {
+    ecm_t *tmpl = make_ecm(2, 25.0);
+    ecm_batch_t *b = ecm_batch_create(tmpl, 2);
+    assert(b != NULL);
+    b->k_R0[1] = 1.5;
+    b->Q_Ah[1] = 0.9 * b->Q_Ah[0];
+    b->dV_oc[1] = -0.005;
+
+    double I[2] = { 2.0, 2.0 };
+    for (int k = 0; k < 1000; k++) assert(ecm_batch_update(b, I, 25.0, DT_S) == 0);
+    assert(b->soc[1] < b->soc[0]);
+    assert(b->V_batt[1] < b->V_batt[0]);
+    assert(b->T_C[1] > b->T_C[0]);
+
+    ecm_batch_destroy(b);
+    free(tmpl);
+}
+
+/* the slopes of the next step predict it, to the drift of R, C and the tables over one step */
+static void test_linear(void) {
+    ecm_t *tmpl = make_ecm(3, 25.0);
+    ecm_batch_t *b = ecm_batch_create(tmpl, N_CHECK);
+    assert(b != NULL);
+
+    double I[N_CHECK], max_dv = 0.0;
+    for (int k = 0; k < 4000; k++) {
+        double V_pred[N_CHECK];
+        for (int c = 0; c < N_CHECK; c++) {
+            I[c] = current(c, k);
+            double h = (I[c] > b->I_quit[c]) ? b->H_dsg[c] : (I[c] < -b->I_quit[c]) ? b->H_chg[c] : b->H[c];
+            V_pred[c] = b->V_oc[c] + h - (b->V_rc[c] - DT_S * b->dV_rc[c]) - I[c] * (b->R0[c] + DT_S * b->inv_C[c]);
+        }
+        assert(ecm_batch_update(b, I, 25.0, DT_S) == 0);
+        for (int c = 0; k > 0 && c < N_CHECK; c++) {
+            double dv = fabs(b->V_batt[c] - V_pred[c]);
+            if (dv > max_dv) max_dv = dv;
+        }
+    }
+    assert(max_dv < 1e-4);
+    printf("slopes of the next step: max |dV_batt| %.1e V\n", max_dv);
+
+    ecm_batch_destroy(b);
+    free(tmpl);
+}
+
+/* cells per second: ecm_update() on each ecm_t against one batch step */
+static void bench(int n_rc) {
+    enum { STEPS = 200, STEPS_B = 50 };
+    static double I[N_BATCH];
+    for (int c = 0; c < N_BATCH; c++) I[c] = (c & 1) ? 2.0 : -1.5;
+
+    ecm_t **e = (ecm_t **)malloc(N_SCALAR * sizeof(ecm_t *));
+    for (int c = 0; c < N_SCALAR; c++) {
+        e[c] = make_ecm(n_rc, 25.0);
+        e[c]->soc = 0.5;
+    }
+    double t0 = now_s();
+    for (int k = 0; k < STEPS; k++)
+        for (int c = 0; c < N_SCALAR; c++) ecm_update(e[c], I[c], 25.0, k * DT_S, DT_S);
+    double t1 = now_s();
+    double scalar = (double)N_SCALAR * STEPS / (t1 - t0);
+
+    ecm_t *tmpl = make_ecm(n_rc, 25.0);
+    tmpl->soc = 0.5;
+    double batch[2];
+    int sizes[2] = { N_SCALAR, N_BATCH };
+    for (int s = 0; s < 2; s++) {
+        ecm_batch_t *b = ecm_batch_create(tmpl, sizes[s]);
+        assert(b != NULL);
+        int steps = STEPS_B * N_BATCH / sizes[s];
+        t0 = now_s();
+        for (int k = 0; k < steps; k++) ecm_batch_update(b, I, 25.0, DT_S);
+        t1 = now_s();
+        batch[s] = (double)sizes[s] * steps / (t1 - t0);
+        ecm_batch_destroy(b);
+    }
+
+    printf("%d RC: ecm_update() %6.1f M cells/s, batch of %d %6.1f M cells/s (%.1fx), of %d %6.1f M cells/s\n",
+           n_rc, scalar * 1e-6, N_SCALAR, batch[0] * 1e-6, batch[0] / scalar, N_BATCH, batch[1] * 1e-6);
+
+    for (int c = 0; c < N_SCALAR; c++) free(e[c]);
+    free(e);
+    free(tmpl);
+}
+
+int main(void) {
+    for (int n_rc = 1; n_rc <= ECM_RC_MAX; n_rc++) test_match(n_rc);
+    test_arrhenius();
+    test_variation();
+    test_linear();
+    bench(1);
+    bench(3);
+    printf("All ecm_batch tests passed.\n");
+    return 0;
+}
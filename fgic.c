@@ -21,7 +21,7 @@ extern flash_params_t g_fgic_flash_params;
  *
  *  @brief	UKF process model updates the state vector 'x' given 'u'
  *
- *  @param	x:		state vector x[0]=soc, x[1] = V_rc
+ *  @param	x:		state vector x[0]=soc, x[1..n] = V_rc of each RC branch, x[n+1] = T
  *  @param	u:		input vector u[0]=dq,  u[1] = T_amb_C
  *  @param	p_usr:	 	pass in fgic pointer	
  *
@@ -40,9 +40,10 @@ void fgic_fx(double *x, const double *u, double dt, void *p_usr)
 
 
    /* read state vars */
+   int n = ecm->row_n_rc;
    double soc  = x[0];
-   double V_rc = x[1];
-   double T_C  = x[2];
+   double *V_rc = &x[1];
+   double T_C  = x[n+1];
 
    /* read inputs */
    double I       = u[0];
@@ -53,20 +54,21 @@ void fgic_fx(double *x, const double *u, double dt, void *p_usr)
    soc -= (I*dt)/Qmax;   
    soc = util_clamp(soc, 0.0, 1.0);
 
-   /* lookup R0, R1, C1 */
-   double R0=0, R1=0, C1=0;
-   ecm_lookup_r0(ecm, soc, &R0);
-   R0 = util_temp_adj(R0, ecm->Ea_R0, ecm->T_C, ecm->params.T_ref_C);
-   ecm_lookup_r1(ecm, soc, &R1);
-   R1 = util_temp_adj(R1, ecm->Ea_R1, ecm->T_C, ecm->params.T_ref_C);
-   ecm_lookup_c1(ecm, soc, &C1);
-   C1 = util_temp_adj(C1, ecm->Ea_C1, ecm->T_C, ecm->params.T_ref_C);
+   /* lookup R0 and each branch's R, C */
+   double row[ECM_ROW_W];
+   ecm_lookup_row_at(ecm, soc, ecm->T_C, row);
+   double R0 = row[ECM_R0];
 
-   double tau = R1 * C1; 
-   if (tau < 1e-9) tau = 1e-9;
+   /* update VRC of each branch */
+   for (int k=0; k<n; k++)
+   {
+      double R = row[ECM_R1 + 2*k];
+      double C = row[ECM_C1 + 2*k];
 
-   /* update VRC */
-   V_rc += dt * (-V_rc / tau + I / C1);
+      double tau = R * C; 
+      if (tau < 1e-9) tau = 1e-9;
+      V_rc[k] += dt * (-V_rc[k] / tau + I / C);
+   }
 
    /* update T */
    double powerloss = I * I * R0;
@@ -74,8 +76,7 @@ void fgic_fx(double *x, const double *u, double dt, void *p_usr)
 
    /* update state vars */
    x[0] = soc;
-   x[1] = V_rc;
-   x[2] = T_C;
+   x[n+1] = T_C;
 }
 
 
@@ -88,8 +89,8 @@ void fgic_fx(double *x, const double *u, double dt, void *p_usr)
  *
  *  @paaram	x:	state vector
  *        		x[0] = soc
- *        		x[1] = V_rc 
- *        		x[2] = T 
+ *        		x[1..n] = V_rc of each RC branch
+ *        		x[n+1] = T 
  *
  *  @param	z:	measurement vector
  *        		z[0] = V_term 
@@ -105,20 +106,20 @@ void fgic_hx(const double *x, double *z, void *p_usr)
    fgic_t *fgic = (fgic_t *)p_usr;
    ecm_t *ecm = fgic->ecm;
 
+   int n = ecm->row_n_rc;
    double soc  = util_clamp(x[0], 0.0, 1.0);
-   double V_rc = x[1];
-   double T_C  = x[2];
+   double V_rc = 0.0;
+   for (int k=0; k<n; k++) V_rc += x[1+k];
+   double T_C  = x[n+1];
 
-   double V_oc;
-   ecm_lookup_ocv(ecm, soc, &V_oc);
+   double row[ECM_ROW_W];
+   ecm_lookup_row_at(ecm, soc, T_C, row);
+   double V_oc = row[ECM_OCV];
 
    /* Update H */
-   double H;
-   ecm_lookup_h(ecm, soc, &H);
+   double H = ecm_row_h(ecm, row);
 
-   double R0;
-   ecm_lookup_r0(ecm, soc, &R0);
-   R0 = util_temp_adj(R0, ecm->Ea_R0, T_C, ecm->params.T_ref_C);   
+   double R0 = row[ECM_R0];
 
    /* compute V_term and T_C */ 
    z[0] = (V_oc + H) - V_rc - ecm->I * R0;
@@ -126,6 +127,102 @@ void fgic_hx(const double *x, double *z, void *p_usr)
 }
 
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void fgic_learn_tbl(fgic_t *fgic, double *tbl, int id, double t, double val)
+ *
+ *  @brief	Learn 'val' into table 'tbl' (table id 'id') at the current SOC, then refresh the ECM's
+ *		interleaved rows and record the change in the table history
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void fgic_learn_tbl(fgic_t *fgic, double *tbl, int id, double t, double val)
+{
+   ecm_t *ecm = fgic->ecm;
+
+   util_update_tbl(tbl, ecm->params.soc_tbl, SOC_GRIDS, ecm->soc, val);
+   ecm_load_rows(ecm);
+   tbl_hist_sync(fgic->hist, t, id);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int fgic_ukf_init(fgic_t *fgic)
+ *
+ *  @brief	(Re)start the UKF from the ECM's state, sized for its RC branches: x = soc, V_rc of each branch, T
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int fgic_ukf_init(fgic_t *fgic)
+{
+   ecm_t *ecm = fgic->ecm;
+   int n = ecm->row_n_rc;
+
+   const int n_x = n + 2;	/* SOC, VRC of each branch, T */
+   const int n_z = 2;	/* V, T */
+
+   double alpha = 1e-3;
+   double beta  = 2.0;
+   double kappa = 0.0;
+
+   /* initial states and covariance */
+   double x0[UKF_MAX_N]; 
+   double P0[UKF_MAX_N * UKF_MAX_N] = { 0 };
+   x0[0] = ecm->soc;
+   P0[0] = 0.01;
+   for (int k=0; k<n; k++)
+   {
+      x0[1+k] = ecm->V_rck[k];
+      P0[(1+k)*n_x + 1+k] = (k == 0) ? 0.5 : P_VRC_SLOW;
+   }
+   x0[n+1] = ecm->T_C;
+   P0[(n+1)*n_x + n+1] = 1.0;
+
+   /* process noise */
+   double q_soc = 1e-4;
+   double q_vrc = 1e-4;
+   double q_T   = 1e-4;
+   double Q[UKF_MAX_N * UKF_MAX_N] = { 0 };
+   Q[0] = q_soc;
+   for (int k=0; k<n; k++) Q[(1+k)*n_x + 1+k] = (k == 0) ? q_vrc : Q_VRC_SLOW;
+   Q[(n+1)*n_x + n+1] = q_T;
+
+   /* measurement noise */
+   double R_meas = fgic->V_noise * fgic->V_noise;
+   double T_meas = fgic->T_noise * fgic->T_noise;
+   if (!fgic->noise_en)
+   {
+      R_meas = 1e-6; 
+      T_meas = 1e-6;
+   }
+   double R[4] = { 
+      R_meas,    0.0,
+         0.0, T_meas
+   };
+
+   /* init ukf */
+   if (ukf_init(fgic->ukf, n_x, n_z, alpha, beta, kappa) != UKF_OK) return -1;
+
+   /* set fx and hx */
+   ukf_set_models(fgic->ukf, fgic_fx, fgic_hx);
+
+   /* set state */
+   if (ukf_set_state(fgic->ukf, x0, P0) != UKF_OK) return -2;
+
+   /* set noise */
+   if (ukf_set_noise(fgic->ukf, Q, R) != UKF_OK) return -3;
+
+   return 0;
+}
+
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
@@ -180,7 +277,8 @@ fgic_t *fgic_create(batt_t *batt, flash_params_t *p, double T0_C)
 
    fgic->batt = batt;
    
-   fgic->ecm = (ecm_t *)malloc(sizeof(ecm_t));
+   fgic->ecm = ecm_alloc();
+   if (fgic->ecm == NULL) goto _err_ret;
    if (ecm_init(fgic->ecm, &g_fgic_flash_params, T0_C) != 0) goto _err_ret;
    //fgic->ecm->soc = 0.5;  // set wrong initially
    
@@ -213,67 +311,8 @@ fgic_t *fgic_create(batt_t *batt, flash_params_t *p, double T0_C)
 
 
    /* UKF setup */
-   const int n_x = 3;	/* SOC, VRC, T */
-   const int n_z = 2;	/* V, T */
-
    fgic->ukf = (ukf_t *)calloc(1, sizeof(ukf_t));
-  
-   double alpha = 1e-3;
-   double beta  = 2.0;
-   double kappa = 0.0;
-
-   /* initial states and covariance */
-   double x0[3]; 
-   x0[0] = fgic->ecm->soc;
-   x0[1] = fgic->ecm->V_rc;
-   x0[2] = fgic->ecm->T_C;
-
-   double P0[9] = {
-      0.01, 0.0, 0.0,
-      0.0,  0.5, 0.0,
-      0.0,  0.0, 1.0
-   }; 
-
-   /* process noise */
-   double q_soc = 1e-4;
-   double q_vrc = 1e-4;
-   double q_T   = 1e-4;
-   double Q[9] = {
-      q_soc,   0.0,   0.0,
-        0.0, q_vrc,   0.0,
-        0.0,   0.0,   q_T
-   };
-
-   /* measurement noise */
-   double R_meas = fgic->V_noise * fgic->V_noise;
-   double T_meas = fgic->T_noise * fgic->T_noise;
-   if (!fgic->noise_en)
-   {
-      R_meas = 1e-6; 
-      T_meas = 1e-6;
-   }
-   double R[4] = { 
-      R_meas,    0.0,
-         0.0, T_meas
-   };
-
-   /* init ukf */
-   if (ukf_init(fgic->ukf, n_x, n_z, alpha, beta, kappa) != UKF_OK)
-      goto _err_ret;
-   
-
-   /* set fx and hx */
-   ukf_set_models(fgic->ukf, fgic_fx, fgic_hx);
-
-
-   /* set state */
-   if (ukf_set_state(fgic->ukf, x0, P0) != UKF_OK) 
-      goto _err_ret;
-
-
-   /* set noise */
-   if (ukf_set_noise(fgic->ukf, Q, R) != UKF_OK) 
-      goto _err_ret;
+   if (fgic->ukf == NULL || fgic_ukf_init(fgic) != 0) goto _err_ret;
 
    return fgic;
 
@@ -367,12 +406,12 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
             double H = fgic->V_meas - ecm->V_oc + ecm->V_rc + (fgic->I_sum*ecm->R0/fgic->rest_time);
             if (fgic->h_dir == CHG)
             {
-               util_update_tbl(ecm->params.h_chg_tbl, ecm->params.soc_tbl, SOC_GRIDS, ecm->soc, H);
+               fgic_learn_tbl(fgic, ecm->params.h_chg_tbl, TBL_H_CHG, t, H);
                printf("learned H_chg at t=%lf H=%lf\n", t, H);
             }
             else if (fgic->h_dir == DSG)
             {
-               util_update_tbl(ecm->params.h_dsg_tbl, ecm->params.soc_tbl, SOC_GRIDS, ecm->soc, H);
+               fgic_learn_tbl(fgic, ecm->params.h_dsg_tbl, TBL_H_DSG, t, H);
                printf("learned H_dsg at t=%lf H=%lf\n", t, H);
             }
          }
@@ -400,6 +439,9 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
       u[0] = fgic->I_meas;         // ecm->I updated by ecm_update() to be equal to fgic->I_meas
       u[1] = T_amb_C;              // same for ecm->T_amb_C
 
+      /* resize the UKF if the number of RC branches changed */
+      if (fgic->ukf->n_x != ecm->row_n_rc + 2 && fgic_ukf_init(fgic) != 0) goto _err_ret;
+
       /* Predict x given u */
       if (ukf_predict(fgic->ukf, u, dt, (void *)fgic) != UKF_OK) goto _err_ret;
       /* Update x given z_meas */
@@ -407,23 +449,35 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
 
 
       /* refresh ECM model params with updated states */
+      int n = ecm->row_n_rc;
       ecm->soc  = util_clamp(fgic->ukf->x[0], 0.0, 1.0);
-      ecm->V_rc = fgic->ukf->x[1];
-      ecm->T_C  = fgic->ukf->x[2];
-
-      double R0, R1, C1;
-      ecm_lookup_r0(ecm, ecm->soc, &R0);
-      ecm->R0 = util_temp_adj(R0, ecm->Ea_R0, ecm->T_C, ecm->params.T_ref_C);
-      ecm_lookup_r1(ecm, ecm->soc, &R1);
-      ecm->R1 = util_temp_adj(R1, ecm->Ea_R1, ecm->T_C, ecm->params.T_ref_C);
-      ecm_lookup_c1(ecm, ecm->soc, &C1);
-      ecm->C1 = util_temp_adj(C1, ecm->Ea_C1, ecm->T_C, ecm->params.T_ref_C);
-   
-      ecm->Tau = ecm->R1 * ecm->C1;
+      ecm->V_rc = 0.0;
+      for (int k=0; k<n; k++)
+      {
+         ecm->V_rck[k] = fgic->ukf->x[1+k];
+         ecm->V_rc += ecm->V_rck[k];
+      }
+      ecm->T_C  = fgic->ukf->x[n+1];
 
-      ecm_lookup_ocv(ecm, ecm->soc, &ecm->V_oc);
+      /* the previous parameters are kept if the lookup fails (e.g. a NaN state from the UKF) */
+      double row[ECM_ROW_W];
+      if (ecm_lookup_cached(ecm, ecm->soc, ecm->T_C, row) == 0)
+      {
+         ecm->R0 = row[ECM_R0];
+         for (int k=0; k<n; k++)
+         {
+            ecm->Rk[k] = row[ECM_R1 + 2*k];
+            ecm->Ck[k] = row[ECM_C1 + 2*k];
+         }
+         ecm->R1 = ecm->Rk[0];
+         ecm->C1 = ecm->Ck[0];
+
+         ecm->V_oc = row[ECM_OCV];
 
-      ecm_lookup_h(ecm, ecm->soc, &ecm->H);
+         ecm->H = ecm_row_h(ecm, row);
+      }
+   
+      ecm->Tau = ecm->R1 * ecm->C1;
    
       ecm->V_batt = (ecm->V_oc + ecm->H) - ecm->V_rc - ecm->I * ecm->R0;
    }
@@ -434,10 +488,12 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
    //---------------------------------------------------
    double dV_batt = ecm->V_batt - ecm->prev_V_batt;
    double dV_rc = ecm->V_rc - ecm->prev_V_rc;
+   double dV_rc1 = ecm->V_rck[0] - ecm->prev_V_rck[0];	/* first branch, for the R1*C1 fit */
    double dH = ecm->H - ecm->prev_H;
    double dV_oc = ecm->V_oc - ecm->prev_V_oc;
    double dI = ecm->I - ecm->prev_I;
    double R0_est=0, C1_est=0; 
+   double k[ECM_TF_W];
 
    if ( fgic->update_model_en && ecm->chg_state == REST )
    {
@@ -459,8 +515,9 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
 	 {
 	    /* adjust R0 to T_ref_C for proper table update */
 	    R0_est = -(dV_batt-dV_oc-dH+dV_rc)/dI;
-	    R0_est = util_temp_unadj(R0_est, ecm->Ea_R0, ecm->T_C, ecm->params.T_ref_C);
-            util_update_tbl(ecm->params.r0_tbl, ecm->params.soc_tbl, SOC_GRIDS, ecm->soc, R0_est);
+	    ecm_lookup_tf(ecm, ecm->soc, ecm->T_C, k);
+	    R0_est /= k[ECM_TF_R0];
+            fgic_learn_tbl(fgic, ecm->params.r0_tbl, TBL_R0, t, R0_est);
              
 	    /* clear vrc_buf */
             fgic->buf_len = 0; 
@@ -476,8 +533,8 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
 	 /* record VRC data if buffer is not full and is less 99 percent */ 
          if ( (fgic->buf_len*dt < NUM_RC*ecm->Tau) && fgic->buf_len < VRC_BUF_SZ )
 	 {
-	    fgic->vrc_x[fgic->buf_len] = ecm->V_rc;
-	    fgic->vrc_y[fgic->buf_len] = dV_rc/dt;
+	    fgic->vrc_x[fgic->buf_len] = ecm->V_rck[0];
+	    fgic->vrc_y[fgic->buf_len] = dV_rc1/dt;
 	    fgic->buf_len++;
          }
 	 /* is full and learning, learn the parameters */ 
@@ -491,10 +548,11 @@ int fgic_update(fgic_t *fgic, double T_amb_C, double t, double dt)
 	       goto _err_ret; 
 	    }
 	    C1_est = -1.0/(r.slope*ecm->R1);
-	    C1_est = util_temp_unadj(C1_est, ecm->Ea_C1, ecm->T_C, ecm->params.T_ref_C);
+	    ecm_lookup_tf(ecm, ecm->soc, ecm->T_C, k);
+	    C1_est /= k[ECM_TF_C1];
 
             /* update C1 tables */
-            util_update_tbl(ecm->params.c1_tbl, ecm->params.soc_tbl, SOC_GRIDS, ecm->soc, C1_est);
+            fgic_learn_tbl(fgic, ecm->params.c1_tbl, TBL_C1, t, C1_est);
 	    fgic->buf_len = 0;
 	    fgic->learning = false;
          }
@@ -24,6 +24,7 @@
 #include "ukf.h"
 #include "flash_params.h"
 #include "soc_ocv_lookup.h"
+#include "tbl_hist.h"
 
 
 typedef struct {
@@ -61,6 +62,7 @@ typedef struct {
    bool ukf_en;                         // enable ukf update
    bool noise_en;                       // enable noise
    bool offset_en;                      // enable offset
+   tbl_hist_t *hist;                    // learned table history (owned by sim); NULL if none
 }
 fgic_t;
 
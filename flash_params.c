@@ -18,6 +18,10 @@ flash_params_t g_batt_flash_params = {
    .r0_tbl  = { R0_TBL },
    .r1_tbl  = { R1_TBL },
    .c1_tbl  = { C1_TBL },
+   .r2_tbl  = { R2_TBL },
+   .c2_tbl  = { C2_TBL },
+   .r3_tbl  = { R3_TBL },
+   .c3_tbl  = { C3_TBL },
 
    .h_chg_tbl = { BATT_H_CHG_TBL },
    .h_dsg_tbl = { BATT_H_DSG_TBL },
@@ -38,6 +42,10 @@ flash_params_t g_fgic_flash_params = {
    .r0_tbl  = { R0_TBL },
    .r1_tbl  = { R1_TBL },
    .c1_tbl  = { C1_TBL },
+   .r2_tbl  = { R2_TBL },
+   .c2_tbl  = { C2_TBL },
+   .r3_tbl  = { R3_TBL },
+   .c3_tbl  = { C3_TBL },
 
    .h_chg_tbl = { FGIC_H_CHG_TBL },
    .h_dsg_tbl = { FGIC_H_DSG_TBL },
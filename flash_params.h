@@ -29,6 +29,10 @@ typedef struct {
    double r0_tbl[SOC_GRIDS];                    /* R0 table @ T_ref */
    double r1_tbl[SOC_GRIDS];                    /* R1 table @ T_ref */
    double c1_tbl[SOC_GRIDS];                    /* C1 table @ T_ref */
+   double r2_tbl[SOC_GRIDS];                    /* R2 table @ T_ref (2nd RC branch) */
+   double c2_tbl[SOC_GRIDS];                    /* C2 table @ T_ref */
+   double r3_tbl[SOC_GRIDS];                    /* R3 table @ T_ref (3rd RC branch) */
+   double c3_tbl[SOC_GRIDS];                    /* C3 table @ T_ref */
 
    double design_capacity;                      /* Battery design capacity */
    double v_end;                                /* End-of-discharge voltage */
@@ -24,15 +24,24 @@
 #define TEMP_0                  (25.0)          /* Degree C */
 #define VRC_BUF_SZ              (256)           /* VRC buffer size */
 #define SOC_GRIDS               (21)            /* SOC grip points */
+#define T_GRIDS			(126)		/* temperature grid points of the R0/R1/C1 factor tables */
+#define T_GRID_MIN_C		(-40.0)		/* first temperature grid point (degC) */
+#define T_GRID_STEP_C		(1.0)		/* temperature grid step (degC) */
+#define ECM_SOC_TOL		(0.0)		/* default SOC move that triggers an R0/R1/C1/OCV re-lookup */
+#define ECM_T_TOL		(0.0)		/* default temperature move (degC) that triggers a re-lookup */
 #define MAX_RUN_TIME		(10000000)	/* max simulation time in sec */
 #define FGIC_PERIOD_MS		(250)		/* FGIC run period (msec) */
 #define DEFAULT_CC		(1)		/* Default charging current (A) */
 #define DEFAULT_CV		(4.2)		/* Default charging voltage (V) */
 #define DEFAULT_I_QUIT          (0.002)         /* Quit current (A) */
-#define MAX_LINE_SZ		(200)		/* max command line size */
-#define MAX_TOKENS		(10)		/* max number of command line tokens */
-#define MAX_PARAMS		(100)		/* max number of string-enabled parameters */
+#define MAX_LINE_SZ		(512)		/* max command line size */
+#define MAX_TOKENS		(48)		/* max number of command line tokens */
+#define MAX_PARAMS		(160)		/* max number of string-enabled parameters */
 #define FN_LEN			(80)		/* logfile name length */
+#define MAX_LOGS		(8)		/* max number of concurrent log sinks */
+#define PLOT_FILES_MAX		(8)		/* max number of files overlaid by 'plot file' */
+#define PLOT_COMPACT_ROWS	(1<<22)		/* plots of more rows keep samples as float32 */
+#define OCV_POINTS		(10001)		/* default grid points of an OCV curve loaded from a log */
 #define MAX_PLOT_PTS		(200000)	/* max number of string-enabled parameters */
 #define DEFAULT_H_CHG		(0.02)		/* default OCV chg hysteresis */
 #define DEFAULT_H_DSG		(-0.02)		/* default OCV dsg hysteresis */
@@ -54,7 +63,17 @@
 #define R0_TBL			NMC_R0_TBL	/* R0 table */
 #define R1_TBL			NMC_R1_TBL	/* R1 table */
 #define C1_TBL			NMC_C1_TBL	/* C1 table */
+#define R2_TBL			SI_R2_TBL	/* R2 table (2nd RC branch) */
+#define C2_TBL			SI_C2_TBL	/* C2 table */
+#define R3_TBL			SI_R3_TBL	/* R3 table (3rd RC branch) */
+#define C3_TBL			SI_C3_TBL	/* C3 table */
+#define DEFAULT_N_RC		(1)		/* default number of RC branches (1..ECM_RC_MAX) */
+#define P_VRC_SLOW		(1e-6)		/* UKF initial variance of the 2nd, 3rd branch V_rc (V^2) */
+#define Q_VRC_SLOW		(1e-10)		/* UKF process noise of the 2nd, 3rd branch V_rc (V^2) */
 #define ALPHA_H			(0.5)		/* OCV hysteresis transient dynamics */
+#define DEFAULT_PACK_SD_R	(0.05)		/* default pack cell-to-cell sd of R (relative) */
+#define DEFAULT_PACK_SD_Q	(0.02)		/* default pack cell-to-cell sd of capacity (relative) */
+#define DEFAULT_PACK_SD_V	(0.002)		/* default pack cell-to-cell sd of OCV (V) */
 
 #define Q_DESIGN		(4.0)		/* 4 Ah */
 #define DEFAULT_SYS_LOAD	SYS_LOAD_CC	/* default system load type */
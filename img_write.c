@@ -0,0 +1,420 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		img_write.c
+ *
+ *  @brief		PNG and PPM image file writer
+ *
+ *  @note		Self-contained so headless plots need nothing beyond SDL and SDL_ttf.  PNG data is
+ *			written as one deflate block with the fixed Huffman codes (RFC 1951 3.2.6); a greedy
+ *			LZ77 pass with a single-candidate hash finds the long runs and repeated rows that make
+ *			up most of a chart.
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "img_write.h"
+
+
+#define IMG_WINDOW		(32768)		/* deflate max match distance */
+#define IMG_MAX_MATCH		(258)
+#define IMG_MIN_MATCH		(3)
+#define IMG_HASH_BITS		(15)
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Deflate length (257..285) and distance (0..29) codes: base value and extra bits
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static const uint16_t len_base[29] =
+{
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] =
+{
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] =
+{
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+   4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] =
+{
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * LSB-first bit writer into a buffer sized for the worst case
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct
+{
+   uint8_t *buf;
+   size_t n;
+   uint64_t bits;
+   int nbits;
+}
+bitw_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void put_bits(bitw_t *bw, uint32_t v, int n)
+ *
+ *  @brief	Append the n low bits of v
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void put_bits(bitw_t *bw, uint32_t v, int n)
+{
+   bw->bits |= (uint64_t)v << bw->nbits;
+   bw->nbits += n;
+   while (bw->nbits >= 8)
+   {
+      bw->buf[bw->n++] = (uint8_t)bw->bits;
+      bw->bits >>= 8;
+      bw->nbits -= 8;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint32_t bit_rev(uint32_t c, int n)
+ *
+ *  @brief	Reverse the n low bits of c (Huffman codes are packed MSB first)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+uint32_t bit_rev(uint32_t c, int n)
+{
+   uint32_t r = 0;
+   for (int i = 0; i < n; i++, c >>= 1) r = (r << 1) | (c & 1);
+   return r;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void fixed_codes(uint16_t *code, uint8_t *len)
+ *
+ *  @brief	Fixed literal/length Huffman codes 0..287, bit-reversed ready for put_bits()
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void fixed_codes(uint16_t *code, uint8_t *len)
+{
+   for (int v = 0; v < 288; v++)
+   {
+      uint32_t c;
+      int n;
+      if (v < 144)      { c = 0x30 + v;          n = 8; }
+      else if (v < 256) { c = 0x190 + (v - 144); n = 9; }
+      else if (v < 280) { c = v - 256;           n = 7; }
+      else              { c = 0xC0 + (v - 280);  n = 8; }
+      code[v] = (uint16_t)bit_rev(c, n);
+      len[v] = (uint8_t)n;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		size_t deflate_fixed(const uint8_t *src, size_t n, uint8_t *dst)
+ *
+ *  @brief	Compress src into a single final fixed-Huffman deflate block
+ *
+ *  @note	dst must hold n * 4 / 3 + 16 bytes (a 3-byte match costs at most 31 bits)
+ *
+ *  @return	compressed size; 0 if out of memory
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+size_t deflate_fixed(const uint8_t *src, size_t n, uint8_t *dst)
+{
+   uint16_t code[288];
+   uint8_t clen[288];
+   uint8_t len_sym[IMG_MAX_MATCH + 1];
+   bitw_t bw = { dst, 0, 0, 0 };
+
+   int32_t *head = (int32_t *)malloc(sizeof(int32_t) << IMG_HASH_BITS);
+   if (head == NULL) return 0;
+   memset(head, 0xFF, sizeof(int32_t) << IMG_HASH_BITS);
+
+   fixed_codes(code, clen);
+   for (int s = 0, l = IMG_MIN_MATCH; l <= IMG_MAX_MATCH; l++)
+   {
+      while (s < 28 && l >= len_base[s+1]) s++;
+      len_sym[l] = (uint8_t)s;
+   }
+
+   put_bits(&bw, 1, 1);		/* BFINAL */
+   put_bits(&bw, 1, 2);		/* BTYPE = fixed Huffman */
+
+   for (size_t i = 0; i < n; )
+   {
+      size_t best = 0, dist = 0;
+
+      if (i + IMG_MIN_MATCH <= n)
+      {
+         uint32_t h = ((src[i] << 16 | src[i+1] << 8 | src[i+2]) * 2654435761u) >> (32 - IMG_HASH_BITS);
+         int32_t cand = head[h];
+         head[h] = (int32_t)i;
+
+         if (cand >= 0 && i - (size_t)cand <= IMG_WINDOW)
+         {
+            size_t max = (n - i < IMG_MAX_MATCH) ? n - i : IMG_MAX_MATCH;
+            const uint8_t *a = &src[cand], *b = &src[i];
+            while (best < max && a[best] == b[best]) best++;
+            dist = i - (size_t)cand;
+         }
+      }
+
+      if (best < IMG_MIN_MATCH)
+      {
+         put_bits(&bw, code[src[i]], clen[src[i]]);
+         i++;
+         continue;
+      }
+
+      int ls = len_sym[best];
+      put_bits(&bw, code[257 + ls], clen[257 + ls]);
+      put_bits(&bw, (uint32_t)(best - len_base[ls]), len_extra[ls]);
+
+      int ds = 0;
+      while (ds < 29 && dist >= dist_base[ds+1]) ds++;
+      put_bits(&bw, bit_rev((uint32_t)ds, 5), 5);
+      put_bits(&bw, (uint32_t)(dist - dist_base[ds]), dist_extra[ds]);
+
+      // index the positions inside the match so following rows can refer to them
+      for (size_t k = i + 1; k < i + best && k + IMG_MIN_MATCH <= n; k++)
+      {
+         uint32_t h = ((src[k] << 16 | src[k+1] << 8 | src[k+2]) * 2654435761u) >> (32 - IMG_HASH_BITS);
+         head[h] = (int32_t)k;
+      }
+      i += best;
+   }
+
+   put_bits(&bw, code[256], clen[256]);	/* end of block */
+   if (bw.nbits > 0) put_bits(&bw, 0, 8 - bw.nbits);
+
+   free(head);
+   return bw.n;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n)
+ *
+ *  @brief	CRC-32 (ISO 3309) as used by PNG chunks
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n)
+{
+   static uint32_t table[256];
+   static int table_ok = 0;
+
+   if (!table_ok)
+   {
+      for (uint32_t i = 0; i < 256; i++)
+      {
+         uint32_t c = i;
+         for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+         table[i] = c;
+      }
+      table_ok = 1;
+   }
+
+   crc = ~crc;
+   for (size_t i = 0; i < n; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+   return ~crc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void put_be32(uint8_t *p, uint32_t v)
+ *
+ *  @brief	Store big-endian u32
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void put_be32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v >> 24);
+   p[1] = (uint8_t)(v >> 16);
+   p[2] = (uint8_t)(v >> 8);
+   p[3] = (uint8_t)v;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int write_chunk(FILE *fp, const char *type, const uint8_t *data, size_t n)
+ *
+ *  @brief	Write one PNG chunk: length, type, data, CRC
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int write_chunk(FILE *fp, const char *type, const uint8_t *data, size_t n)
+{
+   uint8_t hdr[8], crc[4];
+
+   put_be32(hdr, (uint32_t)n);
+   memcpy(&hdr[4], type, 4);
+   put_be32(crc, crc32_update(crc32_update(0, &hdr[4], 4), data, n));
+
+   if (fwrite(hdr, 1, 8, fp) != 8) return -3;
+   if (n > 0 && fwrite(data, 1, n, fp) != n) return -3;
+   if (fwrite(crc, 1, 4, fp) != 4) return -3;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int img_write_png(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+ *
+ *  @brief	Write an RGB image as PNG
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write_png(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+{
+   static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+   int rc = 0;
+   FILE *fp = NULL;
+   uint8_t *raw = NULL, *z = NULL;
+
+   if (fn == NULL || rgb == NULL || w <= 0 || h <= 0 || pitch < 3*w) return -1;
+
+   // Scanlines with the Sub filter: flat runs become zeros
+   size_t row = 1 + (size_t)w * 3, n = row * (size_t)h;
+   raw = (uint8_t *)malloc(n);
+   z = (uint8_t *)malloc(2 + n + n / 3 + 16 + 4);
+   if (raw == NULL || z == NULL) { rc = -4; goto _err_ret; }
+
+   for (int y = 0; y < h; y++)
+   {
+      const uint8_t *s = &rgb[(size_t)y * pitch];
+      uint8_t *d = &raw[(size_t)y * row];
+      d[0] = 1;
+      for (int k = 0; k < 3; k++) d[1+k] = s[k];
+      for (size_t k = 3; k < (size_t)w * 3; k++) d[1+k] = (uint8_t)(s[k] - s[k-3]);
+   }
+
+   // zlib stream: header, deflate block, Adler-32
+   z[0] = 0x78;
+   z[1] = 0x01;
+   size_t zn = deflate_fixed(raw, n, &z[2]);
+   if (zn == 0) { rc = -4; goto _err_ret; }
+   zn += 2;
+
+   uint32_t a = 1, b = 0;
+   for (size_t i = 0; i < n; )
+   {
+      size_t end = (n - i > 5552) ? i + 5552 : n;
+      for (; i < end; i++) { a += raw[i]; b += a; }
+      a %= 65521;
+      b %= 65521;
+   }
+   put_be32(&z[zn], (b << 16) | a);
+   zn += 4;
+
+   uint8_t ihdr[13];
+   put_be32(&ihdr[0], (uint32_t)w);
+   put_be32(&ihdr[4], (uint32_t)h);
+   ihdr[8] = 8;		/* bit depth */
+   ihdr[9] = 2;		/* RGB */
+   ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+   fp = fopen(fn, "wb");
+   if (fp == NULL) { rc = -2; goto _err_ret; }
+
+   if (fwrite(sig, 1, 8, fp) != 8) { rc = -3; goto _err_ret; }
+   if ((rc = write_chunk(fp, "IHDR", ihdr, 13)) != 0) goto _err_ret;
+   if ((rc = write_chunk(fp, "IDAT", z, zn)) != 0) goto _err_ret;
+   if ((rc = write_chunk(fp, "IEND", NULL, 0)) != 0) goto _err_ret;
+
+_err_ret:
+   if (fp != NULL && fclose(fp) != 0 && rc == 0) rc = -3;
+   free(raw);
+   free(z);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int img_write_ppm(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+ *
+ *  @brief	Write an RGB image as binary PPM
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write_ppm(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+{
+   int rc = 0;
+
+   if (fn == NULL || rgb == NULL || w <= 0 || h <= 0 || pitch < 3*w) return -1;
+
+   FILE *fp = fopen(fn, "wb");
+   if (fp == NULL) return -2;
+
+   if (fprintf(fp, "P6\n%d %d\n255\n", w, h) < 0) rc = -3;
+   for (int y = 0; y < h && rc == 0; y++)
+   {
+      if (fwrite(&rgb[(size_t)y * pitch], 3, (size_t)w, fp) != (size_t)w) rc = -3;
+   }
+
+   if (fclose(fp) != 0 && rc == 0) rc = -3;
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int img_write(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+ *
+ *  @brief	Write PPM or PNG by file extension
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write(const char *fn, int w, int h, const uint8_t *rgb, int pitch)
+{
+   if (fn == NULL) return -1;
+
+   size_t n = strlen(fn);
+   if (n > 4 && 0 == strcmp(&fn[n-4], ".ppm")) return img_write_ppm(fn, w, h, rgb, pitch);
+   return img_write_png(fn, w, h, rgb, pitch);
+}
@@ -0,0 +1,51 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		img_write.h
+ *
+ *  @brief		PNG and PPM image file writer
+ *
+ *=====================================================================================================================
+ */
+#ifndef __IMG_WRITE_H__
+#define __IMG_WRITE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write a w x h RGB image (3 bytes per pixel, rows 'pitch' bytes apart) as an 8-bit RGB PNG.  The image data
+ * is Sub-filtered and deflated (LZ77 + fixed Huffman codes), which suits plots with large flat areas.
+ *
+ * Returns 0 if success; -1 bad args, -2 cannot open, -3 write error, -4 out of memory
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write_png(const char *fn, int w, int h, const uint8_t *rgb, int pitch);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write a w x h RGB image as a binary PPM (P6).  Same arguments and return codes as img_write_png().
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write_ppm(const char *fn, int w, int h, const uint8_t *rgb, int pitch);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Write PPM if 'fn' ends in .ppm, PNG otherwise
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int img_write(const char *fn, int w, int h, const uint8_t *rgb, int pitch);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __IMG_WRITE_H__
@@ -0,0 +1,709 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logger.c
+ *
+ *  @brief		Data logger implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "globals.h"
+#include "dtoa.h"
+#include "logger.h"
+
+
+#define LOG_FBUF_SZ		(1<<16)
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_find(const logger_t *lg, int params_sz, const char *name)
+ *
+ *  @brief	Find a parameter by name
+ *
+ *  @return	param index; negative if not found
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logger_find(const logger_t *lg, int params_sz, const char *name)
+{
+   for (int i=0; i < params_sz; i++)
+      if (0==strcmp(name, lg->params[i].name)) return i;
+
+   return -1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int log_type_parse(const char *type, log_type_t *out)
+ *
+ *  @brief	Resolve a param type string
+ *
+ *  @return	0 if success; negative if the type cannot be logged
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int log_type_parse(const char *type, log_type_t *out)
+{
+   if (0==strcmp(type, "%b"))       *out = LOG_T_BOOL;
+   else if (0==strcmp(type, "%d"))  *out = LOG_T_INT;
+   else if (0==strcmp(type, "%ld")) *out = LOG_T_LONG;
+   else if (0==strcmp(type, "%f"))  *out = LOG_T_FLOAT;
+   else if (0==strcmp(type, "%lf")) *out = LOG_T_DOUBLE;
+   else return -1;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logger_cond(const cond_t *c, double v)
+ *
+ *  @brief	Evaluate a trigger against value v
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+bool logger_cond(const cond_t *c, double v)
+{
+   switch (c->compare)
+   {
+      case EQ:  return (v == c->value);
+      case GT:  return (v > c->value);
+      case GTE: return (v >= c->value);
+      case LT:  return (v < c->value);
+      case LTE: return (v <= c->value);
+      default:  return false;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logger_write_row(logger_t *lg, double t, const double *v, bool as_double)
+ *
+ *  @brief	Write one row.  Integral columns are printed as integers unless as_double is set (bucket means 
+ *		are fractional).
+ *
+ *  @note	The row is formatted into lg->row and written with a single fwrite().  Doubles use the shortest
+ *		string that reads back exactly, so the log is both smaller and more precise than "%lf".
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logger_write_row(logger_t *lg, double t, const double *v, bool as_double)
+{
+   if (lg->z != NULL)
+   {
+      logz_write_row(lg->z, t, v);
+      lg->rows++;
+      return;
+   }
+
+   int len = dtoa_row(t, v, lg->n, as_double ? NULL : lg->as_long, lg->row);
+
+   fwrite(lg->row, 1, (size_t)len, lg->fp);
+   lg->rows++;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logger_flush_bkt(logger_t *lg)
+ *
+ *  @brief	Emit the current bucket (min/max or mean) and reset it
+ *
+ *  @note	In min/max mode a bucket is written as two rows: for each column the extremum seen first goes in
+ *		the first row and the other one in the second, so a plot of the rows traces the same envelope as
+ *		the full-rate signal.  A flat bucket collapses to a single row.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logger_flush_bkt(logger_t *lg)
+{
+   double v0[MAX_PARAMS] = {0}, v1[MAX_PARAMS] = {0};
+
+   if (lg->bkt_n == 0) return;
+
+   if (lg->dec == LOG_DEC_MEAN)
+   {
+      for (int i=0; i<lg->n; i++) v0[i] = lg->v_sum[i] / lg->bkt_n;
+      logger_write_row(lg, lg->t_sum / lg->bkt_n, v0, true);
+   }
+   else
+   {
+      double t0 = 0.0, t1 = 0.0;
+      bool flat = true;
+
+      for (int i=0; i<lg->n; i++)
+      {
+         bool min_first = (lg->t_min[i] <= lg->t_max[i]);
+         double ta = min_first ? lg->t_min[i] : lg->t_max[i];
+         double tb = min_first ? lg->t_max[i] : lg->t_min[i];
+
+         v0[i] = min_first ? lg->v_min[i] : lg->v_max[i];
+         v1[i] = min_first ? lg->v_max[i] : lg->v_min[i];
+
+         if (i == 0 || ta < t0) t0 = ta;
+         if (i == 0 || tb > t1) t1 = tb;
+         if (v0[i] != v1[i]) flat = false;
+      }
+
+      logger_write_row(lg, t0, v0, false);
+      if (!flat) logger_write_row(lg, t1, v1, false);
+   }
+
+   lg->bkt_n = 0;
+   lg->t_sum = 0.0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logger_t *logger_create(const char *name, const char *fn, params_t *params)
+ *
+ *  @brief	Create a log sink 'name' writing to file 'fn'.  Columns are added with logger_add_col(); the file is
+ *		not opened until logger_start().  A file name ending in LOGZ_EXT selects the compressed log format.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logger_t *logger_create(const char *name, const char *fn, params_t *params)
+{
+   if (name == NULL || fn == NULL || params == NULL) return NULL;
+   if (strlen(name) == 0 || strlen(name) >= NAME_LEN || strlen(fn) >= FN_LEN) return NULL;
+
+   logger_t *lg = (logger_t *)calloc(1, sizeof(logger_t));
+   if (lg == NULL) return NULL;
+
+   strcpy(lg->name, name);
+   strcpy(lg->fn, fn);
+   lg->params = params;
+   lg->dec = LOG_DEC_NONE;
+   lg->every = 1;
+
+   return lg;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_add_col(logger_t *lg, int params_sz, const char *spec)
+ *
+ *  @brief	Add a log column.  'spec' is <param>[:<deadband>]; the deadband is only used in on-change mode.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logger_add_col(logger_t *lg, int params_sz, const char *spec)
+{
+   char name[NAME_LEN];
+   double db = 0.0;
+
+   if (lg == NULL || spec == NULL) return -1;
+   if (lg->n >= MAX_PARAMS) return -2;
+
+   const char *colon = strchr(spec, ':');
+   size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+   if (len == 0 || len >= NAME_LEN) return -3;
+
+   memcpy(name, spec, len);
+   name[len] = '\0';
+
+   if (colon != NULL)
+   {
+      char *endptr;
+      db = strtod(colon+1, &endptr);
+      if (endptr == colon+1 || db < 0.0) return -4;
+   }
+
+   int i = logger_find(lg, params_sz, name);
+   if (i < 0) return -5;
+   if (log_type_parse(lg->params[i].type, &lg->type[lg->n]) != 0) return -6;
+
+   lg->ptr[lg->n] = lg->params[i].value;
+   lg->as_long[lg->n] = (lg->type[lg->n] <= LOG_T_LONG);
+   lg->idx[lg->n] = i;
+   lg->db[lg->n] = db;
+   lg->n++;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_set_dec(logger_t *lg, log_dec_t dec, double arg)
+ *
+ *  @brief	Set decimation mode.  'arg' is the step count for LOG_DEC_EVERY and the interval/bucket width
+ *		in seconds for LOG_DEC_INTERVAL, LOG_DEC_MINMAX and LOG_DEC_MEAN.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logger_set_dec(logger_t *lg, log_dec_t dec, double arg)
+{
+   if (lg == NULL) return -1;
+
+   if (dec == LOG_DEC_EVERY)
+   {
+      if (arg < 1.0) return -2;
+      lg->every = (int)arg;
+   }
+   else if (dec == LOG_DEC_INTERVAL || dec == LOG_DEC_MINMAX || dec == LOG_DEC_MEAN)
+   {
+      if (arg <= 0.0) return -2;
+      lg->width = arg;
+   }
+
+   lg->dec = dec;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_set_trigger(logger_t *lg, int params_sz, bool is_stop, const char *param, 
+ *				       enum LOP compare, double val)
+ *
+ *  @brief	Set the start (or stop) trigger '<param> <compare> <val>'.  A sink with a start trigger writes
+ *		nothing until the trigger is first true; a stop trigger ends the log (file closed) the first time
+ *		it is true after the start.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logger_set_trigger(logger_t *lg, int params_sz, bool is_stop, const char *param, enum LOP compare, double val)
+{
+   log_type_t type;
+
+   if (lg == NULL || param == NULL) return -1;
+   if (compare != EQ && compare != GT && compare != GTE && compare != LT && compare != LTE) return -2;
+
+   int i = logger_find(lg, params_sz, param);
+   if (i < 0) return -3;
+   if (log_type_parse(lg->params[i].type, &type) != 0) return -4;
+
+   cond_t *c = is_stop ? &lg->stop : &lg->start;
+   c->lop = NOP;
+   strcpy(c->param, lg->params[i].name);
+   c->compare = compare;
+   c->value = val;
+
+   if (is_stop) lg->stop_idx = i;
+   else lg->start_idx = i;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_start(logger_t *lg)
+ *
+ *  @brief	Open the file and write the CSV header, or the compressed log header for a LOGZ_EXT file
+ *
+ *  @return	0 if success; -2 if out of memory; -3 if the file can't be opened
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logger_start(logger_t *lg)
+{
+   if (lg == NULL || lg->fp != NULL) return -1;
+
+   /* worst case row: every field at full width plus separators */
+   lg->row = (char *)malloc((size_t)(lg->n + 1) * (DTOA_BUF_SZ + 1) + 1);
+   if (lg->row == NULL) return -2;
+
+   lg->fp = fopen(lg->fn, "w");
+   if (lg->fp == NULL) return -3;
+
+   lg->fbuf = (char *)malloc(LOG_FBUF_SZ);
+   if (lg->fbuf != NULL) setvbuf(lg->fp, lg->fbuf, _IOFBF, LOG_FBUF_SZ);
+
+   lg->state = (lg->start.compare != NOP) ? LOG_ST_WAIT : LOG_ST_RUN;
+
+   if (logz_has_ext(lg->fn))
+   {
+      const char *names[MAX_PARAMS];
+      for (int i=0; i<lg->n; i++) names[i] = lg->params[lg->idx[i]].name;
+
+      lg->z = logz_writer_create(lg->fp, "t", lg->n, names, LOGZ_BLK_ROWS);
+      return (lg->z != NULL) ? 0 : -2;
+   }
+
+   fprintf(lg->fp, "t");
+   for (int i=0; i<lg->n; i++)
+      fprintf(lg->fp, ",%s", lg->params[lg->idx[i]].name);
+   fprintf(lg->fp, "\n");
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logger_update(logger_t *lg, double t, const double *pv)
+ *
+ *  @brief	Take all columns at time t from the param snapshot pv[] (indexed by param) and write rows 
+ *		according to the triggers and decimation mode
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logger_update(logger_t *lg, double t, const double *pv)
+{
+   double v[MAX_PARAMS];
+
+   if (lg == NULL || pv == NULL) return -1;
+   if (lg->state == LOG_ST_DONE) return 0;
+   if (lg->fp == NULL || lg->row == NULL) return -1;
+
+   if (lg->state == LOG_ST_WAIT)
+   {
+      if (!logger_cond(&lg->start, pv[lg->start_idx])) return 0;
+      lg->state = LOG_ST_RUN;
+   }
+
+   for (int i=0; i<lg->n; i++)
+      v[i] = pv[lg->idx[i]];
+
+   switch (lg->dec)
+   {
+      case LOG_DEC_NONE:
+         logger_write_row(lg, t, v, false);
+         break;
+
+      case LOG_DEC_EVERY:
+         if (lg->steps % lg->every == 0)
+            logger_write_row(lg, t, v, false);
+         break;
+
+      case LOG_DEC_INTERVAL:
+         if (lg->steps == 0 || t >= lg->t_bkt)
+         {
+            logger_write_row(lg, t, v, false);
+            lg->t_bkt = (lg->steps == 0) ? t + lg->width
+                                         : lg->t_bkt + lg->width * (floor((t - lg->t_bkt)/lg->width) + 1.0);
+         }
+         break;
+
+      case LOG_DEC_MINMAX:
+      case LOG_DEC_MEAN:
+         if (lg->steps == 0)
+         {
+            lg->t_bkt = t;
+         }
+         else if (t >= lg->t_bkt + lg->width)
+         {
+            logger_flush_bkt(lg);
+            lg->t_bkt += lg->width * floor((t - lg->t_bkt)/lg->width);
+         }
+
+         for (int i=0; i<lg->n; i++)
+         {
+            if (lg->bkt_n == 0 || v[i] < lg->v_min[i]) { lg->v_min[i] = v[i]; lg->t_min[i] = t; }
+            if (lg->bkt_n == 0 || v[i] > lg->v_max[i]) { lg->v_max[i] = v[i]; lg->t_max[i] = t; }
+            lg->v_sum[i] = (lg->bkt_n == 0) ? v[i] : lg->v_sum[i] + v[i];
+         }
+         lg->t_sum += t;
+         lg->bkt_n++;
+         break;
+
+      case LOG_DEC_ONCHANGE:
+      {
+         bool changed = !lg->have_last;
+         for (int i=0; i<lg->n && !changed; i++)
+            changed = (fabs(v[i] - lg->v_last[i]) > lg->db[i]);
+
+         if (changed)
+         {
+            /* write the last held sample first so steps stay sharp in a plot */
+            if (lg->held) logger_write_row(lg, lg->t_held, lg->v_held, false);
+            logger_write_row(lg, t, v, false);
+            memcpy(lg->v_last, v, lg->n*sizeof(double));
+            lg->have_last = true;
+            lg->held = false;
+         }
+         else
+         {
+            memcpy(lg->v_held, v, lg->n*sizeof(double));
+            lg->t_held = t;
+            lg->held = true;
+         }
+         break;
+      }
+   }
+
+   lg->steps++;
+
+   /* the row that fires the stop trigger is the last one logged */
+   if (lg->stop.compare != NOP && logger_cond(&lg->stop, pv[lg->stop_idx]))
+      logger_finish(lg);
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logger_finish(logger_t *lg)
+ *
+ *  @brief	Flush any pending bucket or held sample and close the file.  The sink stays in its set (state 
+ *		LOG_ST_DONE) so its row counts can still be reported.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logger_finish(logger_t *lg)
+{
+   if (lg == NULL || lg->fp == NULL) return;
+
+   if (lg->row != NULL)
+   {
+      if (lg->dec == LOG_DEC_MINMAX || lg->dec == LOG_DEC_MEAN)
+         logger_flush_bkt(lg);
+      else if (lg->dec == LOG_DEC_ONCHANGE && lg->held)
+         logger_write_row(lg, lg->t_held, lg->v_held, false);
+   }
+
+   logz_writer_destroy(lg->z);
+   lg->z = NULL;
+   fclose(lg->fp);
+   lg->fp = NULL;
+   lg->state = LOG_ST_DONE;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logger_destroy(logger_t *lg)
+ *
+ *  @brief	Finish the log if still open and free the logger
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logger_destroy(logger_t *lg)
+{
+   if (lg == NULL) return;
+
+   logger_finish(lg);
+
+   free(lg->row);
+   free(lg->fbuf);
+   free(lg);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logset_index(logset_t *ls)
+ *
+ *  @brief	Rebuild the list of params read each step from the columns and triggers of all sinks
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logset_index(logset_t *ls)
+{
+   bool use[MAX_PARAMS] = {false};
+
+   for (int k=0; k<ls->n; k++)
+   {
+      logger_t *lg = ls->lg[k];
+
+      for (int i=0; i<lg->n; i++)
+      {
+         int j = lg->idx[i];
+         use[j] = true;
+         ls->type[j] = lg->type[i];
+         ls->ptr[j] = lg->ptr[i];
+      }
+
+      const int trig[2] = { (lg->start.compare != NOP) ? lg->start_idx : -1, 
+                            (lg->stop.compare != NOP) ? lg->stop_idx : -1 };
+      for (int i=0; i<2; i++)
+      {
+         int j = trig[i];
+         if (j < 0 || use[j]) continue;
+         if (log_type_parse(lg->params[j].type, &ls->type[j]) != 0) continue;
+         use[j] = true;
+         ls->ptr[j] = lg->params[j].value;
+      }
+   }
+
+   ls->n_used = 0;
+   for (int j=0; j<MAX_PARAMS; j++)
+      if (use[j]) ls->used[ls->n_used++] = j;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logger_t *logset_find(logset_t *ls, const char *name)
+ *
+ *  @brief	Find a sink by name
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logger_t *logset_find(logset_t *ls, const char *name)
+{
+   if (ls == NULL || name == NULL) return NULL;
+
+   for (int k=0; k<ls->n; k++)
+      if (0==strcmp(ls->lg[k]->name, name)) return ls->lg[k];
+
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logger_t *logset_find_fn(logset_t *ls, const char *fn)
+ *
+ *  @brief	Find a sink by file name
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logger_t *logset_find_fn(logset_t *ls, const char *fn)
+{
+   if (ls == NULL || fn == NULL) return NULL;
+
+   for (int k=0; k<ls->n; k++)
+      if (0==strcmp(ls->lg[k]->fn, fn)) return ls->lg[k];
+
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logset_add(logset_t *ls, logger_t *lg, logger_t **old)
+ *
+ *  @brief	Add a started sink.  A sink with the same name is replaced and returned in *old for the caller 
+ *		to destroy outside any lock.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logset_add(logset_t *ls, logger_t *lg, logger_t **old)
+{
+   if (ls == NULL || lg == NULL || old == NULL) return -1;
+
+   *old = NULL;
+   for (int k=0; k<ls->n; k++)
+   {
+      if (0==strcmp(ls->lg[k]->name, lg->name))
+      {
+         *old = ls->lg[k];
+         ls->lg[k] = lg;
+         logset_index(ls);
+         return 0;
+      }
+   }
+
+   if (ls->n >= MAX_LOGS) return -2;
+
+   ls->lg[ls->n++] = lg;
+   logset_index(ls);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logger_t *logset_remove(logset_t *ls, const char *name)
+ *
+ *  @brief	Detach sink 'name' and return it for the caller to destroy; NULL if not found
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logger_t *logset_remove(logset_t *ls, const char *name)
+{
+   if (ls == NULL || name == NULL) return NULL;
+
+   for (int k=0; k<ls->n; k++)
+   {
+      if (0==strcmp(ls->lg[k]->name, name))
+      {
+         logger_t *lg = ls->lg[k];
+         memmove(&ls->lg[k], &ls->lg[k+1], (size_t)(ls->n - k - 1) * sizeof(logger_t *));
+         ls->n--;
+         logset_index(ls);
+         return lg;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logset_update(logset_t *ls, double t)
+ *
+ *  @brief	Read every used param once, then feed all sinks from the snapshot
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logset_update(logset_t *ls, double t)
+{
+   if (ls == NULL || ls->n == 0) return;
+
+   for (int k=0; k<ls->n_used; k++)
+   {
+      int j = ls->used[k];
+      ls->pv[j] = log_val(ls->type[j], ls->ptr[j]);
+   }
+
+   for (int k=0; k<ls->n; k++)
+      logger_update(ls->lg[k], t, ls->pv);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logset_clear(logset_t *ls)
+ *
+ *  @brief	Finish and destroy all sinks
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logset_clear(logset_t *ls)
+{
+   if (ls == NULL) return;
+
+   for (int k=0; k<ls->n; k++) logger_destroy(ls->lg[k]);
+   ls->n = 0;
+   ls->n_used = 0;
+}
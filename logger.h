@@ -0,0 +1,178 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logger.h
+ *
+ *  @brief		Data logger header
+ *
+ *=====================================================================================================================
+ */
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "globals.h"
+#include "logz.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Decimation modes
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef enum {
+   LOG_DEC_NONE = 0,		/* every step */
+   LOG_DEC_EVERY,		/* every n-th step */
+   LOG_DEC_INTERVAL,		/* first sample of each interval */
+   LOG_DEC_MINMAX,		/* min and max of each bucket (peak preserving) */
+   LOG_DEC_MEAN,		/* mean of each bucket */
+   LOG_DEC_ONCHANGE		/* only when a column moves past its deadband */
+}
+log_dec_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Column value types, resolved from the param type string once when the column is added
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef enum {
+   LOG_T_BOOL = 0,		/* %b */
+   LOG_T_INT,			/* %d */
+   LOG_T_LONG,			/* %ld */
+   LOG_T_FLOAT,			/* %f */
+   LOG_T_DOUBLE			/* %lf */
+}
+log_type_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Read a parameter value of a resolved type as double
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+double log_val(log_type_t type, const void *ptr)
+{
+   switch (type)
+   {
+      case LOG_T_BOOL:   return (double)(*(const bool *)ptr);
+      case LOG_T_INT:    return (double)(*(const int *)ptr);
+      case LOG_T_LONG:   return (double)(*(const long *)ptr);
+      case LOG_T_FLOAT:  return (double)(*(const float *)ptr);
+      case LOG_T_DOUBLE: return *(const double *)ptr;
+   }
+
+   return 0.0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Sink state with respect to its start/stop triggers
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef enum {
+   LOG_ST_WAIT = 0,		/* waiting for start trigger */
+   LOG_ST_RUN,			/* logging */
+   LOG_ST_DONE			/* stop trigger fired; file closed */
+}
+log_state_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Logger object
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   char name[NAME_LEN];		/* sink name */
+   FILE *fp;			/* log file pointer */
+   char fn[FN_LEN];		/* log file name */
+
+   params_t *params;		/* string-enabled parameters (owned by sim) */
+   int n;			/* num of log columns */
+   int idx[MAX_PARAMS];		/* param index per column */
+   log_type_t type[MAX_PARAMS];	/* value type per column */
+   bool as_long[MAX_PARAMS];	/* column written as an integer (bool, int, long) */
+   const void *ptr[MAX_PARAMS];	/* value pointer per column */
+   double db[MAX_PARAMS];	/* on-change deadband per column */
+
+   logz_writer_t *z;		/* compressed writer; NULL for CSV */
+   char *row;			/* reusable row buffer */
+   char *fbuf;			/* stdio buffer for fp */
+
+   log_dec_t dec;		/* decimation mode */
+   int every;			/* LOG_DEC_EVERY step count */
+   double width;		/* interval/bucket width in secs */
+
+   cond_t start;		/* start trigger; compare NOP if none */
+   cond_t stop;			/* stop trigger; compare NOP if none */
+   int start_idx;		/* start trigger param index */
+   int stop_idx;		/* stop trigger param index */
+   log_state_t state;		/* trigger state */
+
+   long steps;			/* steps seen since start */
+   long rows;			/* rows written since start */
+
+   /* interval and bucket state */
+   double t_bkt;		/* current bucket (or next interval) start */
+   int bkt_n;			/* samples in current bucket */
+   double t_sum;		/* sum of t in bucket */
+   double v_sum[MAX_PARAMS];	/* sum of values in bucket */
+   double v_min[MAX_PARAMS];	/* min value in bucket */
+   double v_max[MAX_PARAMS];	/* max value in bucket */
+   double t_min[MAX_PARAMS];	/* time of min value */
+   double t_max[MAX_PARAMS];	/* time of max value */
+
+   /* on-change state */
+   bool have_last;		/* true once a row has been written */
+   double v_last[MAX_PARAMS];	/* last written values */
+   bool held;			/* true if v_held is a skipped sample */
+   double t_held;		/* time of skipped sample */
+   double v_held[MAX_PARAMS];	/* skipped sample values */
+}
+logger_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Set of concurrent log sinks.  Params used by any sink are read once per step into pv[], indexed by param, and 
+ * every sink takes its columns from there.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   logger_t *lg[MAX_LOGS];	/* sinks */
+   int n;			/* num of sinks */
+
+   int used[MAX_PARAMS];	/* param indices read each step */
+   int n_used;			/* num of used params */
+   log_type_t type[MAX_PARAMS];	/* value type per param index */
+   const void *ptr[MAX_PARAMS];	/* value pointer per param index */
+   double pv[MAX_PARAMS];	/* this step's values per param index */
+}
+logset_t;
+
+
+int log_type_parse(const char *type, log_type_t *out);
+
+logger_t *logger_create(const char *name, const char *fn, params_t *params);
+int logger_add_col(logger_t *lg, int params_sz, const char *spec);
+int logger_set_dec(logger_t *lg, log_dec_t dec, double arg);
+int logger_set_trigger(logger_t *lg, int params_sz, bool is_stop, const char *param, enum LOP compare, double val);
+int logger_start(logger_t *lg);
+int logger_update(logger_t *lg, double t, const double *pv);
+void logger_finish(logger_t *lg);
+void logger_destroy(logger_t *lg);
+
+int logset_add(logset_t *ls, logger_t *lg, logger_t **old);
+logger_t *logset_remove(logset_t *ls, const char *name);
+logger_t *logset_find(logset_t *ls, const char *name);
+logger_t *logset_find_fn(logset_t *ls, const char *fn);
+void logset_update(logset_t *ls, double t);
+void logset_clear(logset_t *ls);
+
+
+#endif // __LOGGER_H__
@@ -0,0 +1,996 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logq.c
+ *
+ *  @brief		Indexed log query implementation
+ *
+ *=====================================================================================================================
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "dtoa.h"
+#include "logz.h"
+#include "logq.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		char *logq_strdup(const char *s)
+ *
+ *  @brief	strdup (not in C11)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+char *logq_strdup(const char *s)
+{
+   size_t len = strlen(s) + 1;
+   char *d = (char *)malloc(len);
+   if (d != NULL) memcpy(d, s, len);
+   return d;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_parse_row(char *line, int ncol, double *v)
+ *
+ *  @brief	Parse a CSV row of ncol numbers into v[].  Fields that are not numbers become NaN.
+ *
+ *  @return	1 if the row has exactly ncol fields; 0 otherwise (blank or malformed row)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_parse_row(char *line, int ncol, double *v)
+{
+   char *p = line;
+
+   if (*p == '\n' || *p == '\r' || *p == '\0') return 0;
+
+   for (int i=0; i<ncol; i++)
+   {
+      char *end;
+      v[i] = strtod(p, &end);
+      if (end == p) v[i] = NAN;
+
+      end += strcspn(end, ",\r\n");
+      if (i < ncol-1)
+      {
+         if (*end != ',') return 0;
+         p = end + 1;
+      }
+      else if (*end == ',') return 0;
+   }
+
+   return 1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_alloc_chunks(logq_t *q, int64_t nchunks)
+ *
+ *  @brief	Size the chunk index and its min/max storage
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_alloc_chunks(logq_t *q, int64_t nchunks)
+{
+   size_t cap = (nchunks > 0) ? (size_t)nchunks : 1;
+
+   logq_chunk_t *c = (logq_chunk_t *)realloc(q->chunk, cap * sizeof(logq_chunk_t));
+   if (c == NULL) return -1;
+   q->chunk = c;
+
+   double *mm = (double *)realloc(q->mm, cap * 2 * (size_t)(q->n > 0 ? q->n : 1) * sizeof(double));
+   if (mm == NULL) return -1;
+   q->mm = mm;
+
+   /* min/max pointers are rebased since the storage may have moved */
+   for (int64_t i=0; i<nchunks; i++)
+   {
+      q->chunk[i].min = &q->mm[(size_t)i * 2 * q->n];
+      q->chunk[i].max = q->chunk[i].min + q->n;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logq_chunk_add(logq_chunk_t *c, int n, double t, const double *v)
+ *
+ *  @brief	Fold one row into a chunk's time range and min/max
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logq_chunk_add(logq_chunk_t *c, int n, double t, const double *v)
+{
+   if (c->rows == 0)
+   {
+      c->t_first = t;
+      for (int i=0; i<n; i++) { c->min[i] = INFINITY; c->max[i] = -INFINITY; }
+   }
+   c->t_last = t;
+   c->rows++;
+
+   for (int i=0; i<n; i++)
+   {
+      if (v[i] < c->min[i]) c->min[i] = v[i];		// NaN compares false
+      if (v[i] > c->max[i]) c->max[i] = v[i];
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_build_csv(logq_t *q)
+ *
+ *  @brief	Build the index of a CSV log in one pass.  Chunk offsets come from the summed line lengths.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_build_csv(logq_t *q)
+{
+   int64_t cap = 0, nc = 0, off;
+   double *v = q->rv;
+
+   if (fseek(q->fp, 0, SEEK_SET) != 0 || !fgets(q->line, LOGQ_LINE_SZ, q->fp)) return -2;
+   off = (int64_t)strlen(q->line);
+
+   while (fgets(q->line, LOGQ_LINE_SZ, q->fp))
+   {
+      int64_t len = (int64_t)strlen(q->line);
+
+      if (logq_parse_row(q->line, q->n + 1, v))
+      {
+         if (nc == 0 || q->chunk[nc-1].rows == LOGQ_CHUNK_ROWS)
+         {
+            if (nc == cap)
+            {
+               cap = (cap == 0) ? 256 : cap * 2;
+               if (logq_alloc_chunks(q, cap) != 0) return -1;
+            }
+            q->chunk[nc].offset = off;
+            q->chunk[nc].rows = 0;
+            nc++;
+         }
+         logq_chunk_add(&q->chunk[nc-1], q->n, v[0], &v[1]);
+      }
+
+      off += len;
+   }
+
+   q->nchunks = nc;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_build_lgz(logq_t *q)
+ *
+ *  @brief	Build the index of a compressed log; one chunk per block
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_build_lgz(logq_t *q)
+{
+   int rc;
+   int64_t cap = 0, nc = 0;
+   double t, *v = (double *)malloc(((size_t)q->n + 1) * sizeof(double));
+   if (v == NULL) return -1;
+
+   logz_rewind(q->zr);
+   while ((rc = logz_next_block(q->zr)) == 1)
+   {
+      if (q->zr->blk.rows == 0) continue;
+
+      if (nc == cap)
+      {
+         cap = (cap == 0) ? 256 : cap * 2;
+         if (logq_alloc_chunks(q, cap) != 0) { rc = -1; break; }
+      }
+
+      logq_chunk_t *c = &q->chunk[nc++];
+      c->offset = q->zr->blk.offset;
+      c->rows = 0;
+
+      if ((rc = logz_load_block(q->zr)) != 0) break;
+      for (uint32_t k=0; k<q->zr->blk.rows; k++)
+      {
+         if ((rc = logz_read_row(q->zr, &t, v)) != 1) break;
+         logq_chunk_add(c, q->n, t, v);
+      }
+      if (rc < 0) break;
+   }
+
+   q->nchunks = nc;
+   free(v);
+   return (rc < 0) ? rc : 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_load_index(logq_t *q, const char *idx_fn, const struct stat *st)
+ *
+ *  @brief	Load the sidecar index if it exists and matches the log's size and mtime
+ *
+ *  @return	0 if loaded; negative if missing, stale or unreadable
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_load_index(logq_t *q, const char *idx_fn, const struct stat *st)
+{
+   int rc = -1;
+   char magic[4];
+   uint32_t hdr[4];
+   int64_t src[3];
+
+   FILE *fp = fopen(idx_fn, "rb");
+   if (fp == NULL) return -1;
+
+   if (fread(magic, 1, 4, fp) != 4 || 0!=memcmp(magic, LOGQ_MAGIC, 4)) goto _err_ret;
+   if (fread(hdr, sizeof(uint32_t), 4, fp) != 4 || fread(src, sizeof(int64_t), 3, fp) != 3) goto _err_ret;
+   if (hdr[0] != LOGQ_VERSION || hdr[1] != (uint32_t)q->fmt || hdr[2] != (uint32_t)q->n) goto _err_ret;
+   if (src[0] != (int64_t)st->st_size || src[1] != (int64_t)st->st_mtime || src[2] < 0) goto _err_ret;
+
+   /* column names must match the log's */
+   for (int i=0; i<=q->n; i++)
+   {
+      for (const char *p = q->names[i]; ; p++)
+      {
+         int ch = fgetc(fp);
+         if (ch != (unsigned char)*p) goto _err_ret;
+         if (ch == '\0') break;
+      }
+   }
+
+   if (logq_alloc_chunks(q, src[2]) != 0) goto _err_ret;
+   for (int64_t c=0; c<src[2]; c++)
+   {
+      logq_chunk_t *ch = &q->chunk[c];
+      if (fread(&ch->offset, sizeof(int64_t), 1, fp) != 1 ||
+          fread(&ch->rows, sizeof(int64_t), 1, fp) != 1 ||
+          fread(&ch->t_first, sizeof(double), 1, fp) != 1 ||
+          fread(&ch->t_last, sizeof(double), 1, fp) != 1 ||
+          fread(ch->min, sizeof(double), (size_t)q->n * 2, fp) != (size_t)q->n * 2) goto _err_ret;
+   }
+   q->nchunks = src[2];
+   rc = 0;
+
+_err_ret:
+   fclose(fp);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_save_index(const logq_t *q, const char *idx_fn, const struct stat *st)
+ *
+ *  @brief	Write the sidecar index
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_save_index(const logq_t *q, const char *idx_fn, const struct stat *st)
+{
+   uint32_t hdr[4] = { LOGQ_VERSION, (uint32_t)q->fmt, (uint32_t)q->n, 0 };
+   int64_t src[3] = { (int64_t)st->st_size, (int64_t)st->st_mtime, q->nchunks };
+
+   hdr[3] = (q->fmt == LOGQ_LGZ) ? (uint32_t)q->zr->blk_rows : LOGQ_CHUNK_ROWS;
+
+   FILE *fp = fopen(idx_fn, "wb");
+   if (fp == NULL) return -1;
+
+   fwrite(LOGQ_MAGIC, 1, 4, fp);
+   fwrite(hdr, sizeof(uint32_t), 4, fp);
+   fwrite(src, sizeof(int64_t), 3, fp);
+   for (int i=0; i<=q->n; i++) fwrite(q->names[i], 1, strlen(q->names[i]) + 1, fp);
+
+   for (int64_t c=0; c<q->nchunks; c++)
+   {
+      const logq_chunk_t *ch = &q->chunk[c];
+      fwrite(&ch->offset, sizeof(int64_t), 1, fp);
+      fwrite(&ch->rows, sizeof(int64_t), 1, fp);
+      fwrite(&ch->t_first, sizeof(double), 1, fp);
+      fwrite(&ch->t_last, sizeof(double), 1, fp);
+      fwrite(ch->min, sizeof(double), (size_t)q->n * 2, fp);
+   }
+
+   if (fclose(fp) != 0)
+   {
+      remove(idx_fn);
+      return -2;
+   }
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logq_t *logq_open(const char *fn, bool rebuild)
+ *
+ *  @brief	Open a CSV or compressed log and load its index, building (and saving) it when it is missing,
+ *		stale or 'rebuild' is set.  An index that cannot be saved is kept in memory only.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logq_t *logq_open(const char *fn, bool rebuild)
+{
+   struct stat st;
+   char *idx_fn = NULL;
+
+   if (fn == NULL || stat(fn, &st) != 0) return NULL;
+
+   logq_t *q = (logq_t *)calloc(1, sizeof(logq_t));
+   if (q == NULL) return NULL;
+
+   q->fn = logq_strdup(fn);
+   idx_fn = (char *)malloc(strlen(fn) + sizeof(LOGQ_EXT));
+   if (q->fn == NULL || idx_fn == NULL) goto _err_ret;
+   strcpy(idx_fn, fn);
+   strcat(idx_fn, LOGQ_EXT);
+
+   if (logz_is_logz(fn))
+   {
+      q->fmt = LOGQ_LGZ;
+      if ((q->zr = logz_reader_open(fn)) == NULL) goto _err_ret;
+      q->n = q->zr->n;
+      if ((q->names = (char **)calloc((size_t)q->n + 1, sizeof(char *))) == NULL) goto _err_ret;
+      for (int i=0; i<=q->n; i++)
+         if ((q->names[i] = logq_strdup(q->zr->names[i])) == NULL) goto _err_ret;
+   }
+   else
+   {
+      q->fmt = LOGQ_CSV;
+      if ((q->line = (char *)malloc(LOGQ_LINE_SZ)) == NULL) goto _err_ret;
+      if ((q->fp = fopen(fn, "r")) == NULL || !fgets(q->line, LOGQ_LINE_SZ, q->fp)) goto _err_ret;
+
+      q->line[strcspn(q->line, "\r\n")] = '\0';
+      int ncol = 1;
+      for (char *p = q->line; *p; p++) ncol += (*p == ',');
+      q->n = ncol - 1;
+      if ((q->rv = (double *)malloc((size_t)ncol * sizeof(double))) == NULL) goto _err_ret;
+
+      if ((q->names = (char **)calloc((size_t)ncol, sizeof(char *))) == NULL) goto _err_ret;
+      char *p = q->line;
+      for (int i=0; i<ncol; i++)
+      {
+         char *c = strchr(p, ',');
+         if (c != NULL) *c = '\0';
+         if ((q->names[i] = logq_strdup(p)) == NULL) goto _err_ret;
+         p = (c != NULL) ? c + 1 : p;
+      }
+   }
+
+   if (rebuild || logq_load_index(q, idx_fn, &st) != 0)
+   {
+      int rc = (q->fmt == LOGQ_LGZ) ? logq_build_lgz(q) : logq_build_csv(q);
+      if (rc != 0) goto _err_ret;
+      logq_save_index(q, idx_fn, &st);
+   }
+
+   q->chunks_read = 0;
+   free(idx_fn);
+   return q;
+
+_err_ret:
+   free(idx_fn);
+   logq_close(q);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_col(const logq_t *q, const char *name)
+ *
+ *  @brief	Column index by name
+ *
+ *  @return	0 for the time column, 1..n for value columns; -1 if not found
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logq_col(const logq_t *q, const char *name)
+{
+   if (q == NULL || name == NULL) return -1;
+
+   for (int i=0; i<=q->n; i++)
+      if (0==strcmp(name, q->names[i])) return i;
+
+   return -1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_seek_chunk(logq_t *q, int64_t c)
+ *
+ *  @brief	Position the reader at the first row of chunk c
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logq_seek_chunk(logq_t *q, int64_t c)
+{
+   if (q == NULL || c < 0 || c >= q->nchunks) return -1;
+
+   q->rows_left = 0;
+   if (q->fmt == LOGQ_LGZ)
+   {
+      if (logz_seek(q->zr, (long)q->chunk[c].offset) != 0) return -2;
+      if (logz_next_block(q->zr) != 1 || logz_load_block(q->zr) != 0) return -3;
+   }
+   else if (fseek(q->fp, (long)q->chunk[c].offset, SEEK_SET) != 0) return -2;
+
+   q->rows_left = q->chunk[c].rows;
+   q->chunks_read++;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_next_row(logq_t *q, double *t, double *v)
+ *
+ *  @brief	Read the next row of the current chunk; v[] holds n values
+ *
+ *  @return	1 if a row was read; 0 at end of chunk; negative on error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logq_next_row(logq_t *q, double *t, double *v)
+{
+   if (q == NULL || q->rows_left <= 0) return 0;
+
+   if (q->fmt == LOGQ_LGZ)
+   {
+      int rc = logz_read_row(q->zr, t, v);
+      if (rc != 1) return (rc < 0) ? rc : -4;
+   }
+   else
+   {
+      double *r = q->rv;
+      for (;;)
+      {
+         if (!fgets(q->line, LOGQ_LINE_SZ, q->fp)) return -4;	// file changed under the index
+         if (logq_parse_row(q->line, q->n + 1, r)) break;
+      }
+      *t = r[0];
+      memcpy(v, &r[1], (size_t)q->n * sizeof(double));
+   }
+
+   q->rows_left--;
+   return 1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int64_t logq_first_chunk(const logq_t *q, double t)
+ *
+ *  @brief	First chunk whose time range reaches t (time is monotonic in a log, so binary search)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int64_t logq_first_chunk(const logq_t *q, double t)
+{
+   int64_t lo = 0, hi = q->nchunks;
+
+   while (lo < hi)
+   {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (q->chunk[mid].t_last < t) lo = mid + 1; else hi = mid;
+   }
+
+   return lo;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logq_header(const logq_t *q, const int *cols, int ncols, FILE *out)
+ *
+ *  @brief	Write the CSV header: time, then the selected value columns (all if ncols is 0)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logq_header(const logq_t *q, const int *cols, int ncols, FILE *out)
+{
+   fprintf(out, "%s", q->names[0]);
+   if (ncols == 0)
+      for (int i=1; i<=q->n; i++) fprintf(out, ",%s", q->names[i]);
+   else
+      for (int i=0; i<ncols; i++) fprintf(out, ",%s", q->names[cols[i]]);
+   fprintf(out, "\n");
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logq_emit(const logq_t *q, double t, const double *v, const int *cols, int ncols, char *row,
+ *		               FILE *out)
+ *
+ *  @brief	Write one CSV row of the selected columns
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logq_emit(const logq_t *q, double t, const double *v, const int *cols, int ncols, char *row, FILE *out)
+{
+   if (ncols == 0)
+   {
+      fwrite(row, 1, (size_t)dtoa_row(t, v, q->n, NULL, row), out);
+      return;
+   }
+
+   char *p = row;
+
+   p += dtoa_shortest(t, p);
+   for (int i=0; i<ncols; i++) { *p++ = ','; p += dtoa_shortest(v[cols[i]-1], p); }
+   *p++ = '\n';
+   fwrite(row, 1, (size_t)(p - row), out);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		long logq_window(logq_t *q, double t0, double t1, const int *cols, int ncols, FILE *out)
+ *
+ *  @brief	Write the rows with t0 <= t <= t1 as CSV.  cols[] selects value columns (1..n); all if ncols is 0.
+ *		Only the chunks overlapping the window are read.
+ *
+ *  @return	num of rows written; negative on error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+long logq_window(logq_t *q, double t0, double t1, const int *cols, int ncols, FILE *out)
+{
+   long cnt = 0;
+   int rc = 0;
+   double t;
+
+   if (q == NULL || out == NULL || t1 < t0) return -1;
+
+   double *v = (double *)malloc(((size_t)q->n + 1) * sizeof(double));
+   char *row = (char *)malloc(((size_t)q->n + 1) * (DTOA_BUF_SZ + 1) + 1);
+   if (v == NULL || row == NULL) { cnt = -2; goto _err_ret; }
+
+   logq_header(q, cols, ncols, out);
+
+   for (int64_t c = logq_first_chunk(q, t0); c < q->nchunks && q->chunk[c].t_first <= t1; c++)
+   {
+      if ((rc = logq_seek_chunk(q, c)) != 0) break;
+      while ((rc = logq_next_row(q, &t, v)) == 1)
+      {
+         if (t < t0 || t > t1) continue;
+         logq_emit(q, t, v, cols, ncols, row, out);
+         cnt++;
+      }
+      if (rc < 0) break;
+   }
+   if (rc < 0) cnt = rc;
+
+_err_ret:
+   free(row);
+   free(v);
+   return cnt;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logq_pred_test(enum LOP op, double x, double value)
+ *
+ *  @brief	Evaluate 'x op value'
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+bool logq_pred_test(enum LOP op, double x, double value)
+{
+   switch (op)
+   {
+      case GT:  return x >  value;
+      case GTE: return x >= value;
+      case LT:  return x <  value;
+      case LTE: return x <= value;
+      case EQ:  return x == value;
+      default:  return false;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logq_pred_possible(const logq_t *q, const logq_chunk_t *c, const logq_pred_t *pr)
+ *
+ *  @brief	Can any row of chunk c satisfy the predicate, judging from its min/max?
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+bool logq_pred_possible(const logq_t *q, const logq_chunk_t *c, const logq_pred_t *pr)
+{
+   (void)q;
+   double lo = (pr->col == 0) ? c->t_first : c->min[pr->col-1];
+   double hi = (pr->col == 0) ? c->t_last  : c->max[pr->col-1];
+
+   switch (pr->op)
+   {
+      case GT:  return hi >  pr->value;
+      case GTE: return hi >= pr->value;
+      case LT:  return lo <  pr->value;
+      case LTE: return lo <= pr->value;
+      case EQ:  return lo <= pr->value && pr->value <= hi;
+      default:  return false;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		long logq_find(logq_t *q, const logq_pred_t *pred, int npred, double t_after, bool edge,
+ *		               long max_hits, const int *cols, int ncols, FILE *out)
+ *
+ *  @brief	Write the first max_hits rows at t >= t_after where all predicates hold.  With 'edge' only rows
+ *		where they become true (the previous row did not match) count, e.g. the start of each pulse.
+ *		Chunks whose min/max rule out a predicate are skipped without being read.
+ *
+ *  @return	num of rows written; negative on error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+long logq_find(logq_t *q, const logq_pred_t *pred, int npred, double t_after, bool edge, long max_hits,
+               const int *cols, int ncols, FILE *out)
+{
+   long hits = 0;
+   int rc = 0;
+   bool prev = false;
+   double t;
+
+   if (q == NULL || pred == NULL || npred <= 0 || out == NULL || max_hits <= 0) return -1;
+   for (int k=0; k<npred; k++)
+      if (pred[k].col < 0 || pred[k].col > q->n) return -1;
+
+   double *v = (double *)malloc(((size_t)q->n + 1) * sizeof(double));
+   char *row = (char *)malloc(((size_t)q->n + 1) * (DTOA_BUF_SZ + 1) + 1);
+   if (v == NULL || row == NULL) { hits = -2; goto _err_ret; }
+
+   logq_header(q, cols, ncols, out);
+
+   for (int64_t c = logq_first_chunk(q, t_after); c < q->nchunks && hits < max_hits; c++)
+   {
+      bool possible = true;
+      for (int k=0; k<npred && possible; k++)
+         possible = logq_pred_possible(q, &q->chunk[c], &pred[k]);
+      if (!possible)
+      {
+         prev = false;
+         continue;
+      }
+
+      if ((rc = logq_seek_chunk(q, c)) != 0) break;
+      while (hits < max_hits && (rc = logq_next_row(q, &t, v)) == 1)
+      {
+         if (t < t_after) continue;
+
+         bool match = true;
+         for (int k=0; k<npred && match; k++)
+            match = logq_pred_test(pred[k].op, (pred[k].col == 0) ? t : v[pred[k].col-1], pred[k].value);
+
+         if (match && !(edge && prev))
+         {
+            logq_emit(q, t, v, cols, ncols, row, out);
+            hits++;
+         }
+         prev = match;
+      }
+      if (rc < 0) break;
+   }
+   if (rc < 0) hits = rc;
+
+_err_ret:
+   free(row);
+   free(v);
+   return hits;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logq_close(logq_t *q)
+ *
+ *  @brief	Close the log and free the index
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logq_close(logq_t *q)
+{
+   if (q == NULL) return;
+
+   if (q->fp != NULL) fclose(q->fp);
+   logz_reader_close(q->zr);
+   if (q->names != NULL)
+   {
+      for (int i=0; i<=q->n; i++) free(q->names[i]);
+      free(q->names);
+   }
+   free(q->chunk);
+   free(q->mm);
+   free(q->line);
+   free(q->rv);
+   free(q->fn);
+   free(q);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double logq_ms(void)
+ *
+ *  @brief	Monotonic clock in milliseconds
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double logq_ms(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logq_is_opt(const char *s)
+ *
+ *  @brief	Is s a query option (negative numbers are not)?
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+bool logq_is_opt(const char *s)
+{
+   return 0==strcmp(s, "-c") || 0==strcmp(s, "-o") || 0==strcmp(s, "-after") ||
+          0==strcmp(s, "-n") || 0==strcmp(s, "-edge");
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		enum LOP logq_strtoop(const char *op)
+ *
+ *  @brief	Comparison operator from string; NOP if not one
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+enum LOP logq_strtoop(const char *op)
+{
+   if (0==strcmp(op, ">")) return GT;
+   if (0==strcmp(op, ">=")) return GTE;
+   if (0==strcmp(op, "<")) return LT;
+   if (0==strcmp(op, "<=")) return LTE;
+   if (0==strcmp(op, "==")) return EQ;
+   return NOP;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_cols(const logq_t *q, char *list, int *cols)
+ *
+ *  @brief	Parse a comma separated column list into value column indices; the time column is implied
+ *
+ *  @return	num of columns; negative if a name is unknown
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int logq_cols(const logq_t *q, char *list, int *cols)
+{
+   int n = 0;
+
+   for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+   {
+      int c = logq_col(q, tok);
+      if (c < 0)
+      {
+         fprintf(stderr, "error: no column '%s' in '%s'.\n", tok, q->fn);
+         return -1;
+      }
+      if (c > 0 && n < q->n) cols[n++] = c;
+   }
+
+   return n;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logq_run(int argc, char **argv, FILE *out)
+ *
+ *  @brief	Run a query given as command words (shared by the logq tool and the 'logq' menu command):
+ *
+ *		<log> info
+ *		<log> index
+ *		<log> window <t0> <t1> [-c <col,...>] [-o <out.csv>]
+ *		<log> find <col> <op> <val> [&& <col> <op> <val> ...] [-after <t>] [-edge] [-n <hits>]
+ *		                                                       [-c <col,...>] [-o <out.csv>]
+ *
+ *		Query results go to 'out' (or the -o file); the query cost goes to stderr.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logq_run(int argc, char **argv, FILE *out)
+{
+   int rc = 0, ncols = 0, npred = 0;
+   int *cols = NULL;
+   long cnt = 0;
+   double t_after = -INFINITY;
+   bool edge = false;
+   long max_hits = 1;
+   char *out_fn = NULL;
+   logq_pred_t pred[LOGQ_MAX_PRED];
+   FILE *fo = NULL;
+
+   if (argc < 2) return -1;
+
+   const char *cmd = argv[1];
+   bool rebuild = (0==strcmp(cmd, "index"));
+
+   double ms = logq_ms();
+   logq_t *q = logq_open(argv[0], rebuild);
+   if (q == NULL)
+   {
+      fprintf(stderr, "error: cannot open or index '%s'.\n", argv[0]);
+      return -2;
+   }
+   double open_ms = logq_ms() - ms;
+
+   if (0==strcmp(cmd, "info") || rebuild)
+   {
+      int64_t rows = 0;
+      for (int64_t c=0; c<q->nchunks; c++) rows += q->chunk[c].rows;
+
+      fprintf(out, "%s: %s, %ld rows in %ld chunks, t: [%g, %g] (index %.1f ms)\n", q->fn,
+              q->fmt == LOGQ_LGZ ? "lgz" : "csv", (long)rows, (long)q->nchunks,
+              q->nchunks > 0 ? q->chunk[0].t_first : 0.0, q->nchunks > 0 ? q->chunk[q->nchunks-1].t_last : 0.0,
+              open_ms);
+      for (int i=1; i<=q->n; i++)
+      {
+         double lo = INFINITY, hi = -INFINITY;
+         for (int64_t c=0; c<q->nchunks; c++)
+         {
+            if (q->chunk[c].min[i-1] < lo) lo = q->chunk[c].min[i-1];
+            if (q->chunk[c].max[i-1] > hi) hi = q->chunk[c].max[i-1];
+         }
+         fprintf(out, "  %-20s [%g, %g]\n", q->names[i], lo, hi);
+      }
+      goto _err_ret;
+   }
+
+   if ((cols = (int *)malloc(((size_t)q->n + 1) * sizeof(int))) == NULL) { rc = -3; goto _err_ret; }
+
+   /* positional words end at the first option */
+   int last = 2;
+   while (last < argc && !logq_is_opt(argv[last])) last++;
+
+   for (int i=last; i<argc; i++)
+   {
+      if (0==strcmp(argv[i], "-c") && i+1 < argc)
+      {
+         if ((ncols = logq_cols(q, argv[++i], cols)) < 0) { rc = -4; goto _err_ret; }
+      }
+      else if (0==strcmp(argv[i], "-o") && i+1 < argc) out_fn = argv[++i];
+      else if (0==strcmp(argv[i], "-after") && i+1 < argc) t_after = atof(argv[++i]);
+      else if (0==strcmp(argv[i], "-n") && i+1 < argc) max_hits = atol(argv[++i]);
+      else if (0==strcmp(argv[i], "-edge")) edge = true;
+      else
+      {
+         fprintf(stderr, "error: bad option '%s'.\n", argv[i]);
+         rc = -4;
+         goto _err_ret;
+      }
+   }
+
+   if (out_fn != NULL && (fo = fopen(out_fn, "w")) == NULL)
+   {
+      fprintf(stderr, "error: cannot write '%s'.\n", out_fn);
+      rc = -5;
+      goto _err_ret;
+   }
+   FILE *fp = (fo != NULL) ? fo : out;
+
+   ms = logq_ms();
+   if (0==strcmp(cmd, "window") && last == 4)
+   {
+      cnt = logq_window(q, atof(argv[2]), atof(argv[3]), cols, ncols, fp);
+   }
+   else if (0==strcmp(cmd, "find") && last >= 5 && (last - 5) % 4 == 0)
+   {
+      for (int i=2; i+2<last; i+=4)
+      {
+         if ((i > 2 && 0!=strcmp(argv[i-1], "&&")) || npred == LOGQ_MAX_PRED) { rc = -6; break; }
+
+         logq_pred_t *pr = &pred[npred++];
+         pr->col = logq_col(q, argv[i]);
+         pr->op = logq_strtoop(argv[i+1]);
+         pr->value = atof(argv[i+2]);
+         if (pr->col < 0 || pr->op == NOP)
+         {
+            fprintf(stderr, "error: bad predicate '%s %s %s'.\n", argv[i], argv[i+1], argv[i+2]);
+            rc = -6;
+            break;
+         }
+      }
+      if (rc == 0) cnt = logq_find(q, pred, npred, t_after, edge, max_hits, cols, ncols, fp);
+   }
+   else
+   {
+      fprintf(stderr, "error: bad query '%s'.\n", cmd);
+      rc = -7;
+   }
+
+   if (rc == 0)
+   {
+      fflush(fp);
+      if (cnt < 0) rc = (int)cnt;
+      fprintf(stderr, "# %ld rows, %ld of %ld chunks read, %.2f ms (index %.2f ms)\n",
+              cnt < 0 ? 0 : cnt, q->chunks_read, (long)q->nchunks, logq_ms() - ms, open_ms);
+   }
+
+_err_ret:
+   if (fo != NULL) fclose(fo);
+   free(cols);
+   logq_close(q);
+   return rc;
+}
@@ -0,0 +1,117 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logq.h
+ *
+ *  @brief		Indexed log query header
+ *
+ *  @note		A sidecar index <log>.idx splits a CSV or compressed (.lgz) log into chunks and stores, per
+ *			chunk, its file offset, row count, time range and per-column min/max.  Queries read the
+ *			index, prune chunks that cannot match and seek straight to the rest.
+ *
+ *			Index layout (host byte order):
+ *			  "LIDX" u32 version, u32 fmt, u32 n, u32 chunk_rows, i64 src_size, i64 src_mtime,
+ *			  i64 nchunks, n+1 NUL-terminated column names (time first), then per chunk:
+ *			  i64 offset, i64 rows, f64 t_first, f64 t_last, f64 min[n], f64 max[n]
+ *
+ *=====================================================================================================================
+ */
+#ifndef __LOGQ_H__
+#define __LOGQ_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "globals.h"
+#include "logz.h"
+
+
+#define LOGQ_MAGIC		"LIDX"
+#define LOGQ_VERSION		(1)
+#define LOGQ_EXT		".idx"
+#define LOGQ_CHUNK_ROWS		(4096)		/* CSV rows per chunk; .lgz chunks are its blocks */
+#define LOGQ_MAX_PRED		(8)		/* max predicates in a find */
+#define LOGQ_LINE_SZ		(1<<16)		/* max CSV line */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Log formats
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef enum {
+   LOGQ_CSV = 0,
+   LOGQ_LGZ
+}
+logq_fmt_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Chunk index entry
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   int64_t offset;		/* file offset of the first row (CSV) or block header (.lgz) */
+   int64_t rows;		/* num of rows */
+   double t_first;		/* time of first row */
+   double t_last;		/* time of last row */
+   double *min;			/* per value column min (NaN ignored) */
+   double *max;			/* per value column max */
+}
+logq_chunk_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Predicate '<col> <op> <value>'; col is a column index (0 = time, 1..n = values)
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   int col;
+   enum LOP op;
+   double value;
+}
+logq_pred_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Indexed log
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   char *fn;			/* log file name */
+   logq_fmt_t fmt;		/* log format */
+   int n;			/* num of value columns */
+   char **names;		/* n+1 column names, time first */
+
+   int64_t nchunks;		/* num of chunks */
+   logq_chunk_t *chunk;		/* chunk index */
+   double *mm;			/* min/max storage for all chunks */
+
+   /* chunk reader */
+   FILE *fp;			/* CSV file */
+   char *line;			/* CSV line buffer */
+   double *rv;			/* CSV row values */
+   logz_reader_t *zr;		/* .lgz reader */
+   int64_t rows_left;		/* rows left in current chunk */
+   long chunks_read;		/* chunks read since open (query cost) */
+}
+logq_t;
+
+
+logq_t *logq_open(const char *fn, bool rebuild);
+int logq_col(const logq_t *q, const char *name);
+int logq_seek_chunk(logq_t *q, int64_t c);
+int logq_next_row(logq_t *q, double *t, double *v);
+long logq_window(logq_t *q, double t0, double t1, const int *cols, int ncols, FILE *out);
+long logq_find(logq_t *q, const logq_pred_t *pred, int npred, double t_after, bool edge, long max_hits,
+               const int *cols, int ncols, FILE *out);
+void logq_close(logq_t *q);
+
+int logq_run(int argc, char **argv, FILE *out);
+
+
+#endif // __LOGQ_H__
@@ -0,0 +1,40 @@
+/*!
+ *======================================================================================================================
+ *
+ * @file		logq_cli.c
+ *
+ * @brief		Command line tool for indexed queries on CSV and compressed (.lgz) logs
+ *
+ * @note		logq <log> info				columns, rows and value ranges from the index
+ *			logq <log> index			rebuild the index (<log>.idx)
+ *			logq <log> window <t0> <t1> [-c <col,...>] [-o <out.csv>]
+ *			logq <log> find <col> <op> <val> [&& ...] [-after <t>] [-edge] [-n <hits>] [-c ...] [-o ...]
+ *
+ *======================================================================================================================
+ */
+#include <stdio.h>
+
+#include "logq.h"
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int main(int argc, char *argv[])
+ *
+ *  @brief	main
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[])
+{
+   if (argc < 3)
+   {
+      fprintf(stderr, "usage: logq <log> info | index | window <t0> <t1> [opts] | "
+                      "find <col> <op> <val> [&& ...] [opts]\n"
+                      "opts: -c <col,...> -o <out.csv> -after <t> -edge -n <hits>\n");
+      return 1;
+   }
+
+   return (logq_run(argc - 1, &argv[1], stdout) < 0) ? 1 : 0;
+}
@@ -0,0 +1,940 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logz.c
+ *
+ *  @brief		Compressed streaming log codec implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "logz.h"
+
+
+#define LOGZ_HDR_SZ		(16)		/* magic, version, n, blk_rows */
+#define LOGZ_BLK_HDR_SZ		(28)		/* magic, rows, nbytes, t_first, t_last */
+#define LOGZ_NAME_MAX		(256)
+
+#define LOGZ_P_BITS		(3)
+#define LOGZ_SRC_BITS		(16)
+#define LOGZ_RICE_SHIFT		(3)		/* acc is 2^3 x the running mean residual bit length */
+#define LOGZ_RICE_ESC		(16)		/* quotients from here are escaped */
+#define LOGZ_TRY_STEP		(16)		/* FOLLOW sources are ranked on every 16th row */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint64_t logz_bits(double x)
+ *
+ *  @brief	Raw bits of a double
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+uint64_t logz_bits(double x)
+{
+   uint64_t u;
+   memcpy(&u, &x, sizeof(u));
+   return u;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double logz_double(uint64_t u)
+ *
+ *  @brief	Double from raw bits
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+double logz_double(uint64_t u)
+{
+   double x;
+   memcpy(&x, &u, sizeof(x));
+   return x;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_col_reset(logz_col_t *col, int n)
+ *
+ *  @brief	Reset predictor states at the start of a block
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logz_col_reset(logz_col_t *col, int n)
+{
+   for (int i=0; i<n; i++)
+   {
+      memset(&col[i], 0, sizeof(logz_col_t));
+      col[i].mode = LOGZ_P_LIN;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_bitlen(uint64_t x)
+ *
+ *  @brief	Num of significant bits of x
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+int logz_bitlen(uint64_t x)
+{
+   return (x == 0) ? 0 : 64 - __builtin_clzll(x);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint64_t logz_residual(uint64_t x, uint64_t p)
+ *
+ *  @brief	Prediction error in ulps, zigzag folded so small negative errors have leading zeros too
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+uint64_t logz_residual(uint64_t x, uint64_t p)
+{
+   int64_t d = (int64_t)(x - p);
+   return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint64_t logz_predict(const logz_col_t *c, const logz_col_t *s)
+ *
+ *  @brief	Predicted bits of the next value of c; s is its source column, already at this row
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+uint64_t logz_predict(const logz_col_t *c, const logz_col_t *s)
+{
+   const uint64_t *h = c->h;
+   int order = c->mode + 1;
+
+   if (c->mode == LOGZ_P_COPY) return s->h[0];
+   if (c->mode == LOGZ_P_FOLLOW)
+   {
+      order = 2;
+      if (c->seen >= 3)
+      {
+         /* second differences: the source's now, and both a row back */
+         int64_t dd_s = (int64_t)(s->h[0] - 2 * s->h[1] + s->h[2]);
+         int64_t dd_s1 = (int64_t)(s->h[1] - 2 * s->h[2] + s->h[3]);
+         int64_t dd_c1 = (int64_t)(h[0] - 2 * h[1] + h[2]);
+         int64_t dd = 0;
+
+         if (dd_s1 != 0)
+         {
+            double a = (double)dd_s * ((double)dd_c1 / (double)dd_s1);
+            if (a > -9e18 && a < 9e18) dd = (int64_t)a;
+         }
+         return 2 * h[0] - h[1] + (uint64_t)dd;
+      }
+   }
+
+   if (order > c->seen) order = c->seen;
+   switch (order)
+   {
+      case 0:  return 0;
+      case 1:  return h[0];
+      case 2:  return 2 * h[0] - h[1];
+      case 3:  return 3 * h[0] - 3 * h[1] + h[2];
+      default: return 4 * h[0] - 6 * h[1] + 4 * h[2] - h[3];
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_col_push(logz_col_t *c, uint64_t x)
+ *
+ *  @brief	Shift a coded value into the predictor
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logz_col_push(logz_col_t *c, uint64_t x)
+{
+   c->h[3] = c->h[2];
+   c->h[2] = c->h[1];
+   c->h[1] = c->h[0];
+   c->h[0] = x;
+   if (c->seen < 4) c->seen++;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_rice_k(const logz_col_t *c)
+ *
+ *  @brief	Rice parameter: one bit under the running mean residual bit length
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+int logz_rice_k(const logz_col_t *c)
+{
+   int k = (c->acc >> LOGZ_RICE_SHIFT) - 1;
+   return (k < 0) ? 0 : k;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_rice_update(logz_col_t *c, uint64_t r)
+ *
+ *  @brief	Move the running mean toward the bit length of residual r
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logz_rice_update(logz_col_t *c, uint64_t r)
+{
+   c->acc += logz_bitlen(r) - (c->acc >> LOGZ_RICE_SHIFT);
+}
+
+
+/*
+ *=====================================================================================================================
+ * Writer
+ *=====================================================================================================================
+ */
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_put(logz_writer_t *w, uint64_t v, int nbits)
+ *
+ *  @brief	Append the low nbits (<= 32) of v to the block bit stream
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logz_put(logz_writer_t *w, uint64_t v, int nbits)
+{
+   w->acc = (w->acc << nbits) | (v & ((1ULL << nbits) - 1));
+   w->nacc += nbits;
+
+   while (w->nacc >= 8)
+   {
+      w->nacc -= 8;
+      w->buf[w->len++] = (uint8_t)(w->acc >> w->nacc);
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_put64(logz_writer_t *w, uint64_t v, int nbits)
+ *
+ *  @brief	Append the low nbits (<= 64) of v
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logz_put64(logz_writer_t *w, uint64_t v, int nbits)
+{
+   if (nbits > 32)
+   {
+      logz_put(w, v >> 32, nbits - 32);
+      nbits = 32;
+   }
+   logz_put(w, v, nbits);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_encode(logz_writer_t *w, logz_col_t *c, const logz_col_t *s, uint64_t x)
+ *
+ *  @brief	Code the bits x of one value as its Rice coded residual against the prediction
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logz_encode(logz_writer_t *w, logz_col_t *c, const logz_col_t *s, uint64_t x)
+{
+   uint64_t r = logz_residual(x, logz_predict(c, s));
+   int k = logz_rice_k(c);
+   uint64_t q = r >> k;
+
+   if (q < LOGZ_RICE_ESC)
+   {
+      logz_put(w, ((1ULL << q) - 1) << 1, (int)q + 1);
+      logz_put64(w, r, k);
+   }
+   else
+   {
+      int len = logz_bitlen(r);
+      logz_put(w, (1ULL << LOGZ_RICE_ESC) - 1, LOGZ_RICE_ESC);
+      logz_put(w, (uint64_t)(len - 1), 6);
+      logz_put64(w, r, len);
+   }
+
+   logz_rice_update(c, r);
+   logz_col_push(c, x);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_col_at(const logz_writer_t *w, int i, int r, logz_col_t *c)
+ *
+ *  @brief	History of column i up to and including kept row r (none if r < 0)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+void logz_col_at(const logz_writer_t *w, int i, int r, logz_col_t *c)
+{
+   const size_t stride = (size_t)w->n + 1;
+
+   c->seen = 0;
+   for (int k=0; k<4 && r-k >= 0; k++)
+      c->h[c->seen++] = logz_bits(w->vals[(size_t)(r-k) * stride + (size_t)i]);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_try(const logz_writer_t *w, int i, int mode, int n_mode, int src, int step, long *bits)
+ *
+ *  @brief	Residual bits of column i over the kept rows (every step-th from the 4th if step > 1) under the
+ *		n_mode predictors from mode: the cost that ranks predictors
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logz_try(const logz_writer_t *w, int i, int mode, int n_mode, int src, int step, long *bits)
+{
+   const size_t stride = (size_t)w->n + 1;
+   logz_col_t c, s;
+
+   memset(&c, 0, sizeof(c));
+   memset(&s, 0, sizeof(s));
+   for (int m=0; m<n_mode; m++) bits[m] = 0;
+
+   for (int r = (step > 1) ? 3 : 0; r < w->rows; r += step)
+   {
+      uint64_t x = logz_bits(w->vals[(size_t)r * stride + (size_t)i]);
+
+      logz_col_at(w, i, r-1, &c);
+      if (mode >= LOGZ_P_COPY) logz_col_at(w, src, r, &s);
+      for (int m=0; m<n_mode; m++)
+      {
+         c.mode = mode + m;
+         bits[m] += logz_bitlen(logz_residual(x, logz_predict(&c, &s)));
+      }
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_choose(logz_writer_t *w)
+ *
+ *  @brief	Pick the predictor of every column for the kept rows
+ *
+ *  @note	The polynomial orders are tried on all rows, COPY on the earlier columns equal in the first row.
+ *		FOLLOW sources are ranked on a sample of rows and only the best is tried on all of them.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void logz_choose(logz_writer_t *w)
+{
+   for (int i=0; i<=w->n; i++)
+   {
+      logz_col_t *c = &w->col[i];
+      long bits[LOGZ_P_CUBIC + 1], best;
+
+      logz_try(w, i, LOGZ_P_PREV, LOGZ_P_CUBIC + 1, 0, 1, bits);
+      best = bits[0];
+      c->mode = LOGZ_P_PREV;
+      for (int m=LOGZ_P_LIN; m<=LOGZ_P_CUBIC; m++)
+      {
+         if (bits[m] < best)
+         {
+            best = bits[m];
+            c->mode = m;
+         }
+      }
+      if (best == 0) continue;
+
+      long best_s = -1;
+      int src = -1;
+      for (int j=0; j<i; j++)
+      {
+         if (logz_bits(w->vals[j]) == logz_bits(w->vals[i]))
+         {
+            logz_try(w, i, LOGZ_P_COPY, 1, j, 1, bits);
+            if (bits[0] + LOGZ_SRC_BITS < best)
+            {
+               best = bits[0] + LOGZ_SRC_BITS;
+               c->mode = LOGZ_P_COPY;
+               c->src = j;
+            }
+         }
+
+         logz_try(w, i, LOGZ_P_FOLLOW, 1, j, LOGZ_TRY_STEP, bits);
+         if (best_s < 0 || bits[0] < best_s)
+         {
+            best_s = bits[0];
+            src = j;
+         }
+      }
+
+      if (src >= 0)
+      {
+         logz_try(w, i, LOGZ_P_FOLLOW, 1, src, 1, bits);
+         if (bits[0] + LOGZ_SRC_BITS < best)
+         {
+            c->mode = LOGZ_P_FOLLOW;
+            c->src = src;
+         }
+      }
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logz_writer_t *logz_writer_create(FILE *fp, const char *t_name, int n, const char *const *names,
+ *						  int blk_rows)
+ *
+ *  @brief	Create a writer on an open file and write the file header
+ *
+ *  @param	fp		output file; stays owned by the caller
+ *  @param	t_name		time column name
+ *  @param	n		num of value columns
+ *  @param	names		value column names
+ *  @param	blk_rows	rows per block; <= 0 selects LOGZ_BLK_ROWS
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logz_writer_t *logz_writer_create(FILE *fp, const char *t_name, int n, const char *const *names, int blk_rows)
+{
+   if (fp == NULL || t_name == NULL || n < 0 || (n > 0 && names == NULL)) return NULL;
+   if (blk_rows <= 0) blk_rows = LOGZ_BLK_ROWS;
+
+   logz_writer_t *w = (logz_writer_t *)calloc(1, sizeof(logz_writer_t));
+   if (w == NULL) return NULL;
+
+   w->fp = fp;
+   w->n = n;
+   w->blk_rows = blk_rows;
+   w->col = (logz_col_t *)calloc((size_t)n + 1, sizeof(logz_col_t));
+   w->vals = (double *)malloc((size_t)blk_rows * ((size_t)n + 1) * sizeof(double));
+
+   /* worst case: 3+16 predictor bits per column, an escaped 64-bit residual (86 bits) per value */
+   w->cap = (size_t)blk_rows * ((size_t)n + 1) * 11 + ((size_t)n + 1) * 3 + 16;
+   w->buf = (uint8_t *)malloc(w->cap);
+
+   if (w->col == NULL || w->vals == NULL || w->buf == NULL)
+   {
+      logz_writer_destroy(w);
+      return NULL;
+   }
+   uint32_t hdr[3] = { LOGZ_VERSION, (uint32_t)n, (uint32_t)blk_rows };
+   fwrite(LOGZ_MAGIC, 1, 4, fp);
+   fwrite(hdr, sizeof(uint32_t), 3, fp);
+   fwrite(t_name, 1, strlen(t_name) + 1, fp);
+   w->total_bytes = LOGZ_HDR_SZ + (long)strlen(t_name) + 1;
+   for (int i=0; i<n; i++)
+   {
+      fwrite(names[i], 1, strlen(names[i]) + 1, fp);
+      w->total_bytes += (long)strlen(names[i]) + 1;
+   }
+
+   return w;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_write_row(logz_writer_t *w, double t, const double *v)
+ *
+ *  @brief	Add one row; the block is coded and written out when full
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_write_row(logz_writer_t *w, double t, const double *v)
+{
+   if (w == NULL) return -1;
+
+   double *row = w->vals + (size_t)w->rows * ((size_t)w->n + 1);
+
+   if (w->rows == 0) w->t_first = t;
+   w->t_last = t;
+
+   row[0] = t;
+   if (w->n > 0) memcpy(&row[1], v, (size_t)w->n * sizeof(double));
+
+   w->rows++;
+   w->total_rows++;
+
+   if (w->rows >= w->blk_rows) return logz_writer_flush(w);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_writer_flush(logz_writer_t *w)
+ *
+ *  @brief	Code and write the current (possibly partial) block and start a new one
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_writer_flush(logz_writer_t *w)
+{
+   if (w == NULL) return -1;
+   if (w->rows == 0) return 0;
+
+   const size_t stride = (size_t)w->n + 1;
+
+   logz_col_reset(w->col, w->n + 1);
+   logz_choose(w);
+   for (int i=0; i<=w->n; i++)
+   {
+      logz_put(w, (uint64_t)w->col[i].mode, LOGZ_P_BITS);
+      if (w->col[i].mode >= LOGZ_P_COPY) logz_put(w, (uint64_t)w->col[i].src, LOGZ_SRC_BITS);
+   }
+
+   for (int r=0; r<w->rows; r++)
+   {
+      const double *row = w->vals + (size_t)r * stride;
+      for (int i=0; i<=w->n; i++)
+         logz_encode(w, &w->col[i], &w->col[w->col[i].src], logz_bits(row[i]));
+   }
+
+   if (w->nacc > 0)
+   {
+      w->buf[w->len++] = (uint8_t)(w->acc << (8 - w->nacc));
+      w->nacc = 0;
+   }
+
+   uint32_t hdr[2] = { (uint32_t)w->rows, (uint32_t)w->len };
+   fwrite(LOGZ_BLK_MAGIC, 1, 4, w->fp);
+   fwrite(hdr, sizeof(uint32_t), 2, w->fp);
+   fwrite(&w->t_first, sizeof(double), 1, w->fp);
+   fwrite(&w->t_last, sizeof(double), 1, w->fp);
+   size_t wr = fwrite(w->buf, 1, w->len, w->fp);
+
+   w->total_bytes += LOGZ_BLK_HDR_SZ + (long)w->len;
+   w->rows = 0;
+   w->len = 0;
+   w->acc = 0;
+
+   return (wr == (size_t)hdr[1]) ? 0 : -2;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_writer_destroy(logz_writer_t *w)
+ *
+ *  @brief	Flush the last block and free the writer.  The file is not closed.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logz_writer_destroy(logz_writer_t *w)
+{
+   if (w == NULL) return;
+
+   if (w->buf != NULL && w->vals != NULL && w->col != NULL) logz_writer_flush(w);
+
+   free(w->buf);
+   free(w->vals);
+   free(w->col);
+   free(w);
+}
+
+
+/*
+ *=====================================================================================================================
+ * Reader
+ *=====================================================================================================================
+ */
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint64_t logz_get(logz_reader_t *r, int nbits)
+ *
+ *  @brief	Take the next nbits (<= 32) from the block bit stream.  Reads past the end return zeros.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+uint64_t logz_get(logz_reader_t *r, int nbits)
+{
+   while (r->nacc < nbits)
+   {
+      uint8_t b = (r->pos < r->blk.nbytes) ? r->buf[r->pos] : 0;
+      r->pos++;
+      r->acc = (r->acc << 8) | b;
+      r->nacc += 8;
+   }
+
+   r->nacc -= nbits;
+   return (r->acc >> r->nacc) & ((1ULL << nbits) - 1);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		uint64_t logz_get64(logz_reader_t *r, int nbits)
+ *
+ *  @brief	Take the next nbits (<= 64)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+uint64_t logz_get64(logz_reader_t *r, int nbits)
+{
+   uint64_t v = 0;
+
+   if (nbits > 32)
+   {
+      v = logz_get(r, nbits - 32) << 32;
+      nbits = 32;
+   }
+   return v | logz_get(r, nbits);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double logz_decode(logz_reader_t *r, logz_col_t *c, const logz_col_t *s)
+ *
+ *  @brief	Decode one value of column c, of source column s
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double logz_decode(logz_reader_t *r, logz_col_t *c, const logz_col_t *s)
+{
+   int k = logz_rice_k(c);
+   uint64_t q = 0, res;
+
+   while (q < LOGZ_RICE_ESC && logz_get(r, 1) != 0) q++;
+   if (q < LOGZ_RICE_ESC)
+      res = (q << k) | logz_get64(r, k);
+   else
+      res = logz_get64(r, (int)logz_get(r, 6) + 1);
+
+   uint64_t x = ((res >> 1) ^ (0 - (res & 1))) + logz_predict(c, s);
+   logz_rice_update(c, res);
+   logz_col_push(c, x);
+
+   return logz_double(x);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logz_has_ext(const char *fn)
+ *
+ *  @brief	True if the file name ends in LOGZ_EXT
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+bool logz_has_ext(const char *fn)
+{
+   if (fn == NULL) return false;
+
+   size_t len = strlen(fn), ext = strlen(LOGZ_EXT);
+   return (len > ext && 0==strcmp(fn + len - ext, LOGZ_EXT));
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool logz_is_logz(const char *fn)
+ *
+ *  @brief	True if the file starts with the LOGZ magic
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+bool logz_is_logz(const char *fn)
+{
+   char magic[4];
+
+   FILE *fp = fopen(fn, "rb");
+   if (fp == NULL) return false;
+
+   bool is = (fread(magic, 1, 4, fp) == 4 && 0==memcmp(magic, LOGZ_MAGIC, 4));
+   fclose(fp);
+
+   return is;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		logz_reader_t *logz_reader_open(const char *fn)
+ *
+ *  @brief	Open a compressed log and read its header
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+logz_reader_t *logz_reader_open(const char *fn)
+{
+   char magic[4];
+   uint32_t hdr[3];
+
+   if (fn == NULL) return NULL;
+
+   logz_reader_t *r = (logz_reader_t *)calloc(1, sizeof(logz_reader_t));
+   if (r == NULL) return NULL;
+
+   r->fp = fopen(fn, "rb");
+   if (r->fp == NULL) goto _err_ret;
+
+   if (fread(magic, 1, 4, r->fp) != 4 || 0!=memcmp(magic, LOGZ_MAGIC, 4)) goto _err_ret;
+   if (fread(hdr, sizeof(uint32_t), 3, r->fp) != 3) goto _err_ret;
+   if (hdr[0] != LOGZ_VERSION || hdr[1] > 0xFFFF || hdr[2] == 0) goto _err_ret;
+
+   r->n = (int)hdr[1];
+   r->blk_rows = (int)hdr[2];
+   r->names = (char **)calloc((size_t)r->n + 1, sizeof(char *));
+   r->col = (logz_col_t *)calloc((size_t)r->n + 1, sizeof(logz_col_t));
+   if (r->names == NULL || r->col == NULL) goto _err_ret;
+
+   for (int i=0; i<=r->n; i++)
+   {
+      char name[LOGZ_NAME_MAX];
+      int len = 0, ch;
+
+      while ((ch = fgetc(r->fp)) != EOF && ch != '\0')
+         if (len < LOGZ_NAME_MAX-1) name[len++] = (char)ch;
+      if (ch == EOF) goto _err_ret;
+      name[len] = '\0';
+
+      r->names[i] = (char *)malloc((size_t)len + 1);
+      if (r->names[i] == NULL) goto _err_ret;
+      memcpy(r->names[i], name, (size_t)len + 1);
+   }
+
+   r->data_offset = ftell(r->fp);
+   return r;
+
+_err_ret:
+   logz_reader_close(r);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_next_block(logz_reader_t *r)
+ *
+ *  @brief	Advance to the next block header.  The payload of the previous block is skipped if it was not
+ *		loaded, so a block index can be built by calling this alone.
+ *
+ *  @return	1 if a block was found; 0 at end of file; negative on error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_next_block(logz_reader_t *r)
+{
+   char magic[4];
+   uint32_t hdr[2];
+
+   if (r == NULL) return -1;
+
+   if (r->pending && fseek(r->fp, (long)r->blk.nbytes, SEEK_CUR) != 0) return -2;
+   r->pending = false;
+   r->rows_left = 0;
+
+   r->blk.offset = ftell(r->fp);
+   size_t rd = fread(magic, 1, 4, r->fp);
+   if (rd == 0) return 0;
+   if (rd != 4 || 0!=memcmp(magic, LOGZ_BLK_MAGIC, 4)) return -3;
+
+   if (fread(hdr, sizeof(uint32_t), 2, r->fp) != 2 ||
+       fread(&r->blk.t_first, sizeof(double), 1, r->fp) != 1 ||
+       fread(&r->blk.t_last, sizeof(double), 1, r->fp) != 1) return -4;
+
+   r->blk.rows = hdr[0];
+   r->blk.nbytes = hdr[1];
+   r->pending = true;
+
+   return 1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_load_block(logz_reader_t *r)
+ *
+ *  @brief	Read the payload of the current block so its rows can be decoded
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_load_block(logz_reader_t *r)
+{
+   if (r == NULL || !r->pending) return -1;
+
+   if (r->blk.nbytes > r->cap)
+   {
+      uint8_t *buf = (uint8_t *)realloc(r->buf, r->blk.nbytes);
+      if (buf == NULL) return -2;
+      r->buf = buf;
+      r->cap = r->blk.nbytes;
+   }
+
+   if (fread(r->buf, 1, r->blk.nbytes, r->fp) != r->blk.nbytes) return -3;
+
+   r->pending = false;
+   r->pos = 0;
+   r->acc = 0;
+   r->nacc = 0;
+   logz_col_reset(r->col, r->n + 1);
+
+   /* the predictor of every column */
+   for (int i=0; i<=r->n; i++)
+   {
+      logz_col_t *c = &r->col[i];
+      c->mode = (int)logz_get(r, LOGZ_P_BITS);
+      if (c->mode >= LOGZ_P_COPY) c->src = (int)logz_get(r, LOGZ_SRC_BITS);
+      if (c->mode > LOGZ_P_FOLLOW || (c->mode >= LOGZ_P_COPY && c->src >= i)) return -4;
+   }
+   r->rows_left = r->blk.rows;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_read_row(logz_reader_t *r, double *t, double *v)
+ *
+ *  @brief	Decode the next row into t and v[0..n-1]
+ *
+ *  @return	1 if a row was read; 0 at end of file; negative on error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_read_row(logz_reader_t *r, double *t, double *v)
+{
+   if (r == NULL || t == NULL || (r->n > 0 && v == NULL)) return -1;
+
+   while (r->rows_left == 0)
+   {
+      int rc = logz_next_block(r);
+      if (rc <= 0) return rc;
+      if ((rc = logz_load_block(r)) != 0) return rc;
+   }
+
+   *t = logz_decode(r, &r->col[0], &r->col[r->col[0].src]);
+   for (int i=0; i<r->n; i++)
+      v[i] = logz_decode(r, &r->col[i+1], &r->col[r->col[i+1].src]);
+
+   r->rows_left--;
+   return 1;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_rewind(logz_reader_t *r)
+ *
+ *  @brief	Go back to the first block
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_rewind(logz_reader_t *r)
+{
+   if (r == NULL) return -1;
+
+   r->pending = false;
+   r->rows_left = 0;
+   return (fseek(r->fp, r->data_offset, SEEK_SET) == 0) ? 0 : -2;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int logz_seek(logz_reader_t *r, long offset)
+ *
+ *  @brief	Jump to the block header at 'offset' (a logz_blk_t.offset seen earlier); the next
+ *		logz_next_block() reads it
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int logz_seek(logz_reader_t *r, long offset)
+{
+   if (r == NULL || offset < r->data_offset) return -1;
+
+   r->pending = false;
+   r->rows_left = 0;
+   return (fseek(r->fp, offset, SEEK_SET) == 0) ? 0 : -2;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void logz_reader_close(logz_reader_t *r)
+ *
+ *  @brief	Close the file and free the reader
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void logz_reader_close(logz_reader_t *r)
+{
+   if (r == NULL) return;
+
+   if (r->fp != NULL) fclose(r->fp);
+   if (r->names != NULL)
+   {
+      for (int i=0; i<=r->n; i++) free(r->names[i]);
+      free(r->names);
+   }
+   free(r->col);
+   free(r->buf);
+   free(r);
+}
@@ -0,0 +1,157 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		logz.h
+ *
+ *  @brief		Compressed streaming log codec header
+ *
+ *  @note		File layout (host byte order):
+ *
+ *			  header  "LOGZ" u32 version, u32 n, u32 blk_rows, then n+1 NUL-terminated column names
+ *				  (time column first)
+ *			  block   "LZBK" u32 rows, u32 nbytes, f64 t_first, f64 t_last, nbytes of bit stream
+ *
+ *			Every block is self contained, so a reader can stream a file block by block or skip blocks
+ *			by time range without decoding them.  The writer keeps the rows of a block until it is full
+ *			and then picks, per column, the predictor that codes it in the fewest bits:
+ *
+ *			  0..3  PREV LIN QUAD CUBIC	polynomial extrapolation of the last 1..4 values
+ *			  4     COPY <16b j>		the value of column j < i in the same row
+ *			  5     FOLLOW <16b j>		LIN, plus column j's second difference in this row scaled
+ *						by the ratio of the two columns' second differences a row back
+ *
+ *			all on the IEEE bit patterns as integers.  The bit stream holds the 3-bit predictor (and j)
+ *			of every column, then row by row the residuals r = zigzag(bits(x) - prediction), the
+ *			prediction errors in ulps, Rice coded with a k tracking the column's recent residual size:
+ *
+ *			  <q ones> '0' <k bits>			q = r >> k < 16
+ *			  <16 ones> <6b len-1> <len bits>	escape
+ *
+ *			LIN on the time column is delta-of-delta coding, and a constant column costs one bit a row.
+ *			FOLLOW is for the filter states and parameters, which all move with one innovation per
+ *			step.  Encoding is lossless: decoded doubles are bit exact.
+ *
+ *=====================================================================================================================
+ */
+#ifndef __LOGZ_H__
+#define __LOGZ_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define LOGZ_MAGIC		"LOGZ"
+#define LOGZ_BLK_MAGIC		"LZBK"
+#define LOGZ_VERSION		(1)
+#define LOGZ_BLK_ROWS		(4096)		/* default rows per block */
+#define LOGZ_EXT		".lgz"
+
+#define LOGZ_P_PREV		(0)		/* predictors, see above */
+#define LOGZ_P_LIN		(1)
+#define LOGZ_P_QUAD		(2)
+#define LOGZ_P_CUBIC		(3)
+#define LOGZ_P_COPY		(4)
+#define LOGZ_P_FOLLOW		(5)
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Per-column predictor state (shared by writer and reader)
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   uint64_t h[4];		/* bits of the last values, newest first */
+   int seen;			/* num of values in h, up to 4 */
+   int mode;			/* predictor */
+   int src;			/* source column of COPY and FOLLOW */
+   int acc;			/* 8 x running mean of the residual bit length, sets the Rice k */
+}
+logz_col_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Streaming writer
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   FILE *fp;			/* output file (not owned) */
+   int n;			/* num of value columns */
+   int blk_rows;		/* rows per block */
+   logz_col_t *col;		/* n+1 predictor states, time column first */
+   double *vals;		/* rows of the current block, n+1 values each, coded when it is full */
+
+   uint8_t *buf;		/* current block bit stream */
+   size_t cap;			/* buf capacity in bytes */
+   size_t len;			/* bytes in buf */
+   uint64_t acc;		/* pending bits */
+   int nacc;			/* num of pending bits (< 8 between calls) */
+
+   int rows;			/* rows in current block */
+   double t_first;		/* time of first row in block */
+   double t_last;		/* time of last row in block */
+
+   long total_rows;		/* rows written */
+   long total_bytes;		/* bytes written incl. headers */
+}
+logz_writer_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Block descriptor, as read from a block header
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   long offset;			/* file offset of the block header */
+   uint32_t rows;		/* num of rows */
+   uint32_t nbytes;		/* bit stream size */
+   double t_first;		/* time of first row */
+   double t_last;		/* time of last row */
+}
+logz_blk_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Streaming reader
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   FILE *fp;			/* input file (owned) */
+   int n;			/* num of value columns */
+   int blk_rows;		/* rows per block as written */
+   char **names;		/* n+1 column names, time column first */
+   long data_offset;		/* file offset of the first block */
+   logz_col_t *col;		/* n+1 predictor states */
+
+   logz_blk_t blk;		/* current block */
+   uint8_t *buf;		/* current block bit stream */
+   size_t cap;			/* buf capacity */
+   size_t pos;			/* next byte in buf */
+   uint64_t acc;		/* pending bits */
+   int nacc;			/* num of pending bits */
+   bool pending;		/* current block payload not read yet */
+   uint32_t rows_left;		/* rows not yet decoded in current block */
+}
+logz_reader_t;
+
+
+logz_writer_t *logz_writer_create(FILE *fp, const char *t_name, int n, const char *const *names, int blk_rows);
+int logz_write_row(logz_writer_t *w, double t, const double *v);
+int logz_writer_flush(logz_writer_t *w);
+void logz_writer_destroy(logz_writer_t *w);
+
+bool logz_is_logz(const char *fn);
+bool logz_has_ext(const char *fn);
+logz_reader_t *logz_reader_open(const char *fn);
+int logz_next_block(logz_reader_t *r);
+int logz_load_block(logz_reader_t *r);
+int logz_read_row(logz_reader_t *r, double *t, double *v);
+int logz_rewind(logz_reader_t *r);
+int logz_seek(logz_reader_t *r, long offset);
+void logz_reader_close(logz_reader_t *r);
+
+
+#endif // __LOGZ_H__
@@ -0,0 +1,264 @@
+/*!
+ *======================================================================================================================
+ *
+ * @file		logz_cli.c
+ *
+ * @brief		Command line tool to decode, encode and inspect compressed (.lgz) logs
+ *
+ * @note		logz <in.lgz> [<out.csv>]		decode to CSV (stdout if no output file)
+ *			logz -z <in.csv> <out.lgz>		encode a CSV log
+ *			logz -i <in.lgz>			print columns, blocks and compression ratio
+ *
+ *======================================================================================================================
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "dtoa.h"
+#include "logz.h"
+
+
+#define CLI_LINE_SZ		(1<<16)
+#define CLI_MAX_COLS		(1024)
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int split_csv(char *line, char **tok, int max_tok)
+ *
+ *  @brief	Split a CSV line in place (no quoting).  Returns the number of fields.
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+static
+int split_csv(char *line, char **tok, int max_tok)
+{
+   int n = 0;
+   char *p = line;
+
+   line[strcspn(line, "\r\n")] = '\0';
+   while (n < max_tok)
+   {
+      tok[n++] = p;
+      char *c = strchr(p, ',');
+      if (c == NULL) break;
+      *c = '\0';
+      p = c + 1;
+   }
+
+   return n;
+}
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int decode(const char *in, const char *out)
+ *
+ *  @brief	Decode a compressed log to CSV
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+static
+int decode(const char *in, const char *out)
+{
+   int rc = 0;
+   double t, *v = NULL;
+   char *row = NULL;
+   FILE *fp = stdout;
+
+   logz_reader_t *r = logz_reader_open(in);
+   if (r == NULL)
+   {
+      fprintf(stderr, "error: cannot read '%s'.\n", in);
+      return -1;
+   }
+
+   if (out != NULL && (fp = fopen(out, "w")) == NULL)
+   {
+      fprintf(stderr, "error: cannot write '%s'.\n", out);
+      rc = -2;
+      goto _err_ret;
+   }
+
+   v = (double *)calloc((size_t)r->n + 1, sizeof(double));
+   row = (char *)malloc(((size_t)r->n + 1) * (DTOA_BUF_SZ + 1) + 1);
+   if (v == NULL || row == NULL) { rc = -3; goto _err_ret; }
+
+   fprintf(fp, "%s", r->names[0]);
+   for (int i=1; i<=r->n; i++) fprintf(fp, ",%s", r->names[i]);
+   fprintf(fp, "\n");
+
+   while ((rc = logz_read_row(r, &t, v)) == 1)
+   {
+      int len = dtoa_row(t, v, r->n, NULL, row);
+      fwrite(row, 1, (size_t)len, fp);
+   }
+   if (rc < 0) fprintf(stderr, "error: '%s' is corrupt (%d).\n", in, rc);
+
+_err_ret:
+   if (fp != NULL && fp != stdout) fclose(fp);
+   free(row);
+   free(v);
+   logz_reader_close(r);
+
+   return rc;
+}
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int encode(const char *in, const char *out)
+ *
+ *  @brief	Encode a CSV log.  The first column is the time column; fields that are not numbers become NaN.
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+static
+int encode(const char *in, const char *out)
+{
+   int rc = 0;
+   long rows = 0, in_bytes = 0;
+   FILE *fi = NULL, *fo = NULL;
+   logz_writer_t *w = NULL;
+   char *line = (char *)malloc(CLI_LINE_SZ);
+   char *hdr = (char *)malloc(CLI_LINE_SZ);
+   char **tok = (char **)malloc(CLI_MAX_COLS * sizeof(char *));
+   char **names = (char **)malloc(CLI_MAX_COLS * sizeof(char *));
+   double *v = (double *)malloc(CLI_MAX_COLS * sizeof(double));
+
+   if (line == NULL || hdr == NULL || tok == NULL || names == NULL || v == NULL) { rc = -3; goto _err_ret; }
+
+   if ((fi = fopen(in, "r")) == NULL || !fgets(hdr, CLI_LINE_SZ, fi))
+   {
+      fprintf(stderr, "error: cannot read '%s'.\n", in);
+      rc = -1;
+      goto _err_ret;
+   }
+   in_bytes += (long)strlen(hdr);
+
+   int ncol = split_csv(hdr, names, CLI_MAX_COLS);
+   if ((fo = fopen(out, "wb")) == NULL)
+   {
+      fprintf(stderr, "error: cannot write '%s'.\n", out);
+      rc = -2;
+      goto _err_ret;
+   }
+
+   w = logz_writer_create(fo, names[0], ncol - 1, (const char *const *)&names[1], LOGZ_BLK_ROWS);
+   if (w == NULL) { rc = -3; goto _err_ret; }
+
+   while (fgets(line, CLI_LINE_SZ, fi))
+   {
+      in_bytes += (long)strlen(line);
+      if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0') continue;
+
+      int nt = split_csv(line, tok, CLI_MAX_COLS);
+      if (nt != ncol) continue;	// skip malformed rows
+
+      for (int i=0; i<ncol; i++)
+      {
+         char *endptr;
+         v[i] = strtod(tok[i], &endptr);
+         if (endptr == tok[i]) v[i] = NAN;
+      }
+
+      logz_write_row(w, v[0], &v[1]);
+      rows++;
+   }
+
+   logz_writer_flush(w);
+   fprintf(stderr, "%ld rows, %ld -> %ld bytes (%.1fx)\n",
+           rows, in_bytes, w->total_bytes, w->total_bytes > 0 ? (double)in_bytes / w->total_bytes : 0.0);
+
+_err_ret:
+   logz_writer_destroy(w);
+   if (fo != NULL) fclose(fo);
+   if (fi != NULL) fclose(fi);
+   free(v);
+   free(names);
+   free(tok);
+   free(hdr);
+   free(line);
+
+   return rc;
+}
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int info(const char *in)
+ *
+ *  @brief	Print columns and block layout without decoding rows
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+static
+int info(const char *in)
+{
+   int rc;
+   long blocks = 0, rows = 0, bytes = 0;
+   double t0 = 0.0, t1 = 0.0;
+
+   logz_reader_t *r = logz_reader_open(in);
+   if (r == NULL)
+   {
+      fprintf(stderr, "error: cannot read '%s'.\n", in);
+      return -1;
+   }
+
+   printf("columns (%d):", r->n + 1);
+   for (int i=0; i<=r->n; i++) printf(" %s", r->names[i]);
+   printf("\n");
+
+   while ((rc = logz_next_block(r)) == 1)
+   {
+      if (blocks == 0) t0 = r->blk.t_first;
+      t1 = r->blk.t_last;
+      blocks++;
+      rows += r->blk.rows;
+      bytes += r->blk.nbytes;
+   }
+
+   printf("blocks: %ld (%d rows each), rows: %ld, t: [%g, %g]\n", blocks, r->blk_rows, rows, t0, t1);
+   printf("payload: %ld bytes, %.2f bits/value\n", bytes,
+          rows > 0 ? 8.0 * bytes / ((double)rows * (r->n + 1)) : 0.0);
+   if (rc < 0) fprintf(stderr, "error: '%s' is corrupt (%d).\n", in, rc);
+
+   logz_reader_close(r);
+   return rc;
+}
+
+
+/*!
+ *----------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int main(int argc, char *argv[])
+ *
+ *  @brief	main
+ *
+ *----------------------------------------------------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[])
+{
+   int rc;
+
+   if (argc == 4 && 0==strcmp(argv[1], "-z"))
+      rc = encode(argv[2], argv[3]);
+   else if (argc == 3 && 0==strcmp(argv[1], "-i"))
+      rc = info(argv[2]);
+   else if ((argc == 2 || argc == 3) && argv[1][0] != '-')
+      rc = decode(argv[1], argc == 3 ? argv[2] : NULL);
+   else
+   {
+      fprintf(stderr, "usage: logz <in.lgz> [<out.csv>] | -z <in.csv> <out.lgz> | -i <in.lgz>\n");
+      return 1;
+   }
+
+   return (rc < 0) ? 1 : 0;
+}
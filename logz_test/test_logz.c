@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 199309L
+#include "logz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_ROWS      (10000)     /* more than two default blocks */
+#define N_COLS      (8)
+#define TMP_FN      "test_logz.tmp"
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double uniform(void) {
+    return (double)(xorshift64() >> 11) / 9007199254740992.0 - 0.5;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* rows of n+1 values, time first */
+static long write_log(const double *v, int rows, int n, int blk_rows) {
+    static const char *names[N_COLS] = { "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8" };
+    FILE *fp = fopen(TMP_FN, "wb");
+    assert(fp != NULL);
+    logz_writer_t *w = logz_writer_create(fp, "t", n, names, blk_rows);
+    assert(w != NULL);
+    for (int r = 0; r < rows; r++) assert(logz_write_row(w, v[(size_t)r * (n + 1)], &v[(size_t)r * (n + 1) + 1]) == 0);
+    assert(w->total_rows == rows);
+    logz_writer_destroy(w);
+    long sz = ftell(fp);
+    fclose(fp);
+    return sz;
+}
+
+/* decoded rows must be bit for bit the written ones, NaN payloads and -0 included */
+static void check_log(const double *v, int rows, int n) {
+    logz_reader_t *r = logz_reader_open(TMP_FN);
+    assert(r != NULL && r->n == n);
+    assert(strcmp(r->names[0], "t") == 0 && (n == 0 || strcmp(r->names[1], "c1") == 0));
+
+    double t, x[N_COLS];
+    int k = 0;
+    while (logz_read_row(r, &t, x) == 1) {
+        assert(k < rows);
+        const double *want = &v[(size_t)k * (n + 1)];
+        if (memcmp(&t, &want[0], sizeof(t)) != 0 || memcmp(x, &want[1], (size_t)n * sizeof(double)) != 0) {
+            fprintf(stderr, "row %d differs\n", k);
+            assert(0);
+        }
+        k++;
+    }
+    assert(k == rows);
+    logz_reader_close(r);
+}
+
+/* the mode and source every column of the first block was coded with */
+static void first_block_modes(int n, int *mode, int *src) {
+    logz_reader_t *r = logz_reader_open(TMP_FN);
+    assert(r != NULL);
+    assert(logz_next_block(r) == 1 && logz_load_block(r) == 0);
+    for (int i = 0; i <= n; i++) {
+        mode[i] = r->col[i].mode;
+        src[i] = r->col[i].src;
+    }
+    logz_reader_close(r);
+}
+
+/* constant, smooth, noisy, NaN/Inf/+-0/denormal and random-bit columns over several blocks, at several block sizes */
+static void test_columns(void) {
+    enum { N = 6 };
+    static double v[N_ROWS * (N + 1)];
+    static const double special[] = { NAN, -NAN, INFINITY, -INFINITY, 0.0, -0.0, 5e-324, -2.2250738585072009e-308 };
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double *row = &v[r * (N + 1)];
+        uint64_t b = xorshift64();
+        row[0] = r * 0.25;
+        row[1] = 3.7;
+        row[2] = sin(r * 0.01);
+        row[3] = 4.1 + 0.01 * uniform();
+        row[4] = (r % 3 == 0) ? special[(r / 3) % 8] : 1.0 + r * 1e-3;
+        memcpy(&row[5], &b, sizeof(b));
+        row[6] = ((r / 100) % 2) ? -1e300 : 1e-300;
+    }
+
+    const int blk[] = { 0, 1, 3, 777, N_ROWS };
+    for (size_t k = 0; k < sizeof(blk) / sizeof(blk[0]); k++) {
+        write_log(v, N_ROWS, N, blk[k]);
+        check_log(v, N_ROWS, N);
+    }
+
+    /* no value columns */
+    for (int r = 0; r < N_ROWS; r++) v[r] = r * 0.5;
+    write_log(v, N_ROWS, 0, 0);
+    check_log(v, N_ROWS, 0);
+
+    printf("columns: constant, smooth, noisy, special and random bits round trip at 5 block sizes\n");
+}
+
+/* a constant column and an evenly stepped time cost one bit a row */
+static void test_constant(void) {
+    enum { N = 4 };
+    static double v[N_ROWS * (N + 1)];
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double *row = &v[r * (N + 1)];
+        row[0] = r * 0.25;
+        row[1] = 3.7;
+        row[2] = 0.0;
+        row[3] = -1.0;
+        row[4] = 1e9;
+    }
+
+    long sz = write_log(v, N_ROWS, N, 0);
+    check_log(v, N_ROWS, N);
+    assert(sz < N_ROWS * (N + 1) / 8 + 1024);
+    printf("constant: %d rows of %d columns in %ld bytes\n", N_ROWS, N + 1, sz);
+}
+
+/* a copy of a column is coded as COPY, and a column moving with another by a scale as FOLLOW */
+static void test_predictors(void) {
+    enum { N = 4 };
+    static double v[N_ROWS * (N + 1)];
+    double x = 3.0;
+    int mode[N + 1], src[N + 1];
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double *row = &v[r * (N + 1)];
+        x += 1e-4 * uniform();
+        row[0] = r * 0.25;
+        row[1] = x;
+        row[2] = x;
+        row[3] = 3.0 + 0.5 * (x - 3.0);
+        row[4] = 4.0 + 0.01 * uniform();
+    }
+
+    write_log(v, N_ROWS, N, 0);
+    check_log(v, N_ROWS, N);
+    first_block_modes(N, mode, src);
+    assert(mode[0] == LOGZ_P_LIN);
+    assert(mode[2] == LOGZ_P_COPY && src[2] == 1);
+    assert(mode[3] == LOGZ_P_FOLLOW && (src[3] == 1 || src[3] == 2));
+    assert(mode[4] <= LOGZ_P_CUBIC);
+    printf("predictors: copy and follow picked, t delta-of-delta\n");
+}
+
+/* residuals far over the Rice parameter take the escape: jumps after long constant runs, and a column alternating
+ * between tiny and full-width residuals */
+static void test_escape(void) {
+    enum { N = 3 };
+    static double v[N_ROWS * (N + 1)];
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double *row = &v[r * (N + 1)];
+        uint64_t b = xorshift64();
+        row[0] = r * 0.25;
+        row[1] = (r % 1000 < 999) ? 1.0 : -1e200;
+        memcpy(&row[2], &b, sizeof(b));
+        row[2] = (r % 5 == 0) ? row[2] : 2.0;
+        row[3] = (r < N_ROWS / 2) ? 0.0 : (double)(b >> 1);
+    }
+
+    write_log(v, N_ROWS, N, 0);
+    check_log(v, N_ROWS, N);
+    printf("escape: jumps after constant runs and mixed residual widths round trip\n");
+}
+
+/* a bad file is rejected */
+static void test_bad(void) {
+    FILE *fp = fopen(TMP_FN, "wb");
+    assert(fp != NULL);
+    fwrite("LOGZ", 1, 4, fp);
+    uint32_t hdr[3] = { LOGZ_VERSION + 1, 1, LOGZ_BLK_ROWS };
+    fwrite(hdr, sizeof(uint32_t), 3, fp);
+    fwrite("t\0a\0", 1, 4, fp);
+    fclose(fp);
+    assert(logz_reader_open(TMP_FN) == NULL);
+    assert(logz_reader_open("no_such_file.lgz") == NULL);
+    printf("bad: unknown version and missing file rejected\n");
+}
+
+/* encode and decode time of a sim-like log */
+static void bench(void) {
+    enum { N = 8 };
+    static double v[N_ROWS * (N + 1)];
+    double x = 3.0;
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double *row = &v[r * (N + 1)];
+        x += 1e-4 * uniform();
+        row[0] = r * 0.25;
+        for (int c = 1; c <= N; c++) row[c] = (c % 2) ? 3.0 + 0.5 * c * (x - 3.0) : c + 1e-3 * sin(r * 0.01 * c);
+    }
+
+    double t0 = now_s();
+    long sz = write_log(v, N_ROWS, N, 0);
+    double t1 = now_s();
+    check_log(v, N_ROWS, N);
+    double t2 = now_s();
+
+    double nv = (double)N_ROWS * (N + 1);
+    printf("bench: %.1f bits/value, encode %.1f ns/value, decode %.1f ns/value\n", sz * 8.0 / nv,
+           (t1 - t0) * 1e9 / nv, (t2 - t1) * 1e9 / nv);
+}
+
+int main(void) {
+    test_columns();
+    test_constant();
+    test_predictors();
+    test_escape();
+    test_bad();
+    bench();
+    remove(TMP_FN);
+    printf("All logz tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,576 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		pack.c
+ *
+ *  @brief		Battery pack implementation
+ *
+ *=====================================================================================================================
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "pack.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double randn(uint64_t *s)
+ *
+ *  @brief	Standard normal sample (xorshift64 and Box-Muller), so a seed always gives the same pack
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+double randn(uint64_t *s)
+{
+   double u[2];
+   for (int k=0; k<2; k++)
+   {
+      *s ^= *s << 13;
+      *s ^= *s >> 7;
+      *s ^= *s << 17;
+      u[k] = ((double)(*s >> 11) + 0.5) / 9007199254740992.0;
+   }
+   return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double cell_i(const pack_t *pk, int c, double V, double *lin)
+ *
+ *  @brief	Current of cell c in the next step if its terminal ends at V, with the H the step takes at that
+ *		current: H_dsg discharging, H_chg charging, else the present H
+ *
+ *  @param	lin	set to -dI/dV: 1/Z, or 0 where the hysteresis holds the cell at +-I_quit (about to change
+ *			direction, the flip of H would take it back)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+double cell_i(const pack_t *pk, int c, double V, double *lin)
+{
+   const ecm_batch_t *b = pk->b;
+   double E = pk->E_cell[c], G = pk->G_cell[c], Iq = b->I_quit[c];
+
+   *lin = G;
+
+   double i = (E + b->H_dsg[c] - V) * G;
+   if (i > Iq) return i;
+
+   i = (E + b->H_chg[c] - V) * G;
+   if (i < -Iq) return i;
+
+   i = (E + b->H[c] - V) * G;
+   if (fabs(i) <= Iq) return i;
+
+   *lin = 0.0;
+   return (i > 0.0) ? Iq : -Iq;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void share_group(pack_t *pk, int g)
+ *
+ *  @brief	Share the pack current among the cells of group g so they end the step at one voltage V
+ *
+ *  @note	Each cell's next step is linear in its current, V = E_j + H_j - I_j Z_j, so the group is n_p + 1
+ *		linear equations (the n_p cells at V, their currents summing to I), solved by eliminating the
+ *		I_j.  Which H each cell takes depends on the sign of its current, so the sum is piecewise linear
+ *		in V: Newton steps on V solve the linear system of the pieces they are on, which is exact once
+ *		the pieces are right (one or two steps), kept within a bracket of the root by bisection.  A cell
+ *		the hysteresis holds at +-I_quit has its H set within the band so it ends at V as well.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void share_group(pack_t *pk, int g)
+{
+   ecm_batch_t *b = pk->b;
+   const int c0 = g * pk->n_p, c1 = c0 + pk->n_p;
+   const double I = pk->I_step, dt = pk->dt;
+   double *I_cell = pk->I_cell, *E_cell = pk->E_cell, *G_cell = pk->G_cell;
+
+   if (pk->n_p == 1)
+   {
+      I_cell[c0] = I;
+      return;
+   }
+
+   for (int c=c0; c<c1; c++)
+   {
+      E_cell[c] = b->V_oc[c] - (b->V_rc[c] - dt * b->dV_rc[c]);
+      G_cell[c] = 1.0 / (b->R0[c] + dt * b->inv_C[c]);
+   }
+
+   /* first guess at the present H; a bracket where every cell carries more than all of I either way */
+   double a = 0.0, s = 0.0, lo = INFINITY, hi = -INFINITY, G_min = INFINITY, Iq_max = 0.0;
+   for (int c=c0; c<c1; c++)
+   {
+      a += (E_cell[c] + b->H[c]) * G_cell[c];
+      s += G_cell[c];
+
+      double h_lo = (b->H_dsg[c] < b->H_chg[c]) ? b->H_dsg[c] : b->H_chg[c];
+      double h_hi = (b->H_dsg[c] < b->H_chg[c]) ? b->H_chg[c] : b->H_dsg[c];
+      h_lo = (b->H[c] < h_lo) ? b->H[c] : h_lo;
+      h_hi = (b->H[c] > h_hi) ? b->H[c] : h_hi;
+      lo = (E_cell[c] + h_lo < lo) ? E_cell[c] + h_lo : lo;
+      hi = (E_cell[c] + h_hi > hi) ? E_cell[c] + h_hi : hi;
+      G_min = (G_cell[c] < G_min) ? G_cell[c] : G_min;
+      Iq_max = (b->I_quit[c] > Iq_max) ? b->I_quit[c] : Iq_max;
+   }
+   lo -= (fabs(I) + Iq_max) / G_min + 1e-3;
+   hi += (fabs(I) + Iq_max) / G_min + 1e-3;
+
+   double V = (a - I) / s;
+   for (int it=0; it<PACK_SOLVE_ITER; it++)
+   {
+      double f = -I, df = 0.0, lin;
+      for (int c=c0; c<c1; c++)
+      {
+         f += cell_i(pk, c, V, &lin);
+         df += lin;
+      }
+      if (f == 0.0) break;
+
+      /* the sum falls with V */
+      if (f > 0.0) lo = V;
+      else hi = V;
+
+      double V_new = (df > 0.0) ? V + f / df : 0.5 * (lo + hi);
+      if (!(V_new > lo && V_new < hi)) V_new = 0.5 * (lo + hi);
+      if (fabs(V_new - V) < 1e-12) break;
+      V = V_new;
+   }
+
+   /* a cell held by its hysteresis ends at V too: its H takes up the difference, within the band */
+   for (int c=c0; c<c1; c++)
+   {
+      double lin;
+      I_cell[c] = cell_i(pk, c, V, &lin);
+      if (lin == 0.0) b->H[c] = V - E_cell[c] + I_cell[c] / G_cell[c];
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void job_stats(pack_job_t *jb)
+ *
+ *  @brief	Group voltages and SOC sums of the job's groups; extremes over its cells
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void job_stats(pack_job_t *jb)
+{
+   pack_t *pk = jb->pk;
+   const ecm_batch_t *b = pk->b;
+   const int n_p = pk->n_p;
+   const double I_mean = pk->I / n_p;
+
+   double soc_min = INFINITY, V_min = INFINITY, soc_max = -INFINITY, V_max = -INFINITY, T_max = -INFINITY;
+   double dI_max = 0.0;
+
+   for (int g=jb->g0; g<jb->g1; g++)
+   {
+      double V = 0.0, soc = 0.0;
+      for (int c=g*n_p; c<(g+1)*n_p; c++)
+      {
+         double dI = fabs(b->I[c] - I_mean);
+         V += b->V_batt[c];
+         soc += b->soc[c];
+         soc_min = (b->soc[c] < soc_min) ? b->soc[c] : soc_min;
+         soc_max = (b->soc[c] > soc_max) ? b->soc[c] : soc_max;
+         V_min = (b->V_batt[c] < V_min) ? b->V_batt[c] : V_min;
+         V_max = (b->V_batt[c] > V_max) ? b->V_batt[c] : V_max;
+         T_max = (b->T_C[c] > T_max) ? b->T_C[c] : T_max;
+         dI_max = (dI > dI_max) ? dI : dI_max;
+      }
+      pk->V_grp[g] = V / n_p;
+      pk->soc_grp[g] = soc;
+   }
+
+   jb->soc_min = soc_min;
+   jb->soc_max = soc_max;
+   jb->V_min = V_min;
+   jb->V_max = V_max;
+   jb->T_max = T_max;
+   jb->dI_max = dI_max;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void job_run(pack_job_t *jb)
+ *
+ *  @brief	One step of the job's groups: share the current, step the cells, statistics
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void job_run(pack_job_t *jb)
+{
+   pack_t *pk = jb->pk;
+   const int n_p = pk->n_p;
+
+   for (int g=jb->g0; g<jb->g1; g++) share_group(pk, g);
+   ecm_batch_update_cells(pk->b, jb->g0 * n_p, (jb->g1 - jb->g0) * n_p, pk->I_cell, pk->T_amb_C, pk->dt);
+   job_stats(jb);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void *pack_worker(void *arg)
+ *
+ *  @brief	Worker thread: runs its job on every step until the pack is cleared
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void *pack_worker(void *arg)
+{
+   pack_job_t *jb = (pack_job_t *)arg;
+   pack_t *pk = jb->pk;
+   unsigned seen = 0;
+
+   for (;;)
+   {
+      LOCK(&pk->mtx);
+      while (pk->gen == seen && !pk->quit) pthread_cond_wait(&pk->go, &pk->mtx);
+      bool quit = pk->quit;
+      seen = pk->gen;
+      UNLOCK(&pk->mtx);
+
+      if (quit) break;
+      job_run(jb);
+
+      LOCK(&pk->mtx);
+      if (--pk->busy == 0) pthread_cond_signal(&pk->done);
+      UNLOCK(&pk->mtx);
+   }
+
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void pack_stats(pack_t *pk)
+ *
+ *  @brief	Pack state and probed cells from the jobs' statistics
+ *
+ *  @note	The sums run over the groups in order, so the pack state is the same for any number of threads
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void pack_stats(pack_t *pk)
+{
+   const ecm_batch_t *b = pk->b;
+
+   pk->V = 0.0;
+   pk->soc = 0.0;
+   for (int g=0; g<pk->n_s; g++)
+   {
+      pk->V += pk->V_grp[g];
+      pk->soc += pk->soc_grp[g];
+   }
+   pk->soc /= b->n;
+
+   pk->soc_min = pk->V_min = INFINITY;
+   pk->soc_max = pk->V_max = pk->T_max = -INFINITY;
+   pk->dI_max = 0.0;
+   for (int k=0; k<pk->n_thr; k++)
+   {
+      const pack_job_t *jb = &pk->job[k];
+      pk->soc_min = fmin(pk->soc_min, jb->soc_min);
+      pk->soc_max = fmax(pk->soc_max, jb->soc_max);
+      pk->V_min = fmin(pk->V_min, jb->V_min);
+      pk->V_max = fmax(pk->V_max, jb->V_max);
+      pk->T_max = fmax(pk->T_max, jb->T_max);
+      pk->dI_max = fmax(pk->dI_max, jb->dI_max);
+   }
+
+   for (int k=0; k<PACK_PROBES; k++)
+   {
+      int c = pk->probe[k];
+      c = (c < 0) ? 0 : (c >= b->n) ? b->n - 1 : c;
+      pk->probe_V[k] = b->V_batt[c];
+      pk->probe_I[k] = b->I[c];
+      pk->probe_soc[k] = b->soc[c];
+      pk->probe_T[k] = b->T_C[c];
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		pack_t *pack_create(void)
+ *
+ *  @brief	Create a pack object, without cells until pack_build()
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+pack_t *pack_create(void)
+{
+   pack_t *pk = (pack_t *)calloc(1, sizeof(pack_t));
+   if (pk == NULL) return NULL;
+
+   pk->sd_R = DEFAULT_PACK_SD_R;
+   pk->sd_Q = DEFAULT_PACK_SD_Q;
+   pk->sd_V = DEFAULT_PACK_SD_V;
+   pk->seed = 1;
+   for (int k=0; k<PACK_PROBES; k++) pk->probe[k] = k;
+
+   if (pthread_mutex_init(&pk->mtx, NULL) != 0) goto _err_ret;
+   if (pthread_cond_init(&pk->go, NULL) != 0) goto _err_ret;
+   if (pthread_cond_init(&pk->done, NULL) != 0) goto _err_ret;
+
+   return pk;
+
+_err_ret:
+   free(pk);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int pack_build(pack_t *pk, const ecm_t *ecm, int n_s, int n_p, int nthreads)
+ *
+ *  @brief	Replace the pack with n_s groups in series of n_p cells in parallel, each a copy of 'ecm' (its
+ *		tables, fine OCV curve, measured temperature factors, RC branches and state) with the variation
+ *		of sd_R, sd_Q, sd_V and seed
+ *
+ *  @param	nthreads	threads stepping the pack, the caller's included; <= 0: one per CPU, as many as
+ *				have PACK_MIN_CELLS cells each
+ *
+ *  @return	0 if success; negative otherwise (no pack is left)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int pack_build(pack_t *pk, const ecm_t *ecm, int n_s, int n_p, int nthreads)
+{
+   if (pk == NULL || ecm == NULL || n_s < 1 || n_p < 1) return -1;
+   if ((long)n_s * n_p > PACK_MAX_CELLS) return -2;
+
+   pack_clear(pk);
+
+   int n = n_s * n_p;
+   pk->b = ecm_batch_create(ecm, n);
+   pk->I_cell = (double *)calloc(n, sizeof(double));
+   pk->V_grp = (double *)calloc(n_s, sizeof(double));
+   pk->soc_grp = (double *)calloc(n_s, sizeof(double));
+   pk->E_cell = (double *)calloc(n, sizeof(double));
+   pk->G_cell = (double *)calloc(n, sizeof(double));
+   if (pk->b == NULL || pk->I_cell == NULL || pk->V_grp == NULL || pk->soc_grp == NULL || pk->E_cell == NULL ||
+       pk->G_cell == NULL) goto _err_ret;
+   pk->n_s = n_s;
+   pk->n_p = n_p;
+
+   /* cell-to-cell variation */
+   uint64_t s = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(unsigned)pk->seed * 0xBF58476D1CE4E5B9ULL);
+   if (s == 0) s = 1;
+   ecm_batch_t *b = pk->b;
+   for (int c=0; c<n; c++)
+   {
+      double k_R = 1.0 + pk->sd_R * randn(&s);
+      double k_Q = 1.0 + pk->sd_Q * randn(&s);
+      double dV = pk->sd_V * randn(&s);
+
+      b->k_R0[c] = b->k_R[c] = (k_R < 0.2) ? 0.2 : k_R;
+      b->Q_Ah[c] *= (k_Q < 0.2) ? 0.2 : k_Q;
+      b->dV_oc[c] = dV;
+      b->V_oc[c] += dV;
+      b->R0[c] *= b->k_R0[c];
+      b->dV_rc[c] /= b->k_R[c];
+   }
+
+   /* threads, each a share of the groups */
+   if (nthreads <= 0)
+   {
+      long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      nthreads = (ncpu > 0) ? (int)ncpu : 1;
+      if (nthreads > n / PACK_MIN_CELLS) nthreads = n / PACK_MIN_CELLS;
+   }
+   if (nthreads > PACK_MAX_THREADS) nthreads = PACK_MAX_THREADS;
+   if (nthreads > n_s) nthreads = n_s;
+   if (nthreads < 1) nthreads = 1;
+
+   for (int k=0; k<nthreads; k++)
+   {
+      pk->job[k].pk = pk;
+      pk->job[k].g0 = (int)((long)n_s * k / nthreads);
+      pk->job[k].g1 = (int)((long)n_s * (k+1) / nthreads);
+   }
+
+   pk->quit = false;
+   pk->gen = 0;
+   pk->n_thr = 1;
+   for (int k=1; k<nthreads; k++)
+   {
+      if (pthread_create(&pk->th[k], NULL, pack_worker, &pk->job[k]) != 0) goto _err_ret;
+      pk->n_thr++;
+   }
+
+   for (int k=0; k<pk->n_thr; k++) job_stats(&pk->job[k]);
+   pack_stats(pk);
+
+   return 0;
+
+_err_ret:
+   pack_clear(pk);
+   return -3;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void pack_clear(pack_t *pk)
+ *
+ *  @brief	Remove the cells (and stop the workers); the variation settings and probes are kept
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void pack_clear(pack_t *pk)
+{
+   if (pk == NULL) return;
+
+   LOCK(&pk->mtx);
+   pk->quit = true;
+   pthread_cond_broadcast(&pk->go);
+   UNLOCK(&pk->mtx);
+   for (int k=1; k<pk->n_thr; k++) pthread_join(pk->th[k], NULL);
+   pk->n_thr = 0;
+
+   ecm_batch_destroy(pk->b);
+   free(pk->I_cell);
+   free(pk->V_grp);
+   free(pk->soc_grp);
+   free(pk->E_cell);
+   free(pk->G_cell);
+   pk->b = NULL;
+   pk->I_cell = pk->V_grp = pk->soc_grp = pk->E_cell = pk->G_cell = NULL;
+   pk->n_s = pk->n_p = 0;
+
+   pk->I = pk->V = pk->soc = 0.0;
+   pk->soc_min = pk->soc_max = pk->V_min = pk->V_max = pk->T_max = pk->dI_max = 0.0;
+   for (int k=0; k<PACK_PROBES; k++)
+      pk->probe_V[k] = pk->probe_I[k] = pk->probe_soc[k] = pk->probe_T[k] = 0.0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int pack_update(pack_t *pk, double I, double T_amb_C, double dt)
+ *
+ *  @brief	Step the pack one time step under pack current I (> 0 discharge)
+ *
+ *  @return	0 if success (nothing to do without cells); negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int pack_update(pack_t *pk, double I, double T_amb_C, double dt)
+{
+   if (pk == NULL) return -1;
+   if (pk->b == NULL) return 0;
+
+   pk->I = pk->I_step = I;
+   pk->T_amb_C = T_amb_C;
+   pk->dt = dt;
+
+   if (pk->n_thr > 1)
+   {
+      LOCK(&pk->mtx);
+      pk->busy = pk->n_thr - 1;
+      pk->gen++;
+      pthread_cond_broadcast(&pk->go);
+      UNLOCK(&pk->mtx);
+   }
+
+   job_run(&pk->job[0]);
+
+   if (pk->n_thr > 1)
+   {
+      LOCK(&pk->mtx);
+      while (pk->busy > 0) pthread_cond_wait(&pk->done, &pk->mtx);
+      UNLOCK(&pk->mtx);
+   }
+
+   pack_stats(pk);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int pack_dump(const pack_t *pk, const char *path)
+ *
+ *  @brief	Write the state and variation of every cell to a CSV file
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int pack_dump(const pack_t *pk, const char *path)
+{
+   if (pk == NULL || path == NULL) return -1;
+   if (pk->b == NULL) return -2;
+
+   FILE *fp = fopen(path, "w");
+   if (fp == NULL) return -3;
+
+   const ecm_batch_t *b = pk->b;
+   fprintf(fp, "cell,group,soc,V_batt,I,T_C,H,R0,Q_Ah,k_R,dV_oc\n");
+   for (int c=0; c<b->n; c++)
+   {
+      fprintf(fp, "%d,%d,%.9lf,%.9lf,%.9lf,%.6lf,%.6lf,%.9lf,%.6lf,%.6lf,%.9lf\n", c, c / pk->n_p,
+              b->soc[c], b->V_batt[c], b->I[c], b->T_C[c], b->H[c], b->R0[c], b->Q_Ah[c], b->k_R[c], b->dV_oc[c]);
+   }
+
+   return (fclose(fp) == 0) ? 0 : -4;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void pack_destroy(pack_t *pk)
+ *
+ *  @brief	Free the pack
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void pack_destroy(pack_t *pk)
+{
+   if (pk == NULL) return;
+
+   pack_clear(pk);
+   pthread_cond_destroy(&pk->go);
+   pthread_cond_destroy(&pk->done);
+   pthread_mutex_destroy(&pk->mtx);
+   free(pk);
+}
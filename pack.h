@@ -0,0 +1,91 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		pack.h
+ *
+ *  @brief		Battery pack header: n_s groups in series, each of n_p cells in parallel
+ *
+ *  @note		The cells are one batch of ECM cells (cell c is cell c % n_p of group c / n_p), copies of a
+ *			template cell with random cell-to-cell variation of R, capacity and OCV.  Every step the
+ *			pack current is shared among the cells of each group so they end at one voltage, and the
+ *			groups are solved and stepped in parallel on worker threads when the pack is large.
+ *
+ *=====================================================================================================================
+ */
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ecm.h"
+#include "ecm_batch.h"
+
+
+#define PACK_MAX_CELLS		(1<<24)		/* max cells of a pack */
+#define PACK_MAX_THREADS	(16)		/* max worker threads, the caller's included */
+#define PACK_MIN_CELLS		(8192)		/* fewest cells per thread: a step of fewer costs less than a wakeup */
+#define PACK_PROBES		(4)		/* cells whose state is exposed as params */
+#define PACK_SOLVE_ITER		(50)		/* max Newton steps of a group's current sharing */
+
+
+struct _pack;
+
+typedef struct {
+   struct _pack *pk;
+   int g0, g1;				/* groups of the thread */
+   double soc_min, soc_max, V_min, V_max, T_max, dI_max;	/* over its cells, after the step */
+}
+pack_job_t;
+
+
+typedef struct _pack {
+   /* cell-to-cell variation of the next pack_build(), normal with these standard deviations */
+   double sd_R;				/* of the R0 and branch R scale (relative) */
+   double sd_Q;				/* of the capacity scale (relative) */
+   double sd_V;				/* of the OCV offset (V) */
+   int seed;
+
+   int n_s, n_p;			/* topology; 0 if no pack */
+   ecm_batch_t *b;			/* the cells; NULL if no pack */
+   double *I_cell;			/* current of each cell in the step */
+   double *V_grp;			/* voltage of each group */
+   double *soc_grp;			/* sum of the cell SOC of each group */
+   double *E_cell, *G_cell;		/* each cell's E and 1/Z in the group solves (V = E + H - I Z) */
+
+   /* pack state, after the last step */
+   double I;				/* pack current (> 0 discharge) */
+   double V;				/* pack voltage: the sum of the group voltages */
+   double soc;				/* mean cell SOC */
+   double soc_min, soc_max;		/* the weakest cell ends discharge, the strongest charge */
+   double V_min, V_max;			/* cell voltages */
+   double T_max;			/* hottest cell */
+   double dI_max;			/* largest |I_cell - I/n_p|: the imbalance of the current sharing */
+
+   /* probed cells: set probe[k] to a cell; V, I, soc, T of it after every step */
+   int probe[PACK_PROBES];
+   double probe_V[PACK_PROBES], probe_I[PACK_PROBES], probe_soc[PACK_PROBES], probe_T[PACK_PROBES];
+
+   /* workers: job[0] is run by the caller of pack_update(), job[1..n_thr-1] by the threads */
+   int n_thr;
+   pack_job_t job[PACK_MAX_THREADS];
+   pthread_t th[PACK_MAX_THREADS];
+   pthread_mutex_t mtx;
+   pthread_cond_t go, done;
+   unsigned gen;			/* step count, bumped to start the workers */
+   int busy;				/* workers not done with the step */
+   bool quit;
+   double I_step, T_amb_C, dt;		/* the step the workers run */
+}
+pack_t;
+
+
+pack_t *pack_create(void);
+int pack_build(pack_t *pk, const ecm_t *ecm, int n_s, int n_p, int nthreads);
+void pack_clear(pack_t *pk);
+int pack_update(pack_t *pk, double I, double T_amb_C, double dt);
+int pack_dump(const pack_t *pk, const char *path);
+void pack_destroy(pack_t *pk);
+
+
+#endif // __PACK_H__
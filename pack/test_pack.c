@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 199309L
+#include "pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define DT_S        (0.25)
+
+extern flash_params_t g_batt_flash_params;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ecm_t *make_ecm(int n_rc, double soc) {
+    ecm_t *e = ecm_alloc();
+    assert(e != NULL);
+    assert(ecm_init(e, &g_batt_flash_params, 25.0) == 0);
+    e->n_rc = n_rc;
+    ecm_load_rows(e);
+    double row[ECM_ROW_W];
+    ecm_lookup_row(e, soc, row);
+    e->soc = soc;
+    e->V_oc = row[ECM_OCV];
+    e->R0 = row[ECM_R0];
+    return e;
+}
+
+static pack_t *make_pack(const ecm_t *e, int n_s, int n_p, double sd_R, double sd_Q, double sd_V, int nthreads) {
+    pack_t *pk = pack_create();
+    assert(pk != NULL);
+    pk->sd_R = sd_R;
+    pk->sd_Q = sd_Q;
+    pk->sd_V = sd_V;
+    assert(pack_build(pk, e, n_s, n_p, nthreads) == 0);
+    return pk;
+}
+
+/* a pack of one cell without variation is that cell */
+static void test_single(void) {
+    ecm_t *e = make_ecm(2, 0.8);
+    pack_t *pk = make_pack(e, 1, 1, 0.0, 0.0, 0.0, 1);
+    ecm_batch_t *b = ecm_batch_create(e, 1);
+    assert(b != NULL);
+
+    for (int k = 0; k < 20000; k++) {
+        double I = (k % 2000 < 1200) ? 3.0 : -1.0;
+        assert(pack_update(pk, I, 25.0, DT_S) == 0);
+        assert(ecm_batch_update(b, &I, 25.0, DT_S) == 0);
+        assert(pk->V == b->V_batt[0] && pk->soc == b->soc[0] && pk->b->T_C[0] == b->T_C[0]);
+    }
+    printf("1s1p: the pack steps as its cell\n");
+
+    ecm_batch_destroy(b);
+    pack_destroy(pk);
+    free(e);
+}
+
+/* after an OCV load and a temperature map load, a pack of one cell without variation still steps as the batt cell:
+ * the fine curve read bit for bit, R and C by the measured factors */
+static void test_loaded(void) {
+    enum { N_OCV = 2001, N_LV = 3, N_SOC = 11 };
+    ecm_t *e = make_ecm(2, 0.8);
+
+    /* a fine curve off the table by a wiggle, on an uneven grid */
+    static double x[N_OCV], y[N_OCV];
+    for (int i = 0; i < N_OCV; i++) {
+        x[i] = (i + 0.3 * sin(i * 0.7)) / (N_OCV - 1);
+        x[i] = (i == 0) ? 0.0 : (i == N_OCV - 1) ? 1.0 : x[i];
+        ecm_lookup_ocv(e, x[i], &y[i]);
+        y[i] += 0.01 * sin(40.0 * x[i]);
+    }
+    tbl_t *ocv = tbl_create(x, y, N_OCV, 0);
+    assert(ocv != NULL);
+    ecm_set_ocv(e, ocv);
+
+    /* R0, R1 fall and C1 rises with temperature, not as Arrhenius */
+    double T[N_LV * N_SOC], soc[N_LV * N_SOC], r0[N_LV * N_SOC], r1[N_LV * N_SOC], c1[N_LV * N_SOC];
+    double T_lv[N_LV] = { 0.0, 25.0, 45.0 };
+    for (int l = 0; l < N_LV; l++) {
+        for (int i = 0; i < N_SOC; i++) {
+            int r = l * N_SOC + i;
+            double row[ECM_ROW_W];
+            T[r] = T_lv[l];
+            soc[r] = (double)i / (N_SOC - 1);
+            ecm_lookup_row(e, soc[r], row);
+            r0[r] = row[ECM_R0] * (1.0 + 0.03 * (25.0 - T[r]));
+            r1[r] = row[ECM_R1] * (1.0 + 0.02 * (25.0 - T[r]));
+            c1[r] = row[ECM_C1] * (1.0 - 0.01 * (25.0 - T[r]));
+        }
+    }
+    const double *const val[3] = { r0, r1, c1 };
+    assert(ecm_load_tf(e, T, soc, val, N_LV * N_SOC) == N_LV);
+
+    pack_t *pk = make_pack(e, 1, 1, 0.0, 0.0, 0.0, 1);
+    ecm_batch_t *b = pk->b;
+    assert(b->ocv_n == N_OCV && b->tf != NULL);
+
+    double max_dv = 0.0, max_dr = 0.0, max_docv = 0.0;
+    for (int k = 0; k < 20000; k++) {
+        double I = (k % 2000 < 1200) ? 3.0 : (k % 2000 < 1600) ? 0.0 : -2.0;
+        double T_amb = 20.0 + 20.0 * sin(k * 3e-4);
+        assert(pack_update(pk, I, T_amb, DT_S) == 0);
+        assert(ecm_update(e, I, T_amb, k * DT_S, DT_S) == 0);
+
+        /* the fine curve: the table and the wiggle */
+        double v;
+        tbl_grid_interp(&e->soc_grid, e->params.soc_tbl, e->params.ocv_tbl, e->soc, &v);
+        max_docv = fmax(max_docv, fabs(b->V_oc[0] - v - 0.01 * sin(40.0 * e->soc)));
+
+        assert(b->soc[0] == e->soc && b->V_oc[0] == e->V_oc && b->H[0] == e->H);
+        max_dr = fmax(max_dr, fabs(b->R0[0] / e->R0 - 1.0));
+        max_dv = fmax(max_dv, fabs(pk->V - e->V_batt));
+    }
+    assert(max_docv < 1e-4);
+    assert(max_dr < 1e-9);
+    assert(max_dv < 1e-6);
+    printf("1s1p after ocv and tmap load: OCV bit for bit, R0 within %.1e, V within %.1e V of batt\n", max_dr, max_dv);
+
+    pack_destroy(pk);
+    ecm_cleanup(e);
+    free(e);
+}
+
+/* the cells of a group carry the pack current between them and end every step at one voltage; the one of less
+ * R takes more */
+static void test_parallel(int n_rc) {
+    ecm_t *e = make_ecm(n_rc, 0.9);
+    pack_t *pk = make_pack(e, 1, 6, 0.1, 0.05, 0.005, 1);
+    ecm_batch_t *b = pk->b;
+
+    double max_dv = 0.0, max_di = 0.0;
+    for (int k = 0; k < 40000; k++) {
+        double I = (k % 4000 < 2400) ? 12.0 : (k % 4000 < 3200) ? 0.0 : -6.0;
+        assert(pack_update(pk, I, 25.0, DT_S) == 0);
+
+        double sum = 0.0;
+        for (int c = 0; c < 6; c++) {
+            sum += b->I[c];
+            max_dv = fmax(max_dv, fabs(b->V_batt[c] - pk->V));
+        }
+        max_di = fmax(max_di, fabs(sum - I));
+    }
+    assert(max_di < 1e-7);
+    assert(max_dv < 1e-4);
+
+    /* at one state, the cell of least R carries the most */
+    pack_t *p2 = make_pack(e, 1, 2, 0.0, 0.0, 0.0, 1);
+    p2->b->k_R0[1] = p2->b->k_R[1] = 2.0;
+    p2->b->R0[1] *= 2.0;
+    assert(pack_update(p2, 3.0, 25.0, DT_S) == 0);
+    assert(p2->b->I[0] > 1.9 && p2->b->I[0] < 2.1 && p2->b->I[1] > 0.9 && p2->b->I[1] < 1.1);
+
+    printf("%d RC 1s6p: currents sum to I within %.1e A, cells of a group within %.1e V\n", n_rc, max_di, max_dv);
+    pack_destroy(p2);
+    pack_destroy(pk);
+    free(e);
+}
+
+/* at rest, cells of different OCV settle without flipping their hysteresis back and forth */
+static void test_rest(void) {
+    ecm_t *e = make_ecm(1, 0.6);
+    pack_t *pk = make_pack(e, 1, 4, 0.1, 0.05, 0.01, 1);
+    ecm_batch_t *b = pk->b;
+
+    for (int k = 0; k < 4000; k++) assert(pack_update(pk, 8.0, 25.0, DT_S) == 0);
+
+    double I_prev[4] = { 0 };
+    int flips = 0;
+    for (int k = 0; k < 14400; k++) {
+        assert(pack_update(pk, 0.0, 25.0, DT_S) == 0);
+        for (int c = 0; c < 4; c++) {
+            if (k > 0 && b->I[c] * I_prev[c] < 0.0 && fabs(b->I[c]) > b->I_quit[c]) flips++;
+            I_prev[c] = b->I[c];
+        }
+    }
+    assert(flips == 0);
+    for (int c = 0; c < 4; c++) assert(fabs(b->I[c]) <= b->I_quit[c] * (1.0 + 1e-6));
+    printf("1s4p rest: no flips, every cell within I_quit after 1 h\n");
+
+    pack_destroy(pk);
+    free(e);
+}
+
+/* in series the weakest cell ends the discharge: the pack pauses on soc_min while the others hold charge */
+static void test_series(void) {
+    ecm_t *e = make_ecm(1, 1.0);
+    pack_t *pk = make_pack(e, 4, 2, 0.05, 0.05, 0.002, 1);
+
+    int k = 0;
+    while (pk->soc_min > 0.0 && k < 100000) {
+        assert(pack_update(pk, 2.0 * 2, 25.0, DT_S) == 0);
+        k++;
+    }
+    assert(pk->soc_min <= 0.0 && pk->soc_max > 0.02);
+
+    double V = 0.0;
+    for (int g = 0; g < pk->n_s; g++) V += pk->V_grp[g];
+    assert(V == pk->V);
+    printf("4s2p: weakest cell empty at t=%.0f s, the strongest at soc %.3f\n", k * DT_S, pk->soc_max);
+
+    pack_destroy(pk);
+    free(e);
+}
+
+/* the groups are independent: any number of threads steps the same pack */
+static void test_threads(void) {
+    ecm_t *e = make_ecm(2, 0.9);
+    pack_t *p1 = make_pack(e, 16, 64, 0.1, 0.05, 0.005, 1);
+    pack_t *p4 = make_pack(e, 16, 64, 0.1, 0.05, 0.005, 4);
+    assert(p1->n_thr == 1 && p4->n_thr == 4);
+
+    for (int k = 0; k < 4000; k++) {
+        double I = (k % 1000 < 600) ? 128.0 : -32.0;
+        assert(pack_update(p1, I, 25.0, DT_S) == 0);
+        assert(pack_update(p4, I, 25.0, DT_S) == 0);
+    }
+    assert(memcmp(p1->b->V_batt, p4->b->V_batt, p1->b->n * sizeof(double)) == 0);
+    assert(memcmp(p1->b->soc, p4->b->soc, p1->b->n * sizeof(double)) == 0);
+    assert(p1->V == p4->V && p1->soc == p4->soc && p1->dI_max == p4->dI_max);
+    printf("16s64p: 1 and 4 threads step the same pack\n");
+
+    pack_destroy(p1);
+    pack_destroy(p4);
+    free(e);
+}
+
+/* cells per second of a large pack, one thread and one per CPU */
+static void bench(void) {
+    enum { NS = 64, NP = 1024, STEPS = 200 };
+    ecm_t *e = make_ecm(1, 0.9);
+    int thr[2] = { 1, 0 };
+    for (int t = 0; t < 2; t++) {
+        pack_t *pk = make_pack(e, NS, NP, 0.05, 0.02, 0.002, thr[t]);
+        double t0 = now_s();
+        for (int k = 0; k < STEPS; k++) pack_update(pk, 2.0 * NP, 25.0, DT_S);
+        double t1 = now_s();
+        printf("%ds%dp, %d thread%s: %6.1f M cells/s\n", NS, NP, pk->n_thr, (pk->n_thr > 1) ? "s" : "",
+               (double)NS * NP * STEPS / (t1 - t0) * 1e-6);
+        pack_destroy(pk);
+    }
+    free(e);
+}
+
+int main(void) {
+    test_single();
+    test_loaded();
+    for (int n_rc = 1; n_rc <= ECM_RC_MAX; n_rc++) test_parallel(n_rc);
+    test_rest();
+    test_series();
+    test_threads();
+    bench();
+    printf("All pack tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,274 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		scope_live.c
+ *
+ *  @brief		Live scope of a running simulation implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "globals.h"
+#include "scope_plot.h"
+#include "scope_live.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		scope_live_t *scope_live_create(params_t *params)
+ *
+ *  @brief	Create a live scope.  Columns are added with scope_live_add_col(), then scope_live_start().
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+scope_live_t *scope_live_create(params_t *params)
+{
+   if (params == NULL) return NULL;
+
+   scope_live_t *sl = (scope_live_t *)calloc(1, sizeof(scope_live_t));
+   if (sl == NULL) return NULL;
+
+   sl->params = params;
+   sl->cap = SCOPE_LIVE_RING;
+   atomic_init(&sl->head, 0);
+   atomic_init(&sl->tail, 0);
+   atomic_init(&sl->dropped, 0);
+   atomic_init(&sl->stop, false);
+   atomic_init(&sl->running, false);
+
+   return sl;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int scope_live_add_col(scope_live_t *sl, int params_sz, const char *name)
+ *
+ *  @brief	Add a column.  All columns must be added before scope_live_start().
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int scope_live_add_col(scope_live_t *sl, int params_sz, const char *name)
+{
+   if (sl == NULL || name == NULL) return -1;
+   if (sl->n >= MAX_PARAMS || sl->started) return -2;
+
+   for (int i=0; i<params_sz; i++)
+   {
+      if (0==strcmp(name, sl->params[i].name))
+      {
+         if (log_type_parse(sl->params[i].type, &sl->type[sl->n]) != 0) return -3;
+
+         sl->ptr[sl->n] = sl->params[i].value;
+         sl->idx[sl->n] = i;
+         sl->n++;
+         return 0;
+      }
+   }
+
+   return -5;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_live_push(scope_live_t *sl, double t)
+ *
+ *  @brief	Copy one row into the ring (sim thread).  Never blocks; the row is dropped if the ring is full
+ *		or the render thread is not running.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_live_push(scope_live_t *sl, double t)
+{
+   if (sl == NULL || sl->buf == NULL) return;
+
+   long head = atomic_load_explicit(&sl->head, memory_order_relaxed);
+   long tail = atomic_load_explicit(&sl->tail, memory_order_acquire);
+
+   if (head - tail >= sl->cap || !atomic_load_explicit(&sl->running, memory_order_relaxed))
+   {
+      atomic_fetch_add_explicit(&sl->dropped, 1, memory_order_relaxed);
+      return;
+   }
+
+   double *row = &sl->buf[(head & (sl->cap - 1)) * (sl->n + 1)];
+   row[0] = t;
+   for (int i=0; i<sl->n; i++)
+      row[i+1] = log_val(sl->type[i], sl->ptr[i]);
+
+   atomic_store_explicit(&sl->head, head + 1, memory_order_release);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void *scope_live_fn(void *arg)
+ *
+ *  @brief	Render thread: drain the ring into the plot and redraw the last 'window' secs, at most fps times
+ *		a second, until the window is closed or scope_live_destroy() asks it to stop
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+void *scope_live_fn(void *arg)
+{
+   scope_live_t *sl = (scope_live_t *)arg;
+   SDL_Window *win = NULL;
+   SDL_Renderer *ren = NULL;
+   scope_plot_t *p = NULL;
+   scope_trace_desc_t tr[MAX_PARAMS];
+   double t_last = 0.0;
+
+   win = SDL_CreateWindow("Scope", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1100, 650, SDL_WINDOW_SHOWN);
+   if (win == NULL) goto _err_ret;
+
+   ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
+   if (ren == NULL) goto _err_ret;
+
+   memset(tr, 0, sizeof(tr));
+   for (int i=0; i<sl->n; i++)
+   {
+      tr[i].name = sl->params[sl->idx[i]].name;
+      tr[i].color = sl->color[i];
+   }
+
+   scope_plot_cfg_t cfg = scope_plot_default_cfg();
+   cfg.max_points = sl->plot_pts;
+   p = scope_plot_create(win, ren, sl->n, tr, &cfg);
+   if (p == NULL) goto _err_ret;
+
+   scope_plot_set_title(p, "Scope");
+   scope_plot_set_x_label(p, "t");
+
+   Uint32 frame_ms = 1000 / (Uint32)sl->fps;
+   while (!atomic_load(&sl->stop))
+   {
+      Uint32 t0 = SDL_GetTicks();
+
+      /* drain what the sim thread produced since the last frame */
+      long head = atomic_load_explicit(&sl->head, memory_order_acquire);
+      long tail = atomic_load_explicit(&sl->tail, memory_order_relaxed);
+      for (; tail < head; tail++)
+      {
+         const double *row = &sl->buf[(tail & (sl->cap - 1)) * (sl->n + 1)];
+         scope_plot_push(p, row[0], &row[1]);
+         t_last = row[0];
+      }
+      atomic_store_explicit(&sl->tail, tail, memory_order_release);
+
+      scope_plot_set_x_range(p, t_last - sl->window, t_last);
+      scope_plot_render(p);
+      SDL_RenderPresent(ren);
+
+      SDL_Event e;
+      while (SDL_PollEvent(&e))
+      {
+         if (e.type == SDL_QUIT) atomic_store(&sl->stop, true);
+         if (e.type == SDL_KEYDOWN)
+         {
+            SDL_Keycode k = e.key.keysym.sym;
+            if (k == SDLK_ESCAPE || k == SDLK_q) atomic_store(&sl->stop, true);
+         }
+      }
+
+      Uint32 spent = SDL_GetTicks() - t0;
+      if (spent < frame_ms) SDL_Delay(frame_ms - spent);
+   }
+
+_err_ret:
+   atomic_store(&sl->running, false);
+   if (p != NULL) scope_plot_destroy(p);
+   if (ren != NULL) SDL_DestroyRenderer(ren);
+   if (win != NULL) SDL_DestroyWindow(win);
+
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int scope_live_start(scope_live_t *sl, const SDL_Color *colors, double window, int plot_pts, int fps)
+ *
+ *  @brief	Allocate the ring and start the render thread
+ *
+ *  @param	window		x-window in secs
+ *  @param	plot_pts	plot capacity; should hold at least one window of samples
+ *  @param	fps		frame rate cap
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int scope_live_start(scope_live_t *sl, const SDL_Color *colors, double window, int plot_pts, int fps)
+{
+   if (sl == NULL || colors == NULL || sl->n == 0 || sl->started || window <= 0.0 || fps <= 0) return -1;
+
+   sl->buf = (double *)malloc((size_t)sl->cap * (size_t)(sl->n + 1) * sizeof(double));
+   if (sl->buf == NULL) return -2;
+
+   memcpy(sl->color, colors, (size_t)sl->n * sizeof(SDL_Color));
+   sl->window = window;
+   sl->plot_pts = plot_pts;
+   sl->fps = (fps > 1000) ? 1000 : fps;
+
+   atomic_store(&sl->running, true);
+   if (pthread_create(&sl->th, NULL, scope_live_fn, sl) != 0)
+   {
+      atomic_store(&sl->running, false);
+      return -3;
+   }
+   sl->started = true;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool scope_live_running(scope_live_t *sl)
+ *
+ *  @brief	Is the scope window open?
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+bool scope_live_running(scope_live_t *sl)
+{
+   return (sl != NULL) && atomic_load(&sl->running);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_live_destroy(scope_live_t *sl)
+ *
+ *  @brief	Close the window, join the render thread and free the scope.  The sim thread must no longer
+ *		push to it.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_live_destroy(scope_live_t *sl)
+{
+   if (sl == NULL) return;
+
+   if (sl->started)
+   {
+      atomic_store(&sl->stop, true);
+      pthread_join(sl->th, NULL);
+   }
+   free(sl->buf);
+   free(sl);
+}
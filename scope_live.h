@@ -0,0 +1,71 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		scope_live.h
+ *
+ *  @brief		Live scope of a running simulation header
+ *
+ *  @note		The sim thread copies the selected params into a single-producer/single-consumer ring
+ *			(scope_live_push, no locks, never blocks; rows are dropped when the ring is full).  A
+ *			render thread drains the ring into a scope_plot and redraws a rolling x-window at a
+ *			capped frame rate.
+ *
+ *=====================================================================================================================
+ */
+#ifndef __SCOPE_LIVE_H__
+#define __SCOPE_LIVE_H__
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <SDL2/SDL.h>
+
+#include "globals.h"
+#include "logger.h"
+
+
+#define SCOPE_LIVE_RING		(1<<17)		/* ring rows between sim and render thread */
+#define SCOPE_LIVE_FPS		(30)		/* default frame rate cap */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Live scope
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   params_t *params;		/* string-enabled parameters (owned by sim) */
+   int n;			/* num of columns */
+   int idx[MAX_PARAMS];		/* param index per column */
+   log_type_t type[MAX_PARAMS];	/* value type per column */
+   const void *ptr[MAX_PARAMS];	/* value pointer per column */
+
+   /* SPSC ring: rows of n+1 doubles (t first) */
+   long cap;			/* ring rows (power of 2) */
+   double *buf;			/* ring storage */
+   atomic_long head;		/* rows written (sim thread) */
+   atomic_long tail;		/* rows read (render thread) */
+   atomic_long dropped;		/* rows dropped on a full ring */
+
+   /* render thread */
+   pthread_t th;
+   bool started;		/* thread was started */
+   atomic_bool stop;		/* ask render thread to exit */
+   atomic_bool running;		/* render thread is up */
+   SDL_Color color[MAX_PARAMS];	/* trace color per column */
+   double window;		/* x-window in secs */
+   int plot_pts;		/* plot ring capacity */
+   int fps;			/* frame rate cap */
+}
+scope_live_t;
+
+
+scope_live_t *scope_live_create(params_t *params);
+int scope_live_add_col(scope_live_t *sl, int params_sz, const char *name);
+void scope_live_push(scope_live_t *sl, double t);
+int scope_live_start(scope_live_t *sl, const SDL_Color *colors, double window, int plot_pts, int fps);
+bool scope_live_running(scope_live_t *sl);
+void scope_live_destroy(scope_live_t *sl);
+
+
+#endif // __SCOPE_LIVE_H__
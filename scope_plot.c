@@ -6,19 +6,33 @@
  *=====================================================================================================================
  */
 #include "scope_plot.h"
+#include "img_write.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <SDL2/SDL_ttf.h>
 
 
+#define SCOPE_BLK   (1024)  // samples per min/max block summary
+#define SCOPE_FAN   (8)     // fan-out of the min/max pyramid
+#define SCOPE_PTS   (4096)  // points per SDL_RenderDrawLinesF batch
+#define SCOPE_RECTS (256)   // 1-px lines per SDL_RenderFillRects batch
+#define SCOPE_LABELS (128)  // rasterized labels kept across frames
+#define SCOPE_LABEL_LEN (96)
+#define SCOPE_DENS_THREADS (8)        // max threads binning a density histogram
+#define SCOPE_DENS_MIN_CHUNK (1<<18)  // min samples per binning thread
+
+
 typedef struct 
 {
     double *x;      // ring buffer (shared x per trace would be nicer, but simpler per trace: keep x once globally)
     double *y;      // ring buffer
+    float *yf;      // ring buffer in compact mode (y is NULL)
     int head;       // next write index
     int size;       // number of valid samples
     SDL_Color color;
@@ -26,10 +40,33 @@ typedef struct
 } trace_t;
 
 
+// Per-pixel-column reduction of one trace (screen coordinates)
+typedef struct
+{
+    int first, last;    // y of first/last sample in the column
+    int min, max;       // y range in the column
+    bool used;          // column has samples
+    bool brk;           // first sample follows an out-of-window or NaN sample
+    bool gap;           // a NaN sample (no value) follows the last one: end the polyline here
+} px_col_t;
+
+
+// Rasterized text, reused while the same string is drawn in the same color
+typedef struct
+{
+    char txt[SCOPE_LABEL_LEN];
+    SDL_Color color;
+    SDL_Texture *tex;
+    int w, h;
+    unsigned used;      // clock of last use; 0 = empty
+} label_t;
+
+
 struct scope_plot 
 {
-    SDL_Window   *win;
+    SDL_Window   *win;          // NULL for a headless plot
     SDL_Renderer *ren;
+    SDL_Surface  *surf;         // headless: surface and renderer owned by the plot
 
     int trace_count;
     trace_t *traces;
@@ -40,6 +77,14 @@ struct scope_plot
     int size;
     int cap;
 
+    // Compact mode (cfg.compact): samples and pyramid nodes are float32 and x is a float offset from a
+    // double base per SCOPE_BLK block, so x keeps its resolution on long time axes.  Read through
+    // x_at() / y_at() / node_min() / node_max().
+    bool compact;
+    float *xoff;                    // x - xbase[block]; xbuf is NULL
+    double *xbase;                  // per block; NaN until its first non-NaN x
+    double xbase_prev;              // base of the older samples still after head in the head block
+
     double x_min, x_max;   // caller-controlled
 
     // Dual Y-axes (0=left, 1=right). Auto-assigned each render.
@@ -57,6 +102,63 @@ struct scope_plot
     // TTF
     bool ttf_inited_here;
     TTF_Font *font;
+
+    // Block summaries of the ring, updated on push: block b covers slots [b*SCOPE_BLK, (b+1)*SCOPE_BLK)
+    int blk_n;
+    double *blk_xmin, *blk_xmax;    // x range per block (NaN x excluded)
+    double *blk_ymin, *blk_ymax;    // y range per [trace][block]
+
+    // Autoscale cache: axis layout is recomputed only when a trace's window range changes
+    double *win_min, *win_max;      // per-trace range in the current x-window
+    double *as_min, *as_max;        // ranges the current layout was computed from
+    bool as_valid;
+
+    // Min/max pyramid for monotonic x: node k of level L (1..pyr_levels) covers slots [k*FAN^L, (k+1)*FAN^L).
+    // A node is folded into its parent when its last slot is written, so only nodes whose slots are all
+    // from the same lap of the ring are ever read.
+    int pyr_levels;
+    int *pyr_n;                     // nodes per level
+    void **pyr_min, **pyr_max;      // [level-1][trace * pyr_n + node], double (float in compact mode)
+    bool x_mono;                    // every x pushed so far is >= the one before it (and not NaN)
+    double x_last;
+
+    // Mouse pan
+    bool drag;
+    int drag_px;
+    double drag_x0, drag_x1;
+
+    // draw_traces scratch: trace_count x (plot width + 1) columns
+    px_col_t *px_cols;
+    int px_cols_cap;
+
+    // Geometry batches
+    SDL_FPoint pts[SCOPE_PTS];
+    SDL_Rect rects[SCOPE_RECTS];
+
+    // Label texture cache
+    label_t labels[SCOPE_LABELS];
+    unsigned label_clock;
+
+    // Static layer (background, grid, ticks, axis labels), redrawn only on resize or range change
+    bool layer_ok;                  // renderer supports target textures
+    bool layer_dirty;               // x label or background changed
+    SDL_Texture *layer;
+    int layer_w, layer_h;
+    double layer_rng[6];            // x_min, x_max, y_min[2], y_max[2] the layer was drawn with
+    bool layer_axis1;               // right axis was drawn
+
+    // XY density mode: samples binned into a per-pixel count histogram, drawn as one texture.  The
+    // histogram is rebuilt only when samples were pushed or the size or ranges changed.
+    bool density;
+    unsigned long pushes;           // samples pushed so far
+    uint32_t *dens_cnt;             // [trace][row][col] counts
+    uint32_t *dens_px;              // ARGB8888 pixels
+    size_t dens_cap;                // counts allocated
+    SDL_Texture *dens_tex;
+    int dens_w, dens_h;             // histogram (and texture) size
+    double dens_rng[6];             // ranges the histogram was built with
+    unsigned long dens_pushes;      // pushes the histogram was built with
+    bool dens_ok;                   // histogram is valid
 };
 
 
@@ -111,6 +213,7 @@ scope_plot_cfg_t scope_plot_default_cfg(void)
 
     c.y_padding_frac = 0.05f;
     c.max_points     = 24000000;
+    c.compact        = false;
 
     c.ttf_path = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
     c.font_px  = 14;
@@ -171,502 +274,515 @@ void fill_rect(SDL_Renderer *r, SDL_Rect rc, SDL_Color c)
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void render_text(SDL_Renderer *r, TTF_Font *font, const char *txt, SDL_Color color, int x, int y) 
+ *  @fn		void rect_flush(scope_plot_t *p, int *n) 
  *
- *  @brief	Render text
+ *  @brief	Submit the batched 1-px lines in the current draw color
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void render_text(SDL_Renderer *r, TTF_Font *font, const char *txt, SDL_Color color, int x, int y) 
+void rect_flush(scope_plot_t *p, int *n) 
 {
-    if (!font || !txt) return;
-    SDL_Surface *surf = TTF_RenderUTF8_Blended(font, txt, color);
-    if (!surf) return;
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(r, surf);
-    if (!tex) { SDL_FreeSurface(surf); return; }
-    SDL_Rect dst = { x, y, surf->w, surf->h };
-    SDL_RenderCopy(r, tex, NULL, &dst);
-    SDL_DestroyTexture(tex);
-    SDL_FreeSurface(surf);
+    if (*n > 0) SDL_RenderFillRects(p->ren, p->rects, *n);
+    *n = 0;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void render_text_center(SDL_Renderer *r, TTF_Font *font, const char *txt, 
- *                                      SDL_Color color, int cx, int cy) 
+ *  @fn		void rect_line(scope_plot_t *p, int *n, int x1, int y1, int x2, int y2) 
  *
- *  @brief	Render text centered
+ *  @brief	Add a horizontal or vertical line (end points included, like SDL_RenderDrawLine) to the batch
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void render_text_center(SDL_Renderer *r, TTF_Font *font, const char *txt, SDL_Color color, int cx, int cy) 
+void rect_line(scope_plot_t *p, int *n, int x1, int y1, int x2, int y2) 
 {
-    if (!font || !txt) return;
-    SDL_Surface *surf = TTF_RenderUTF8_Blended(font, txt, color);
-    if (!surf) return;
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(r, surf);
-    if (!tex) { SDL_FreeSurface(surf); return; }
-    SDL_Rect dst = { cx - surf->w/2, cy - surf->h/2, surf->w, surf->h };
-    SDL_RenderCopy(r, tex, NULL, &dst);
-    SDL_DestroyTexture(tex);
-    SDL_FreeSurface(surf);
+    if (*n == SCOPE_RECTS) rect_flush(p, n);
+
+    int x = (x1 < x2) ? x1 : x2, y = (y1 < y2) ? y1 : y2;
+    p->rects[(*n)++] = (SDL_Rect){ x, y, abs(x2 - x1) + 1, abs(y2 - y1) + 1 };
 }
 
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		bool in_x_window(double x, double xmin, double xmax) 
+ *  @fn		void pts_flush(scope_plot_t *p, int *n) 
  *
- *  @brief	Check if x inside window
+ *  @brief	Submit the batched polyline in the current draw color and start a new one
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-bool in_x_window(double x, double xmin, double xmax) 
+void pts_flush(scope_plot_t *p, int *n) 
 {
-    return (x >= xmin && x <= xmax);
+    if (*n > 1) SDL_RenderDrawLinesF(p->ren, p->pts, *n);
+    *n = 0;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void compute_y_autoscale(scope_plot_t *p) 
+ *  @fn		void pts_add(scope_plot_t *p, int *n, int x, int y) 
  *
- *  @brief	Compute Y autoscaling
+ *  @brief	Extend the batched polyline to (x, y).  A full batch is submitted and continued from its last
+ *		point.
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void compute_y_autoscale(scope_plot_t *p) 
+void pts_add(scope_plot_t *p, int *n, int x, int y) 
 {
-    // Dual-Y auto scale & trace-to-axis assignment based on per-trace data ranges
-    // within the current x-window.
-    const double EPS = 1e-12;
-    const double SPLIT_RATIO = 20.0; // only bother splitting if ranges differ a lot
-
-    double t_min[64], t_max[64], t_rng[64], t_logrng[64];
-    if (p->trace_count > 64) 
-    {
-        // Fallback: keep everything on left for very large trace counts
-        for (int t = 0; t < p->trace_count; t++) p->trace_axis[t] = 0;
-    } 
-    else 
-    {
-        // per-trace min/max
-        for (int t = 0; t < p->trace_count; t++) 
-	{
-            bool have = false;
-            double mn = 0.0, mx = 0.0;
-
-            for (int i = 0; i < p->size; i++) 
-	    {
-                int idx = (p->head - p->size + i);
-                if (idx < 0) idx += p->cap * ((-idx / p->cap) + 1);
-                idx %= p->cap;
-
-                double x = p->xbuf[idx];
-                if (!in_x_window(x, p->x_min, p->x_max)) continue;
-
-                double y = p->traces[t].y[idx];
-                if (!have) { mn = mx = y; have = true; }
-                else { if (y < mn) mn = y; if (y > mx) mx = y; }
-            }
-
-            if (!have) 
-	    { 
-	       mn = 0.0; 
-	       mx = 0.0; 
-	    }
-
-            t_min[t] = mn;
-            t_max[t] = mx;
-            double rng = t_max[t] - t_min[t];
-
-            if (rng < EPS) rng = EPS;
-            t_rng[t] = rng;
-            t_logrng[t] = log10(rng);
-        }
-
-        // Decide whether dual-axis is warranted
-        double rng_min = t_rng[0], rng_max = t_rng[0];
-        for (int t = 1; t < p->trace_count; t++) 
-	{
-            if (t_rng[t] < rng_min) rng_min = t_rng[t];
-            if (t_rng[t] > rng_max) rng_max = t_rng[t];
-        }
-
-        bool do_split = (rng_max / rng_min) >= SPLIT_RATIO;
-
-        if (!do_split) 
-	{
-            for (int t = 0; t < p->trace_count; t++) 
-	       p->trace_axis[t] = 0;
-        } 
-	else 
-	{
-            // 1D k-means (k=2) on log10(range)
-            double c1 = t_logrng[0], c2 = t_logrng[0];
-            for (int t = 1; t < p->trace_count; t++) 
-	    {
-                if (t_logrng[t] < c1) c1 = t_logrng[t];
-                if (t_logrng[t] > c2) c2 = t_logrng[t];
-            }
-
-            for (int it = 0; it < 12; it++) 
-	    {
-                double s1 = 0.0, s2 = 0.0;
-                int n1 = 0, n2 = 0;
-
-                for (int t = 0; t < p->trace_count; t++) 
-		{
-                    double d1 = fabs(t_logrng[t] - c1);
-                    double d2 = fabs(t_logrng[t] - c2);
-                    uint8_t a = (d2 < d1) ? 1 : 0;
-                    p->trace_axis[t] = a;
-                    if (a == 0) 
-		    { 
-		       s1 += t_logrng[t]; 
-		       n1++; 
-		    }
-                    else 
-		    { 
-		       s2 += t_logrng[t]; 
-		       n2++; 
-		    }
-                }
-
-                if (n1 > 0) c1 = s1 / (double)n1;
-                if (n2 > 0) c2 = s2 / (double)n2;
-                if (n1 == 0 || n2 == 0) break;
-            }
-
-            // Ensure both axes have at least one trace; if not, split by median
-            int n0 = 0, n1 = 0;
-            for (int t = 0; t < p->trace_count; t++) 
-	       (p->trace_axis[t] == 0) ? n0++ : n1++;
-
-            if (n0 == 0 || n1 == 0) 
-	    {
-                // median split
-                double tmp[64];
-                for (int t = 0; t < p->trace_count; t++) 
-                   tmp[t] = t_logrng[t];
-
-                // simple selection sort (small n)
-                for (int i = 0; i < p->trace_count; i++) 
-		{
-                   int k = i;
-                   for (int j = i+1; j < p->trace_count; j++) 
-		      if (tmp[j] < tmp[k]) k = j;
-
-                   double v = tmp[i]; tmp[i] = tmp[k]; tmp[k] = v;
-                }
-
-                double med = tmp[p->trace_count/2];
-                for (int t = 0; t < p->trace_count; t++) 
-                    p->trace_axis[t] = (t_logrng[t] > med) ? 1 : 0;
-            }
-
-            // Choose which cluster is left/right:
-            // Put the cluster with MORE traces on the left (more readable). If tie, larger-range cluster on left.
-            double sum_rng0 = 0.0, sum_rng1 = 0.0;
-            n0 = 0; n1 = 0;
-            for (int t = 0; t < p->trace_count; t++) 
-	    {
-                if (p->trace_axis[t] == 0) 
-		{ 
-	           sum_rng0 += t_rng[t]; 
-		   n0++; 
-		}
-                else
-		{ 
-	           sum_rng1 += t_rng[t]; 
-		   n1++; 
-		}
-            }
-
-            bool swap = false;
-            if (n1 > n0) 
-               swap = true;
-            else if (n1 == n0 && sum_rng1 > sum_rng0) 
-	       swap = true;
-
-            if (swap) 
-	    {
-                for (int t = 0; t < p->trace_count; t++) 
-	           p->trace_axis[t] ^= 1;
-            }
-        }
-    }
+    SDL_FPoint pt = { (float)x, (float)y };
 
-    // Compute y min/max per axis from visible samples
-    for (int a = 0; a < 2; a++) 
+    if (*n > 0 && p->pts[*n-1].x == pt.x && p->pts[*n-1].y == pt.y) return;
+    if (*n == SCOPE_PTS) 
     {
-        p->axis_used[a] = false;
-        p->y_min[a] = 0.0;
-        p->y_max[a] = 0.0;
+        SDL_FPoint last = p->pts[*n-1];
+        pts_flush(p, n);
+        p->pts[(*n)++] = last;
     }
+    p->pts[(*n)++] = pt;
+}
 
-    for (int a = 0; a < 2; a++) 
-    {
-        bool have = false;
-        double ymin = 0.0, ymax = 0.0;
-
-        for (int i = 0; i < p->size; i++) 
-	{
-            int idx = (p->head - p->size + i);
-            if (idx < 0) idx += p->cap * ((-idx / p->cap) + 1);
-            idx %= p->cap;
-
-            double x = p->xbuf[idx];
-            if (!in_x_window(x, p->x_min, p->x_max)) continue;
-
-            for (int t = 0; t < p->trace_count; t++) 
-	    {
-                if ((int)p->trace_axis[t] != a) 
-                   continue;
 
-                double y = p->traces[t].y[idx];
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		SDL_Texture *text_tex(scope_plot_t *p, const char *txt, SDL_Color color, int *w, int *h, 
+ *                                    bool *owned) 
+ *
+ *  @brief	Texture of a text in the given color.  Texts are rasterized once and kept in a small cache;
+ *		the least recently used entry makes room for a new one.
+ *
+ *  @note	Texts too long to cache return a texture the caller must destroy (*owned = true)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+SDL_Texture *text_tex(scope_plot_t *p, const char *txt, SDL_Color color, int *w, int *h, bool *owned) 
+{
+    *owned = false;
+    if (!p->font || !txt || !txt[0]) return NULL;
 
-                if (!have) 
-		{ 
-	           ymin = ymax = y; 
-		   have = true; 
-		}
-                else 
-		{ 
-	           if (y < ymin) 
-	              ymin = y; 
-		   if (y > ymax) 
-	              ymax = y; 
-		}
+    size_t len = strlen(txt);
+    label_t *lru = NULL;
+    if (len < SCOPE_LABEL_LEN) 
+    {
+        for (int i = 0; i < SCOPE_LABELS; i++) 
+        {
+            label_t *l = &p->labels[i];
+            if (l->used && l->color.r == color.r && l->color.g == color.g && l->color.b == color.b && 
+                l->color.a == color.a && 0 == strcmp(l->txt, txt)) 
+            {
+                l->used = ++p->label_clock;
+                *w = l->w; *h = l->h;
+                return l->tex;
             }
+            if (!lru || l->used < lru->used) lru = l;
         }
-
-        if (!have) continue;
-
-        if (ymax - ymin < 1e-12) 
-	{
-            double c = 0.5 * (ymax + ymin);
-            ymin = c - 1.0;
-            ymax = c + 1.0;
-        }
-
-        double span = ymax - ymin;
-        double pad = (double)p->cfg.y_padding_frac * span;
-        p->y_min[a] = ymin - pad;
-        p->y_max[a] = ymax + pad;
-        p->axis_used[a] = true;
     }
 
-    // If only one axis has data, mirror it so math doesn't divide by 0
-    if (p->axis_used[0] && !p->axis_used[1]) 
-    {
-        p->y_min[1] = p->y_min[0];
-        p->y_max[1] = p->y_max[0];
-    } 
-    else if (!p->axis_used[0] && p->axis_used[1]) 
-    {
-        p->y_min[0] = p->y_min[1];
-        p->y_max[0] = p->y_max[1];
-
-        // also move traces to left for consistency
-        for (int t = 0; t < p->trace_count; t++) 
-           p->trace_axis[t] = 0;
+    SDL_Surface *surf = TTF_RenderUTF8_Blended(p->font, txt, color);
+    if (!surf) return NULL;
+    SDL_Texture *tex = SDL_CreateTextureFromSurface(p->ren, surf);
+    *w = surf->w; *h = surf->h;
+    SDL_FreeSurface(surf);
+    if (!tex) return NULL;
 
-        p->axis_used[0] = true;
-        p->axis_used[1] = false;
-    } 
-    else if (!p->axis_used[0] && !p->axis_used[1]) 
+    if (!lru) 
     {
-        p->y_min[0] = -1.0; p->y_max[0] = 1.0;
-        p->y_min[1] = -1.0; p->y_max[1] = 1.0;
-        p->axis_used[0] = true;
-        p->axis_used[1] = false;
-        for (int t = 0; t < p->trace_count; t++) 
-           p->trace_axis[t] = 0;
+        *owned = true;
+        return tex;
     }
+
+    if (lru->tex) SDL_DestroyTexture(lru->tex);
+    memcpy(lru->txt, txt, len + 1);
+    lru->color = color;
+    lru->tex = tex;
+    lru->w = *w; lru->h = *h;
+    lru->used = ++p->label_clock;
+    return tex;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		int map_x(scope_plot_t *p, double x, int plot_x, int plot_w) 
+ *  @fn		void render_text(scope_plot_t *p, const char *txt, SDL_Color color, int x, int y) 
  *
- *  @brief	Map x into plot
+ *  @brief	Render text
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-int map_x(scope_plot_t *p, double x, int plot_x, int plot_w) 
+void render_text(scope_plot_t *p, const char *txt, SDL_Color color, int x, int y) 
 {
-    double den = (p->x_max - p->x_min);
-    if (fabs(den) < 1e-18) 
-       return plot_x;
-
-    double u = (x - p->x_min) / den;
-    if (u < 0.0) u = 0.0;
-    if (u > 1.0) u = 1.0;
-    return plot_x + (int)lround(u * (double)plot_w);
+    int w = 0, h = 0;
+    bool owned;
+    SDL_Texture *tex = text_tex(p, txt, color, &w, &h, &owned);
+    if (!tex) return;
+    SDL_Rect dst = { x, y, w, h };
+    SDL_RenderCopy(p->ren, tex, NULL, &dst);
+    if (owned) SDL_DestroyTexture(tex);
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		int map_y(scope_plot_t *p, double y, int axis, int plot_y, int plot_h) 
+ *  @fn		void render_text_center(scope_plot_t *p, const char *txt, SDL_Color color, int cx, int cy) 
  *
- *  @brief	Map Y into plot
+ *  @brief	Render text centered
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-int map_y(scope_plot_t *p, double y, int axis, int plot_y, int plot_h) 
+void render_text_center(scope_plot_t *p, const char *txt, SDL_Color color, int cx, int cy) 
 {
-    double den = (p->y_max[axis] - p->y_min[axis]);
-    if (fabs(den) < 1e-18) return plot_y + plot_h/2;
-    double v = (y - p->y_min[axis]) / den; // 0..1 bottom->top
-    if (v < 0.0) v = 0.0;
-    if (v > 1.0) v = 1.0;
-    return plot_y + plot_h - (int)lround(v * (double)plot_h);
+    int w = 0, h = 0;
+    bool owned;
+    SDL_Texture *tex = text_tex(p, txt, color, &w, &h, &owned);
+    if (!tex) return;
+    SDL_Rect dst = { cx - w/2, cy - h/2, w, h };
+    SDL_RenderCopy(p->ren, tex, NULL, &dst);
+    if (owned) SDL_DestroyTexture(tex);
 }
 
-
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void draw_grid(scope_plot_t *p, SDL_Rect pr) 
+ *  @fn		bool in_x_window(double x, double xmin, double xmax) 
  *
- *  @brief	Draw plot grids
+ *  @brief	Check if x inside window
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void draw_grid(scope_plot_t *p, SDL_Rect pr) 
+bool in_x_window(double x, double xmin, double xmax) 
 {
-    // Minor grid
-    int major_x = (p->cfg.grid_major_div_x > 0) ? p->cfg.grid_major_div_x : 10;
-    int major_y = (p->cfg.grid_major_div_y > 0) ? p->cfg.grid_major_div_y : 10;
-    int minor   = (p->cfg.grid_minor_div   > 0) ? p->cfg.grid_minor_div   : 5;
+    return (x >= xmin && x <= xmax);
+}
 
-    // Vertical lines
-    for (int mx = 0; mx <= major_x; mx++) 
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double x_at(const scope_plot_t *p, int i) 
+ *
+ *  @brief	x of ring slot i
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline 
+double x_at(const scope_plot_t *p, int i) 
+{
+    if (!p->compact) return p->xbuf[i];
+
+    // a head block that is partly overwritten: slots from head on still hold the previous lap
+    int b = i / SCOPE_BLK;
+    bool prev = (i >= p->head && b == p->head / SCOPE_BLK && p->head % SCOPE_BLK != 0);
+    double base = prev ? p->xbase_prev : p->xbase[b];
+    return base + (double)p->xoff[i];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double y_at(const scope_plot_t *p, int t, int i) 
+ *
+ *  @brief	y of trace t at ring slot i
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline 
+double y_at(const scope_plot_t *p, int t, int i) 
+{
+    return p->compact ? (double)p->traces[t].yf[i] : p->traces[t].y[i];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double node_min(const scope_plot_t *p, int L, size_t k) 
+ *
+ *  @brief	Min of node k (trace * pyr_n + node) of pyramid level L >= 1; node_max() likewise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline 
+double node_min(const scope_plot_t *p, int L, size_t k) 
+{
+    return p->compact ? (double)((const float*)p->pyr_min[L-1])[k] : ((const double*)p->pyr_min[L-1])[k];
+}
+
+static inline 
+double node_max(const scope_plot_t *p, int L, size_t k) 
+{
+    return p->compact ? (double)((const float*)p->pyr_max[L-1])[k] : ((const double*)p->pyr_max[L-1])[k];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void node_set(scope_plot_t *p, int L, size_t k, double mn, double mx) 
+ *
+ *  @brief	Set node k of pyramid level L >= 1.  In compact mode mn/mx are float values already, so
+ *		storing them is exact.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline 
+void node_set(scope_plot_t *p, int L, size_t k, double mn, double mx) 
+{
+    if (p->compact) 
     {
-        int x = pr.x + (int)lround((double)mx * pr.w / (double)major_x);
+        ((float*)p->pyr_min[L-1])[k] = (float)mn;
+        ((float*)p->pyr_max[L-1])[k] = (float)mx;
+    }
+    else 
+    {
+        ((double*)p->pyr_min[L-1])[k] = mn;
+        ((double*)p->pyr_max[L-1])[k] = mx;
+    }
+}
 
-        // minor subdivisions between this and next major
-        if (mx < major_x) 
-	{
-            int x_next = pr.x + (int)lround((double)(mx+1) * pr.w / (double)major_x);
-            for (int k = 1; k < minor; k++) 
-	    {
-                int xm = x + (int)lround((double)k * (x_next - x) / (double)minor);
-                draw_line(p->ren, xm, pr.y, xm, pr.y + pr.h, p->cfg.grid_minor);
-            }
-        }
-        draw_line(p->ren, x, pr.y, x, pr.y + pr.h, p->cfg.grid_major);
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void blk_reset(scope_plot_t *p, int b) 
+ *
+ *  @brief	Empty the summary of block b
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void blk_reset(scope_plot_t *p, int b) 
+{
+    p->blk_xmin[b] = INFINITY;
+    p->blk_xmax[b] = -INFINITY;
+    for (int t = 0; t < p->trace_count; t++) 
+    {
+        p->blk_ymin[t * p->blk_n + b] = INFINITY;
+        p->blk_ymax[t * p->blk_n + b] = -INFINITY;
     }
+}
 
-    // Horizontal lines
-    for (int my = 0; my <= major_y; my++) 
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scan_slots(scope_plot_t *p, int a, int b) 
+ *
+ *  @brief	Fold ring slots [a, b) that are inside the x-window into win_min/win_max
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void scan_slots(scope_plot_t *p, int a, int b) 
+{
+    for (int i = a; i < b; i++) 
     {
-        int y = pr.y + (int)lround((double)my * pr.h / (double)major_y);
+        if (!in_x_window(x_at(p, i), p->x_min, p->x_max)) continue;
 
-        if (my < major_y) 
-	{
-            int y_next = pr.y + (int)lround((double)(my+1) * pr.h / (double)major_y);
-            for (int k = 1; k < minor; k++) 
-	    {
-                int ym = y + (int)lround((double)k * (y_next - y) / (double)minor);
-                draw_line(p->ren, pr.x, ym, pr.x + pr.w, ym, p->cfg.grid_minor);
-            }
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            double y = y_at(p, t, i);
+            if (y < p->win_min[t]) p->win_min[t] = y;
+            if (y > p->win_max[t]) p->win_max[t] = y;
         }
-        draw_line(p->ren, pr.x, y, pr.x + pr.w, y, p->cfg.grid_major);
     }
-
-    // Plot border (axis)
-    draw_line(p->ren, pr.x, pr.y, pr.x + pr.w, pr.y, p->cfg.axis);
-    draw_line(p->ren, pr.x, pr.y + pr.h, pr.x + pr.w, pr.y + pr.h, p->cfg.axis);
-    draw_line(p->ren, pr.x, pr.y, pr.x, pr.y + pr.h, p->cfg.axis);
-    draw_line(p->ren, pr.x + pr.w, pr.y, pr.x + pr.w, pr.y + pr.h, p->cfg.axis);
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void draw_axis_labels(scope_plot_t *p, SDL_Rect pr) 
+ *  @fn		int ring_slot(scope_plot_t *p, int i) 
  *
- *  @brief	Draw axis labels
+ *  @brief	Ring slot of the i-th oldest sample
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void draw_axis_labels(scope_plot_t *p, SDL_Rect pr) 
+int ring_slot(scope_plot_t *p, int i) 
 {
-    int major_x = (p->cfg.grid_major_div_x > 0) ? p->cfg.grid_major_div_x : 10;
-    int major_y = (p->cfg.grid_major_div_y > 0) ? p->cfg.grid_major_div_y : 10;
-
-    // X labels (bottom)
-    for (int i = 0; i <= major_x; i++) 
-    {
-        double x = p->x_min + (p->x_max - p->x_min) * ((double)i / (double)major_x);
-        int sx = pr.x + (int)lround((double)i * pr.w / (double)major_x);
+    int idx = p->head - p->size + i;
+    return (idx < 0) ? idx + p->cap : (idx >= p->cap ? idx - p->cap : idx);
+}
 
-        char buf[64];
-        snprintf(buf, sizeof(buf), "%.3g", x);
 
-        render_text_center(p->ren, p->font, buf, p->cfg.text, sx, pr.y + pr.h + 18);
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void pyr_push(scope_plot_t *p, int s) 
+ *
+ *  @brief	Fold the sample just written to slot s into the pyramid.  The first child of a node restarts it
+ *		and each completed node is folded one level up, so a push costs O(1) amortized.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void pyr_push(scope_plot_t *p, int s) 
+{
+    if (p->pyr_levels == 0) return;
 
-        // tick mark
-        draw_line(p->ren, sx, pr.y + pr.h, sx, pr.y + pr.h + 6, p->cfg.axis);
+    // Level 1 takes every sample
+    int n = p->pyr_n[0], k = s / SCOPE_FAN;
+    if (!p->compact) 
+    {
+        double *mn = (double*)p->pyr_min[0] + k, *mx = (double*)p->pyr_max[0] + k;
+        if (s % SCOPE_FAN == 0) 
+        {
+            for (int t = 0; t < p->trace_count; t++) 
+            {
+                // a NaN y (no value) leaves the node empty so it never wins a min/max
+                double y = p->traces[t].y[s];
+                mn[t * n] = isnan(y) ? INFINITY : y;
+                mx[t * n] = isnan(y) ? -INFINITY : y;
+            }
+        }
+        else 
+        {
+            for (int t = 0; t < p->trace_count; t++) 
+            {
+                double y = p->traces[t].y[s];
+                if (y < mn[t * n]) mn[t * n] = y;
+                if (y > mx[t * n]) mx[t * n] = y;
+            }
+        }
     }
-
-    // X axis label (centered below ticks)
-    if (p->x_label) 
+    else 
     {
-        render_text_center(p->ren, p->font, p->x_label, p->cfg.text,
-                           pr.x + pr.w/2, pr.y + pr.h + 38);
+        float *mn = (float*)p->pyr_min[0] + k, *mx = (float*)p->pyr_max[0] + k;
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            float y = p->traces[t].yf[s];
+            if (s % SCOPE_FAN == 0) 
+            {
+                mn[t * n] = isnan(y) ? INFINITY : y;
+                mx[t * n] = isnan(y) ? -INFINITY : y;
+            }
+            else 
+            {
+                if (y < mn[t * n]) mn[t * n] = y;
+                if (y > mx[t * n]) mx[t * n] = y;
+            }
+        }
     }
 
-    // Y labels (left, axis 0)
-    for (int i = 0; i <= major_y; i++) 
+    // Completed nodes move up
+    for (int L = 2; L <= p->pyr_levels && (s + 1) % SCOPE_FAN == 0; L++) 
     {
-        double y = p->y_max[0] - (p->y_max[0] - p->y_min[0]) * ((double)i / (double)major_y);
-        int sy = pr.y + (int)lround((double)i * pr.h / (double)major_y);
+        int n_dn = p->pyr_n[L-2], k_up = k / SCOPE_FAN;
+        bool first = (k % SCOPE_FAN == 0);
 
-        char buf[64];
-        snprintf(buf, sizeof(buf), "%.3g", y);
+        n = p->pyr_n[L-1];
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            size_t dn = (size_t)t * n_dn + k, up = (size_t)t * n + k_up;
+            double lo = node_min(p, L-1, dn), hi = node_max(p, L-1, dn);
+
+            if (!first) 
+            {
+                double up_mn = node_min(p, L, up), up_mx = node_max(p, L, up);
+                if (up_mn < lo) lo = up_mn;
+                if (up_mx > hi) hi = up_mx;
+            }
+            node_set(p, L, up, lo, hi);
+        }
 
-        render_text(p->ren, p->font, buf, p->cfg.text, pr.x - p->cfg.margin_left + 8, sy - 8);
-        draw_line(p->ren, pr.x - 6, sy, pr.x, sy, p->cfg.axis);
+        s = k;
+        k = k_up;
     }
+}
 
-    // Y labels (right, axis 1) if used
-    if (p->axis_used[1]) 
-    {
-        for (int i = 0; i <= major_y; i++) 
-	{
-            double y = p->y_max[1] - (p->y_max[1] - p->y_min[1]) * ((double)i / (double)major_y);
-            int sy = pr.y + (int)lround((double)i * pr.h / (double)major_y);
 
-            char buf[64];
-            snprintf(buf, sizeof(buf), "%.3g", y);
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void pyr_range(scope_plot_t *p, int t, int a, int b, double *mn, double *mx) 
+ *
+ *  @brief	Fold min/max of trace t over ring slots [a, b) into *mn / *mx.  The range is covered by the
+ *		largest whole nodes inside it, so the cost is O(FAN * levels).
+ *
+ *  @note	[a, b) must not contain the head slot unless the ring has not wrapped
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void pyr_range(scope_plot_t *p, int t, int a, int b, double *mn, double *mx) 
+{
+    for (int L = 0; a < b; L++) 
+    {
+        size_t base = L ? (size_t)t * p->pyr_n[L-1] : 0;
+
+        if (L == p->pyr_levels) 
+        {
+            for (; a < b; a++) 
+            {
+                double lo = L ? node_min(p, L, base + a) : y_at(p, t, a);
+                double hi = L ? node_max(p, L, base + a) : lo;
+                if (lo < *mn) *mn = lo;
+                if (hi > *mx) *mx = hi;
+            }
+            break;
+        }
 
-            render_text(p->ren, p->font, buf, p->cfg.text, pr.x + pr.w + 10, sy - 8);
-            draw_line(p->ren, pr.x + pr.w, sy, pr.x + pr.w + 6, sy, p->cfg.axis);
+        for (; a < b && a % SCOPE_FAN; a++) 
+        {
+            double lo = L ? node_min(p, L, base + a) : y_at(p, t, a);
+            double hi = L ? node_max(p, L, base + a) : lo;
+            if (lo < *mn) *mn = lo;
+            if (hi > *mx) *mx = hi;
+        }
+        for (; a < b && b % SCOPE_FAN; b--) 
+        {
+            double lo = L ? node_min(p, L, base + b - 1) : y_at(p, t, b - 1);
+            double hi = L ? node_max(p, L, base + b - 1) : lo;
+            if (lo < *mn) *mn = lo;
+            if (hi > *mx) *mx = hi;
         }
+        a /= SCOPE_FAN;
+        b /= SCOPE_FAN;
     }
+}
 
-    if (p->title) 
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void range_minmax(scope_plot_t *p, int t, int i0, int i1, double *mn, double *mx) 
+ *
+ *  @brief	Min/max of trace t over samples [i0, i1) in age order (oldest = 0)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void range_minmax(scope_plot_t *p, int t, int i0, int i1, double *mn, double *mx) 
+{
+    *mn = INFINITY;
+    *mx = -INFINITY;
+    if (i0 >= i1) return;
+
+    // the samples are slots [head, cap) then [0, head) once wrapped; split there
+    int a = ring_slot(p, i0), b = ring_slot(p, i1 - 1) + 1;
+    if (a < b) 
+    {
+        pyr_range(p, t, a, b, mn, mx);
+    }
+    else 
     {
-        render_text(p->ren, p->font, p->title, p->cfg.text, pr.x + 6, pr.y + 6);
+        pyr_range(p, t, a, p->cap, mn, mx);
+        pyr_range(p, t, 0, b, mn, mx);
     }
 }
 
@@ -674,69 +790,87 @@ void draw_axis_labels(scope_plot_t *p, SDL_Rect pr)
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void draw_legend(scope_plot_t *p, SDL_Rect pr) 
+ *  @fn		int x_search(scope_plot_t *p, int lo, int hi, double x, bool after) 
  *
- *  @brief	Draw legend
+ *  @brief	First sample in [lo, hi) with x >= the given x (or > it if after); hi if none.  x must be
+ *		monotonic.
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void draw_legend(scope_plot_t *p, SDL_Rect pr) 
+int x_search(scope_plot_t *p, int lo, int hi, double x, bool after) 
 {
-    // Legend box top-right inside plot
-    const int pad = 8;
-    const int swatch = 18;
-    const int line_h = p->cfg.font_px + 6;
+    while (lo < hi) 
+    {
+        int mid = lo + (hi - lo) / 2;
+        double xm = x_at(p, ring_slot(p, mid));
+        if (after ? (xm <= x) : (xm < x)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-    bool show_axis_tag = p->axis_used[1];
 
-    // Measure width roughly
-    int max_chars = 0;
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void window_minmax(scope_plot_t *p) 
+ *
+ *  @brief	Per-trace min/max over the x-window into win_min/win_max (min > max if no samples).  With
+ *		monotonic x this is a pyramid query.  Otherwise blocks entirely inside the window use their
+ *		summary, blocks outside are skipped, and only blocks straddling an edge (plus the block being
+ *		overwritten after the ring wraps) are scanned.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void window_minmax(scope_plot_t *p) 
+{
     for (int t = 0; t < p->trace_count; t++) 
     {
-        const char *nm = p->traces[t].name ? p->traces[t].name : "(null)";
-        int n = (int)strlen(nm) + (show_axis_tag ? 4 : 0); // " [R]"
-        if (n > max_chars) max_chars = n;
+        p->win_min[t] = INFINITY;
+        p->win_max[t] = -INFINITY;
     }
-    int box_w = pad*3 + swatch + max_chars * (p->cfg.font_px/2 + 1);
-    int box_h = pad*2 + p->trace_count * line_h;
 
-    SDL_Rect box = 
+    // Monotonic x: the window is one index range, reduced by the pyramid
+    if (p->x_mono) 
     {
-        pr.x + pr.w - box_w - 8,
-        pr.y + 8,
-        box_w,
-        box_h
-    };
-    fill_rect(p->ren, box, p->cfg.legend_bg);
+        int i0 = x_search(p, 0, p->size, p->x_min, false);
+        int i1 = x_search(p, i0, p->size, p->x_max, true);
+        for (int t = 0; t < p->trace_count; t++) 
+            range_minmax(p, t, i0, i1, &p->win_min[t], &p->win_max[t]);
+        return;
+    }
 
-    // border
-    draw_line(p->ren, box.x, box.y, box.x + box.w, box.y, p->cfg.axis);
-    draw_line(p->ren, box.x, box.y + box.h, box.x + box.w, box.y + box.h, p->cfg.axis);
-    draw_line(p->ren, box.x, box.y, box.x, box.y + box.h, p->cfg.axis);
-    draw_line(p->ren, box.x + box.w, box.y, box.x + box.w, box.y + box.h, p->cfg.axis);
+    bool wrapped = (p->size == p->cap);
+    int used = wrapped ? p->cap : p->head;
+    int head_blk = p->head / SCOPE_BLK;
 
-    for (int t = 0; t < p->trace_count; t++) 
+    for (int b = 0; b * SCOPE_BLK < used; b++) 
     {
-        int y = box.y + pad + t * line_h + (line_h/2);
-        int x0 = box.x + pad;
+        int a = b * SCOPE_BLK;
+        int e = (a + SCOPE_BLK < used) ? a + SCOPE_BLK : used;
 
-        // swatch line
-        draw_line(p->ren, x0, y, x0 + swatch, y, p->traces[t].color);
+        // the head block holds new samples before head and old ones after; its summary covers only the new
+        if (wrapped && b == head_blk) 
+        {
+            scan_slots(p, a, e);
+            continue;
+        }
 
-        // name (optionally with axis tag)
-        char buf[256];
-        const char *nm = p->traces[t].name ? p->traces[t].name : "(null)";
-        if (show_axis_tag) 
-	{
-            snprintf(buf, sizeof(buf), "%s [%c]", nm, (p->trace_axis[t] ? 'R' : 'L'));
-        } 
-	else 
-	{
-            snprintf(buf, sizeof(buf), "%s", nm);
+        if (p->blk_xmax[b] < p->x_min || p->blk_xmin[b] > p->x_max) continue;
+        if (p->blk_xmin[b] < p->x_min || p->blk_xmax[b] > p->x_max) 
+        {
+            scan_slots(p, a, e);
+            continue;
         }
 
-        render_text(p->ren, p->font, buf, p->cfg.text, x0 + swatch + pad, y - (p->cfg.font_px/2));
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            double mn = p->blk_ymin[t * p->blk_n + b], mx = p->blk_ymax[t * p->blk_n + b];
+            if (mn < p->win_min[t]) p->win_min[t] = mn;
+            if (mx > p->win_max[t]) p->win_max[t] = mx;
+        }
     }
 }
 
@@ -744,301 +878,1694 @@ void draw_legend(scope_plot_t *p, SDL_Rect pr)
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		scope_plot_t *scope_plot_create(SDL_Window *win, SDL_Renderer *ren, int trace_count,
- *                                              const scope_trace_desc_t *traces, const scope_plot_cfg_t *cfg)
+ *  @fn		void compute_y_autoscale(scope_plot_t *p) 
+ *
+ *  @brief	Compute Y autoscaling.  Per-trace window ranges come from the block summaries; the dual-axis
+ *		layout is only recomputed when one of them changed since the last call.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void compute_y_autoscale(scope_plot_t *p) 
+{
+    window_minmax(p);
+
+    size_t rng_sz = (size_t)p->trace_count * sizeof(double);
+    if (p->as_valid && 
+        0 == memcmp(p->win_min, p->as_min, rng_sz) && 
+        0 == memcmp(p->win_max, p->as_max, rng_sz)) 
+       return;
+
+    memcpy(p->as_min, p->win_min, rng_sz);
+    memcpy(p->as_max, p->win_max, rng_sz);
+    p->as_valid = true;
+
+    // Dual-Y auto scale & trace-to-axis assignment based on per-trace data ranges
+    // within the current x-window.
+    const double EPS = 1e-12;
+    const double SPLIT_RATIO = 20.0; // only bother splitting if ranges differ a lot
+
+    double t_min[64], t_max[64], t_rng[64] = {0}, t_logrng[64] = {0};
+    if (p->trace_count > 64) 
+    {
+        // Fallback: keep everything on left for very large trace counts
+        for (int t = 0; t < p->trace_count; t++) p->trace_axis[t] = 0;
+    } 
+    else 
+    {
+        // per-trace min/max
+        for (int t = 0; t < p->trace_count; t++) 
+	{
+            bool have = (p->win_min[t] <= p->win_max[t]);
+            double mn = have ? p->win_min[t] : 0.0;
+            double mx = have ? p->win_max[t] : 0.0;
+
+            t_min[t] = mn;
+            t_max[t] = mx;
+            double rng = t_max[t] - t_min[t];
+
+            if (rng < EPS) rng = EPS;
+            t_rng[t] = rng;
+            t_logrng[t] = log10(rng);
+        }
+
+        // Decide whether dual-axis is warranted
+        double rng_min = t_rng[0], rng_max = t_rng[0];
+        for (int t = 1; t < p->trace_count; t++) 
+	{
+            if (t_rng[t] < rng_min) rng_min = t_rng[t];
+            if (t_rng[t] > rng_max) rng_max = t_rng[t];
+        }
+
+        bool do_split = (rng_max / rng_min) >= SPLIT_RATIO;
+
+        if (!do_split) 
+	{
+            for (int t = 0; t < p->trace_count; t++) 
+	       p->trace_axis[t] = 0;
+        } 
+	else 
+	{
+            // 1D k-means (k=2) on log10(range)
+            double c1 = t_logrng[0], c2 = t_logrng[0];
+            for (int t = 1; t < p->trace_count; t++) 
+	    {
+                if (t_logrng[t] < c1) c1 = t_logrng[t];
+                if (t_logrng[t] > c2) c2 = t_logrng[t];
+            }
+
+            for (int it = 0; it < 12; it++) 
+	    {
+                double s1 = 0.0, s2 = 0.0;
+                int n1 = 0, n2 = 0;
+
+                for (int t = 0; t < p->trace_count; t++) 
+		{
+                    double d1 = fabs(t_logrng[t] - c1);
+                    double d2 = fabs(t_logrng[t] - c2);
+                    uint8_t a = (d2 < d1) ? 1 : 0;
+                    p->trace_axis[t] = a;
+                    if (a == 0) 
+		    { 
+		       s1 += t_logrng[t]; 
+		       n1++; 
+		    }
+                    else 
+		    { 
+		       s2 += t_logrng[t]; 
+		       n2++; 
+		    }
+                }
+
+                if (n1 > 0) c1 = s1 / (double)n1;
+                if (n2 > 0) c2 = s2 / (double)n2;
+                if (n1 == 0 || n2 == 0) break;
+            }
+
+            // Ensure both axes have at least one trace; if not, split by median
+            int n0 = 0, n1 = 0;
+            for (int t = 0; t < p->trace_count; t++) 
+	       (p->trace_axis[t] == 0) ? n0++ : n1++;
+
+            if (n0 == 0 || n1 == 0) 
+	    {
+                // median split
+                double tmp[64];
+                for (int t = 0; t < p->trace_count; t++) 
+                   tmp[t] = t_logrng[t];
+
+                // simple selection sort (small n)
+                for (int i = 0; i < p->trace_count; i++) 
+		{
+                   int k = i;
+                   for (int j = i+1; j < p->trace_count; j++) 
+		      if (tmp[j] < tmp[k]) k = j;
+
+                   double v = tmp[i]; tmp[i] = tmp[k]; tmp[k] = v;
+                }
+
+                double med = tmp[p->trace_count/2];
+                for (int t = 0; t < p->trace_count; t++) 
+                    p->trace_axis[t] = (t_logrng[t] > med) ? 1 : 0;
+            }
+
+            // Choose which cluster is left/right:
+            // Put the cluster with MORE traces on the left (more readable). If tie, larger-range cluster on left.
+            double sum_rng0 = 0.0, sum_rng1 = 0.0;
+            n0 = 0; n1 = 0;
+            for (int t = 0; t < p->trace_count; t++) 
+	    {
+                if (p->trace_axis[t] == 0) 
+		{ 
+	           sum_rng0 += t_rng[t]; 
+		   n0++; 
+		}
+                else
+		{ 
+	           sum_rng1 += t_rng[t]; 
+		   n1++; 
+		}
+            }
+
+            bool swap = false;
+            if (n1 > n0) 
+               swap = true;
+            else if (n1 == n0 && sum_rng1 > sum_rng0) 
+	       swap = true;
+
+            if (swap) 
+	    {
+                for (int t = 0; t < p->trace_count; t++) 
+	           p->trace_axis[t] ^= 1;
+            }
+        }
+    }
+
+    // Compute y min/max per axis from visible samples
+    for (int a = 0; a < 2; a++) 
+    {
+        p->axis_used[a] = false;
+        p->y_min[a] = 0.0;
+        p->y_max[a] = 0.0;
+    }
+
+    for (int a = 0; a < 2; a++) 
+    {
+        bool have = false;
+        double ymin = 0.0, ymax = 0.0;
+
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            if ((int)p->trace_axis[t] != a || p->win_min[t] > p->win_max[t]) 
+               continue;
+
+            if (!have) 
+            { 
+               ymin = p->win_min[t]; 
+               ymax = p->win_max[t]; 
+               have = true; 
+            }
+            else 
+            { 
+               if (p->win_min[t] < ymin) 
+                  ymin = p->win_min[t]; 
+               if (p->win_max[t] > ymax) 
+                  ymax = p->win_max[t]; 
+            }
+        }
+
+        if (!have) continue;
+
+        if (ymax - ymin < 1e-12) 
+	{
+            double c = 0.5 * (ymax + ymin);
+            ymin = c - 1.0;
+            ymax = c + 1.0;
+        }
+
+        double span = ymax - ymin;
+        double pad = (double)p->cfg.y_padding_frac * span;
+        p->y_min[a] = ymin - pad;
+        p->y_max[a] = ymax + pad;
+        p->axis_used[a] = true;
+    }
+
+    // If only one axis has data, mirror it so math doesn't divide by 0
+    if (p->axis_used[0] && !p->axis_used[1]) 
+    {
+        p->y_min[1] = p->y_min[0];
+        p->y_max[1] = p->y_max[0];
+    } 
+    else if (!p->axis_used[0] && p->axis_used[1]) 
+    {
+        p->y_min[0] = p->y_min[1];
+        p->y_max[0] = p->y_max[1];
+
+        // also move traces to left for consistency
+        for (int t = 0; t < p->trace_count; t++) 
+           p->trace_axis[t] = 0;
+
+        p->axis_used[0] = true;
+        p->axis_used[1] = false;
+    } 
+    else if (!p->axis_used[0] && !p->axis_used[1]) 
+    {
+        p->y_min[0] = -1.0; p->y_max[0] = 1.0;
+        p->y_min[1] = -1.0; p->y_max[1] = 1.0;
+        p->axis_used[0] = true;
+        p->axis_used[1] = false;
+        for (int t = 0; t < p->trace_count; t++) 
+           p->trace_axis[t] = 0;
+    }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		SDL_Rect plot_rect(scope_plot_t *p, int *w, int *h) 
+ *
+ *  @brief	Plot area inside the margins; *w, *h get the window (or headless surface) size
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+SDL_Rect plot_rect(scope_plot_t *p, int *w, int *h) 
+{
+    if (p->win) SDL_GetWindowSize(p->win, w, h);
+    else SDL_GetRendererOutputSize(p->ren, w, h);
+
+    SDL_Rect pr = 
+    {
+        p->cfg.margin_left,
+        p->cfg.margin_top,
+        *w - p->cfg.margin_left - p->cfg.margin_right,
+        *h - p->cfg.margin_top - p->cfg.margin_bottom
+    };
+    return pr;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int map_x(scope_plot_t *p, double x, int plot_x, int plot_w) 
+ *
+ *  @brief	Map x into plot
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int map_x(scope_plot_t *p, double x, int plot_x, int plot_w) 
+{
+    double den = (p->x_max - p->x_min);
+    if (fabs(den) < 1e-18) 
+       return plot_x;
+
+    double u = (x - p->x_min) / den;
+    if (u < 0.0) u = 0.0;
+    if (u > 1.0) u = 1.0;
+    return plot_x + (int)lround(u * (double)plot_w);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int map_y(scope_plot_t *p, double y, int axis, int plot_y, int plot_h) 
+ *
+ *  @brief	Map Y into plot
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+int map_y(scope_plot_t *p, double y, int axis, int plot_y, int plot_h) 
+{
+    double den = (p->y_max[axis] - p->y_min[axis]);
+    if (fabs(den) < 1e-18) return plot_y + plot_h/2;
+    double v = (y - p->y_min[axis]) / den; // 0..1 bottom->top
+    if (v < 0.0) v = 0.0;
+    if (v > 1.0) v = 1.0;
+    return plot_y + plot_h - (int)lround(v * (double)plot_h);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void draw_grid(scope_plot_t *p, SDL_Rect pr) 
+ *
+ *  @brief	Draw plot grids
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void draw_grid(scope_plot_t *p, SDL_Rect pr) 
+{
+    int major_x = (p->cfg.grid_major_div_x > 0) ? p->cfg.grid_major_div_x : 10;
+    int major_y = (p->cfg.grid_major_div_y > 0) ? p->cfg.grid_major_div_y : 10;
+    int minor   = (p->cfg.grid_minor_div   > 0) ? p->cfg.grid_minor_div   : 5;
+    int n = 0;
+
+    // Minor subdivisions between majors
+    set_color(p->ren, p->cfg.grid_minor);
+    for (int mx = 0; mx < major_x; mx++) 
+    {
+        int x = pr.x + (int)lround((double)mx * pr.w / (double)major_x);
+        int x_next = pr.x + (int)lround((double)(mx+1) * pr.w / (double)major_x);
+        for (int k = 1; k < minor; k++) 
+        {
+            int xm = x + (int)lround((double)k * (x_next - x) / (double)minor);
+            rect_line(p, &n, xm, pr.y, xm, pr.y + pr.h);
+        }
+    }
+    for (int my = 0; my < major_y; my++) 
+    {
+        int y = pr.y + (int)lround((double)my * pr.h / (double)major_y);
+        int y_next = pr.y + (int)lround((double)(my+1) * pr.h / (double)major_y);
+        for (int k = 1; k < minor; k++) 
+        {
+            int ym = y + (int)lround((double)k * (y_next - y) / (double)minor);
+            rect_line(p, &n, pr.x, ym, pr.x + pr.w, ym);
+        }
+    }
+    rect_flush(p, &n);
+
+    // Major lines
+    set_color(p->ren, p->cfg.grid_major);
+    for (int mx = 0; mx <= major_x; mx++) 
+    {
+        int x = pr.x + (int)lround((double)mx * pr.w / (double)major_x);
+        rect_line(p, &n, x, pr.y, x, pr.y + pr.h);
+    }
+    for (int my = 0; my <= major_y; my++) 
+    {
+        int y = pr.y + (int)lround((double)my * pr.h / (double)major_y);
+        rect_line(p, &n, pr.x, y, pr.x + pr.w, y);
+    }
+    rect_flush(p, &n);
+
+    // Plot border (axis)
+    set_color(p->ren, p->cfg.axis);
+    SDL_Rect border = { pr.x, pr.y, pr.w + 1, pr.h + 1 };
+    SDL_RenderDrawRect(p->ren, &border);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void draw_axis_labels(scope_plot_t *p, SDL_Rect pr) 
+ *
+ *  @brief	Draw axis tick marks and labels
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void draw_axis_labels(scope_plot_t *p, SDL_Rect pr) 
+{
+    int major_x = (p->cfg.grid_major_div_x > 0) ? p->cfg.grid_major_div_x : 10;
+    int major_y = (p->cfg.grid_major_div_y > 0) ? p->cfg.grid_major_div_y : 10;
+    char buf[64];
+    int n = 0;
+
+    // Tick marks
+    set_color(p->ren, p->cfg.axis);
+    for (int i = 0; i <= major_x; i++) 
+    {
+        int sx = pr.x + (int)lround((double)i * pr.w / (double)major_x);
+        rect_line(p, &n, sx, pr.y + pr.h, sx, pr.y + pr.h + 6);
+    }
+    for (int i = 0; i <= major_y; i++) 
+    {
+        int sy = pr.y + (int)lround((double)i * pr.h / (double)major_y);
+        rect_line(p, &n, pr.x - 6, sy, pr.x, sy);
+        if (p->axis_used[1]) rect_line(p, &n, pr.x + pr.w, sy, pr.x + pr.w + 6, sy);
+    }
+    rect_flush(p, &n);
+
+    // X labels (bottom)
+    for (int i = 0; i <= major_x; i++) 
+    {
+        double x = p->x_min + (p->x_max - p->x_min) * ((double)i / (double)major_x);
+        int sx = pr.x + (int)lround((double)i * pr.w / (double)major_x);
+
+        snprintf(buf, sizeof(buf), "%.3g", x);
+        render_text_center(p, buf, p->cfg.text, sx, pr.y + pr.h + 18);
+    }
+
+    // X axis label (centered below ticks)
+    if (p->x_label) 
+    {
+        render_text_center(p, p->x_label, p->cfg.text, pr.x + pr.w/2, pr.y + pr.h + 38);
+    }
+
+    // Y labels (left, axis 0)
+    for (int i = 0; i <= major_y; i++) 
+    {
+        double y = p->y_max[0] - (p->y_max[0] - p->y_min[0]) * ((double)i / (double)major_y);
+        int sy = pr.y + (int)lround((double)i * pr.h / (double)major_y);
+
+        snprintf(buf, sizeof(buf), "%.3g", y);
+        render_text(p, buf, p->cfg.text, pr.x - p->cfg.margin_left + 8, sy - 8);
+    }
+
+    // Y labels (right, axis 1) if used
+    if (p->axis_used[1]) 
+    {
+        for (int i = 0; i <= major_y; i++) 
+        {
+            double y = p->y_max[1] - (p->y_max[1] - p->y_min[1]) * ((double)i / (double)major_y);
+            int sy = pr.y + (int)lround((double)i * pr.h / (double)major_y);
+
+            snprintf(buf, sizeof(buf), "%.3g", y);
+            render_text(p, buf, p->cfg.text, pr.x + pr.w + 10, sy - 8);
+        }
+    }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void draw_static(scope_plot_t *p, SDL_Rect pr, int w, int h) 
+ *
+ *  @brief	Draw background, grid, ticks and axis labels.  They are drawn once into a target texture and
+ *		copied each frame until the window size, x-range, y-ranges or axis layout change.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void draw_static(scope_plot_t *p, SDL_Rect pr, int w, int h) 
+{
+    double rng[6] = { p->x_min, p->x_max, p->y_min[0], p->y_min[1], p->y_max[0], p->y_max[1] };
+
+    if (p->layer_ok && (!p->layer || p->layer_w != w || p->layer_h != h)) 
+    {
+        if (p->layer) SDL_DestroyTexture(p->layer);
+        p->layer = SDL_CreateTexture(p->ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h);
+        p->layer_w = w;
+        p->layer_h = h;
+        p->layer_dirty = true;
+        if (p->layer) SDL_SetTextureBlendMode(p->layer, SDL_BLENDMODE_NONE);
+    }
+
+    SDL_Texture *target = SDL_GetRenderTarget(p->ren);
+    if (!p->layer || SDL_SetRenderTarget(p->ren, p->layer) != 0) 
+    {
+        // no target textures: draw straight to the screen
+        set_color(p->ren, p->bg);
+        SDL_RenderClear(p->ren);
+        draw_grid(p, pr);
+        draw_axis_labels(p, pr);
+        return;
+    }
+
+    if (p->layer_dirty || p->layer_axis1 != p->axis_used[1] || 0 != memcmp(rng, p->layer_rng, sizeof(rng))) 
+    {
+        set_color(p->ren, p->bg);
+        SDL_RenderClear(p->ren);
+        draw_grid(p, pr);
+        draw_axis_labels(p, pr);
+
+        memcpy(p->layer_rng, rng, sizeof(rng));
+        p->layer_axis1 = p->axis_used[1];
+        p->layer_dirty = false;
+    }
+
+    SDL_SetRenderTarget(p->ren, target);
+    SDL_Rect dst = { 0, 0, w, h };
+    SDL_RenderCopy(p->ren, p->layer, NULL, &dst);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void draw_legend(scope_plot_t *p, SDL_Rect pr) 
+ *
+ *  @brief	Draw title and legend
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void draw_legend(scope_plot_t *p, SDL_Rect pr) 
+{
+    if (p->title) 
+    {
+        render_text(p, p->title, p->cfg.text, pr.x + 6, pr.y + 6);
+    }
+
+    // Legend box top-right inside plot
+    const int pad = 8;
+    const int swatch = 18;
+    const int line_h = p->cfg.font_px + 6;
+
+    bool show_axis_tag = p->axis_used[1];
+
+    // Measure width roughly
+    int max_chars = 0;
+    for (int t = 0; t < p->trace_count; t++) 
+    {
+        const char *nm = p->traces[t].name ? p->traces[t].name : "(null)";
+        int n = (int)strlen(nm) + (show_axis_tag ? 4 : 0); // " [R]"
+        if (n > max_chars) max_chars = n;
+    }
+    int box_w = pad*3 + swatch + max_chars * (p->cfg.font_px/2 + 1);
+    int box_h = pad*2 + p->trace_count * line_h;
+
+    SDL_Rect box = 
+    {
+        pr.x + pr.w - box_w - 8,
+        pr.y + 8,
+        box_w,
+        box_h
+    };
+    fill_rect(p->ren, box, p->cfg.legend_bg);
+
+    // border
+    set_color(p->ren, p->cfg.axis);
+    SDL_Rect border = { box.x, box.y, box.w + 1, box.h + 1 };
+    SDL_RenderDrawRect(p->ren, &border);
+
+    for (int t = 0; t < p->trace_count; t++) 
+    {
+        int y = box.y + pad + t * line_h + (line_h/2);
+        int x0 = box.x + pad;
+
+        // swatch line
+        draw_line(p->ren, x0, y, x0 + swatch, y, p->traces[t].color);
+
+        // name (optionally with axis tag)
+        char buf[256];
+        const char *nm = p->traces[t].name ? p->traces[t].name : "(null)";
+        if (show_axis_tag) 
+        {
+            snprintf(buf, sizeof(buf), "%s [%c]", nm, (p->trace_axis[t] ? 'R' : 'L'));
+        } 
+        else 
+        {
+            snprintf(buf, sizeof(buf), "%s", nm);
+        }
+
+        render_text(p, buf, p->cfg.text, x0 + swatch + pad, y - (p->cfg.font_px/2));
+    }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		scope_plot_t *scope_plot_create(SDL_Window *win, SDL_Renderer *ren, int trace_count,
+ *                                              const scope_trace_desc_t *traces, const scope_plot_cfg_t *cfg)
+ *
+ *  @brief	Create the plot
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+scope_plot_t *scope_plot_create(SDL_Window *win,
+                                SDL_Renderer *ren,
+                                int trace_count,
+                                const scope_trace_desc_t *traces,
+                                const scope_plot_cfg_t *cfg)
+{
+    if (!ren || trace_count <= 0 || !traces) return NULL;
+
+    scope_plot_t *p = (scope_plot_t*)calloc(1, sizeof(*p));
+    if (!p) return NULL;
+
+    p->win = win;
+    p->ren = ren;
+    p->trace_count = trace_count;
+
+    p->cfg = cfg ? *cfg : scope_plot_default_cfg();
+    p->bg  = p->cfg.background;
+
+    p->cap = (p->cfg.max_points > 16) ? p->cfg.max_points : 1024;
+    p->compact = p->cfg.compact;
+    p->blk_n = (p->cap + SCOPE_BLK - 1) / SCOPE_BLK;
+    if (p->compact) 
+    {
+       p->xoff = (float*)calloc((size_t)p->cap, sizeof(float));
+       p->xbase = (double*)malloc((size_t)p->blk_n * sizeof(double));
+    }
+    else 
+    {
+       p->xbuf = (double*)calloc((size_t)p->cap, sizeof(double));
+    }
+    if (!p->xbuf && (!p->xoff || !p->xbase)) 
+    { 
+       free(p->xoff); 
+       free(p->xbase); 
+       free(p); 
+       return NULL; 
+    }
+    for (int b = 0; p->xbase && b < p->blk_n; b++) 
+       p->xbase[b] = NAN;
+    p->xbase_prev = NAN;
+
+    p->traces = (trace_t*)calloc((size_t)trace_count, sizeof(trace_t));
+    if (!p->traces) 
+    { 
+       scope_plot_destroy(p); 
+       return NULL; 
+    }
+
+    p->trace_axis = (uint8_t*)calloc((size_t)trace_count, sizeof(uint8_t));
+    if (!p->trace_axis) 
+    {
+       scope_plot_destroy(p);
+       return NULL;
+    }
+
+    p->axis_used[0] = true;
+    p->axis_used[1] = false;
+    p->y_min[0] = -1.0; p->y_max[0] = 1.0;
+    p->y_min[1] = -1.0; p->y_max[1] = 1.0;
+
+    for (int i = 0; i < trace_count; i++) 
+    {
+       if (p->compact) p->traces[i].yf = (float*)calloc((size_t)p->cap, sizeof(float));
+       else p->traces[i].y = (double*)calloc((size_t)p->cap, sizeof(double));
+       if (!p->traces[i].y && !p->traces[i].yf) 
+       {
+          scope_plot_destroy(p);
+          return NULL;
+       }
+
+       p->traces[i].color = traces[i].color;
+       p->traces[i].name  = str_dup(traces[i].name ? traces[i].name : "");
+
+       if (!p->traces[i].name) 
+       {
+          scope_plot_destroy(p);
+          return NULL;
+       }
+    }
+
+    // Block summaries and autoscale scratch
+    p->blk_xmin = (double*)malloc((size_t)p->blk_n * sizeof(double));
+    p->blk_xmax = (double*)malloc((size_t)p->blk_n * sizeof(double));
+    p->blk_ymin = (double*)malloc((size_t)p->blk_n * trace_count * sizeof(double));
+    p->blk_ymax = (double*)malloc((size_t)p->blk_n * trace_count * sizeof(double));
+    p->win_min  = (double*)malloc((size_t)trace_count * sizeof(double));
+    p->win_max  = (double*)malloc((size_t)trace_count * sizeof(double));
+    p->as_min   = (double*)malloc((size_t)trace_count * sizeof(double));
+    p->as_max   = (double*)malloc((size_t)trace_count * sizeof(double));
+    if (!p->blk_xmin || !p->blk_xmax || !p->blk_ymin || !p->blk_ymax || 
+        !p->win_min || !p->win_max || !p->as_min || !p->as_max) 
+    {
+       scope_plot_destroy(p);
+       return NULL;
+    }
+    for (int b = 0; b < p->blk_n; b++) 
+       blk_reset(p, b);
+
+    // Pyramid levels down to at most FAN nodes
+    for (long n = (p->cap + SCOPE_FAN - 1) / SCOPE_FAN; n > 1; n = (n + SCOPE_FAN - 1) / SCOPE_FAN) 
+    {
+       p->pyr_levels++;
+       if (n <= SCOPE_FAN) break;
+    }
+    p->pyr_n   = (int*)calloc((size_t)p->pyr_levels + 1, sizeof(int));
+    p->pyr_min = (void**)calloc((size_t)p->pyr_levels + 1, sizeof(void*));
+    p->pyr_max = (void**)calloc((size_t)p->pyr_levels + 1, sizeof(void*));
+    if (!p->pyr_n || !p->pyr_min || !p->pyr_max) 
+    {
+       scope_plot_destroy(p);
+       return NULL;
+    }
+    for (int L = 1, n = p->cap; L <= p->pyr_levels; L++) 
+    {
+       n = (n + SCOPE_FAN - 1) / SCOPE_FAN;
+       p->pyr_n[L-1] = n;
+       size_t sz = p->compact ? sizeof(float) : sizeof(double);
+       p->pyr_min[L-1] = malloc((size_t)n * trace_count * sz);
+       p->pyr_max[L-1] = malloc((size_t)n * trace_count * sz);
+       if (!p->pyr_min[L-1] || !p->pyr_max[L-1]) 
+       {
+          scope_plot_destroy(p);
+          return NULL;
+       }
+    }
+    p->x_mono = true;
+
+    // X defaults
+    p->x_min = 0.0;
+    p->x_max = 1.0;
+
+    // TTF init
+    if (TTF_WasInit() == 0) 
+    {
+       if (TTF_Init() != 0) 
+       {
+          scope_plot_destroy(p);
+          return NULL;
+       }
+       p->ttf_inited_here = true;
+    }
+
+    p->font = TTF_OpenFont(p->cfg.ttf_path, p->cfg.font_px);
+    if (!p->font) 
+    {
+       scope_plot_destroy(p);
+       return NULL;
+    }
+
+    p->layer_ok = SDL_RenderTargetSupported(ren);
+
+    return p;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_destroy(scope_plot_t *p) 
+ *
+ *  @brief	Destroy plot
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_destroy(scope_plot_t *p) 
+{
+    if (!p) return;
+
+    for (int i = 0; i < SCOPE_LABELS; i++) 
+    {
+        if (p->labels[i].tex) SDL_DestroyTexture(p->labels[i].tex);
+    }
+    if (p->layer) SDL_DestroyTexture(p->layer);
+    if (p->dens_tex) SDL_DestroyTexture(p->dens_tex);
+    free(p->dens_cnt);
+    free(p->dens_px);
+
+    if (p->font) 
+    {
+        TTF_CloseFont(p->font);
+        p->font = NULL;
+    }
+    if (p->ttf_inited_here) 
+    {
+        TTF_Quit();
+        p->ttf_inited_here = false;
+    }
+
+    if (p->traces) 
+    {
+        for (int i = 0; i < p->trace_count; i++) 
+	{
+            free(p->traces[i].y);
+            free(p->traces[i].yf);
+            free(p->traces[i].name);
+        }
+        free(p->traces);
+    }
+    free(p->xbuf);
+    free(p->xoff);
+    free(p->xbase);
+    free(p->trace_axis);
+    free(p->blk_xmin);
+    free(p->blk_xmax);
+    free(p->blk_ymin);
+    free(p->blk_ymax);
+    free(p->win_min);
+    free(p->win_max);
+    free(p->as_min);
+    free(p->as_max);
+    for (int L = 0; L < p->pyr_levels; L++) 
+    {
+        if (p->pyr_min) free(p->pyr_min[L]);
+        if (p->pyr_max) free(p->pyr_max[L]);
+    }
+    free(p->pyr_n);
+    free(p->pyr_min);
+    free(p->pyr_max);
+    free(p->px_cols);
+    free(p->title);
+    if (p->surf) 
+    {
+        SDL_DestroyRenderer(p->ren);
+        SDL_FreeSurface(p->surf);
+    }
+    free(p);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		scope_plot_t *scope_plot_create_headless(int w, int h, int trace_count, 
+ *                                                       const scope_trace_desc_t *traces, const scope_plot_cfg_t *cfg)
+ *
+ *  @brief	Create a plot that renders into an offscreen w x h software surface (no window, no display)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+scope_plot_t *scope_plot_create_headless(int w, int h,
+                                         int trace_count,
+                                         const scope_trace_desc_t *traces,
+                                         const scope_plot_cfg_t *cfg)
+{
+    if (w <= 0 || h <= 0) return NULL;
+
+    SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surf) return NULL;
+
+    SDL_Renderer *ren = SDL_CreateSoftwareRenderer(surf);
+    if (!ren) 
+    {
+        SDL_FreeSurface(surf);
+        return NULL;
+    }
+
+    scope_plot_t *p = scope_plot_create(NULL, ren, trace_count, traces, cfg);
+    if (!p) 
+    {
+        SDL_DestroyRenderer(ren);
+        SDL_FreeSurface(surf);
+        return NULL;
+    }
+    p->surf = surf;
+
+    return p;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int scope_plot_save_image(scope_plot_t *p, const char *fn) 
+ *
+ *  @brief	Render the plot and write it to a PNG file (PPM if fn ends in .ppm)
+ *
+ *  @return	0 if success; -1 bad args, -2 cannot open, -3 write error, -4 out of memory, -5 cannot read pixels
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int scope_plot_save_image(scope_plot_t *p, const char *fn) 
+{
+    if (!p || !fn) return -1;
+
+    int w = 0, h = 0;
+    scope_plot_render(p);
+    if (SDL_GetRendererOutputSize(p->ren, &w, &h) != 0 || w <= 0 || h <= 0) return -5;
+
+    uint32_t *px = (uint32_t*)malloc((size_t)w * h * sizeof(uint32_t));
+    uint8_t *rgb = (uint8_t*)malloc((size_t)w * h * 3);
+    if (!px || !rgb) 
+    {
+        free(px);
+        free(rgb);
+        return -4;
+    }
+
+    int rc = -5;
+    if (SDL_RenderReadPixels(p->ren, NULL, SDL_PIXELFORMAT_ARGB8888, px, w * (int)sizeof(uint32_t)) == 0) 
+    {
+        for (size_t i = 0; i < (size_t)w * h; i++) 
+        {
+            rgb[3*i]   = (uint8_t)(px[i] >> 16);
+            rgb[3*i+1] = (uint8_t)(px[i] >> 8);
+            rgb[3*i+2] = (uint8_t)px[i];
+        }
+        rc = img_write(fn, w, h, rgb, w * 3);
+    }
+
+    free(px);
+    free(rgb);
+    return rc;
+}
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_set_x_range(scope_plot_t *p, double x_min, double x_max) 
+ *
+ *  @brief	Set X range
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_x_range(scope_plot_t *p, double x_min, double x_max) 
+{
+    if (!p) return;
+    if (x_max == x_min) x_max = x_min + 1.0;
+    if (x_max < x_min) 
+    {
+        double tmp = x_min; x_min = x_max; x_max = tmp;
+    }
+    p->x_min = x_min;
+    p->x_max = x_max;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_get_x_range(scope_plot_t *p, double *x_min, double *x_max) 
+ *
+ *  @brief	Get X range
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_get_x_range(scope_plot_t *p, double *x_min, double *x_max) 
+{
+    if (!p) return;
+    if (x_min) *x_min = p->x_min;
+    if (x_max) *x_max = p->x_max;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_fit_x(scope_plot_t *p) 
+ *
+ *  @brief	Set X range to span all samples held
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_fit_x(scope_plot_t *p) 
+{
+    if (!p || p->size == 0) return;
+
+    double lo = INFINITY, hi = -INFINITY;
+    if (p->x_mono) 
+    {
+        lo = x_at(p, ring_slot(p, 0));
+        hi = x_at(p, ring_slot(p, p->size - 1));
+    }
+    else 
+    {
+        for (int i = 0; i < p->size; i++) 
+        {
+            double x = x_at(p, ring_slot(p, i));
+            if (x < lo) lo = x;
+            if (x > hi) hi = x;
+        }
+    }
+    if (lo <= hi) scope_plot_set_x_range(p, lo, hi);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void zoom_x(scope_plot_t *p, double x, double k) 
+ *
+ *  @brief	Scale the X range by k around x
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void zoom_x(scope_plot_t *p, double x, double k) 
+{
+    double lo = x - (x - p->x_min) * k;
+    double hi = x + (p->x_max - x) * k;
+    if (hi - lo > 1e-9 * (fabs(lo) + fabs(hi)) && hi - lo > 1e-300) 
+        scope_plot_set_x_range(p, lo, hi);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool scope_plot_handle_event(scope_plot_t *p, const SDL_Event *e) 
+ *
+ *  @brief	Zoom and pan the X range from mouse and keyboard events
+ *
+ *  @note	Wheel zooms around the pointer, left-drag pans, Left/Right pan by a tenth of the range,
+ *		Up/+ and Down/- zoom around the center, Home or r shows all samples
+ *
+ *  @return	true if the view changed and the plot should be rendered again
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+bool scope_plot_handle_event(scope_plot_t *p, const SDL_Event *e) 
+{
+    if (!p || !e) return false;
+
+    int w = 0, h = 0;
+    SDL_Rect pr = plot_rect(p, &w, &h);
+    if (pr.w < 1) return false;
+
+    double span = p->x_max - p->x_min;
+    switch (e->type) 
+    {
+    case SDL_MOUSEWHEEL: 
+    {
+        int mx = 0;
+        SDL_GetMouseState(&mx, NULL);
+        if (mx < pr.x) mx = pr.x;
+        if (mx > pr.x + pr.w) mx = pr.x + pr.w;
+        zoom_x(p, p->x_min + span * (mx - pr.x) / pr.w, pow(0.8, e->wheel.y));
+        return true;
+    }
+
+    case SDL_MOUSEBUTTONDOWN:
+        if (e->button.button != SDL_BUTTON_LEFT) return false;
+        p->drag = true;
+        p->drag_px = e->button.x;
+        p->drag_x0 = p->x_min;
+        p->drag_x1 = p->x_max;
+        return false;
+
+    case SDL_MOUSEBUTTONUP:
+        if (e->button.button == SDL_BUTTON_LEFT) p->drag = false;
+        return false;
+
+    case SDL_MOUSEMOTION: 
+    {
+        if (!p->drag) return false;
+        double dx = (p->drag_x1 - p->drag_x0) * (e->motion.x - p->drag_px) / pr.w;
+        scope_plot_set_x_range(p, p->drag_x0 - dx, p->drag_x1 - dx);
+        return true;
+    }
+
+    case SDL_KEYDOWN:
+        switch (e->key.keysym.sym) 
+        {
+        case SDLK_LEFT:     scope_plot_set_x_range(p, p->x_min - span/10, p->x_max - span/10); return true;
+        case SDLK_RIGHT:    scope_plot_set_x_range(p, p->x_min + span/10, p->x_max + span/10); return true;
+        case SDLK_UP:
+        case SDLK_PLUS:
+        case SDLK_EQUALS:
+        case SDLK_KP_PLUS:  zoom_x(p, p->x_min + span/2, 0.8); return true;
+        case SDLK_DOWN:
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS: zoom_x(p, p->x_min + span/2, 1.25); return true;
+        case SDLK_HOME:
+        case SDLK_r:        scope_plot_fit_x(p); return true;
+        default:            return false;
+        }
+
+    case SDL_WINDOWEVENT:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_set_title(scope_plot_t *p, const char *title) 
+ *
+ *  @brief	Set plot title
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_title(scope_plot_t *p, const char *title) 
+{
+    if (!p) return;
+    free(p->title);
+    p->title = str_dup(title);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_set_x_label(scope_plot_t *p, const char *x_label) 
+ *
+ *  @brief	Set X label
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_x_label(scope_plot_t *p, const char *x_label) 
+{
+    if (!p) return;
+    if (p->x_label) 
+    { 
+       free(p->x_label); 
+       p->x_label = NULL; 
+    }
+    if (x_label) p->x_label = str_dup(x_label);
+    p->layer_dirty = true;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_set_background(scope_plot_t *p, SDL_Color bg) 
+ *
+ *  @brief	Set plot background color
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_background(scope_plot_t *p, SDL_Color bg) 
+{
+    if (!p) return;
+    p->bg = bg;
+    p->layer_dirty = true;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void scope_plot_set_density(scope_plot_t *p, bool on) 
+ *
+ *  @brief	Draw samples as an x-y density (2D histogram, log color scale) instead of lines
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_density(scope_plot_t *p, bool on) 
+{
+    if (!p) return;
+    p->density = on;
+    p->dens_ok = false;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		bool scope_plot_push(scope_plot_t *p, double x, const double *y) 
  *
- *  @brief	Create the plot
+ *  @brief	Push data into plot buffer
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-scope_plot_t *scope_plot_create(SDL_Window *win,
-                                SDL_Renderer *ren,
-                                int trace_count,
-                                const scope_trace_desc_t *traces,
-                                const scope_plot_cfg_t *cfg)
+bool scope_plot_push(scope_plot_t *p, double x, const double *y) 
 {
-    if (!win || !ren || trace_count <= 0 || !traces) return NULL;
-
-    scope_plot_t *p = (scope_plot_t*)calloc(1, sizeof(*p));
-    if (!p) return NULL;
-
-    p->win = win;
-    p->ren = ren;
-    p->trace_count = trace_count;
-
-    p->cfg = cfg ? *cfg : scope_plot_default_cfg();
-    p->bg  = p->cfg.background;
+    if (!p || !y) return false;
 
-    p->cap = (p->cfg.max_points > 16) ? p->cfg.max_points : 1024;
-    p->xbuf = (double*)calloc((size_t)p->cap, sizeof(double));
-    if (!p->xbuf) 
-    { 
-       free(p); 
-       return NULL; 
+    // Entering a block: its summary restarts with the samples that overwrite it
+    int b = p->head / SCOPE_BLK;
+    if (p->head % SCOPE_BLK == 0) 
+    {
+        blk_reset(p, b);
+        if (p->compact) 
+        {
+            p->xbase_prev = p->xbase[b];
+            p->xbase[b] = NAN;
+        }
     }
 
-    p->traces = (trace_t*)calloc((size_t)trace_count, sizeof(trace_t));
-    if (!p->traces) 
-    { 
-       free(p->xbuf); 
-       free(p); 
-       return NULL; 
+    // Write at head
+    if (!p->compact) 
+    {
+        p->xbuf[p->head] = x;
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            p->traces[t].y[p->head] = y[t];
+        }
     }
-
-    for (int i = 0; i < trace_count; i++) 
+    else 
     {
-       p->traces[i].y = (double*)calloc((size_t)p->cap, sizeof(double));
-       if (!p->traces[i].y) 
-       {
-          for (int k = 0; k < i; k++) 
-             free(p->traces[k].y);
-
-          free(p->traces);
-          free(p->xbuf);
-          free(p);
-          return NULL;
-       }
-
-       p->trace_axis = (uint8_t*)calloc((size_t)trace_count, sizeof(uint8_t));
-       if (!p->trace_axis) 
-       {
-          free(p->xbuf);
-          free(p->traces);
-          free(p);
-          return NULL;
-       }
-
-       p->axis_used[0] = true;
-       p->axis_used[1] = false;
-       p->y_min[0] = -1.0; p->y_max[0] = 1.0;
-       p->y_min[1] = -1.0; p->y_max[1] = 1.0;
-       p->traces[i].color = traces[i].color;
-       p->traces[i].name  = str_dup(traces[i].name ? traces[i].name : "");
-
-       if (!p->traces[i].name) 
-       {
-          for (int k = 0; k <= i; k++) 
-	  { 
-	     free(p->traces[k].y); 
-	     free(p->traces[k].name); 
-	  }
-          free(p->traces);
-          free(p->xbuf);
-          free(p);
-          return NULL;
-       }
+        // the block's first x is its base; x and y are then read back as stored
+        if (isnan(p->xbase[b]) && !isnan(x)) p->xbase[b] = x;
+        p->xoff[p->head] = (float)(x - p->xbase[b]);
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            p->traces[t].yf[p->head] = (float)y[t];
+        }
+        x = p->xbase[b] + (double)p->xoff[p->head];
     }
 
-    // X defaults
-    p->x_min = 0.0;
-    p->x_max = 1.0;
+    pyr_push(p, p->head);
+    p->pushes++;
+    if (isnan(x) || (p->size > 0 && x < p->x_last)) p->x_mono = false;
+    p->x_last = x;
 
-    // TTF init
-    if (TTF_WasInit() == 0) 
+    // Fold into the block summary (samples with NaN x are never in a window)
+    if (!isnan(x)) 
     {
-       if (TTF_Init() != 0) 
-       {
-          scope_plot_destroy(p);
-          return NULL;
-       }
-       p->ttf_inited_here = true;
+        if (x < p->blk_xmin[b]) p->blk_xmin[b] = x;
+        if (x > p->blk_xmax[b]) p->blk_xmax[b] = x;
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            double *mn = &p->blk_ymin[t * p->blk_n + b], *mx = &p->blk_ymax[t * p->blk_n + b];
+            double v = p->compact ? (double)p->traces[t].yf[p->head] : y[t];
+            if (v < *mn) *mn = v;
+            if (v > *mx) *mx = v;
+        }
     }
 
-    p->font = TTF_OpenFont(p->cfg.ttf_path, p->cfg.font_px);
-    if (!p->font) 
-    {
-       scope_plot_destroy(p);
-       return NULL;
-    }
+    p->head = (p->head + 1) % p->cap;
+    if (p->size < p->cap) p->size++;
 
-    return p;
+    return true;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void scope_plot_destroy(scope_plot_t *p) 
+ *  @fn		void scope_plot_clear(scope_plot_t *p) 
  *
- *  @brief	Destroy plot
+ *  @brief	Drop all samples, keeping the traces, ranges and labels (e.g. to redraw an animation frame)
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-void scope_plot_destroy(scope_plot_t *p) 
+void scope_plot_clear(scope_plot_t *p) 
 {
     if (!p) return;
 
-    if (p->font) 
-    {
-        TTF_CloseFont(p->font);
-        p->font = NULL;
-    }
-    if (p->ttf_inited_here) 
-    {
-        TTF_Quit();
-        p->ttf_inited_here = false;
-    }
+    p->head = 0;
+    p->size = 0;
+    p->x_mono = true;
+    for (int b = 0; b < p->blk_n; b++) 
+       blk_reset(p, b);
+    for (int b = 0; p->xbase && b < p->blk_n; b++) 
+       p->xbase[b] = NAN;
+    p->xbase_prev = NAN;
+    p->pushes++;
+}
 
-    if (p->traces) 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void draw_traces_raw(scope_plot_t *p, SDL_Rect pr) 
+ *
+ *  @brief	Draw traces through every sample (fallback when x is not monotonic)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static 
+void draw_traces_raw(scope_plot_t *p, SDL_Rect pr) 
+{
+    // For each trace: one polyline per run of visible points
+    for (int t = 0; t < p->trace_count; t++) 
     {
-        for (int i = 0; i < p->trace_count; i++) 
-	{
-            free(p->traces[i].y);
-            free(p->traces[i].name);
+        int n = 0;
+
+        set_color(p->ren, p->traces[t].color);
+        for (int i = 0; i < p->size; i++) 
+        {
+            int idx = ring_slot(p, i);
+
+            double x = x_at(p, idx);
+            if (!in_x_window(x, p->x_min, p->x_max)) 
+            {
+                pts_flush(p, &n);
+                continue;
+            }
+
+            double y = y_at(p, t, idx);
+            if (isnan(y)) 
+            {
+                pts_flush(p, &n);
+                continue;
+            }
+            int px = map_x(p, x, pr.x, pr.w);
+            int py = map_y(p, y, (int)p->trace_axis[t], pr.y, pr.h);
+            pts_add(p, &n, px, py);
         }
-        free(p->traces);
+        pts_flush(p, &n);
     }
-    free(p->xbuf);
-    free(p->title);
-    free(p);
 }
 
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void scope_plot_set_x_range(scope_plot_t *p, double x_min, double x_max) 
+ *  @fn		bool scan_columns(scope_plot_t *p, SDL_Rect pr) 
  *
- *  @brief	Set X range
+ *  @brief	Reduce the visible samples into pixel columns by visiting each of them
+ *
+ *  @return	false if x turns out not to be monotonic
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-void scope_plot_set_x_range(scope_plot_t *p, double x_min, double x_max) 
+static 
+bool scan_columns(scope_plot_t *p, SDL_Rect pr) 
 {
-    if (!p) return;
-    if (x_max == x_min) x_max = x_min + 1.0;
-    if (x_max < x_min) 
+    int ncol = pr.w + 1;
+    bool in_prev = false;
+    double x_prev = -INFINITY;
+
+    for (int i = 0; i < p->size; i++) 
     {
-        double tmp = x_min; x_min = x_max; x_max = tmp;
+        int idx = ring_slot(p, i);
+
+        double x = x_at(p, idx);
+        if (x < x_prev)
+        {
+            // columns only preserve sample order for monotonic x
+            return false;
+        }
+        if (!isnan(x)) x_prev = x;
+
+        if (!in_x_window(x, p->x_min, p->x_max)) 
+        {
+            in_prev = false;
+            continue;
+        }
+
+        int c = map_x(p, x, pr.x, pr.w) - pr.x;
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            double y = y_at(p, t, idx);
+            px_col_t *col = &p->px_cols[t * ncol + c];
+
+            if (isnan(y)) 
+            {
+                col->gap = true;
+                continue;
+            }
+
+            int py = map_y(p, y, (int)p->trace_axis[t], pr.y, pr.h);
+            if (col->gap) 
+            {
+                // a value after a gap in the same column: the column's bar covers both sides
+                col->gap = false;
+                if (!col->used) col->brk = true;
+            }
+            if (!col->used) 
+            {
+                col->used = true;
+                col->brk = col->brk || !in_prev;
+                col->first = col->last = col->min = col->max = py;
+            }
+            else 
+            {
+                col->last = py;
+                if (py < col->min) col->min = py;
+                if (py > col->max) col->max = py;
+            }
+        }
+        in_prev = true;
     }
-    p->x_min = x_min;
-    p->x_max = x_max;
+
+    return true;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void scope_plot_set_title(scope_plot_t *p, const char *title) 
+ *  @fn		void bin_columns(scope_plot_t *p, SDL_Rect pr) 
  *
- *  @brief	Set plot title
+ *  @brief	Reduce the visible samples into pixel columns for monotonic x: each column is an index range
+ *		found by binary search, its min/max a pyramid query, so the work is O(width * log N) at any zoom
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-void scope_plot_set_title(scope_plot_t *p, const char *title) 
+static 
+void bin_columns(scope_plot_t *p, SDL_Rect pr) 
 {
-    if (!p) return;
-    free(p->title);
-    p->title = str_dup(title);
+    int ncol = pr.w + 1;
+    int i0 = x_search(p, 0, p->size, p->x_min, false);
+    int i1 = x_search(p, i0, p->size, p->x_max, true);
+
+    for (int a = i0; a < i1; ) 
+    {
+        int c = map_x(p, x_at(p, ring_slot(p, a)), pr.x, pr.w) - pr.x;
+
+        // end of column c
+        int lo = a + 1, hi = i1;
+        while (lo < hi) 
+        {
+            int mid = lo + (hi - lo) / 2;
+            if (map_x(p, x_at(p, ring_slot(p, mid)), pr.x, pr.w) - pr.x <= c) lo = mid + 1;
+            else hi = mid;
+        }
+
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            int axis = (int)p->trace_axis[t];
+            px_col_t *col = &p->px_cols[t * ncol + c];
+            double mn, mx;
+
+            range_minmax(p, t, a, lo, &mn, &mx);
+            if (mn > mx) 
+            {
+                // only NaN samples in this column
+                col->gap = true;
+                continue;
+            }
+
+            double y0 = y_at(p, t, ring_slot(p, a)), y1 = y_at(p, t, ring_slot(p, lo - 1));
+            col->used = true;
+            col->brk = (a == i0) || isnan(y0);
+            col->gap = isnan(y1);
+            col->min = map_y(p, mx, axis, pr.y, pr.h);
+            col->max = map_y(p, mn, axis, pr.y, pr.h);
+            col->first = isnan(y0) ? col->min : map_y(p, y0, axis, pr.y, pr.h);
+            col->last = isnan(y1) ? col->max : map_y(p, y1, axis, pr.y, pr.h);
+        }
+        a = lo;
+    }
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void scope_plot_set_x_label(scope_plot_t *p, const char *x_label) 
+ *  @fn		void draw_traces(scope_plot_t *p, SDL_Rect pr) 
  *
- *  @brief	Set X label
+ *  @brief	Draw traces reduced to first/last/min/max per pixel column, so the number of segments drawn
+ *		depends on the plot width, not on the number of samples.  The vertical min-max bar of each
+ *		column keeps spikes and pulse edges that fall between pixels.
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-void scope_plot_set_x_label(scope_plot_t *p, const char *x_label) 
+static 
+void draw_traces(scope_plot_t *p, SDL_Rect pr) 
 {
-    if (!p) return;
-    if (p->x_label) 
-    { 
-       free(p->x_label); 
-       p->x_label = NULL; 
+    int ncol = pr.w + 1;
+    int need = ncol * p->trace_count;
+
+    if (need > p->px_cols_cap)
+    {
+        px_col_t *c = (px_col_t*)realloc(p->px_cols, (size_t)need * sizeof(px_col_t));
+        if (!c) 
+        {
+            draw_traces_raw(p, pr);
+            return;
+        }
+        p->px_cols = c;
+        p->px_cols_cap = need;
+    }
+    for (int k = 0; k < need; k++) p->px_cols[k].used = p->px_cols[k].brk = p->px_cols[k].gap = false;
+
+    // Reduce visible samples into their pixel columns
+    if (p->x_mono) 
+    {
+        bin_columns(p, pr);
+    }
+    else if (!scan_columns(p, pr)) 
+    {
+        draw_traces_raw(p, pr);
+        return;
+    }
+
+    // One polyline per trace: previous last -> first -> min -> max -> last of each column, so the
+    // column's min-max bar is part of the line; a break or a gap starts a new polyline
+    for (int t = 0; t < p->trace_count; t++) 
+    {
+        const px_col_t *cols = &p->px_cols[t * ncol];
+        int n = 0;
+
+        set_color(p->ren, p->traces[t].color);
+        for (int c = 0; c < ncol; c++) 
+        {
+            if (cols[c].used) 
+            {
+                if (cols[c].brk) pts_flush(p, &n);
+
+                int px = pr.x + c;
+                pts_add(p, &n, px, cols[c].first);
+                pts_add(p, &n, px, cols[c].min);
+                pts_add(p, &n, px, cols[c].max);
+                pts_add(p, &n, px, cols[c].last);
+            }
+            if (cols[c].gap) pts_flush(p, &n);
+        }
+        pts_flush(p, &n);
     }
-    if (x_label) p->x_label = str_dup(x_label);
 }
 
 
+// One binning job: ring slots [a, b) into its own count grid
+typedef struct
+{
+    scope_plot_t *p;
+    int a, b;
+    uint32_t *cnt;
+} dens_job_t;
+
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void scope_plot_set_background(scope_plot_t *p, SDL_Color bg) 
+ *  @fn		void *dens_bin_fn(void *arg) 
  *
- *  @brief	Set plot background color
+ *  @brief	Count the samples of a job's slots that are inside the x-window into their pixels.  Sample
+ *		order does not matter, so slots are visited in memory order.
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-void scope_plot_set_background(scope_plot_t *p, SDL_Color bg) 
+static 
+void *dens_bin_fn(void *arg) 
 {
-    if (!p) return;
-    p->bg = bg;
+    dens_job_t *j = (dens_job_t *)arg;
+    scope_plot_t *p = j->p;
+    int w = p->dens_w, h = p->dens_h;
+    size_t plane = (size_t)w * h;
+
+    double x0 = p->x_min, x1 = p->x_max;
+    double sx = (x1 - x0 > 1e-18) ? (double)(w - 1) / (x1 - x0) : 0.0;
+
+    for (int t = 0; t < p->trace_count; t++) 
+    {
+        int axis = (int)p->trace_axis[t];
+        double y0 = p->y_min[axis], y1 = p->y_max[axis];
+        double sy = (y1 - y0 > 1e-18) ? (double)(h - 1) / (y1 - y0) : 0.0;
+        uint32_t *cnt = j->cnt + t * plane;
+
+        for (int i = j->a; i < j->b; i++) 
+        {
+            double x = x_at(p, i), y = y_at(p, t, i);
+            if (!(x >= x0 && x <= x1) || isnan(y)) continue;
+
+            double v = (y - y0) * sy;
+            if (v < 0.0) v = 0.0;
+            if (v > h - 1) v = h - 1;
+
+            int c = (int)((x - x0) * sx + 0.5);
+            int r = (h - 1) - (int)(v + 0.5);
+            cnt[(size_t)r * w + c]++;
+        }
+    }
+
+    return NULL;
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		bool scope_plot_push(scope_plot_t *p, double x, const double *y) 
+ *  @fn		bool dens_build(scope_plot_t *p) 
  *
- *  @brief	Push data into plot buffer
+ *  @brief	Bin every sample into the histogram: the ring is split across threads that each fill a private
+ *		grid, summed at the end.  Each trace then adds its color scaled by log(1+count)/log(1+max
+ *		count); empty pixels stay transparent so the grid shows through.
+ *
+ *  @return	false if out of memory
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
-bool scope_plot_push(scope_plot_t *p, double x, const double *y) 
+static 
+bool dens_build(scope_plot_t *p) 
 {
-    if (!p || !y) return false;
+    size_t plane = (size_t)p->dens_w * p->dens_h;
+    size_t need = plane * p->trace_count;
 
-    // Write at head
-    p->xbuf[p->head] = x;
-    for (int t = 0; t < p->trace_count; t++) 
+    if (need > p->dens_cap) 
     {
-        p->traces[t].y[p->head] = y[t];
+        uint32_t *c = (uint32_t*)realloc(p->dens_cnt, need * sizeof(uint32_t));
+        if (c) p->dens_cnt = c;
+        uint32_t *px = (uint32_t*)realloc(p->dens_px, plane * sizeof(uint32_t));
+        if (px) p->dens_px = px;
+        if (!c || !px) return false;
+        p->dens_cap = need;
     }
+    memset(p->dens_cnt, 0, need * sizeof(uint32_t));
 
-    p->head = (p->head + 1) % p->cap;
-    if (p->size < p->cap) p->size++;
+    // One job per thread; job 0 bins straight into dens_cnt in the calling thread
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nth = (ncpu > 0) ? (int)ncpu : 1;
+    if (nth > SCOPE_DENS_THREADS) nth = SCOPE_DENS_THREADS;
+    if (nth > p->size / SCOPE_DENS_MIN_CHUNK) nth = p->size / SCOPE_DENS_MIN_CHUNK;
+    if (nth < 1) nth = 1;
+
+    dens_job_t job[SCOPE_DENS_THREADS];
+    pthread_t th[SCOPE_DENS_THREADS];
+    bool started[SCOPE_DENS_THREADS] = {false};
+
+    for (int k = 0; k < nth; k++) 
+    {
+        job[k].p = p;
+        job[k].a = (int)((long)p->size * k / nth);
+        job[k].b = (int)((long)p->size * (k + 1) / nth);
+        job[k].cnt = p->dens_cnt;
+        if (k == 0) continue;
+
+        uint32_t *c = (uint32_t*)calloc(need, sizeof(uint32_t));
+        if (!c) continue;
+        job[k].cnt = c;
+        started[k] = (pthread_create(&th[k], NULL, dens_bin_fn, &job[k]) == 0);
+        if (!started[k]) 
+        {
+            free(c);
+            job[k].cnt = p->dens_cnt;
+        }
+    }
+
+    // the calling thread bins its own slots and those of any job that did not start
+    for (int k = 0; k < nth; k++) 
+    {
+        if (!started[k]) dens_bin_fn(&job[k]);
+    }
+    for (int k = 1; k < nth; k++) 
+    {
+        if (!started[k]) continue;
+        pthread_join(th[k], NULL);
+        for (size_t i = 0; i < need; i++) p->dens_cnt[i] += job[k].cnt[i];
+        free(job[k].cnt);
+    }
+
+    // Log color scale
+    uint32_t c_max = 0;
+    for (size_t i = 0; i < need; i++) 
+    {
+        if (p->dens_cnt[i] > c_max) c_max = p->dens_cnt[i];
+    }
+    double k_log = (c_max > 0) ? 1.0 / log1p((double)c_max) : 0.0;
+
+    for (size_t i = 0; i < plane; i++) 
+    {
+        double r = 0.0, g = 0.0, b = 0.0;
+        bool any = false;
+        for (int t = 0; t < p->trace_count; t++) 
+        {
+            uint32_t c = p->dens_cnt[t * plane + i];
+            if (c == 0) continue;
+
+            // a single sample is still visible at a quarter of the trace color
+            double a = 0.25 + 0.75 * log1p((double)c) * k_log;
+            SDL_Color tc = p->traces[t].color;
+            r += a * tc.r;
+            g += a * tc.g;
+            b += a * tc.b;
+            any = true;
+        }
+        p->dens_px[i] = !any ? 0u : 0xFF000000u | 
+                        (uint32_t)(r > 255.0 ? 255.0 : r) << 16 | 
+                        (uint32_t)(g > 255.0 ? 255.0 : g) << 8 | 
+                        (uint32_t)(b > 255.0 ? 255.0 : b);
+    }
 
     return true;
 }
 
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  *
- *  @fn		void draw_traces(scope_plot_t *p, SDL_Rect pr) 
+ *  @fn		bool draw_density(scope_plot_t *p, SDL_Rect pr) 
  *
- *  @brief	Draw traces
+ *  @brief	Draw the samples in the x-window as one density texture covering the plot area
+ *
+ *  @return	false if the texture cannot be made (the caller draws lines instead)
  *
  *---------------------------------------------------------------------------------------------------------------------
  */
 static 
-void draw_traces(scope_plot_t *p, SDL_Rect pr) 
+bool draw_density(scope_plot_t *p, SDL_Rect pr) 
 {
-   // For each trace: connect successive visible points
-   for (int t = 0; t < p->trace_count; t++) 
-   {
-      bool have_prev = false;
-      int px_prev = 0, py_prev = 0;
-
-      for (int i = 0; i < p->size; i++) 
-      {
-         int idx = (p->head - p->size + i);
-         if (idx < 0) idx += p->cap * ((-idx / p->cap) + 1);
-         idx %= p->cap;
-
-         double x = p->xbuf[idx];
-         if (!in_x_window(x, p->x_min, p->x_max)) 
-	 {
-            have_prev = false;
-            continue;
-         }
-
-         double y = p->traces[t].y[idx];
-         int px = map_x(p, x, pr.x, pr.w);
-         int axis = (int)p->trace_axis[t];
-         int py = map_y(p, y, axis, pr.y, pr.h);
-
-         if (have_prev) 
-	 {
-            draw_line(p->ren, px_prev, py_prev, px, py, p->traces[t].color);
-         }
-         px_prev = px; py_prev = py;
-         have_prev = true;
-      }
-   }
+    int w = pr.w + 1, h = pr.h + 1;
+    double rng[6] = { p->x_min, p->x_max, p->y_min[0], p->y_min[1], p->y_max[0], p->y_max[1] };
+
+    if (!p->dens_tex || w != p->dens_w || h != p->dens_h) 
+    {
+        if (p->dens_tex) SDL_DestroyTexture(p->dens_tex);
+        p->dens_tex = SDL_CreateTexture(p->ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (!p->dens_tex) return false;
+        SDL_SetTextureBlendMode(p->dens_tex, SDL_BLENDMODE_BLEND);
+        p->dens_w = w;
+        p->dens_h = h;
+        p->dens_ok = false;
+    }
+
+    if (!p->dens_ok || p->dens_pushes != p->pushes || memcmp(rng, p->dens_rng, sizeof(rng)) != 0) 
+    {
+        if (!dens_build(p)) return false;
+        SDL_UpdateTexture(p->dens_tex, NULL, p->dens_px, w * (int)sizeof(uint32_t));
+        memcpy(p->dens_rng, rng, sizeof(rng));
+        p->dens_pushes = p->pushes;
+        p->dens_ok = true;
+    }
+
+    SDL_Rect dst = { pr.x, pr.y, w, h };
+    SDL_RenderCopy(p->ren, p->dens_tex, NULL, &dst);
+    return true;
 }
 
 
@@ -1056,27 +2583,19 @@ void scope_plot_render(scope_plot_t *p)
     if (!p) return;
 
     int w = 0, h = 0;
-    SDL_GetWindowSize(p->win, &w, &h);
-
-    // Full background
-    set_color(p->ren, p->bg);
-    SDL_RenderClear(p->ren);
-
-    SDL_Rect pr = 
+    SDL_Rect pr = plot_rect(p, &w, &h);
+    if (pr.w < 50 || pr.h < 50) 
     {
-        p->cfg.margin_left,
-        p->cfg.margin_top,
-        w - p->cfg.margin_left - p->cfg.margin_right,
-        h - p->cfg.margin_top - p->cfg.margin_bottom
-    };
-    if (pr.w < 50 || pr.h < 50) return;
+        set_color(p->ren, p->bg);
+        SDL_RenderClear(p->ren);
+        return;
+    }
 
     // auto y-scale each frame
     compute_y_autoscale(p);
 
-    draw_grid(p, pr);
-    draw_traces(p, pr);
-    draw_axis_labels(p, pr);
+    draw_static(p, pr, w, h);
+    if (!p->density || !draw_density(p, pr)) draw_traces(p, pr);
     draw_legend(p, pr);
 }
 
@@ -48,6 +48,7 @@ typedef struct
 
     float y_padding_frac;  // e.g., 0.05 -> 5% padding
     int max_points;        // ring buffer capacity per trace
+    bool compact;          // store samples as float32 (x relative to a per-block base): about half the memory
 
     const char *ttf_path;  // font path (e.g., /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf)
     int font_px;           // e.g., 14
@@ -60,7 +61,8 @@ scope_plot_cfg_t scope_plot_default_cfg(void);
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  * Create a plot with N traces.
- * - window/renderer are owned by the caller (plot does not destroy them).
+ * - window/renderer are owned by the caller (plot does not destroy them); win may be NULL if the renderer
+ *   draws offscreen.
  * - plot owns its internal buffers + font resources.
  *---------------------------------------------------------------------------------------------------------------------
  */
@@ -73,12 +75,50 @@ scope_plot_t *scope_plot_create(SDL_Window *win,
 void scope_plot_destroy(scope_plot_t *p);
 
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Create a plot that renders into an offscreen w x h software surface: no window, no display and no event
+ * loop needed.  The plot owns the surface and renderer.  Use scope_plot_save_image() to write it out.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+scope_plot_t *scope_plot_create_headless(int w, int h,
+                                         int trace_count,
+                                         const scope_trace_desc_t *traces,
+                                         const scope_plot_cfg_t *cfg);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Render the plot and write it as PNG, or PPM if fn ends in .ppm.  Works for windowed plots too.
+ * Returns 0 if success; negative otherwise.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int scope_plot_save_image(scope_plot_t *p, const char *fn);
+
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  * Set the x-axis range (NOT auto-scaled). 
  *---------------------------------------------------------------------------------------------------------------------
  */
 void scope_plot_set_x_range(scope_plot_t *p, double x_min, double x_max);
+void scope_plot_get_x_range(scope_plot_t *p, double *x_min, double *x_max);
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Set the x-axis range to span all samples held. 
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_fit_x(scope_plot_t *p);
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Interactive zoom/pan of the x-axis: wheel zooms around the pointer, left-drag pans, Left/Right pan,
+ * Up/+ and Down/- zoom, Home or r fits all samples.  Returns true if the plot needs to be rendered again.
+ * With monotonic x (e.g. time) a frame costs O(plot width * log samples) at any zoom level.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+bool scope_plot_handle_event(scope_plot_t *p, const SDL_Event *e);
 
 
 /*!
@@ -107,10 +147,28 @@ void scope_plot_set_background(scope_plot_t *p, SDL_Color bg);
  * Push one sample:
  * - x is the independent variable
  * - y[] must have trace_count elements
+ * - a NaN y[k] means trace k has no value at x; it is drawn with a gap there
  *---------------------------------------------------------------------------------------------------------------------
  */
 bool scope_plot_push(scope_plot_t *p, double x, const double *y);
 
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Drop all samples; traces, x-range, title and labels are kept.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_clear(scope_plot_t *p);
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Density mode: draw samples as an x-y density instead of lines, for phase plots (e.g. V_batt vs soc_batt)
+ * of millions of unordered points.  Samples in the x-window are binned per pixel (in parallel) and drawn as
+ * one texture with a log color scale; the histogram is rebuilt only when data, size or ranges change.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void scope_plot_set_density(scope_plot_t *p, bool on);
+
 /*!
  *---------------------------------------------------------------------------------------------------------------------
  * Render the plot into the current renderer target. 
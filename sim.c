@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <sched.h>
+#include <string.h>
 
 #include "globals.h"
 #include "flash_params.h"
@@ -46,8 +47,16 @@ int params_init(sim_t *sim)
    batt_t *batt = sim->batt;
    fgic_t *fgic = sim->fgic;
    system_t *system = sim->system;
+   pack_t *pack = sim->pack;
 
-   if (batt==NULL || fgic==NULL || system==NULL) return -1;
+   if (batt==NULL || fgic==NULL || system==NULL || pack==NULL) return -1;
+
+   static char *probe_params[PACK_PROBES][5] = {
+      { "c0_pack", "V_c0_pack", "I_c0_pack", "soc_c0_pack", "T_c0_pack" },
+      { "c1_pack", "V_c1_pack", "I_c1_pack", "soc_c1_pack", "T_c1_pack" },
+      { "c2_pack", "V_c2_pack", "I_c2_pack", "soc_c2_pack", "T_c2_pack" },
+      { "c3_pack", "V_c3_pack", "I_c3_pack", "soc_c3_pack", "T_c3_pack" }
+   };
 
    sim->params[i].name = "realtime";
    sim->params[i].type = "%b";
@@ -101,6 +110,34 @@ int params_init(sim_t *sim)
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->batt->ecm->Tau;
 
+   sim->params[i].name = "n_rc_batt";
+   sim->params[i].type = "%d";
+   sim->params[i++].value= &sim->batt->ecm->n_rc;
+
+   sim->params[i].name = "R2_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->Rk[1];
+
+   sim->params[i].name = "C2_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->Ck[1];
+
+   sim->params[i].name = "V_rc2_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->V_rck[1];
+
+   sim->params[i].name = "R3_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->Rk[2];
+
+   sim->params[i].name = "C3_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->Ck[2];
+
+   sim->params[i].name = "V_rc3_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->V_rck[2];
+
    sim->params[i].name = "Qmax_batt";
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->batt->ecm->Q_Ah;
@@ -125,6 +162,14 @@ int params_init(sim_t *sim)
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->batt->ecm->Ea_C1;
 
+   sim->params[i].name = "soc_tol_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->soc_tol;
+
+   sim->params[i].name = "T_tol_batt";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->batt->ecm->T_tol;
+
    sim->params[i].name = "chg_state_batt";
    sim->params[i].type = "%d";
    sim->params[i++].value= &sim->batt->ecm->chg_state;
@@ -229,6 +274,34 @@ int params_init(sim_t *sim)
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->fgic->ecm->Tau;
 
+   sim->params[i].name = "n_rc_fgic";
+   sim->params[i].type = "%d";
+   sim->params[i++].value= &sim->fgic->ecm->n_rc;
+
+   sim->params[i].name = "R2_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->Rk[1];
+
+   sim->params[i].name = "C2_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->Ck[1];
+
+   sim->params[i].name = "V_rc2_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->V_rck[1];
+
+   sim->params[i].name = "R3_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->Rk[2];
+
+   sim->params[i].name = "C3_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->Ck[2];
+
+   sim->params[i].name = "V_rc3_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->V_rck[2];
+
    sim->params[i].name = "R0_fgic";
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->fgic->ecm->R0;
@@ -265,6 +338,14 @@ int params_init(sim_t *sim)
    sim->params[i].type = "%lf";
    sim->params[i++].value= &sim->fgic->ecm->Ea_C1;
 
+   sim->params[i].name = "soc_tol_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->soc_tol;
+
+   sim->params[i].name = "T_tol_fgic";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &sim->fgic->ecm->T_tol;
+
    sim->params[i].name = "chg_state_fgic";
    sim->params[i].type = "%d";
    sim->params[i++].value= &sim->fgic->ecm->chg_state;
@@ -361,6 +442,82 @@ int params_init(sim_t *sim)
    sim->params[i].type = "%b";
    sim->params[i++].value= &sim->fgic->offset_en;
 
+   sim->params[i].name = "V_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->V;
+
+   sim->params[i].name = "I_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->I;
+
+   sim->params[i].name = "soc_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->soc;
+
+   sim->params[i].name = "soc_min_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->soc_min;
+
+   sim->params[i].name = "soc_max_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->soc_max;
+
+   sim->params[i].name = "V_min_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->V_min;
+
+   sim->params[i].name = "V_max_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->V_max;
+
+   sim->params[i].name = "T_max_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->T_max;
+
+   sim->params[i].name = "dI_max_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->dI_max;
+
+   sim->params[i].name = "sd_R_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->sd_R;
+
+   sim->params[i].name = "sd_Q_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->sd_Q;
+
+   sim->params[i].name = "sd_V_pack";
+   sim->params[i].type = "%lf";
+   sim->params[i++].value= &pack->sd_V;
+
+   sim->params[i].name = "seed_pack";
+   sim->params[i].type = "%d";
+   sim->params[i++].value= &pack->seed;
+
+   /* probed cells: set c<k>_pack to a cell index to log its V, I, soc, T */
+   for (int k=0; k<PACK_PROBES; k++)
+   {
+      sim->params[i].name = probe_params[k][0];
+      sim->params[i].type = "%d";
+      sim->params[i++].value= &pack->probe[k];
+
+      sim->params[i].name = probe_params[k][1];
+      sim->params[i].type = "%lf";
+      sim->params[i++].value= &pack->probe_V[k];
+
+      sim->params[i].name = probe_params[k][2];
+      sim->params[i].type = "%lf";
+      sim->params[i++].value= &pack->probe_I[k];
+
+      sim->params[i].name = probe_params[k][3];
+      sim->params[i].type = "%lf";
+      sim->params[i++].value= &pack->probe_soc[k];
+
+      sim->params[i].name = probe_params[k][4];
+      sim->params[i].type = "%lf";
+      sim->params[i++].value= &pack->probe_T[k];
+   }
+
    sim->params_sz = i;
    return i;
 }
@@ -454,6 +611,11 @@ bool sim_check_pause(sim_t *sim)
    if (batt->ecm->chg_state==CHG && batt->ecm->soc >= 1.0f) do_pause = true;
    if (batt->ecm->chg_state==DSG && batt->ecm->soc <= 0.0f) do_pause = true;
 
+   /* the weakest cell of a pack ends its discharge, the strongest its charge */
+   pack_t *pack = sim->pack;
+   if (pack->b != NULL && pack->I > 0.0 && pack->soc_min <= 0.0) do_pause = true;
+   if (pack->b != NULL && pack->I < 0.0 && pack->soc_max >= 1.0) do_pause = true;
+
    /* check conditional */
    bool res = false;
    for (int k=0; k<MAX_COND; k++)
@@ -634,18 +796,17 @@ sim_t *sim_create(double t0, double dt, double temp0)
    sim_t *sim = calloc(1, sizeof(sim_t));
    if (sim == NULL) return NULL;
 
-   sim->logfp = NULL;
-   memset(sim->logfn, 0, FN_LEN);
+   sim->logs.n = 0;
+   sim->trace = NULL;
+   sim->scope = NULL;
    memset(sim->script_fn, 0, FN_LEN);
-   memset(sim->logi, 0, MAX_PARAMS*sizeof(int));
-   sim->logn = 0;
    sim->m_root = NULL;
 
    /* init scope_plot */
    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) 
    {
-      printf("error: cannot init scope.\n");
-      goto _err_ret;
+      /* no display: the sim still runs and 'plot file -o' still renders offscreen */
+      printf("note: no display, only 'plot file ... -o <image>' is available.\n");
    }
 
 
@@ -672,6 +833,13 @@ sim_t *sim_create(double t0, double dt, double temp0)
    sim->fgic = fgic_create(sim->batt, &g_fgic_flash_params, temp0);
    if (sim->fgic == NULL) goto _err_ret;
 
+   sim->pack = pack_create();
+   if (sim->pack == NULL) goto _err_ret;
+
+   sim->hist = tbl_hist_create(&sim->fgic->ecm->params, t0, TBL_HIST_MAX);
+   if (sim->hist == NULL) goto _err_ret;
+   sim->fgic->hist = sim->hist;
+
    sim->system = (system_t *)system_create(sim->fgic);
    if (sim->system == NULL) goto _err_ret;
 
@@ -768,59 +936,18 @@ void sim_destroy(sim_t *sim)
    if (sim->thread != NULL) pthread_join(*sim->thread, NULL);
    if (sim->thread != NULL) free(sim->thread);
 
+   logset_clear(&sim->logs);
+   trace_destroy(sim->trace);
+   scope_live_destroy(sim->scope);
    if (sim->system != NULL) system_destroy(sim->system);
    if (sim->fgic != NULL) fgic_destroy(sim->fgic);
+   tbl_hist_destroy(sim->hist);
+   pack_destroy(sim->pack);
    if (sim->batt != NULL) batt_destroy(sim->batt);
 }
 
 
 
-/*!
- *----------------------------------------------------------------------------------------------------------------------
- *
- *  @fn		int sim_update_log(sim_t *sim)
- *
- *  @brief	Update logging
- *
- *----------------------------------------------------------------------------------------------------------------------
- */
-static
-int sim_update_log(sim_t *sim)
-{
-   char fmt[200];
-   memset(fmt, 0, sizeof(fmt));
-
-   if (sim != NULL && sim->logn > 0)
-   {
-      fprintf(sim->logfp, "%lf,", sim->t); 
-      for (int i=0; i<sim->logn; i++)
-      {
-         int idx = sim->logi[i];
-         char *type = sim->params[idx].type;
-         if (i == sim->logn-1)
-            snprintf(fmt, sizeof(fmt), "%s", type);
-         else
-            snprintf(fmt, sizeof(fmt), "%s,", type);
-
-         if (0==strcmp(type, "%b")) 
-            fprintf(sim->logfp, fmt, *(int *)sim->params[idx].value); 
-	 else if (0==strcmp(type, "%d")) 
-            fprintf(sim->logfp, fmt, *(int *)sim->params[idx].value); 
-         else if (0==strcmp(type, "%ld")) 
-            fprintf(sim->logfp, fmt, *(long *)sim->params[idx].value); 
-         else if (0==strcmp(type, "%f")) 
-            fprintf(sim->logfp, fmt, *(float *)sim->params[idx].value); 
-         else if (0==strcmp(type, "%lf")) 
-            fprintf(sim->logfp, fmt, *(double *)sim->params[idx].value); 
-         else 
-            fprintf(sim->logfp, "%s", (char *)sim->params[idx].value); 
-      }
-      fprintf(sim->logfp, "\n");
-   }
-   return 0;
-}
-
-
 /*!
  *----------------------------------------------------------------------------------------------------------------------
  *
@@ -836,13 +963,19 @@ int sim_update(sim_t *sim)
 
    if (sim == NULL) return -1;
 
-   sim_update_log(sim);
+   logset_update(&sim->logs, sim->t);
+   trace_update(sim->trace, sim->t);
+   scope_live_push(sim->scope, sim->t);
    rc = system_update(sim->system, sim->t, sim->dt);
    if (rc != 0) goto _err_ret;
 
    rc = batt_update(sim->batt, sim->system->I, sim->T_amb_C, sim->t, sim->dt);
    if (rc != 0) goto _err_ret;
 
+   /* the system load is per cell: the pack draws it n_p times, so its cells carry what batt does */
+   rc = pack_update(sim->pack, sim->system->I * sim->pack->n_p, sim->T_amb_C, sim->dt);
+   if (rc != 0) goto _err_ret;
+
    rc = fgic_update(sim->fgic, sim->T_amb_C, sim->t, sim->dt);
    if (rc != 0) goto _err_ret;
 
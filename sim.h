@@ -19,17 +19,22 @@
 #include <pthread.h>
 
 #include "batt.h"
+#include "pack.h"
 #include "fgic.h"
 #include "system.h"
 #include "itimer.h"
 #include "menu.h"
+#include "logger.h"
+#include "trace.h"
+#include "scope_live.h"
+#include "tbl_hist.h"
 
 
 typedef struct {
-   FILE *logfp;			/* log file pointer */
-   char logfn[FN_LEN];		/* log file name */
-   int logi[MAX_PARAMS];	/* log data index */
-   int logn;			/* num of log items */
+   logset_t logs;		/* active log sinks */
+   trace_t *trace;		/* in-memory trace ring; NULL if not capturing */
+   scope_live_t *scope;		/* live scope; NULL if not open */
+   tbl_hist_t *hist;		/* history of the fgic's learned tables */
 
    params_t params[MAX_PARAMS];	/* string-enabled parameters */
    int params_sz;		/* parameter sz */
@@ -44,6 +49,7 @@ typedef struct {
    bool pause;			/* set true to pause a sim run */
 
    batt_t *batt;     		/* battery object */
+   pack_t *pack;		/* battery pack; no cells until 'pack build' */
    fgic_t *fgic;     		/* fgic object */
    system_t *system;		/* system object */
 
@@ -0,0 +1,333 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		tbl_hist.c
+ *
+ *  @brief		History of the FGIC's learned tables implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "globals.h"
+#include "tbl_hist.h"
+
+
+#define REC_MAX		(1 + 10 + 4)		/* largest record: id/index byte, 64-bit varint, float */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		const char *tbl_hist_name(int id)
+ *
+ *  @brief	Table name as used by 'plot table' (without the _batt/_fgic suffix)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+const char *tbl_hist_name(int id)
+{
+   static const char *names[TBL_IDS] = { "OCV", "H_chg", "H_dsg", "R0", "R1", "C1" };
+   return (id >= 0 && id < TBL_IDS) ? names[id] : NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double *tbl_hist_tbl(flash_params_t *fp, int id)
+ *
+ *  @brief	Table 'id' within flash params
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+double *tbl_hist_tbl(flash_params_t *fp, int id)
+{
+   switch (id)
+   {
+      case TBL_OCV:   return fp->ocv_tbl;
+      case TBL_H_CHG: return fp->h_chg_tbl;
+      case TBL_H_DSG: return fp->h_dsg_tbl;
+      case TBL_R0:    return fp->r0_tbl;
+      case TBL_R1:    return fp->r1_tbl;
+      case TBL_C1:    return fp->c1_tbl;
+      default:        return NULL;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int64_t to_tick(double t)
+ *
+ *  @brief	Time in ticks
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+int64_t to_tick(double t)
+{
+   return (int64_t)llround(t / TBL_HIST_TICK);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int new_chunk(tbl_hist_t *h)
+ *
+ *  @brief	Start a chunk keyed on the tables as of the last record, dropping the oldest chunks to stay
+ *		under the memory cap.  The decoder state restarts from the exact tables.
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int new_chunk(tbl_hist_t *h)
+{
+   if (h->n == h->cap)
+   {
+      int cap = (h->cap == 0) ? 64 : 2 * h->cap;
+      tbl_chunk_t **ch = (tbl_chunk_t **)realloc(h->ch, (size_t)cap * sizeof(tbl_chunk_t *));
+      if (ch == NULL) return -1;
+      h->ch = ch;
+      h->cap = cap;
+   }
+
+   tbl_chunk_t *c = (tbl_chunk_t *)malloc(sizeof(tbl_chunk_t));
+   if (c == NULL) return -2;
+
+   c->tick0 = h->tick;
+   c->t0 = c->t1 = (double)h->tick * TBL_HIST_TICK;
+   memcpy(c->key, h->seen, sizeof(c->key));
+   memcpy(h->rec, h->seen, sizeof(h->rec));
+   c->len = 0;
+   c->nrec = 0;
+   h->ch[h->n++] = c;
+
+   int drop = 0;
+   while (h->n - drop > 1 && (long)(h->n - drop) * (long)sizeof(tbl_chunk_t) > h->max_bytes)
+   {
+      h->nrec -= h->ch[drop]->nrec;
+      free(h->ch[drop]);
+      drop++;
+   }
+   if (drop > 0)
+   {
+      memmove(h->ch, h->ch + drop, (size_t)(h->n - drop) * sizeof(tbl_chunk_t *));
+      h->n -= drop;
+      h->dropped += drop;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		tbl_hist_t *tbl_hist_create(const flash_params_t *params, double t0, long max_bytes)
+ *
+ *  @brief	Create a history of the tables in 'params', starting with their values at t0
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+tbl_hist_t *tbl_hist_create(const flash_params_t *params, double t0, long max_bytes)
+{
+   if (params == NULL || max_bytes < (long)sizeof(tbl_chunk_t)) return NULL;
+
+   tbl_hist_t *h = (tbl_hist_t *)calloc(1, sizeof(tbl_hist_t));
+   if (h == NULL) return NULL;
+
+   if (pthread_mutex_init(&h->mtx, NULL) != 0)
+   {
+      free(h);
+      return NULL;
+   }
+
+   h->params = params;
+   h->max_bytes = max_bytes;
+   h->tick = to_tick(t0);
+   for (int id=0; id<TBL_IDS; id++)
+      memcpy(h->seen[id], tbl_hist_tbl((flash_params_t *)params, id), SOC_GRIDS * sizeof(double));
+
+   if (new_chunk(h) != 0)
+   {
+      tbl_hist_destroy(h);
+      return NULL;
+   }
+
+   return h;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void tbl_hist_sync(tbl_hist_t *h, double t, int id)
+ *
+ *  @brief	Record the entries of table 'id' that changed since the last sync (sim thread, after a table
+ *		update).  Each delta is taken against the decoder's value, not the exact previous one, so the
+ *		float rounding of one record is corrected by the next and never accumulates.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void tbl_hist_sync(tbl_hist_t *h, double t, int id)
+{
+   if (h == NULL || id < 0 || id >= TBL_IDS) return;
+
+   const double *tbl = tbl_hist_tbl((flash_params_t *)h->params, id);
+   int64_t tk = to_tick(t);
+
+   LOCK(&h->mtx);
+   for (int i=0; i<SOC_GRIDS; i++)
+   {
+      double v = tbl[i];
+      if (v == h->seen[id][i] || (isnan(v) && isnan(h->seen[id][i]))) continue;
+
+      tbl_chunk_t *c = h->ch[h->n-1];
+      if (c->len + REC_MAX > TBL_HIST_CHUNK)
+      {
+         if (new_chunk(h) != 0) break;
+         c = h->ch[h->n-1];
+      }
+
+      uint8_t *b = &c->buf[c->len];
+      *b++ = (uint8_t)((id << 5) | i);
+
+      uint64_t dt = (tk > h->tick) ? (uint64_t)(tk - h->tick) : 0;
+      while (dt >= 0x80)
+      {
+         *b++ = (uint8_t)(dt | 0x80);
+         dt >>= 7;
+      }
+      *b++ = (uint8_t)dt;
+
+      float d = (float)(v - h->rec[id][i]);
+      memcpy(b, &d, sizeof(float));
+      b += sizeof(float);
+
+      h->rec[id][i] += (double)d;
+      h->seen[id][i] = v;
+      if (tk > h->tick) h->tick = tk;
+
+      c->len = (int)(b - c->buf);
+      c->t1 = (double)h->tick * TBL_HIST_TICK;
+      c->nrec++;
+      h->nrec++;
+   }
+   UNLOCK(&h->mtx);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_hist_span(tbl_hist_t *h, double *t0, double *t1)
+ *
+ *  @brief	Time of the oldest keyframe held and of the last record
+ *
+ *  @return	num of records held; negative if error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_hist_span(tbl_hist_t *h, double *t0, double *t1)
+{
+   if (h == NULL || t0 == NULL || t1 == NULL) return -1;
+
+   LOCK(&h->mtx);
+   *t0 = h->ch[0]->t0;
+   *t1 = h->ch[h->n-1]->t1;
+   long nrec = h->nrec;
+   UNLOCK(&h->mtx);
+
+   return (int)((nrec > 0x7fffffff) ? 0x7fffffff : nrec);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_hist_at(tbl_hist_t *h, double t, flash_params_t *out)
+ *
+ *  @brief	Rebuild the tables as they were at time t into 'out' (other fields of 'out' are left alone):
+ *		find the last keyframe at or before t, then replay its chunk up to t.
+ *
+ *  @return	0 if success; 1 if t is before the history held (the oldest tables are returned); negative
+ *		if error
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_hist_at(tbl_hist_t *h, double t, flash_params_t *out)
+{
+   if (h == NULL || out == NULL) return -1;
+
+   double v[TBL_IDS][SOC_GRIDS];
+   int64_t tk = to_tick(t);
+   int rc = 0;
+
+   LOCK(&h->mtx);
+   int lo = 0, hi = h->n - 1;
+   if (tk < h->ch[0]->tick0) rc = 1;
+   while (lo < hi)
+   {
+      int mid = (lo + hi + 1) / 2;
+      if (h->ch[mid]->tick0 <= tk) lo = mid; else hi = mid - 1;
+   }
+
+   const tbl_chunk_t *c = h->ch[lo];
+   memcpy(v, c->key, sizeof(v));
+
+   int64_t tick = c->tick0;
+   const uint8_t *b = c->buf, *end = c->buf + c->len;
+   while (rc == 0 && b < end)
+   {
+      int id = b[0] >> 5, i = b[0] & 0x1f;
+      b++;
+
+      uint64_t dt = 0;
+      for (int s=0; ; s+=7)
+      {
+         dt |= (uint64_t)(*b & 0x7f) << s;
+         if ((*b++ & 0x80) == 0) break;
+      }
+      tick += (int64_t)dt;
+      if (tick > tk) break;
+
+      float d;
+      memcpy(&d, b, sizeof(float));
+      b += sizeof(float);
+      v[id][i] += (double)d;
+   }
+   UNLOCK(&h->mtx);
+
+   for (int id=0; id<TBL_IDS; id++)
+      memcpy(tbl_hist_tbl(out, id), v[id], SOC_GRIDS * sizeof(double));
+
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void tbl_hist_destroy(tbl_hist_t *h)
+ *
+ *  @brief	Free the history
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void tbl_hist_destroy(tbl_hist_t *h)
+{
+   if (h == NULL) return;
+
+   for (int k=0; k<h->n; k++) free(h->ch[k]);
+   free(h->ch);
+   pthread_mutex_destroy(&h->mtx);
+   free(h);
+}
@@ -0,0 +1,101 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		tbl_hist.h
+ *
+ *  @brief		History of the FGIC's learned tables header
+ *
+ *  @note		Every entry the FGIC learns is appended as a (time, table, index, value) delta to a byte
+ *			stream of chunks.  Each chunk starts with a keyframe of all tables, so the tables at any
+ *			time are rebuilt from the nearest keyframe plus at most one chunk of deltas.  The sim
+ *			thread appends (tbl_hist_sync) while the menu thread reads (tbl_hist_at); both take the
+ *			history's own lock.
+ *
+ *=====================================================================================================================
+ */
+#ifndef __TBL_HIST_H__
+#define __TBL_HIST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "flash_params.h"
+
+
+#define TBL_HIST_CHUNK		(16*1024)		/* delta bytes per chunk */
+#define TBL_HIST_MAX		(64L*1024*1024)		/* bytes held before the oldest chunks are dropped */
+#define TBL_HIST_TICK		(1e-3)			/* time resolution in secs */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Table ids; a record packs id (3 bits) and SOC index (5 bits) into one byte
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef enum {
+   TBL_OCV = 0,
+   TBL_H_CHG,
+   TBL_H_DSG,
+   TBL_R0,
+   TBL_R1,
+   TBL_C1,
+   TBL_IDS
+}
+tbl_id_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * One chunk: keyframe of all tables at t0, then records of
+ *   byte     id<<5 | index
+ *   varint   ticks since the previous record (or t0)
+ *   float32  value minus the decoder's previous value of that entry
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   double t0;				/* keyframe time */
+   double t1;				/* time of the last record */
+   int64_t tick0;			/* t0 in ticks */
+   double key[TBL_IDS][SOC_GRIDS];	/* all tables at t0 */
+   uint8_t buf[TBL_HIST_CHUNK];		/* records */
+   int len;				/* bytes used in buf */
+   int nrec;				/* num of records */
+}
+tbl_chunk_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Table history
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   const flash_params_t *params;	/* learned tables (owned by fgic) */
+   pthread_mutex_t mtx;			/* guards everything below */
+
+   double seen[TBL_IDS][SOC_GRIDS];	/* tables as of the last sync (exact) */
+   double rec[TBL_IDS][SOC_GRIDS];	/* tables as the decoder rebuilds them */
+   int64_t tick;			/* tick of the last record */
+
+   tbl_chunk_t **ch;			/* chunks, oldest first */
+   int n;				/* num of chunks */
+   int cap;				/* chunk pointer slots */
+   long max_bytes;			/* memory cap */
+   long dropped;			/* chunks dropped under the cap */
+   long nrec;				/* records held */
+}
+tbl_hist_t;
+
+
+tbl_hist_t *tbl_hist_create(const flash_params_t *params, double t0, long max_bytes);
+const char *tbl_hist_name(int id);
+double *tbl_hist_tbl(flash_params_t *fp, int id);
+void tbl_hist_sync(tbl_hist_t *h, double t, int id);
+int tbl_hist_span(tbl_hist_t *h, double *t0, double *t1);
+int tbl_hist_at(tbl_hist_t *h, double t, flash_params_t *out);
+void tbl_hist_destroy(tbl_hist_t *h);
+
+
+#endif // __TBL_HIST_H__
@@ -0,0 +1,427 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		tbl_lookup.c
+ *
+ *  @brief		Table lookup on an ascending grid implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tbl_lookup.h"
+
+
+#define UNIFORM_TOL	(1e-6)		/* max deviation from a uniform grid, relative to the step; float grids (SOC_TBL) are off ~5e-7 */
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_grid_init(tbl_grid_t *g, const double *xs, int n)
+ *
+ *  @brief	Init lookup state for grid xs[0..n-1] (strictly ascending)
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_grid_init(tbl_grid_t *g, const double *xs, int n)
+{
+   if (g == NULL || xs == NULL || n < 2) return -1;
+
+   g->n = n;
+   g->x0 = xs[0];
+   g->seg = 0;
+
+   double h = (xs[n-1] - xs[0]) / (double)(n - 1);
+   g->inv_h = (h > 0.0) ? 1.0 / h : 0.0;
+   for (int i=1; i<n && g->inv_h > 0.0; i++)
+   {
+      if (fabs(xs[i] - (xs[0] + i*h)) > UNIFORM_TOL * h) g->inv_h = 0.0;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int seg_search(const double *xs, int n, double x)
+ *
+ *  @brief	Binary search for the last segment i with xs[i] < x (given xs[0] < x).  Branch-free, so a random x
+ *		costs no mispredictions.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int seg_search(const double *xs, int n, double x)
+{
+   const double *base = xs;
+   int len = n - 1;
+   while (len > 1)
+   {
+      int half = len / 2;
+      base = (base[half] < x) ? base + half : base;
+      len -= half;
+   }
+   return (int)(base - xs);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_grid_seg(tbl_grid_t *g, const double *xs, double x)
+ *
+ *  @brief	Segment i holding x, i.e. xs[i] < x <= xs[i+1] (the first segment also holds xs[0]).  x must be
+ *		within [xs[0], xs[n-1]].
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_grid_seg(tbl_grid_t *g, const double *xs, double x)
+{
+   int n = g->n;
+
+   /* guess: direct index on a uniform grid, else the last segment */
+   int i = (g->inv_h > 0.0) ? (int)((x - g->x0) * g->inv_h) : g->seg;
+   if (i < 0) i = 0;
+   if (i > n - 2) i = n - 2;
+
+   if ((i > 0 && x <= xs[i]) || x > xs[i+1])
+   {
+      /* off by one from rounding or a small move; anything else is searched */
+      if (i > 0 && x <= xs[i] && (i == 1 || xs[i-1] < x)) i--;
+      else if (i < n - 2 && x > xs[i+1] && x <= xs[i+2]) i++;
+      else i = seg_search(xs, n, x);
+   }
+
+   g->seg = i;
+   return i;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_grid_interp(tbl_grid_t *g, const double *xs, const double *tbl, double x, double *val)
+ *
+ *  @brief	Linear interpolation of tbl over grid xs, held at the end values outside the grid
+ *
+ *  @return	0 if success; negative otherwise (x is NaN)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_grid_interp(tbl_grid_t *g, const double *xs, const double *tbl, double x, double *val)
+{
+   int n = g->n;
+
+   if (x <= xs[0])
+   {
+      *val = tbl[0];
+   }
+   else if (x >= xs[n-1])
+   {
+      *val = tbl[n-1];
+   }
+   else if (!isnan(x))
+   {
+      int i = tbl_grid_seg(g, xs, x);
+      double t = (x - xs[i]) / (xs[i+1] - xs[i]);
+      *val = tbl[i] + t * (tbl[i+1] - tbl[i]);
+   }
+   else
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_grid_interp_rows(tbl_grid_t *g, const double *xs, const double *rows, int w, double x,
+ *		                         double *out)
+ *
+ *  @brief	Interpolate w tables at once, stored as rows of w values per grid point: one segment search
+ *		and two rows read.  out[k] is what tbl_grid_interp() gives for column k.
+ *
+ *  @return	0 if success; negative otherwise (x is NaN)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_grid_interp_rows(tbl_grid_t *g, const double *xs, const double *rows, int w, double x, double *out)
+{
+   int n = g->n;
+
+   if (x <= xs[0])
+   {
+      memcpy(out, rows, (size_t)w * sizeof(double));
+   }
+   else if (x >= xs[n-1])
+   {
+      memcpy(out, rows + (size_t)(n-1) * w, (size_t)w * sizeof(double));
+   }
+   else if (!isnan(x))
+   {
+      int i = tbl_grid_seg(g, xs, x);
+      double t = (x - xs[i]) / (xs[i+1] - xs[i]);
+      const double *a = rows + (size_t)i * w, *b = a + w;
+      for (int k=0; k<w; k++) out[k] = a[k] + t * (b[k] - a[k]);
+   }
+   else
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int grid_frac(tbl_grid_t *g, const double *xs, double x, double *t)
+ *
+ *  @brief	Segment holding x and the fraction of the way along it, with x held at the ends of the grid.
+ *		The fraction is taken from the grid points, not the uniform step: a grid of float literals is
+ *		uniform only to float precision.
+ *
+ *  @return	segment; negative if x is NaN
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+int grid_frac(tbl_grid_t *g, const double *xs, double x, double *t)
+{
+   int n = g->n;
+
+   if (x <= xs[0])
+   {
+      *t = 0.0;
+      return 0;
+   }
+   if (x >= xs[n-1])
+   {
+      *t = 1.0;
+      return n - 2;
+   }
+   if (isnan(x))
+   {
+      *t = 0.0;
+      return -1;
+   }
+
+   int i = tbl_grid_seg(g, xs, x);
+   *t = (x - xs[i]) / (xs[i+1] - xs[i]);
+   return i;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_grid_interp2_rows(tbl_grid_t *gy, const double *ys, tbl_grid_t *gx, const double *xs,
+ *		                          const double *rows, int w, double y, double x, double *out)
+ *
+ *  @brief	Bilinear interpolation of w tables over grids ys (outer) and xs (inner), stored as
+ *		rows[j][i][k] for ys[j], xs[i] and table k.  x and y are held at the ends of their grids.
+ *
+ *  @return	0 if success; negative otherwise (x or y is NaN)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_grid_interp2_rows(tbl_grid_t *gy, const double *ys, tbl_grid_t *gx, const double *xs,
+                          const double *rows, int w, double y, double x, double *out)
+{
+   double tx, ty;
+   int i = grid_frac(gx, xs, x, &tx);
+   int j = grid_frac(gy, ys, y, &ty);
+   if (i < 0 || j < 0) return -1;
+
+   size_t stride = (size_t)gx->n * w;
+   const double *a = rows + (size_t)j * stride + (size_t)i * w, *b = a + w;
+   const double *c = a + stride, *d = c + w;
+   for (int k=0; k<w; k++)
+   {
+      double lo = a[k] + tx * (b[k] - a[k]);
+      double hi = c[k] + tx * (d[k] - c[k]);
+      out[k] = lo + ty * (hi - lo);
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int cmp_pt(const void *a, const void *b)
+ *
+ *  @brief	qsort order of (x, y) pairs by x
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static
+int cmp_pt(const void *a, const void *b)
+{
+   double xa = ((const double *)a)[0], xb = ((const double *)b)[0];
+   return (xa > xb) - (xa < xb);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		tbl_t *tbl_create(const double *x, const double *y, long n, int n_out)
+ *
+ *  @brief	Build a table from n sample points in any order, e.g. soc and V columns of a log.  Points with
+ *		a NaN are skipped and points of equal x are averaged.
+ *
+ *  @param	n_out	0 to keep every distinct x as a grid point (looked up by hinted search); else the
+ *			points are averaged into n_out bins centred on a uniform grid (looked up in O(1)).
+ *			Bins no sample fell in are interpolated.
+ *
+ *  @return	table; NULL if fewer than 2 distinct x or out of memory
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+tbl_t *tbl_create(const double *x, const double *y, long n, int n_out)
+{
+   if (x == NULL || y == NULL || n < 2 || n_out == 1 || n_out < 0) return NULL;
+
+   tbl_t *t = NULL;
+   double *pt = (double *)malloc((size_t)n * 2 * sizeof(double));
+   if (pt == NULL) return NULL;
+
+   /* sorted finite pairs, equal x merged */
+   long m = 0;
+   for (long i=0; i<n; i++)
+   {
+      if (isnan(x[i]) || isnan(y[i]) || isinf(x[i]) || isinf(y[i])) continue;
+      pt[2*m] = x[i];
+      pt[2*m+1] = y[i];
+      m++;
+   }
+   qsort(pt, (size_t)m, 2 * sizeof(double), cmp_pt);
+
+   long k = 0;
+   for (long i=0; i<m; )
+   {
+      long j = i;
+      double sum = 0.0;
+      for (; j<m && pt[2*j] == pt[2*i]; j++) sum += pt[2*j+1];
+      pt[2*k] = pt[2*i];
+      pt[2*k+1] = sum / (double)(j - i);
+      k++;
+      i = j;
+   }
+   if (k < 2 || k > 0x7fffffff) goto _err_ret;
+
+   int nt = (n_out > 0) ? n_out : (int)k;
+   t = (tbl_t *)calloc(1, sizeof(tbl_t));
+   if (t == NULL) goto _err_ret;
+   t->n = nt;
+   t->x = (double *)malloc((size_t)nt * sizeof(double));
+   t->y = (double *)malloc((size_t)nt * sizeof(double));
+   if (t->x == NULL || t->y == NULL) goto _err_ret;
+
+   if (n_out == 0)
+   {
+      for (long i=0; i<k; i++)
+      {
+         t->x[i] = pt[2*i];
+         t->y[i] = pt[2*i+1];
+      }
+   }
+   else
+   {
+      double x0 = pt[0], x1 = pt[2*(k-1)], h = (x1 - x0) / (double)(nt - 1);
+      int *cnt = (int *)calloc((size_t)nt, sizeof(int));
+      if (cnt == NULL) goto _err_ret;
+
+      for (int j=0; j<nt; j++)
+      {
+         t->x[j] = x0 + j * h;
+         t->y[j] = 0.0;
+      }
+      for (long i=0; i<k; i++)
+      {
+         int j = (int)lround((pt[2*i] - x0) / h);
+         if (j < 0) j = 0;
+         if (j > nt - 1) j = nt - 1;
+         t->y[j] += pt[2*i+1];
+         cnt[j]++;
+      }
+
+      /* empty bins: interpolate the merged points */
+      tbl_grid_t g;
+      double *px = (double *)malloc((size_t)k * 2 * sizeof(double));
+      if (px == NULL) { free(cnt); goto _err_ret; }
+      double *py = px + k;
+      for (long i=0; i<k; i++)
+      {
+         px[i] = pt[2*i];
+         py[i] = pt[2*i+1];
+      }
+      tbl_grid_init(&g, px, (int)k);
+      for (int j=0; j<nt; j++)
+      {
+         if (cnt[j] > 0) t->y[j] /= (double)cnt[j];
+         else tbl_grid_interp(&g, px, py, t->x[j], &t->y[j]);
+      }
+      free(px);
+      free(cnt);
+   }
+
+   tbl_grid_init(&t->g, t->x, t->n);
+   free(pt);
+   return t;
+
+_err_ret:
+   free(pt);
+   tbl_destroy(t);
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int tbl_eval(tbl_t *t, double x, double *val)
+ *
+ *  @brief	Linear interpolation of the table at x, held at the end values outside its grid
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int tbl_eval(tbl_t *t, double x, double *val)
+{
+   return tbl_grid_interp(&t->g, t->x, t->y, x, val);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void tbl_destroy(tbl_t *t)
+ *
+ *  @brief	Free a table from tbl_create()
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void tbl_destroy(tbl_t *t)
+{
+   if (t == NULL) return;
+
+   free(t->x);
+   free(t->y);
+   free(t);
+}
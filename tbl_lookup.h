@@ -0,0 +1,62 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		tbl_lookup.h
+ *
+ *  @brief		Table lookup on an ascending grid header
+ *
+ *  @note		tbl_grid_init() checks once whether the grid is uniform.  A uniform grid is indexed
+ *			directly; otherwise the segment of the previous lookup is tried first (SOC moves very
+ *			little per step), then its neighbours, then a binary search.  Results are the same as a
+ *			linear scan of the grid, bit for bit.  tbl_grid_interp_rows() reads several tables
+ *			stored as one row per grid point, so they share the search and a few cache lines;
+ *			tbl_grid_interp2_rows() does the same over two grids (bilinear).
+ *
+ *=====================================================================================================================
+ */
+#ifndef __TBL_LOOKUP_H__
+#define __TBL_LOOKUP_H__
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Lookup state of one grid.  The grid values themselves are passed to each call, so a struct holding both
+ * can be copied by value.
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   int n;			/* grid points (>= 2) */
+   double x0;			/* first grid point */
+   double inv_h;		/* 1/step if the grid is uniform; 0 otherwise */
+   int seg;			/* segment of the last lookup */
+}
+tbl_grid_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Table of runtime size with its own grid, e.g. a measured OCV curve of tens of thousands of points
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   int n;			/* points */
+   double *x;			/* grid, strictly ascending */
+   double *y;			/* values */
+   tbl_grid_t g;		/* lookup state */
+}
+tbl_t;
+
+
+int tbl_grid_init(tbl_grid_t *g, const double *xs, int n);
+int tbl_grid_seg(tbl_grid_t *g, const double *xs, double x);
+int tbl_grid_interp(tbl_grid_t *g, const double *xs, const double *tbl, double x, double *val);
+int tbl_grid_interp_rows(tbl_grid_t *g, const double *xs, const double *rows, int w, double x, double *out);
+int tbl_grid_interp2_rows(tbl_grid_t *gy, const double *ys, tbl_grid_t *gx, const double *xs,
+                          const double *rows, int w, double y, double x, double *out);
+
+tbl_t *tbl_create(const double *x, const double *y, long n, int n_out);
+int tbl_eval(tbl_t *t, double x, double *val);
+void tbl_destroy(tbl_t *t);
+
+
+#endif // __TBL_LOOKUP_H__
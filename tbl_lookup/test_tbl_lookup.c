@@ -0,0 +1,376 @@
+#define _POSIX_C_SOURCE 199309L
+#include "tbl_lookup.h"
+#include "cell_chem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_GRID      (21)
+#define N_RANDOM    (1000000)
+#define N_BENCH     (4000000)
+#define N_TBL       (6)         /* tables per row, as ECM_OCV..ECM_H_DSG */
+#define ROW_W       (8)         /* row width, as ECM_ROW_W */
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double urand(void) {
+    return (double)(xorshift64() >> 11) / 9007199254740992.0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the linear scan tbl_grid_interp() replaces (ecm.c tbl_interp, which also returned -1 for x off the grid) */
+static int scan_interp(const double *grid, const double *tbl, int n, double soc, double *val) {
+    if (soc <= grid[0]) {
+        *val = tbl[0];
+    } else if (soc >= grid[n - 1]) {
+        *val = tbl[n - 1];
+    } else {
+        for (int i = 0; i < n - 1; ++i) {
+            double s0 = grid[i];
+            double s1 = grid[i + 1];
+            if (soc >= s0 && soc <= s1) {
+                double t = (soc - s0) / (s1 - s0);
+                *val = tbl[i] + t * (tbl[i + 1] - tbl[i]);
+                return 0;
+            }
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static double soc_uniform[N_GRID] = { SOC_TBL };  /* the shipped grid: float literals, off uniform by ~5e-7 h */
+static double soc_skewed[N_GRID], tbl[N_GRID];
+static double tbls[N_TBL][N_GRID], rows[N_GRID][ROW_W];
+
+static void make_grids(void) {
+    for (int i = 0; i < N_GRID; i++) {
+        double u = (double)i / (N_GRID - 1);
+        soc_skewed[i] = u * u * (3.0 - 2.0 * u); /* dense at both ends */
+        tbl[i] = 3.0 + 1.2 * u + 0.05 * sin(17.0 * u);
+        for (int k = 0; k < N_TBL; k++) {
+            tbls[k][i] = (k + 1) * (0.01 + urand());
+            rows[i][k] = tbls[k][i];
+        }
+    }
+}
+
+/* every column of a fused row lookup equals its single-table lookup */
+static void test_rows(const double *grid) {
+    tbl_grid_t g;
+    assert(tbl_grid_init(&g, grid, N_GRID) == 0);
+
+    for (int j = 0; j < N_RANDOM; j++) {
+        double x = (j < N_GRID) ? grid[j] : 1.2 * urand() - 0.1, out[ROW_W], v;
+        assert(tbl_grid_interp_rows(&g, grid, &rows[0][0], ROW_W, x, out) == 0);
+        for (int k = 0; k < N_TBL; k++) {
+            assert(tbl_grid_interp(&g, grid, tbls[k], x, &v) == 0);
+            if (memcmp(&v, &out[k], sizeof(double)) != 0) {
+                printf("row mismatch at x=%.17g col %d: %.17g vs %.17g\n", x, k, out[k], v);
+                exit(1);
+            }
+        }
+    }
+    double out[ROW_W];
+    assert(tbl_grid_interp_rows(&g, grid, &rows[0][0], ROW_W, NAN, out) == -1);
+}
+
+static void check(tbl_grid_t *g, const double *grid, double x) {
+    double a = -1.0, b = -1.0;
+    int ra = scan_interp(grid, tbl, N_GRID, x, &a);
+    int rb = tbl_grid_interp(g, grid, tbl, x, &b);
+    if (ra != rb || (ra == 0 && memcmp(&a, &b, sizeof(double)) != 0)) {
+        printf("mismatch at x=%.17g: scan %d %.17g, grid %d %.17g\n", x, ra, a, rb, b);
+        exit(1);
+    }
+}
+
+/* uniform: the grid must be detected as one (SOC_TBL is), so lookups index the segment directly */
+static void test_grid(const double *grid, int uniform) {
+    tbl_grid_t g;
+    assert(tbl_grid_init(&g, grid, N_GRID) == 0);
+    assert((g.inv_h > 0.0) == uniform);
+
+    /* grid points, their neighbours, ends and beyond */
+    for (int i = 0; i < N_GRID; i++) {
+        check(&g, grid, grid[i]);
+        check(&g, grid, nextafter(grid[i], -1.0));
+        check(&g, grid, nextafter(grid[i], 2.0));
+    }
+    check(&g, grid, -0.5);
+    check(&g, grid, 1.5);
+    check(&g, grid, NAN);
+
+    /* random jumps, then a slow walk as in a simulation */
+    for (int k = 0; k < N_RANDOM; k++) check(&g, grid, urand());
+    double x = 1.0;
+    for (int k = 0; k < N_RANDOM; k++) {
+        x -= 2e-6 * urand();
+        check(&g, grid, x);
+    }
+}
+
+static void bench(const char *name, const double *grid) {
+    static double xs[N_BENCH];
+    volatile double sink = 0.0;
+    double v;
+    tbl_grid_t g;
+    tbl_grid_init(&g, grid, N_GRID);
+
+    for (int pass = 0; pass < 2; pass++) {
+        /* pass 0: slow walk up and down the grid (temporal coherence), pass 1: random x */
+        double x = 0.5, dx = 1e-6;
+        for (int k = 0; k < N_BENCH; k++) {
+            if (x + dx > 1.0 || x + dx < 0.0) dx = -dx;
+            x += dx * urand();
+            xs[k] = pass ? urand() : x;
+        }
+
+        double t0 = now_s();
+        for (int k = 0; k < N_BENCH; k++) { scan_interp(grid, tbl, N_GRID, xs[k], &v); sink += v; }
+        double t1 = now_s();
+        for (int k = 0; k < N_BENCH; k++) { tbl_grid_interp(&g, grid, tbl, xs[k], &v); sink += v; }
+        double t2 = now_s();
+
+        printf("%-8s %-7s scan %5.1f ns, tbl_grid %5.1f ns (%.1fx)\n", name, pass ? "random" : "walk",
+               (t1 - t0) * 1e9 / N_BENCH, (t2 - t1) * 1e9 / N_BENCH, (t1 - t0) / (t2 - t1));
+    }
+    (void)sink;
+}
+
+/* five tables per step as ecm_update(): five scans, five tbl_grid lookups, one fused row lookup */
+static void bench_rows(void) {
+    enum { STEPS = 2000000 };
+    volatile double sink = 0.0;
+    double v, out[ROW_W];
+    tbl_grid_t g;
+    tbl_grid_init(&g, soc_uniform, N_GRID);
+
+    double x = 0.5, dx = 1e-6, t0 = now_s();
+    for (int k = 0; k < STEPS; k++) {
+        if (x + dx > 1.0 || x + dx < 0.0) dx = -dx;
+        x += dx;
+        for (int j = 0; j < 5; j++) { scan_interp(soc_uniform, tbls[j], N_GRID, x, &v); sink += v; }
+    }
+    double t1 = now_s();
+    for (int k = 0; k < STEPS; k++) {
+        if (x + dx > 1.0 || x + dx < 0.0) dx = -dx;
+        x += dx;
+        for (int j = 0; j < 5; j++) { tbl_grid_interp(&g, soc_uniform, tbls[j], x, &v); sink += v; }
+    }
+    double t2 = now_s();
+    for (int k = 0; k < STEPS; k++) {
+        if (x + dx > 1.0 || x + dx < 0.0) dx = -dx;
+        x += dx;
+        tbl_grid_interp_rows(&g, soc_uniform, &rows[0][0], ROW_W, x, out);
+        sink += out[0] + out[1] + out[2] + out[3] + out[4];
+    }
+    double t3 = now_s();
+
+    printf("5 tables: scan %5.1f ns, tbl_grid %5.1f ns, rows %5.1f ns (%.1fx vs scan)\n",
+           (t1 - t0) * 1e9 / STEPS, (t2 - t1) * 1e9 / STEPS, (t3 - t2) * 1e9 / STEPS, (t1 - t0) / (t3 - t2));
+    (void)sink;
+}
+
+/* tables built from unordered samples: merge, bins, gaps, bad input */
+static void test_create(void) {
+    enum { N = 30000 };
+    static double x[N], y[N];
+
+    /* shuffled samples of a line, each x twice */
+    for (int i = 0; i < N; i++) {
+        x[i] = (double)(i / 2) / (N / 2 - 1);
+        y[i] = 3.0 + 1.2 * x[i] + ((i & 1) ? 0.01 : -0.01);
+    }
+    for (int i = N - 1; i > 0; i--) {
+        int j = (int)(xorshift64() % (uint64_t)(i + 1));
+        double tx = x[i], ty = y[i];
+        x[i] = x[j]; y[i] = y[j];
+        x[j] = tx; y[j] = ty;
+    }
+
+    tbl_t *t = tbl_create(x, y, N, 0);
+    assert(t != NULL && t->n == N / 2);
+    for (int i = 0; i < t->n; i++) {
+        assert(i == 0 || t->x[i] > t->x[i - 1]);
+        assert(fabs(t->y[i] - (3.0 + 1.2 * t->x[i])) < 1e-12);
+    }
+    tbl_destroy(t);
+
+    t = tbl_create(x, y, N, 2001);
+    assert(t != NULL && t->n == 2001 && t->g.inv_h > 0.0);
+    for (int i = 0; i < t->n; i++) assert(fabs(t->y[i] - (3.0 + 1.2 * t->x[i])) < 1.2 / 2000);
+    tbl_destroy(t);
+
+    /* empty bins are interpolated; NaN samples are skipped */
+    double gx[] = { 0.0, NAN, 0.5, 1.0 }, gy[] = { 1.0, 5.0, 2.0, 4.0 }, v;
+    t = tbl_create(gx, gy, 4, 101);
+    assert(t != NULL);
+    assert(tbl_eval(t, 0.25, &v) == 0 && fabs(v - 1.5) < 1e-12);
+    assert(tbl_eval(t, 0.8, &v) == 0 && fabs(v - 3.2) < 1e-12);
+    assert(tbl_eval(t, 7.0, &v) == 0 && v == 4.0);
+    tbl_destroy(t);
+
+    double sx[] = { 0.3, 0.3, NAN }, sy[] = { 1.0, 2.0, 3.0 };
+    assert(tbl_create(sx, sy, 3, 0) == NULL);
+    assert(tbl_create(gx, gy, 4, 1) == NULL);
+}
+
+/* a 20k-point curve against the 21-point scan, per lookup */
+static void bench_fine(void) {
+    enum { N = 20001 };
+    static double x[N], y[N], xs[N_BENCH];
+    volatile double sink = 0.0;
+    double v;
+
+    for (int i = 0; i < N; i++) {
+        double u = (double)i / (N - 1);
+        x[i] = u * u * (3.0 - 2.0 * u);
+        y[i] = 3.0 + 1.2 * x[i] + 0.05 * sin(17.0 * x[i]);
+    }
+    tbl_t *skewed = tbl_create(x, y, N, 0);
+    tbl_t *uniform = tbl_create(x, y, N, N);
+    assert(skewed != NULL && uniform != NULL && skewed->g.inv_h == 0.0 && uniform->g.inv_h > 0.0);
+
+    for (int pass = 0; pass < 2; pass++) {
+        double p = 0.5, dx = 1e-6;
+        for (int k = 0; k < N_BENCH; k++) {
+            if (p + dx > 1.0 || p + dx < 0.0) dx = -dx;
+            p += dx * urand();
+            xs[k] = pass ? urand() : p;
+        }
+
+        double t0 = now_s();
+        for (int k = 0; k < N_BENCH; k++) { scan_interp(soc_uniform, tbl, N_GRID, xs[k], &v); sink += v; }
+        double t1 = now_s();
+        for (int k = 0; k < N_BENCH; k++) { tbl_eval(uniform, xs[k], &v); sink += v; }
+        double t2 = now_s();
+        for (int k = 0; k < N_BENCH; k++) { tbl_eval(skewed, xs[k], &v); sink += v; }
+        double t3 = now_s();
+
+        printf("%-7s 21-pt scan %5.1f ns, 20k uniform %5.1f ns, 20k skewed %5.1f ns\n", pass ? "random" : "walk",
+               (t1 - t0) * 1e9 / N_BENCH, (t2 - t1) * 1e9 / N_BENCH, (t3 - t2) * 1e9 / N_BENCH);
+    }
+    tbl_destroy(skewed);
+    tbl_destroy(uniform);
+    (void)sink;
+}
+
+/* SOC x T grid as the ECM temperature factors (ecm.h ECM_TF_*) */
+#define N_TEMP      (126)
+#define TF_W        (4)
+
+static double temps[N_TEMP], tf[N_TEMP][N_GRID][TF_W];
+
+static double arrhenius(double Ea, double T_C) {
+    return exp(-Ea * (1.0 / (T_C + 273.15) - 1.0 / (25.0 + 273.15)));
+}
+
+/* bilinear lookup: exact on a bilinear function, held at the edges, agrees with Arrhenius between nodes */
+static void test_interp2(const double *grid) {
+    tbl_grid_t gt, gs;
+    double out[TF_W];
+
+    for (int j = 0; j < N_TEMP; j++) temps[j] = -40.0 + j;
+    assert(tbl_grid_init(&gt, temps, N_TEMP) == 0 && gt.inv_h > 0.0);
+    assert(tbl_grid_init(&gs, grid, N_GRID) == 0);
+
+    for (int j = 0; j < N_TEMP; j++)
+        for (int i = 0; i < N_GRID; i++) {
+            tf[j][i][0] = 1.0 + 0.5 * grid[i] - 0.01 * temps[j] + 0.002 * grid[i] * temps[j];
+            tf[j][i][1] = -3.0 * grid[i];
+            tf[j][i][2] = temps[j];
+            tf[j][i][3] = 0.0;
+        }
+    for (int k = 0; k < N_RANDOM; k++) {
+        double s = urand(), T = -40.0 + 125.0 * urand();
+        assert(tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, T, s, out) == 0);
+        assert(fabs(out[0] - (1.0 + 0.5 * s - 0.01 * T + 0.002 * s * T)) < 1e-12);
+        assert(fabs(out[1] + 3.0 * s) < 1e-12 && fabs(out[2] - T) < 1e-12);
+    }
+    assert(tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, -80.0, 2.0, out) == 0);
+    assert(out[1] == tf[0][N_GRID - 1][1] && out[2] == tf[0][N_GRID - 1][2]);
+    assert(tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, 200.0, -1.0, out) == 0);
+    assert(out[1] == tf[N_TEMP - 1][0][1] && out[2] == tf[N_TEMP - 1][0][2]);
+    assert(tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, NAN, 0.5, out) < 0);
+    assert(tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, 25.0, NAN, out) < 0);
+
+    /* Arrhenius on a 1 degC grid: error well under the model's own accuracy */
+    const double Ea[3] = { -20.0, -20.0, 20.0 };
+    for (int j = 0; j < N_TEMP; j++)
+        for (int i = 0; i < N_GRID; i++)
+            for (int p = 0; p < 3; p++) tf[j][i][p] = arrhenius(Ea[p], temps[j]);
+    for (int k = 0; k < N_RANDOM; k++) {
+        double s = urand(), T = -40.0 + 125.0 * urand();
+        tbl_grid_interp2_rows(&gt, temps, &gs, grid, &tf[0][0][0], TF_W, T, s, out);
+        for (int p = 0; p < 3; p++) assert(fabs(out[p] / arrhenius(Ea[p], T) - 1.0) < 1e-6);
+    }
+}
+
+/* R0, R1, C1 at temperature per step as fgic_fx(): three exp() against one bilinear lookup */
+static void bench_interp2(void) {
+    enum { STEPS = 2000000 };
+    volatile double sink = 0.0;
+    const double Ea[3] = { -20.0, -20.0, 20.0 };
+    double out[TF_W];
+    tbl_grid_t gt, gs;
+    tbl_grid_init(&gt, temps, N_TEMP);
+    tbl_grid_init(&gs, soc_uniform, N_GRID);
+
+    double s = 0.5, ds = 1e-6, T = 25.0, dT = 1e-4, t0 = now_s();
+    for (int k = 0; k < STEPS; k++) {
+        if (s + ds > 1.0 || s + ds < 0.0) ds = -ds;
+        if (T + dT > 45.0 || T + dT < 5.0) dT = -dT;
+        s += ds;
+        T += dT;
+        for (int p = 0; p < 3; p++) sink += arrhenius(Ea[p], T);
+    }
+    double t1 = now_s();
+    for (int k = 0; k < STEPS; k++) {
+        if (s + ds > 1.0 || s + ds < 0.0) ds = -ds;
+        if (T + dT > 45.0 || T + dT < 5.0) dT = -dT;
+        s += ds;
+        T += dT;
+        tbl_grid_interp2_rows(&gt, temps, &gs, soc_uniform, &tf[0][0][0], TF_W, T, s, out);
+        sink += out[0] + out[1] + out[2];
+    }
+    double t2 = now_s();
+
+    printf("3 temp factors: exp %5.1f ns, bilinear %5.1f ns (%.1fx)\n",
+           (t1 - t0) * 1e9 / STEPS, (t2 - t1) * 1e9 / STEPS, (t1 - t0) / (t2 - t1));
+    (void)sink;
+}
+
+int main(void) {
+    make_grids();
+    test_grid(soc_uniform, 1);
+    test_grid(soc_skewed, 0);
+    test_rows(soc_uniform);
+    test_rows(soc_skewed);
+    test_create();
+    test_interp2(soc_skewed);
+    test_interp2(soc_uniform);
+    bench("uniform", soc_uniform);
+    bench("skewed", soc_skewed);
+    bench_rows();
+    bench_fine();
+    bench_interp2();
+    printf("All tbl_lookup tests passed.\n");
+    return 0;
+}
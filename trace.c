@@ -0,0 +1,312 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		trace.c
+ *
+ *  @brief		In-memory trace capture ring implementation
+ *
+ *=====================================================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "globals.h"
+#include "dtoa.h"
+#include "logz.h"
+#include "trace.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		long trace_slot(const trace_t *tr, long k)
+ *
+ *  @brief	Ring slot of logical row k (0 = oldest held row)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+static inline
+long trace_slot(const trace_t *tr, long k)
+{
+   long s = tr->head - tr->count + k;
+   return (s < 0) ? s + tr->cap : s;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		trace_t *trace_create(params_t *params, long cap)
+ *
+ *  @brief	Create a trace ring holding the last 'cap' rows.  Columns are added with trace_add_col().
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+trace_t *trace_create(params_t *params, long cap)
+{
+   if (params == NULL || cap < 2) return NULL;
+
+   trace_t *tr = (trace_t *)calloc(1, sizeof(trace_t));
+   if (tr == NULL) return NULL;
+
+   tr->params = params;
+   tr->cap = cap;
+   tr->t = (double *)malloc((size_t)cap * sizeof(double));
+   if (tr->t == NULL)
+   {
+      free(tr);
+      return NULL;
+   }
+
+   return tr;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int trace_add_col(trace_t *tr, int params_sz, const char *name)
+ *
+ *  @brief	Add a column.  All columns must be added before the first trace_update().
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int trace_add_col(trace_t *tr, int params_sz, const char *name)
+{
+   if (tr == NULL || name == NULL) return -1;
+   if (tr->n >= MAX_PARAMS || tr->count > 0) return -2;
+
+   for (int i=0; i<params_sz; i++)
+   {
+      if (0==strcmp(name, tr->params[i].name))
+      {
+         if (log_type_parse(tr->params[i].type, &tr->type[tr->n]) != 0) return -3;
+
+         double *v = (double *)realloc(tr->v, (size_t)tr->cap * (size_t)(tr->n + 1) * sizeof(double));
+         if (v == NULL) return -4;
+         tr->v = v;
+
+         tr->ptr[tr->n] = tr->params[i].value;
+         tr->idx[tr->n] = i;
+         tr->n++;
+         return 0;
+      }
+   }
+
+   return -5;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void trace_update(trace_t *tr, double t)
+ *
+ *  @brief	Capture one row, overwriting the oldest when full
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void trace_update(trace_t *tr, double t)
+{
+   if (tr == NULL || tr->v == NULL) return;
+
+   double *row = &tr->v[tr->head * tr->n];
+   tr->t[tr->head] = t;
+   for (int i=0; i<tr->n; i++)
+      row[i] = log_val(tr->type[i], tr->ptr[i]);
+
+   if (++tr->head == tr->cap) tr->head = 0;
+   if (tr->count < tr->cap) tr->count++;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		double trace_t_at(const trace_t *tr, long k)
+ *
+ *  @brief	Time of logical row k (0 = oldest)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+double trace_t_at(const trace_t *tr, long k)
+{
+   return tr->t[trace_slot(tr, k)];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		const double *trace_row(const trace_t *tr, long k)
+ *
+ *  @brief	Values of logical row k (0 = oldest)
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+const double *trace_row(const trace_t *tr, long k)
+{
+   return &tr->v[trace_slot(tr, k) * tr->n];
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		long trace_range(const trace_t *tr, double t0, double t1, long *first)
+ *
+ *  @brief	Find the rows with t0 <= t <= t1 (time is monotonic in the ring, so binary search)
+ *
+ *  @return	num of rows; *first is the logical index of the first one
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+long trace_range(const trace_t *tr, double t0, double t1, long *first)
+{
+   if (tr == NULL || first == NULL || tr->count == 0 || t1 < t0) return 0;
+
+   long lo = 0, hi = tr->count;
+   while (lo < hi)
+   {
+      long mid = lo + (hi - lo) / 2;
+      if (trace_t_at(tr, mid) < t0) lo = mid + 1; else hi = mid;
+   }
+   *first = lo;
+
+   hi = tr->count;
+   while (lo < hi)
+   {
+      long mid = lo + (hi - lo) / 2;
+      if (trace_t_at(tr, mid) <= t1) lo = mid + 1; else hi = mid;
+   }
+
+   return lo - *first;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int trace_stats(const trace_t *tr, long first, long cnt, trace_stats_t *st)
+ *
+ *  @brief	Statistics of every column over logical rows [first, first+cnt).  st[] holds tr->n entries.
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int trace_stats(const trace_t *tr, long first, long cnt, trace_stats_t *st)
+{
+   if (tr == NULL || st == NULL || cnt <= 0 || first < 0 || first + cnt > tr->count) return -1;
+
+   double sum[MAX_PARAMS] = {0}, sum2[MAX_PARAMS] = {0};
+
+   for (long k=first; k<first+cnt; k++)
+   {
+      const double *row = trace_row(tr, k);
+      double t = trace_t_at(tr, k);
+
+      for (int i=0; i<tr->n; i++)
+      {
+         double x = row[i];
+         if (k == first || x < st[i].min) { st[i].min = x; st[i].t_min = t; }
+         if (k == first || x > st[i].max) { st[i].max = x; st[i].t_max = t; }
+         if (k == first) st[i].first = x;
+         st[i].last = x;
+
+         /* shift by the first value to keep the variance well conditioned */
+         double d = x - st[i].first;
+         sum[i] += d;
+         sum2[i] += d*d;
+      }
+   }
+
+   for (int i=0; i<tr->n; i++)
+   {
+      double m = sum[i] / cnt;
+      double var = sum2[i] / cnt - m*m;
+      st[i].mean = st[i].first + m;
+      st[i].std = (var > 0.0) ? sqrt(var) : 0.0;
+   }
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		int trace_dump(const trace_t *tr, const char *fn, long first, long cnt)
+ *
+ *  @brief	Write logical rows [first, first+cnt) to a CSV file, or a compressed log if fn ends in LOGZ_EXT
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+int trace_dump(const trace_t *tr, const char *fn, long first, long cnt)
+{
+   int rc = 0;
+
+   if (tr == NULL || fn == NULL || first < 0 || cnt < 0 || first + cnt > tr->count) return -1;
+
+   FILE *fp = fopen(fn, "w");
+   if (fp == NULL) return -2;
+
+   if (logz_has_ext(fn))
+   {
+      const char *names[MAX_PARAMS];
+      for (int i=0; i<tr->n; i++) names[i] = tr->params[tr->idx[i]].name;
+
+      logz_writer_t *w = logz_writer_create(fp, "t", tr->n, names, LOGZ_BLK_ROWS);
+      if (w == NULL) rc = -3;
+      for (long k=first; w != NULL && k<first+cnt; k++)
+         logz_write_row(w, trace_t_at(tr, k), trace_row(tr, k));
+      logz_writer_destroy(w);
+   }
+   else
+   {
+      char *row = (char *)malloc((size_t)(tr->n + 1) * (DTOA_BUF_SZ + 1) + 1);
+      if (row == NULL) rc = -3;
+
+      bool as_long[MAX_PARAMS];
+      fprintf(fp, "t");
+      for (int i=0; i<tr->n; i++)
+      {
+         fprintf(fp, ",%s", tr->params[tr->idx[i]].name);
+         as_long[i] = (tr->type[i] <= LOG_T_LONG);
+      }
+      fprintf(fp, "\n");
+
+      for (long k=first; row != NULL && k<first+cnt; k++)
+      {
+         int len = dtoa_row(trace_t_at(tr, k), trace_row(tr, k), tr->n, as_long, row);
+         fwrite(row, 1, (size_t)len, fp);
+      }
+      free(row);
+   }
+
+   if (fclose(fp) != 0 && rc == 0) rc = -4;
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ *
+ *  @fn		void trace_destroy(trace_t *tr)
+ *
+ *  @brief	Free the trace ring
+ *
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+void trace_destroy(trace_t *tr)
+{
+   if (tr == NULL) return;
+
+   free(tr->t);
+   free(tr->v);
+   free(tr);
+}
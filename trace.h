@@ -0,0 +1,70 @@
+/*!
+ *=====================================================================================================================
+ *
+ *  @file		trace.h
+ *
+ *  @brief		In-memory trace capture ring header
+ *
+ *=====================================================================================================================
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "globals.h"
+#include "logger.h"
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Trace ring: the last 'cap' samples of the selected params, one row per sim step
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   params_t *params;		/* string-enabled parameters (owned by sim) */
+   int n;			/* num of columns */
+   int idx[MAX_PARAMS];		/* param index per column */
+   log_type_t type[MAX_PARAMS];	/* value type per column */
+   const void *ptr[MAX_PARAMS];	/* value pointer per column */
+
+   long cap;			/* ring capacity in rows */
+   long head;			/* next row to write */
+   long count;			/* rows held (<= cap) */
+   double *t;			/* time per row */
+   double *v;			/* values, row-major [cap][n] */
+}
+trace_t;
+
+
+/*!
+ *---------------------------------------------------------------------------------------------------------------------
+ * Per-column statistics over a time window
+ *---------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct {
+   double min;			/* minimum */
+   double max;			/* maximum */
+   double mean;			/* mean */
+   double std;			/* standard deviation */
+   double first;		/* first value in window */
+   double last;			/* last value in window */
+   double t_min;		/* time of minimum */
+   double t_max;		/* time of maximum */
+}
+trace_stats_t;
+
+
+trace_t *trace_create(params_t *params, long cap);
+int trace_add_col(trace_t *tr, int params_sz, const char *name);
+void trace_update(trace_t *tr, double t);
+long trace_range(const trace_t *tr, double t0, double t1, long *first);
+double trace_t_at(const trace_t *tr, long k);
+const double *trace_row(const trace_t *tr, long k);
+int trace_stats(const trace_t *tr, long first, long cnt, trace_stats_t *st);
+int trace_dump(const trace_t *tr, const char *fn, long first, long cnt);
+void trace_destroy(trace_t *tr);
+
+
+#endif // __TRACE_H__